@@ -0,0 +1,135 @@
+// g++ -O2 -std=c++17 -pthread -I.. BatchRender.cpp ../mandelbrot_simd.cpp ../colorizer.cpp ../perturbation.cpp ../debug.cpp -o batch_render
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <new>
+
+#include "main.h"
+#include "debug.h"
+#include "batch_render.h"
+
+static void print_usage(void)
+{
+	std::cerr <<
+		"usage: batch_render [key=value ...]\n"
+		"  x=<real> y=<imag>          centre of the view\n"
+		"  scaleA=<a> scaleB=<b>      scale of the view\n"
+		"  width=<n> height=<n>       frame size in pixels\n"
+		"  iterations=<n>             1 .. " << RENDER_MAX_ITERATIONS << "\n"
+		"  tier=auto|float|double|double-double|perturbation\n"
+		"  smooth=0|1\n"
+		"  offset=<n>                 palette offset\n"
+		"  format=auto|p6|p5|pam|p3|raw|png|qoi|mbit\n"
+		"                             auto follows the extension of out (.pgm, .pam, .raw, .png, .qoi, .mbit, else P6)\n"
+		"                             mbit keeps the escape times with the view, to colour again later\n"
+		"  field=<file.mbit>          colour the escape times of the file instead of rendering\n"
+		"  out=<file>\n"
+		"  window=<MB>                render out of core within this much memory, 0 = in memory\n"
+		"                             P6, P5, PAM and raw output only\n"
+		"  pyramid=0|1                tile pyramid of the view into the directory out\n"
+		"  jobs=<file>                one job per line, same keys, the command line gives the defaults\n"
+		"  threads=<n>                workers, 0 = one per core\n";
+}
+
+int main(int argc, char **argv)
+{
+	batch::renderJob defaults = batch::get_default_job(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+		IMAGE_SCALEA, IMAGE_SCALEB);
+	std::string jobList;
+	uint32_t threadCount = THREAD_POOL_DEFAULT_WORKERS;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg.compare(0, 5, "jobs=") == 0) {
+			jobList = arg.substr(5);
+		}
+		else if (arg.compare(0, 8, "threads=") == 0) {
+			if (!batch::parse_uint(arg.substr(8), &threadCount)) {
+				print_usage();
+				return -1;
+			}
+		}
+		else if (batch::parse_job_token(arg, &defaults) != 0) {
+			DERROR("Bad argument: " + arg);
+			print_usage();
+			return -1;
+		}
+	}
+
+	std::vector<batch::renderJob> jobs;
+	if (jobList.empty()) {
+		const char *error = batch::get_job_error(defaults);
+		if (error != nullptr) {
+			DERROR(std::string("Bad job: ") + error);
+			return -1;
+		}
+		jobs.push_back(defaults);
+	}
+	else {
+		uint32_t badLine = 0;
+		std::string reason;
+		if (batch::load_job_list(jobList, defaults, &jobs, &badLine, &reason) != 0) {
+			DERROR(badLine == 0 ? "Cannot read the job list " + jobList :
+				"Bad job in " + jobList + " line " + std::to_string(badLine) + ": " + reason);
+			return -1;
+		}
+	}
+
+	batch::batchRenderer renderer(threadCount);
+	std::cout << jobs.size() << " job(s) on " << renderer.get_worker_count() << " worker(s)" << std::endl;
+
+	uint64_t totalPixels = 0;
+	double totalRenderMs = 0.0;
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const batch::renderJob &job = jobs[i];
+		batch::jobResult result;
+		error_t err = 0;
+		try {
+			err = renderer.render_job(job, &result);
+		}
+		catch (const std::bad_alloc &) {
+			DERROR("Job " + std::to_string(i + 1) + " (" + job.output + ") ran out of memory");
+			return -1;
+		}
+		if (err == BATCH_ERROR_OUTPUT) {
+			DERROR("Writing " + renderer.get_output_file() + " failed");
+			return err;
+		}
+		if (err != 0) {
+			DERROR("Job " + std::to_string(i + 1) + " (" + job.output + ") failed: " + std::to_string(err));
+			return err;
+		}
+
+		totalPixels += (uint64_t)result.width * result.height;
+		totalRenderMs += result.renderMs;
+		std::cout << std::fixed << std::setprecision(1)
+			<< "[" << (i + 1) << "/" << jobs.size() << "] "
+			<< result.width << "x" << result.height << " i=" << result.iterations
+			<< " tier=" << cpu::get_precision_tier_name(result.tier)
+			<< " render " << result.renderMs << " ms"
+			<< " (" << std::setprecision(2) << result.mpixPerSecond << " Mpix/s, iterated "
+			<< std::setprecision(1) << result.iteratedFraction * 100.0 << "%)"
+			<< std::setprecision(1) << " write " << result.writeMs << " ms"
+			<< " wall " << result.wallMs << " ms -> " << job.output << std::endl;
+	}
+
+	// The last frame may still be in the output stage
+	if (renderer.finish() != 0) {
+		DERROR("Writing " + renderer.get_output_file() + " failed");
+		return BATCH_ERROR_OUTPUT;
+	}
+
+	const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::fixed << std::setprecision(1)
+		<< "total: " << totalPixels << " pixels, render " << totalRenderMs << " ms"
+		<< " (" << std::setprecision(2) << (double)totalPixels / (totalRenderMs * 1000.0) << " Mpix/s)"
+		<< std::setprecision(1) << " wall " << wallMs << " ms" << std::endl;
+
+	return 0;
+}
+
+//EOF
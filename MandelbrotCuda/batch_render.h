@@ -0,0 +1,723 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+
+#include "types.h"
+#include "ppm.h"
+#include "mapped_image.h"
+#include "output_stage.h"
+#include "iteration_file.h"
+#include "tile_pyramid.h"
+#include "thread_pool.h"
+#include "fixed_point.h"
+#include "precision_ladder.h"
+#include "mandelbrot_cpu.h"
+
+/*
+ * Headless batch rendering on the CPU tiers
+ *  A job is one view rendered to one file. Jobs are written as key=value
+ *  tokens, on the command line or one job per line of a job list, keys the
+ *  line leaves out keep the value of the command line:
+ *   x=<real> y=<imag>			centre, decimal digits are kept to the fixedPoint precision
+ *   scaleA=<a> scaleB=<b>		view scale, same meaning as the renderers
+ *   width=<n> height=<n>		frame size in pixels
+ *   iterations=<n>				1 .. RENDER_MAX_ITERATIONS (types.h)
+ *   tier=auto|float|double|double-double|perturbation
+ *   smooth=0|1					continuous colouring
+ *   offset=<n>					palette offset (palette cycling)
+ *   format=auto|p6|p5|pam|p3|raw|png|qoi|mbit	auto picks from the extension of out (.pgm,
+ *								.pam, .raw, .png, .qoi, .mbit, else P6), p5 is a grayscale map
+ *								of the escape times, raw the rgbaPixel rows without a header,
+ *								mbit the escape times (smooth ones with smooth=1) with the
+ *								view, see iteration_file.h
+ *   field=<file.mbit>			colours the field of an .mbit file instead of rendering, the
+ *								view and size are those of the file
+ *   out=<file>
+ *   window=<MB>				0 renders in memory, otherwise out of core: the file is
+ *								mapped by bands of rows and a band with its buffers stays
+ *								within the window, whatever the image size. P6, P5, PAM
+ *								and raw only, other outputs are refused with the job
+ *   pyramid=0|1				1 exports a tile pyramid of the view to the directory out
+ *								(see tile_pyramid.h)
+ *  Jobs render one after the other, each on every worker of one shared pool.
+ *  In memory frames other than P5 go to the output stage (output_stage.h):
+ *  a frame is encoded and written on the pool while the next job renders.
+ */
+
+#define BATCH_DEFAULT_WIDTH			1920
+#define BATCH_DEFAULT_HEIGHT		1080
+#define BATCH_DEFAULT_ITERATIONS	1024
+#define BATCH_DEFAULT_OUTPUT		"frame.ppm"
+
+// Comment character of the job lists
+#define BATCH_COMMENT				'#'
+
+// Returned when the output stage failed to write the frame of an earlier job
+#define BATCH_ERROR_OUTPUT			-2
+
+namespace batch {
+	typedef struct renderJob {
+		cpu::fixedPoint centerX, centerY;
+		double scaleA, scaleB;
+		uint32_t width, height;
+		uint32_t iterations;
+		cpu::PRECISION_TIER tier;
+		bool autoTier;				// Tier picked from the zoom depth, tier is ignored
+		bool smooth;
+		ppm::PPM_FORMAT format;		// Netpbm format when encoder is FRAME_ENCODER_NETPBM
+		frame::FRAME_ENCODER encoder;
+		bool fieldOutput;			// Iteration field to an .mbit file instead of an image
+		bool autoFormat;			// Format and encoder picked from the extension of output
+		std::string output;
+		uint64_t windowBytes;		// Out of core memory window, 0 = in memory
+		bool pyramid;				// Tile pyramid into the directory output
+		uint32_t paletteOffset;
+		std::string field;			// .mbit file coloured instead of rendering, empty to render
+	} RENDER_JOB, *PRENDER_JOB;
+
+	typedef struct jobResult {
+		double renderMs;			// Iteration and colouring
+		double writeMs;				// Conversion and file output, or the wait for the output stage
+		double wallMs;				// Whole job
+		double mpixPerSecond;		// Pixels over the render time
+		double iteratedFraction;	// Pixels iterated over pixels of the image
+		cpu::PRECISION_TIER tier;	// Tier the frame was rendered in
+		uint32_t width, height;		// Of the frame, those of the file for a field job
+		uint32_t iterations;
+	} JOB_RESULT, *PJOB_RESULT;
+
+	static inline renderJob get_default_job(double offsetX, double offsetY, double scaleA, double scaleB)
+	{
+		renderJob job;
+		job.centerX = cpu::fixedPoint(offsetX);
+		job.centerY = cpu::fixedPoint(offsetY);
+		job.scaleA = scaleA;
+		job.scaleB = scaleB;
+		job.width = BATCH_DEFAULT_WIDTH;
+		job.height = BATCH_DEFAULT_HEIGHT;
+		job.iterations = BATCH_DEFAULT_ITERATIONS;
+		job.tier = cpu::PRECISION_TIER_DOUBLE;
+		job.autoTier = true;
+		job.smooth = false;
+		job.format = ppm::PPM_FORMAT_P6;
+		job.encoder = frame::FRAME_ENCODER_NETPBM;
+		job.fieldOutput = false;
+		job.autoFormat = true;
+		job.output = BATCH_DEFAULT_OUTPUT;
+		job.windowBytes = 0;
+		job.pyramid = false;
+		job.paletteOffset = 0;
+		return job;
+	}
+
+	static inline bool parse_double(const std::string &s, __inout double *out)
+	{
+		char *end = nullptr;
+		*out = std::strtod(s.c_str(), &end);
+		return !s.empty() && *end == '\0';
+	}
+
+	static inline bool parse_uint(const std::string &s, __inout uint32_t *out)
+	{
+		char *end = nullptr;
+		const unsigned long long val = std::strtoull(s.c_str(), &end, 10);
+		*out = (uint32_t)val;
+		return !s.empty() && s[0] != '-' && *end == '\0' && val <= UINT32_MAX;
+	}
+
+	// "[-]int.frac" only, fixedPoint::from_string does not validate
+	static inline bool parse_fixed(const std::string &s, __inout cpu::fixedPoint *out)
+	{
+		const size_t first = (!s.empty() && (s[0] == '-' || s[0] == '+')) ? 1 : 0;
+		bool dot = false, digit = false;
+		for (size_t i = first; i < s.size(); i++) {
+			if (s[i] == '.' && !dot) {
+				dot = true;
+			}
+			else if (s[i] >= '0' && s[i] <= '9') {
+				digit = true;
+			}
+			else {
+				return false;
+			}
+		}
+		if (!digit) {
+			return false;
+		}
+
+		*out = cpu::fixedPoint::from_string(s);
+		return true;
+	}
+
+	/*
+	 * Applies one key=value token to *job, -1 on an unknown key or a bad value
+	 */
+	static inline error_t parse_job_token(const std::string &token, __inout renderJob *job)
+	{
+		const size_t eq = token.find('=');
+		if (eq == std::string::npos || eq == 0) {
+			return -1;
+		}
+
+		const std::string key = token.substr(0, eq), value = token.substr(eq + 1);
+		bool ok = false;
+		if (key == "x") {
+			ok = parse_fixed(value, &job->centerX);
+		}
+		else if (key == "y") {
+			ok = parse_fixed(value, &job->centerY);
+		}
+		else if (key == "scaleA") {
+			ok = parse_double(value, &job->scaleA) && job->scaleA > 0.0;
+		}
+		else if (key == "scaleB") {
+			ok = parse_double(value, &job->scaleB) && job->scaleB > 0.0;
+		}
+		else if (key == "width") {
+			ok = parse_uint(value, &job->width) && job->width != 0;
+		}
+		else if (key == "height") {
+			ok = parse_uint(value, &job->height) && job->height != 0;
+		}
+		else if (key == "iterations") {
+			ok = parse_uint(value, &job->iterations) && job->iterations != 0 && job->iterations <= RENDER_MAX_ITERATIONS;
+		}
+		else if (key == "tier") {
+			job->autoTier = value == "auto";
+			ok = job->autoTier;
+			for (uint32_t tier = cpu::PRECISION_TIER_FLOAT; tier <= cpu::PRECISION_TIER_PERTURBATION && !ok; tier++) {
+				if (value == cpu::get_precision_tier_name((cpu::PRECISION_TIER)tier)) {
+					job->tier = (cpu::PRECISION_TIER)tier;
+					ok = true;
+				}
+			}
+		}
+		else if (key == "smooth") {
+			ok = value == "0" || value == "1";
+			job->smooth = value == "1";
+		}
+		else if (key == "format") {
+			const char *names[] = { "p6", "p5", "pam", "p3", "raw" };
+			job->autoFormat = value == "auto";
+			job->fieldOutput = value == "mbit";
+			job->encoder = value == "png" ? frame::FRAME_ENCODER_PNG :
+				value == "qoi" ? frame::FRAME_ENCODER_QOI : frame::FRAME_ENCODER_NETPBM;
+			ok = job->autoFormat || job->fieldOutput || job->encoder != frame::FRAME_ENCODER_NETPBM;
+			for (uint32_t format = ppm::PPM_FORMAT_P6; format <= ppm::PPM_FORMAT_RAW && !ok; format++) {
+				if (value == names[format]) {
+					job->format = (ppm::PPM_FORMAT)format;
+					ok = true;
+				}
+			}
+		}
+		else if (key == "out") {
+			job->output = value;
+			ok = !value.empty();
+		}
+		else if (key == "offset") {
+			ok = parse_uint(value, &job->paletteOffset);
+		}
+		else if (key == "field") {
+			job->field = value;
+			ok = !value.empty();
+		}
+		else if (key == "pyramid") {
+			ok = value == "0" || value == "1";
+			job->pyramid = value == "1";
+		}
+		else if (key == "window") {
+			uint32_t megabytes = 0;
+			ok = parse_uint(value, &megabytes);
+			job->windowBytes = (uint64_t)megabytes * 1024 * 1024;
+		}
+
+		return ok ? 0 : -1;
+	}
+
+	// True when job writes its iteration field rather than an image
+	static inline bool is_field_output(const renderJob &job)
+	{
+		if (!job.autoFormat) {
+			return job.fieldOutput;
+		}
+
+		const size_t dot = job.output.rfind('.');
+		return dot != std::string::npos && job.output.substr(dot) == ".mbit";
+	}
+
+	// Encoder of the file of job
+	static inline frame::FRAME_ENCODER get_output_encoder(const renderJob &job)
+	{
+		return job.autoFormat ? frame::get_file_encoder(job.output) : job.encoder;
+	}
+
+	// Netpbm format of the file of job
+	static inline ppm::PPM_FORMAT get_output_format(const renderJob &job)
+	{
+		if (!job.autoFormat) {
+			return job.format;
+		}
+
+		const size_t dot = job.output.rfind('.');
+		const std::string extension = dot == std::string::npos ? "" : job.output.substr(dot);
+		if (extension == ".pgm") {
+			return ppm::PPM_FORMAT_P5;
+		}
+		if (extension == ".pam") {
+			return ppm::PPM_FORMAT_PAM;
+		}
+		if (extension == ".raw") {
+			return ppm::PPM_FORMAT_RAW;
+		}
+		return ppm::PPM_FORMAT_P6;
+	}
+
+	/*
+	 * Why job cannot be rendered as its tokens combine, nullptr when it can.
+	 *  Checked once every token of the job is in, the format may follow from out
+	 */
+	static inline const char *get_job_error(const renderJob &job)
+	{
+		const bool outOfCore = job.windowBytes != 0 && job.field.empty() && !job.pyramid;
+		if (outOfCore && (get_output_encoder(job) != frame::FRAME_ENCODER_NETPBM || is_field_output(job) ||
+			get_output_format(job) == ppm::PPM_FORMAT_P3)) {
+			return "window= renders P6, P5, PAM or raw files only";
+		}
+		return nullptr;
+	}
+
+	/*
+	 * Reads a job list, every line that is neither empty nor a comment is a
+	 *  job starting from defaults. On a bad line *badLine is its number (1 based)
+	 *  and *reason says what is wrong with it
+	 */
+	static inline error_t load_job_list(const std::string &filename, const renderJob &defaults,
+		__inout std::vector<renderJob> *jobs, __inout uint32_t *badLine, __inout std::string *reason)
+	{
+		std::ifstream list(filename);
+		if (!list.is_open()) {
+			*badLine = 0;
+			*reason = "cannot read the file";
+			return -1;
+		}
+
+		std::string line;
+		for (uint32_t lineNumber = 1; std::getline(list, line); lineNumber++) {
+			const size_t comment = line.find(BATCH_COMMENT);
+			if (comment != std::string::npos) {
+				line.resize(comment);
+			}
+
+			std::istringstream tokens(line);
+			std::string token;
+			renderJob job = defaults;
+			bool empty = true;
+			while (tokens >> token) {
+				if (parse_job_token(token, &job) != 0) {
+					*badLine = lineNumber;
+					*reason = "bad token " + token;
+					return -1;
+				}
+				empty = false;
+			}
+			if (empty) {
+				continue;
+			}
+
+			const char *error = get_job_error(job);
+			if (error != nullptr) {
+				*badLine = lineNumber;
+				*reason = error;
+				return -1;
+			}
+			jobs->push_back(job);
+		}
+
+		return 0;
+	}
+
+	class batchRenderer {
+	private:
+		cpu::threadPool *pool;
+
+		// Frame of the last job, reused while the size stays
+		std::vector<rgbaPixel> frameBuffer;
+
+		// Encodes and writes the last in memory frame while the next one renders
+		frame::outputStage *stage;
+
+	public:
+		uint32_t get_worker_count(void) const { return pool->get_worker_count(); }
+
+		// File of the frame last handed to the output stage
+		const std::string &get_output_file(void) const { return stage->get_filename(); }
+
+	private:
+		// Renderer of a width * height frame of job on the pool
+		std::unique_ptr<mandelbrotFractalCpu> create_renderer(const renderJob &job, uint32_t height)
+		{
+			std::unique_ptr<mandelbrotFractalCpu> renderer(new mandelbrotFractalCpu(0.0, 0.0, job.width, height,
+				job.scaleA, job.scaleB, job.iterations, THREAD_POOL_DEFAULT_WORKERS));
+			renderer->set_thread_pool(pool);
+			renderer->set_center(job.centerX, job.centerY);
+			if (job.autoTier) {
+				renderer->set_auto_precision(true);
+			}
+			else {
+				renderer->set_precision_tier(job.tier);
+			}
+			renderer->set_smooth_colouring(job.smooth);
+			renderer->set_palette_offset(job.paletteOffset);
+			return renderer;
+		}
+
+		static double get_elapsed_ms(std::chrono::steady_clock::time_point since)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+		}
+
+		// Waits for the frame in the output stage and frees its buffer
+		error_t flush_output(void)
+		{
+			return stage->flush() != 0 ? BATCH_ERROR_OUTPUT : 0;
+		}
+
+		/*
+		 * Renders job by bands of whole rows into the mapped output file. The
+		 *  band height keeps the mapped rows, the frame they are rendered into
+		 *  and the iteration field within job.windowBytes. Raw frames are
+		 *  rendered straight into the mapping, the other formats are encoded
+		 *  into it on the pool
+		 */
+		error_t render_job_out_of_core(const renderJob &job, __inout jobResult *result)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			if (get_job_error(job) != nullptr) {
+				return -1;
+			}
+			const ppm::PPM_FORMAT format = get_output_format(job);
+			const uint32_t maxVal = format == ppm::PPM_FORMAT_P5 ? std::min<uint32_t>(job.iterations + 1, PPM_MAX_SAMPLE) : 255;
+
+			// A whole frame left by an in-memory job would stay resident
+			std::vector<rgbaPixel>().swap(frameBuffer);
+			error_t err = flush_output();
+			if (err != 0) {
+				return err;
+			}
+
+			frame::mappedImage image;
+			if (image.create(job.output, format, job.width, job.height, maxVal) != 0) {
+				return -1;
+			}
+
+			const uint64_t pixelBytes = ppm::get_pixel_bytes(format, maxVal) + sizeof(uint32_t) +
+				(format == ppm::PPM_FORMAT_RAW ? 0 : sizeof(rgbaPixel)) + (job.smooth ? sizeof(float) : 0);
+			const uint32_t bandRows = (uint32_t)std::max<uint64_t>(1,
+				std::min<uint64_t>(job.height, job.windowBytes / (pixelBytes * job.width)));
+
+			// Every band samples the pixel grid of the whole image in the same tier,
+			//  its pixels are those of the in-memory render
+			const double pixelScale = job.scaleA / ((double)job.width / job.scaleB);
+			const cpu::PRECISION_TIER tier = job.autoTier ?
+				cpu::select_precision_tier(pixelScale, job.centerX.to_double(), job.centerY.to_double()) : job.tier;
+
+			std::unique_ptr<mandelbrotFractalCpu> renderer;
+			uint32_t rendererRows = 0;
+			double renderMs = 0.0;
+			uint64_t iteratedPixels = 0;
+			for (uint32_t first = 0; first < job.height; first += bandRows) {
+				const uint32_t rows = std::min(bandRows, job.height - first);
+				if (rows != rendererRows) {
+					renderer = create_renderer(job, rows);
+					renderer->set_precision_tier(tier);
+					rendererRows = rows;
+				}
+
+				// Row first + i of the image is row i of the band
+				renderer->set_frame_region(job.width, job.height, 0, first);
+
+				uint8_t *out = image.map_rows(first, rows);
+				if (out == nullptr) {
+					return -1;
+				}
+
+				const auto bandStart = std::chrono::steady_clock::now();
+				rgbaPixel *target = (rgbaPixel *)out;
+				if (format != ppm::PPM_FORMAT_RAW) {
+					frameBuffer.resize((size_t)job.width * rows);
+					target = frameBuffer.data();
+				}
+				err = renderer->compute_image_tiled(target);
+				if (err != 0) {
+					return err;
+				}
+				renderMs += get_elapsed_ms(bandStart);
+				iteratedPixels += renderer->get_render_stats().iteratedPixels;
+
+				const size_t rowBytes = image.get_row_bytes();
+				const uint32_t *field = renderer->get_iteration_field();
+				pool->parallel_for(rows, [this, &job, format, maxVal, out, rowBytes, field](size_t i) {
+					const size_t offset = i * job.width;
+					switch (format) {
+					case ppm::PPM_FORMAT_P6:
+						ppm::encode_rgb(frameBuffer.data() + offset, job.width, out + i * rowBytes);
+						break;
+					case ppm::PPM_FORMAT_P5:
+						ppm::encode_gray(field + offset, job.width, job.iterations, maxVal, out + i * rowBytes);
+						break;
+					case ppm::PPM_FORMAT_PAM:
+						ppm::encode_rgba(frameBuffer.data() + offset, job.width, false, out + i * rowBytes);
+						break;
+					default:
+						break;
+					}
+				});
+
+				if (image.release_rows() != 0) {
+					return -1;
+				}
+			}
+
+			if (image.close() != 0) {
+				return -1;
+			}
+
+			result->renderMs = renderMs;
+			result->wallMs = get_elapsed_ms(start);
+			result->writeMs = result->wallMs - renderMs;
+			result->mpixPerSecond = (double)job.width * job.height / (renderMs * 1000.0);
+			result->iteratedFraction = (double)iteratedPixels / ((double)job.width * job.height);
+			result->tier = tier;
+
+			return 0;
+		}
+
+		/*
+		 * Exports the tile pyramid of job to the directory job.output, the
+		 *  pixels are those of the finest level
+		 */
+		error_t render_job_pyramid(const renderJob &job, __inout jobResult *result)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const double pixelScale = job.scaleA / ((double)job.width / job.scaleB);
+			const cpu::PRECISION_TIER tier = job.autoTier ?
+				cpu::select_precision_tier(pixelScale, job.centerX.to_double(), job.centerY.to_double()) : job.tier;
+
+			pyramidExporter exporter(pool, job.centerX, job.centerY, job.width, job.height,
+				job.scaleA, job.scaleB, job.iterations, tier, job.smooth);
+			const error_t err = exporter.export_pyramid(job.output);
+			if (err != 0) {
+				return err;
+			}
+
+			const pyramidStats stats = exporter.get_stats();
+			result->renderMs = result->wallMs = get_elapsed_ms(start);
+			result->writeMs = 0.0;
+			result->mpixPerSecond = (double)stats.pixelsFinest / (result->renderMs * 1000.0);
+			result->iteratedFraction = (double)stats.pixelsIterated / (double)stats.pixelsFinest;
+			result->tier = tier;
+
+			return 0;
+		}
+
+		/*
+		 * Writes the field of the frame renderer just rendered to job.output,
+		 *  the smooth escape times when it has them
+		 */
+		error_t write_field(const renderJob &job, const mandelbrotFractalCpu &renderer)
+		{
+			frame::mbitView view;
+			view.centerX = job.centerX;
+			view.centerY = job.centerY;
+			view.scaleA = job.scaleA;
+			view.scaleB = job.scaleB;
+			view.width = job.width;
+			view.height = job.height;
+			view.maxIterations = job.iterations;
+			view.precisionTier = renderer.get_render_stats().precisionTier;
+			view.fieldType = renderer.get_smooth_field() != nullptr ? frame::MBIT_FIELD_SMOOTH : frame::MBIT_FIELD_ESCAPE_TIME;
+			view.formula = frame::MBIT_FORMULA_MANDELBROT;
+
+			const void *samples = view.fieldType == frame::MBIT_FIELD_SMOOTH ?
+				(const void *)renderer.get_smooth_field() : (const void *)renderer.get_iteration_field();
+			frame::iterationFileWriter writer;
+			if (samples == nullptr || writer.create(job.output, view) != 0 ||
+				writer.write_rows(0, job.height, samples) != 0) {
+				writer.close();
+				return -1;
+			}
+			return writer.close();
+		}
+
+		/*
+		 * Colours the field of the .mbit file job.field with the palette at
+		 *  job.paletteOffset and writes it like a rendered frame. The rows are
+		 *  read straight from the mapping, nothing is iterated
+		 */
+		error_t render_job_from_field(const renderJob &job, __inout jobResult *result)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			if (is_field_output(job)) {
+				return -1;
+			}
+
+			frame::iterationFile field;
+			if (field.open(job.field) != 0) {
+				return -1;
+			}
+			const frame::mbitView &view = field.get_view();
+			const bool smooth = view.fieldType == frame::MBIT_FIELD_SMOOTH;
+
+			cpu::colorizer colouring(cpu::cpuPixelColour, sizeof(cpu::cpuPixelColour) / sizeof(cpu::cpuPixelColour[0]),
+				view.maxIterations);
+			colouring.set_palette_offset(job.paletteOffset);
+
+			frameBuffer.resize((size_t)view.width * view.height);
+			pool->parallel_for(view.height, [this, &field, &colouring, &view, smooth](size_t y) {
+				rgbaPixel *out = frameBuffer.data() + y * view.width;
+				if (smooth) {
+					colouring.colorize_smooth(field.get_smooth((uint32_t)y), view.width, out);
+				}
+				else {
+					colouring.colorize(field.get_escape_times((uint32_t)y), view.width, out);
+				}
+			});
+			const auto coloured = std::chrono::steady_clock::now();
+
+			// P5 is the escape times themselves, a smooth field has none
+			error_t err = 0;
+			const frame::FRAME_ENCODER encoder = get_output_encoder(job);
+			const ppm::PPM_FORMAT format = get_output_format(job);
+			if (encoder == frame::FRAME_ENCODER_NETPBM && format == ppm::PPM_FORMAT_P5) {
+				if (smooth) {
+					return -1;
+				}
+
+				std::vector<uint32_t> packed;
+				const uint32_t *escapeTimes = field.get_escape_times(0);
+				if (field.get_header().rowStride != (uint64_t)view.width * sizeof(uint32_t)) {
+					packed.resize((size_t)view.width * view.height);
+					for (uint32_t y = 0; y < view.height; y++) {
+						std::memcpy(&packed[(size_t)y * view.width], field.get_escape_times(y), view.width * sizeof(uint32_t));
+					}
+					escapeTimes = packed.data();
+				}
+				err = ppm::write_iteration_map(job.output, escapeTimes, view.width, view.height, view.maxIterations);
+			}
+			else {
+				err = stage->submit(encoder, format, &frameBuffer, view.width, view.height, job.output) != 0 ?
+					BATCH_ERROR_OUTPUT : 0;
+			}
+			if (err != 0) {
+				return err;
+			}
+
+			result->renderMs = std::chrono::duration<double, std::milli>(coloured - start).count();
+			result->writeMs = get_elapsed_ms(coloured);
+			result->wallMs = get_elapsed_ms(start);
+			result->mpixPerSecond = (double)view.width * view.height / (result->renderMs * 1000.0);
+			result->iteratedFraction = 0.0;
+			result->tier = (cpu::PRECISION_TIER)view.precisionTier;
+			result->width = view.width;
+			result->height = view.height;
+			result->iterations = view.maxIterations;
+
+			return field.close();
+		}
+
+	public:
+		/*
+		 * Renders job on the pool and writes its file, the timings go to *result.
+		 *  Frames written by the output stage may still be in flight on return,
+		 *  finish() waits for the last
+		 */
+		error_t render_job(const renderJob &job, __inout jobResult *result)
+		{
+			result->width = job.width;
+			result->height = job.height;
+			result->iterations = job.iterations;
+			if (!job.field.empty()) {
+				return render_job_from_field(job, result);
+			}
+			if (job.pyramid) {
+				return render_job_pyramid(job, result);
+			}
+			if (job.windowBytes != 0) {
+				return render_job_out_of_core(job, result);
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+
+			frameBuffer.resize((size_t)job.width * job.height);
+			std::unique_ptr<mandelbrotFractalCpu> renderer = create_renderer(job, job.height);
+			error_t err = renderer->compute_image_tiled(frameBuffer.data());
+			if (err != 0) {
+				return err;
+			}
+			const auto rendered = std::chrono::steady_clock::now();
+
+			// The escape times stay with the renderer, P5 and fields are written here
+			const frame::FRAME_ENCODER encoder = get_output_encoder(job);
+			const ppm::PPM_FORMAT format = get_output_format(job);
+			if (is_field_output(job)) {
+				err = write_field(job, *renderer);
+			}
+			else if (encoder == frame::FRAME_ENCODER_NETPBM && format == ppm::PPM_FORMAT_P5) {
+				err = ppm::write_iteration_map(job.output, renderer->get_iteration_field(),
+					job.width, job.height, job.iterations);
+			}
+			else {
+				err = stage->submit(encoder, format, &frameBuffer, job.width, job.height, job.output) != 0 ?
+					BATCH_ERROR_OUTPUT : 0;
+			}
+			if (err != 0) {
+				return err;
+			}
+
+			result->renderMs = std::chrono::duration<double, std::milli>(rendered - start).count();
+			result->writeMs = get_elapsed_ms(rendered);
+			result->wallMs = get_elapsed_ms(start);
+			result->mpixPerSecond = (double)job.width * job.height / (result->renderMs * 1000.0);
+			result->iteratedFraction = renderer->get_render_stats().iteratedFraction;
+			result->tier = renderer->get_render_stats().precisionTier;
+
+			return 0;
+		}
+
+		/*
+		 * Waits until the last frame handed to the output stage is written,
+		 *  after the last job
+		 */
+		error_t finish(void)
+		{
+			return flush_output();
+		}
+
+	public:
+		// threadCount workers, THREAD_POOL_DEFAULT_WORKERS for one per core
+		batchRenderer(uint32_t threadCount) :
+			pool(new cpu::threadPool(threadCount))
+		{
+			stage = new frame::outputStage(pool);
+		}
+
+		~batchRenderer(void)
+		{
+			delete stage;
+			delete pool;
+		}
+
+		batchRenderer(const batchRenderer &) = delete;
+		batchRenderer &operator=(const batchRenderer &) = delete;
+	};
+}
+
+//EOF
@@ -0,0 +1,85 @@
+#include "colorizer.h"
+
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIMD_X86_64
+#include <immintrin.h>
+#endif //_M_X64 || __x86_64__
+
+// MSVC compiles any intrinsic without flags, GCC/Clang need a per-function target
+#if defined(_MSC_VER)
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif //_MSC_VER
+
+using namespace cpu::simd;
+
+static_assert(sizeof(rgbaPixel) == sizeof(uint32_t), "the colour table is gathered as 32-bit words");
+
+static void colorize_scalar(const uint32_t *field, size_t count,
+	const rgbaPixel *lut, uint32_t lutLast, __inout rgbaPixel *out)
+{
+	for (size_t k = 0; k < count; k++) {
+		out[k] = lut[field[k] < lutLast ? field[k] : lutLast];
+	}
+}
+
+/*
+ * SSE2 has no gather and no unsigned min, the scalar loop is used below AVX2
+ */
+#if defined(SIMD_X86_64)
+SIMD_TARGET("avx2")
+static void colorize_avx2(const uint32_t *field, size_t count,
+	const rgbaPixel *lut, uint32_t lutLast, __inout rgbaPixel *out)
+{
+	const __m256i last = _mm256_set1_epi32((int32_t)lutLast);
+
+	size_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		const __m256i iter = _mm256_min_epu32(_mm256_loadu_si256((const __m256i *)&field[k]), last);
+		const __m256i colour = _mm256_i32gather_epi32((const int *)lut, iter, 4);
+		_mm256_storeu_si256((__m256i *)&out[k], colour);
+	}
+
+	colorize_scalar(&field[k], count - k, lut, lutLast, &out[k]);
+}
+
+SIMD_TARGET("avx512f")
+static void colorize_avx512(const uint32_t *field, size_t count,
+	const rgbaPixel *lut, uint32_t lutLast, __inout rgbaPixel *out)
+{
+	const __m512i last = _mm512_set1_epi32((int32_t)lutLast);
+
+	size_t k = 0;
+	for (; k + 16 <= count; k += 16) {
+		const __m512i iter = _mm512_min_epu32(_mm512_loadu_si512((const void *)&field[k]), last);
+		const __m512i colour = _mm512_i32gather_epi32(iter, (const void *)lut, 4);
+		_mm512_storeu_si512((void *)&out[k], colour);
+	}
+
+	colorize_scalar(&field[k], count - k, lut, lutLast, &out[k]);
+}
+#endif //SIMD_X86_64
+
+colorizeKernel cpu::simd::get_colorize_kernel(SIMD_LEVEL level)
+{
+	const SIMD_LEVEL supported = detect_simd_level();
+	if (level > supported) {
+		level = supported;
+	}
+
+	switch (level) {
+#if defined(SIMD_X86_64)
+	case SIMD_LEVEL_AVX512:
+		return colorize_avx512;
+	case SIMD_LEVEL_AVX2:
+		return colorize_avx2;
+#endif //SIMD_X86_64
+	default:
+		return colorize_scalar;
+	}
+}
+
+//EOF
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "types.h"
+#include "mandelbrot_simd.h"
+
+/*
+ * Palette stage of the renderer
+ *  The engines write an iteration field (escape time per pixel, maxIter + 1
+ *  for the interior) and the colorizer maps it through a lookup table with
+ *  one entry per escape time. Swapping or cycling the palette only rebuilds
+ *  the table, recolouring a frame is a memory-bound gather with no iteration.
+ *  Same rule as mandelbrot_kernel: escape times 1 .. maxIter - 1 get
+ *  palette[iter % size], everything else is black.
+ */
+
+namespace cpu {
+	namespace simd {
+		/*
+		 * Writes lut[min(field[k], lutLast)] to out[k] for count pixels
+		 */
+		typedef void (*colorizeKernel)(const uint32_t *field, size_t count,
+			const rgbaPixel *lut, uint32_t lutLast, __inout rgbaPixel *out);
+
+		colorizeKernel get_colorize_kernel(SIMD_LEVEL level);
+	}
+
+	class colorizer {
+	private:
+		std::vector<rgbaPixel> palette;
+		uint32_t paletteOffset;
+		uint32_t maxIter;
+
+		// One colour per escape time, 0 .. maxIter + 1
+		std::vector<rgbaPixel> lut;
+		simd::colorizeKernel kernel;
+
+	private:
+		void build_lut(void)
+		{
+			lut.assign((size_t)maxIter + 2, rgbaPixel{ 0, 0, 0, 0 });
+			if (palette.empty()) {
+				return;
+			}
+
+			for (uint32_t iter = 1; iter < maxIter; iter++) {
+				lut[iter] = palette[(iter + paletteOffset) % palette.size()];
+			}
+		}
+
+	public:
+		/*
+		 * Colours count pixels of an iteration field
+		 */
+		void colorize(const uint32_t *field, size_t count, __inout rgbaPixel *out) const
+		{
+			kernel(field, count, lut.data(), maxIter + 1, out);
+		}
+
+		/*
+		 * Colours a smooth (fractional) escape time field, the colour is
+		 *  interpolated between the two palette entries around each value
+		 */
+		void colorize_smooth(const float *field, size_t count, __inout rgbaPixel *out) const
+		{
+			const size_t size = palette.size();
+			for (size_t k = 0; k < count; k++) {
+				const float mu = field[k];
+				if (!(mu > 0.0f && mu < (float)maxIter) || size == 0) {
+					out[k] = rgbaPixel{ 0, 0, 0, 0 };
+					continue;
+				}
+
+				const uint32_t index = (uint32_t)mu;
+				const float t = mu - (float)index;
+				const rgbaPixel &a = palette[(index + paletteOffset) % size];
+				const rgbaPixel &b = palette[(index + 1 + paletteOffset) % size];
+				out[k].red = (BYTE)((float)a.red + t * ((float)b.red - (float)a.red));
+				out[k].green = (BYTE)((float)a.green + t * ((float)b.green - (float)a.green));
+				out[k].blue = (BYTE)((float)a.blue + t * ((float)b.blue - (float)a.blue));
+				out[k].alpha = 0;
+			}
+		}
+
+		void set_palette(const rgbaPixel *colours, uint32_t count)
+		{
+			palette.assign(colours, colours + count);
+			build_lut();
+		}
+
+		// Rotates the palette by offset entries (palette cycling)
+		void set_palette_offset(uint32_t offset)
+		{
+			paletteOffset = offset;
+			build_lut();
+		}
+
+		void set_max_iterations(uint32_t val)
+		{
+			if (val != maxIter) {
+				maxIter = val;
+				build_lut();
+			}
+		}
+
+		void set_simd_level(simd::SIMD_LEVEL level) { kernel = simd::get_colorize_kernel(level); }
+
+		uint32_t get_palette_offset(void) const { return paletteOffset; }
+		uint32_t get_palette_size(void) const { return (uint32_t)palette.size(); }
+
+	public:
+		colorizer(const rgbaPixel *colours, uint32_t count, uint32_t maxIter) :
+			palette(colours, colours + count),
+			paletteOffset(0),
+			maxIter(maxIter),
+			kernel(simd::get_colorize_kernel(simd::detect_simd_level()))
+		{
+			build_lut();
+		}
+	};
+}
+
+//EOF
@@ -1,6 +1,7 @@
 #include <Windows.h>
 
 #include <math.h>
+#include <sstream>
 
 #include "controller.h"
 
@@ -12,92 +13,289 @@
 
 using namespace controller;
 
-static render::sdlBase *renderer = nullptr;
-
-rgbaPixel *loopTimer::generate_blank_frame(size_t pixelCount) const
+void loopTimer::generate_blank_frame(__inout rgbaPixel *out, size_t pixelCount) const
 {
-	rgbaPixel *out = (rgbaPixel *)std::malloc(pixelCount * sizeof(rgbaPixel));
 	std::memset((void *)out, 0x0, (size_t)(pixelCount * sizeof(rgbaPixel)));
 	for (uint32_t i = 0; i < pixelCount; i++) {
 		out[i].red = std::rand() % 256;
 		out[i].blue = std::rand() % 256;
 		out[i].green = std::rand() % 256;
 	}
-
-	return out;
 }
 
 void loopTimer::cuda_render_thread(loopTimer *controller)
 {
 	cuda::cudaKernel *kernel = controller->cudaKernel;
+	mandelbrotFractalCpu *cpuKernel = controller->cpuKernel;
 
 	double lastSCALEA = 0.0000055;
 	DINFO("Setting render thread to THREAD_STATE_RUNNING");
-	while (controller->threadStateCuda == THREAD_STATE_RUNNING) {
+	// Frame on screen shows the current view with every pass
+	bool frameCurrent = false;
+
+	// View generation of the commands drained so far, a view change queued after
+	//  them moves controller->viewGeneration on and cancels the frame
+	uint64_t frameGeneration = 0;
+	while (controller->threadStateCuda != THREAD_STATE_TERMINATED) {
 		Sleep(CONTROLLER_LOOP_WAIT);
 
+		// Cleared before draining, a command pushed after the drain wakes a parked thread
+		{
+			std::lock_guard<std::mutex> lock(controller->wakeLock);
+			controller->wakePending = false;
+		}
+		pendingInput input = { 0 };
+		controller->drain_commands(&input);
+		if (input.commandCount != 0) {
+			frameGeneration = input.generation;
+		}
+		cpuKernel->set_cancel_generation(&controller->viewGeneration, frameGeneration);
+		if (input.zoom) {
+			controller->user_io_state = input.zoomState;
+		}
+		if (input.dump) {
+			error_t dumpErr = controller->dump_parameters_json();
+			if (dumpErr != 0) {
+				DERROR("Failed to dump parameters to JSON: " + std::to_string(dumpErr));
+			}
+		}
+
 #if defined(MEASURE_CUDA_EXECUTION_TIME)
 		auto t1 = std::chrono::high_resolution_clock::now();
 #endif //MEASURE_CUDA_EXECUTION_TIME
 		//kernel->setScaleA(kernel->getScaleA() + controller->process_scale(kernel->getScaleA(), 0.0));
 
-		double newSCALEA = 0.0;
-		switch (controller->user_io_state) {
-		case SET_ZOOM_PAUSE:
-			break; // Perform no zoom
-		case SET_ZOOM_REVERSE:
-			newSCALEA = ZOOM_ALPHA * kernel->getScaleA() * std::exp(-ZOOM_BETA * lastSCALEA);
-			if (newSCALEA >= MAX_DELTA_SCALE_A) {
-				newSCALEA = 0.0;
-			}
-			break;
-		case SET_ZOOM_RESUME:
-			newSCALEA = -ZOOM_ALPHA * kernel->getScaleA() * std::exp(-ZOOM_BETA * lastSCALEA);
-		}
+		// The zoom stands where the clock will be once this frame is on screen, a
+		//  slow frame catches up at most CONTROLLER_ZOOM_MAX_TICKS
+		double presentMs = controller->clock.next_presentation_ms();
+		const uint64_t ticks = zoomClock::take_ticks(presentMs, CONTROLLER_ZOOM_TICK_MS, CONTROLLER_ZOOM_MAX_TICKS,
+			&controller->zoomTicks);
 
 		// Sec scaling
-		kernel->setScaleA(kernel->getScaleA() + newSCALEA);
+		double scaleA = kernel->getScaleA();
+		const double newSCALEA = advance_zoom(controller->user_io_state, &scaleA, &lastSCALEA, ticks);
+		kernel->setScaleA(scaleA);
 		kernel->setScaleB(kernel->getScaleB());
-		lastSCALEA -= newSCALEA;
 
-		// Check for mouse override
-		controller->mouseLock.lock();
-		if (controller->setMouseState) {
-			kernel->setOffsetX(kernel->getOffsetX() + (controller->mouseX * kernel->getScaleA()));
-			kernel->setOffsetY(kernel->getOffsetY() + (controller->mouseY * kernel->getScaleA()));
-			controller->setMouseState = false;
+		// Zoom running, whether or not a tick fell into this frame
+		const bool zooming = next_zoom_step(controller->user_io_state, kernel->getScaleA(), lastSCALEA) != 0.0;
+
+		// Check for mouse override, moves snap to whole pixels so the CPU tiers
+		//  can reuse the frame
+		const double pixelScale = kernel->getScaleA() / ((double)controller->pixelLength / kernel->getScaleB());
+		const bool viewJumped = input.pan;
+		double panX = 0.0, panY = 0.0;
+		if (input.pan) {
+			panX = std::round(input.panX * kernel->getScaleA() / pixelScale);
+			panY = std::round(input.panY * kernel->getScaleA() / pixelScale);
+		}
+		if (input.panPixels) {
+			panX += (double)input.panPixelsX;
+			panY += (double)input.panPixelsY;
+		}
+		if (panX != 0.0 || panY != 0.0) {
+			const double deltaX = panX * pixelScale;
+			const double deltaY = panY * pixelScale;
+			kernel->setOffsetX(kernel->getOffsetX() + deltaX);
+			kernel->setOffsetY(kernel->getOffsetY() + deltaY);
+			cpuKernel->offset_by(deltaX, deltaY);
 		}
 
-		error_t err = kernel->generate_mandelbrot();
-		if (err != 0) {
-			DERROR("Error in generating CUDA kernel: " + std::to_string(err));
+		// Paused (or zoomed out to the limit) on a finished frame, nothing to draw.
+		//  The clock runs on while parked, the zoom does not catch up on it
+		if (!viewJumped && !input.panPixels && !zooming && frameCurrent) {
+			controller->park_render_thread();
+			controller->zoomTicks = zoomClock::get_ticks(controller->clock.next_presentation_ms(), CONTROLLER_ZOOM_TICK_MS);
+			controller->clock.restart_interval();
+			continue;
 		}
 
-		// Release mouse lock
-		controller->mouseLock.unlock();
+		// No tick since the frame on screen, it is still current
+		if (!viewJumped && !input.panPixels && newSCALEA == 0.0 && frameCurrent) {
+			if (controller->clock.is_virtual()) {
+				controller->clock.frame_presented(presentMs);
+			}
+			continue;
+		}
+		frameCurrent = false;
+
+		// Cheapest arithmetic that still resolves the pixel grid, float and double
+		//  run on the GPU, double-double and perturbation on the CPU
+		const cpu::PRECISION_TIER tier = cpu::select_precision_tier(pixelScale, kernel->getOffsetX(), kernel->getOffsetY());
+		if (tier != controller->precisionTier) {
+			std::ostringstream switchPoint;
+			switchPoint << "Precision tier " << cpu::get_precision_tier_name(controller->precisionTier) <<
+				" -> " << cpu::get_precision_tier_name(tier) << " at SCALE Alpha: " << kernel->getScaleA();
+			DINFO(switchPoint.str());
+
+			controller->previousPrecisionTier = controller->precisionTier;
+			controller->precisionTier = tier;
+			controller->precisionSwitchScaleA = kernel->getScaleA();
+		}
 
-		rgbaPixel *pixelBuffer = kernel->get_pixel_buffer();
-		assert(pixelBuffer != nullptr);
+		const bool cpuTier = tier >= cpu::PRECISION_TIER_DOUBLE_DOUBLE;
+		if (cpuTier) {
+			cpuKernel->setScaleA(kernel->getScaleA());
+			cpuKernel->setScaleB(kernel->getScaleB());
+			cpuKernel->set_precision_tier(tier);
+		}
+		else {
+			kernel->setSinglePrecision(tier == cpu::PRECISION_TIER_FLOAT);
+		}
 
-		renderer->write_static_frame(pixelBuffer, controller->pixelLength, controller->pixelHeight);
+		// Automatic zoom on the CPU tiers with no input, the next views are known
+		//  and already rendering (controller::renderAhead)
+		const bool aheadFrame = controller->ahead != nullptr && cpuTier && !viewJumped && !input.panPixels && zooming;
+		if (!aheadFrame && controller->ahead != nullptr && controller->ahead->is_active()) {
+			controller->ahead->discard();
+		}
+
+		// A jump to a new view, or a slow CPU frame, is shown coarse to fine. A zoom
+		//  step or a pixel pan on the CPU tiers reuses the last frame instead
+		const bool reprojected = !aheadFrame && cpuTier && !viewJumped && cpuKernel->can_reproject();
+		const bool progressive = !aheadFrame && controller->progressiveRendering &&
+			(viewJumped || (cpuTier && !reprojected));
+		const uint32_t passCount = !progressive ? 1 :
+			cpuTier ? cpuKernel->get_progressive_pass_count() : CUDA_PROGRESSIVE_PASSES;
+
+		double firstPassElapsedms = 0.0;
+		uint32_t passesPublished = 0;
+		for (uint32_t pass = 0; pass < passCount; pass++) {
+			// The write slot belongs to this thread until it is published
+			rgbaPixel *frame = controller->frames.get_write_slot();
+			error_t err = 0;
+			if (aheadFrame) {
+				err = controller->present_ahead_frame(tier, frame, &lastSCALEA, &presentMs);
+			}
+			else if (cpuTier) {
+				err = progressive ? cpuKernel->generate_mandelbrot_pass(pass, frame) : cpuKernel->generate_mandelbrot(frame);
+			}
+			else {
+				err = progressive ? kernel->generate_mandelbrot_pass(pass, frame) : controller->render_gpu_frame(frame);
+			}
+			if (err == ERROR_RENDER_CANCELLED) {
+				// Stale view, the write slot is reused by the next frame. The render-ahead
+				//  queue keeps its own count
+				if (!aheadFrame) {
+					controller->cancelledFrames++;
+					controller->wastedIterations += cpuKernel->get_render_stats().iterationsSpent;
+				}
+				break;
+			}
+			if (err != 0) {
+				DERROR("Error in generating CUDA kernel: " + std::to_string(err));
+				break;
+			}
+
+			controller->frames.publish();
+			passesPublished++;
+
+			// New input makes the finer passes of this view stale
+			if (pass + 1 < passCount && controller->viewGeneration.load(std::memory_order_relaxed) != frameGeneration) {
+				break;
+			}
+
+#if defined(MEASURE_CUDA_EXECUTION_TIME)
+			if (pass == 0) {
+				firstPassElapsedms = std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - t1).count();
+			}
+#endif //MEASURE_CUDA_EXECUTION_TIME
+		}
+
+		frameCurrent = passesPublished == passCount;
+		if (passesPublished != 0) {
+			controller->clock.frame_presented(presentMs);
+		}
 
 #if defined(MEASURE_CUDA_EXECUTION_TIME)
 		auto t2 = std::chrono::high_resolution_clock::now();
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+		const cpu::tileCacheStats cacheStats = cpuKernel->get_tile_cache_stats();
 		const double cudaExecTime = std::chrono::duration<double>(duration).count();
 		render::cudaRenderingStats stats = {
 			std::chrono::duration<double>(duration).count(),
 			kernel->getOffsetX(),
 			kernel->getOffsetY(),
 			kernel->getScaleA(),
-			kernel->getScaleB()
+			kernel->getScaleB(),
+			cpu::get_precision_tier_name(controller->precisionTier),
+			cpu::get_precision_tier_name(controller->previousPrecisionTier),
+			controller->precisionSwitchScaleA,
+			passCount,
+			firstPassElapsedms,
+			controller->cancelledFrames,
+			controller->wastedIterations,
+			reprojected ? cpuKernel->get_render_stats().reuseRatio : 0.0,
+			cacheStats.hits,
+			cacheStats.misses,
+			cacheStats.evictions,
+			controller->ahead != nullptr ? controller->ahead->get_queued() : 0,
+			controller->ahead != nullptr ? controller->ahead->get_discarded_frames() : 0
 		};
-		renderer->update_cuda_rendering_stats(stats);
+		render::sdlBase *renderer = controller->sdlRenderer.load(std::memory_order_acquire);
+		if (renderer != nullptr) {
+			renderer->update_cuda_rendering_stats(stats);
+		}
 #endif //MEASURE_CUDA_EXECUTION_TIME
 	}
 	DINFO("Terminating CUDA thread");
 }
 
+error_t loopTimer::render_gpu_frame(__inout rgbaPixel *frame)
+{
+	error_t err = cudaKernel->generate_iteration_field(gpuField.data());
+	if (err != 0) {
+		return err;
+	}
+
+	gpuColours.colorize(gpuField.data(), gpuField.size(), frame);
+	return 0;
+}
+
+error_t loopTimer::present_ahead_frame(cpu::PRECISION_TIER tier, __inout rgbaPixel *frame, __inout double *lastScaleA,
+	__inout double *presentMs)
+{
+	// The view about to be shown leads a new sequence
+	if (!ahead->is_active()) {
+		aheadNext = { cudaKernel->getScaleA(), cudaKernel->getScaleB(), *lastScaleA,
+			cpuKernel->get_center_x(), cpuKernel->get_center_y(), tier, zoomTicks, *presentMs,
+			tier < cpu::PRECISION_TIER_DOUBLE_DOUBLE };
+	}
+
+	// Every free slot takes the view after the last one queued, as long as the
+	//  zoom moves and stays on the CPU tiers. Views are a frame interval apart
+	const double intervalMs = clock.get_frame_interval_ms();
+	const uint64_t ticksPerFrame = std::min<uint64_t>(CONTROLLER_ZOOM_MAX_TICKS,
+		std::max<uint64_t>(1, (uint64_t)std::llround(intervalMs / CONTROLLER_ZOOM_TICK_MS)));
+	while (!aheadNext.stop && ahead->can_queue()) {
+		ahead->queue(aheadNext);
+
+		const double step = advance_zoom(user_io_state, &aheadNext.scaleA, &aheadNext.lastScaleA, ticksPerFrame);
+		aheadNext.zoomTicks += ticksPerFrame;
+		aheadNext.presentMs += intervalMs;
+		const double pixelScale = aheadNext.scaleA / ((double)pixelLength / aheadNext.scaleB);
+		aheadNext.tier = cpu::select_precision_tier(pixelScale, cudaKernel->getOffsetX(), cudaKernel->getOffsetY());
+		aheadNext.stop = step == 0.0 || aheadNext.tier < cpu::PRECISION_TIER_DOUBLE_DOUBLE;
+	}
+
+	aheadView view;
+	const error_t err = ahead->present(frame, &view);
+	if (err != 0) {
+		ahead->discard();
+		return err;
+	}
+
+	// The zoom state and the clock move to the frame shown
+	cudaKernel->setScaleA(view.scaleA);
+	cpuKernel->setScaleA(view.scaleA);
+	*lastScaleA = view.lastScaleA;
+	zoomTicks = view.zoomTicks;
+	*presentMs = view.presentMs;
+
+	return 0;
+}
+
 // Dump parameters to a new JSON file
 error_t loopTimer::dump_parameters_json(void)
 {
@@ -115,27 +313,107 @@ void loopTimer::set_mouse_button_offset(uint32_t inMouseX, uint32_t inMouseY)
 	// SDL2 starts at position (0,0), and our complex scale works from
 	//  (-inf,inf), so we need to convert this type
 
-	mouseLock.lock();
+	userCommand command = { USER_COMMAND_PAN };
+	command.x = (double)inMouseX * (2.0 / (double)RENDER_WINDOW_LENGTH) - 1.0;
+	command.y = (double)inMouseY * (2.0 / (double)RENDER_WINDOW_HEIGHT) - 1.0;
+	push_command(command);
+}
+
+void loopTimer::pan_by_pixels(int32_t dx, int32_t dy)
+{
+	userCommand command = { USER_COMMAND_PAN_PIXELS };
+	command.pixelsX = dx;
+	command.pixelsY = dy;
+	push_command(command);
+}
 
-	if (inMouseX > 0.0f) {
-		mouseX = (double)inMouseX * (2.0 / (double)RENDER_WINDOW_LENGTH) - 1.0;
+void loopTimer::push_command(const userCommand &command)
+{
+	// A new view supersedes the frame in flight, pause and dump keep it. Pixel
+	//  pans keep it as well, the next frame reuses it and a drag would
+	//  otherwise cancel every frame
+	const bool viewChange = command.type == USER_COMMAND_PAN ||
+		(command.type == USER_COMMAND_ZOOM && command.zoomState != SET_ZOOM_PAUSE);
+
+	// The generation moves on before the push: once the render thread drains
+	//  the command it also sees the generation, a frame started for it is
+	//  never cancelled by it. This is the only producer
+	userCommand queued = command;
+	const uint64_t previous = viewGeneration.load(std::memory_order_relaxed);
+	queued.generation = viewChange ? previous + 1 : previous;
+	viewGeneration.store(queued.generation, std::memory_order_relaxed);
+
+	if (!commands.push(queued)) {
+		viewGeneration.store(previous, std::memory_order_relaxed);
+		droppedCommands++;
+		DERROR("Command queue full, input dropped");
+		return;
 	}
+	wake_render_thread();
 
-	if (inMouseY > 0.0f) {
-		mouseY = (double)inMouseY * (2.0 / (double)RENDER_WINDOW_HEIGHT) - 1.0;
+	// Frames rendered ahead assume no input at all
+	if (ahead != nullptr) {
+		ahead->cancel();
 	}
+}
 
-	this->setMouseState = true;
-	mouseLock.unlock();
-	return;
+void loopTimer::wake_render_thread(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeLock);
+		wakePending = true;
+	}
+	wakeCondition.notify_one();
 }
 
-void loopTimer::frame_render_thread(loopTimer *controller)
+void loopTimer::park_render_thread(void)
 {
-	while (controller->testFrameThread) {
-		rgbaPixel *out = controller->generate_blank_frame(controller->pixelBufferRawSize);
+	std::unique_lock<std::mutex> lock(wakeLock);
+	thread_state running = THREAD_STATE_RUNNING;
+	if (!wakePending && threadStateCuda.compare_exchange_strong(running, THREAD_STATE_PAUSED)) {
+		DINFO("Render thread paused");
+		wakeCondition.wait(lock, [this] { return wakePending || threadStateCuda == THREAD_STATE_TERMINATED; });
+
+		// A stop while parked keeps THREAD_STATE_TERMINATED
+		thread_state paused = THREAD_STATE_PAUSED;
+		threadStateCuda.compare_exchange_strong(paused, THREAD_STATE_RUNNING);
+		DINFO("Render thread resumed");
+	}
+}
 
-		renderer->write_static_frame(out, controller->pixelLength, controller->pixelHeight);
+void loopTimer::drain_commands(__inout pendingInput *input)
+{
+	userCommand command;
+	while (commands.pop(&command)) {
+		input->commandCount++;
+		input->generation = command.generation;
+		switch (command.type) {
+		case USER_COMMAND_PAN:
+			input->pan = true;
+			input->panX = command.x;
+			input->panY = command.y;
+			break;
+		case USER_COMMAND_PAN_PIXELS:
+			input->panPixels = true;
+			input->panPixelsX += command.pixelsX;
+			input->panPixelsY += command.pixelsY;
+			break;
+		case USER_COMMAND_ZOOM:
+			input->zoom = true;
+			input->zoomState = command.zoomState;
+			break;
+		case USER_COMMAND_DUMP:
+			input->dump = true;
+			break;
+		}
+	}
+}
+
+void loopTimer::frame_render_thread(loopTimer *controller)
+{
+	while (controller->runTestFrameThread) {
+		controller->generate_blank_frame(controller->frames.get_write_slot(), controller->pixelLength * controller->pixelHeight);
+		controller->frames.publish();
 
 		std::this_thread::sleep_for(std::chrono::milliseconds(STATIC_FRAME_RENDERING_WAIT_TIME));
 	}
@@ -143,9 +421,15 @@ void loopTimer::frame_render_thread(loopTimer *controller)
 
 void loopTimer::set_user_io_state(USER_IO_STATE state)
 {
-	user_io_state = state;
+	userCommand command = { USER_COMMAND_ZOOM };
+	command.zoomState = state;
+	push_command(command);
+}
 
-	return;
+void loopTimer::request_parameter_dump(void)
+{
+	userCommand command = { USER_COMMAND_DUMP };
+	push_command(command);
 }
 
 error_t loopTimer::create_cuda_thread(void)
@@ -156,6 +440,26 @@ error_t loopTimer::create_cuda_thread(void)
 		pixelLength, pixelHeight,
 		origScaleA, origScaleB);
 
+	assert(cpuKernel == nullptr);
+	this->cpuKernel = new mandelbrotFractalCpu(
+		origOffsetX, origOffsetY,
+		pixelLength, pixelHeight,
+		origScaleA, origScaleB,
+		CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+
+	// Subdivides the double-double tier (perturbation always iterates every pixel)
+	this->cpuKernel->set_subdivision(true);
+	this->cpuKernel->set_cancel_generation(&viewGeneration, 0);
+	this->cpuKernel->set_reprojection(true);
+	this->cpuKernel->set_tile_cache_budget(TILE_CACHE_DEFAULT_BUDGET);
+
+	// Render-ahead needs cores the frame on screen leaves idle, it shares the pool
+	assert(ahead == nullptr);
+	if (std::thread::hardware_concurrency() > 1) {
+		this->ahead = new renderAhead(CONTROLLER_RENDER_AHEAD_DEPTH, pixelLength, pixelHeight,
+			CUDA_MANDELBROT_INTERATIONS, cpuKernel->get_thread_pool());
+	}
+
 	threadStateCuda = THREAD_STATE_RUNNING;
 	this->cudaThread = new std::thread(&cuda_render_thread, this);
 	DINFO("Created CUDA rendering thread");
@@ -163,9 +467,17 @@ error_t loopTimer::create_cuda_thread(void)
 	return 0;
 }
 
+void loopTimer::set_virtual_clock(double frameMs)
+{
+	assert(cudaThread == nullptr);
+	clock.set_virtual_clock(frameMs);
+	zoomTicks = 0;
+}
+
 error_t loopTimer::pause_cuda_thread(void)
 {
-	assert(threadStateCuda == THREAD_STATE_RUNNING);
+	assert(threadStateCuda == THREAD_STATE_RUNNING || threadStateCuda == THREAD_STATE_PAUSED);
+	set_user_io_state(SET_ZOOM_PAUSE);
 	return 0;
 }
 
@@ -182,15 +494,17 @@ void loopTimer::stop_cuda_thread(void)
 {
 	assert(threadStateCuda == THREAD_STATE_RUNNING || threadStateCuda == THREAD_STATE_PAUSED);
 	threadStateCuda = THREAD_STATE_TERMINATED;
+	wake_render_thread();
 }
 
 error_t loopTimer::init_sdl2_renderer(const std::string windowName)
 {
 	windowName != "" ? sdlWindowTitle = windowName : sdlWindowTitle = DEFAULT_WINDOW_NAME;
-	renderer = new render::sdlBase(pixelHeight, pixelLength, sdlWindowTitle);
+	render::sdlBase *renderer = new render::sdlBase(pixelHeight, pixelLength, sdlWindowTitle);
 
 	// Set the controller type for user I/O
 	renderer->set_controller_obj((void *)this);
+	renderer->set_frame_ring(&frames);
 
 	error_t err = renderer->init_window();
 	if (err != 0) {
@@ -198,8 +512,8 @@ error_t loopTimer::init_sdl2_renderer(const std::string windowName)
 		return err;
 	}
 
-	rgbaPixel *blankFrame = generate_blank_frame(pixelBufferRawSize);
-	renderer->write_static_frame(blankFrame, pixelLength, pixelHeight);
+	// The render thread may already run, it sees the renderer from here on
+	sdlRenderer.store(renderer, std::memory_order_release);
 
 	err = renderer->enter_render_loop();
 	if (err != 0) {
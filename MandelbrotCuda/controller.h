@@ -5,13 +5,21 @@
 #include <random>
 #include <thread>
 #include <string>
+#include <vector>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <assert.h>
 
 #include "main.h"
 #include "types.h"
 #include "cudaMandelbrot.h"
+#include "mandelbrot_cpu.h"
+#include "frame_ring.h"
+#include "spsc_queue.h"
+#include "render_ahead.h"
+#include "zoom_clock.h"
 
 #define DEFAULT_WINDOW_NAME "sdl_window"
 
@@ -21,19 +29,63 @@
 // Measures CUDA execution time
 #define MEASURE_CUDA_EXECUTION_TIME 
 
+// Input commands that can wait for the render thread (power of two)
+#define CONTROLLER_COMMAND_QUEUE_SIZE 64
+
+// Pixels the view moves per arrow key press
+#define CONTROLLER_PAN_STEP 16
+
+// Automatic zoom frames rendered ahead on the CPU tiers (pipeline depth)
+#define CONTROLLER_RENDER_AHEAD_DEPTH 3
+
+// The automatic zoom takes one step (ZOOM_ALPHA, ZOOM_BETA) per tick, whatever the frame rate
+#define CONTROLLER_ZOOM_TICK_MS (1000.0 / 60.0)
+
+// Ticks a slow frame catches up at most, past that the zoom slows down instead of jumping
+#define CONTROLLER_ZOOM_MAX_TICKS 16
+
+// Virtual zoom clock, every frame advances it by this many ms (exact frame sequences for benchmarks)
+#undef CONTROLLER_VIRTUAL_CLOCK_MS
+
 
 // prng
 // https://stackoverflow.com/questions/25298585/efficiently-generating-random-bytes-of-data-in-c11-14
 using random_bytes_engine = std::independent_bits_engine<std::default_random_engine, CHAR_BIT, unsigned char>;
 
+namespace render {
+	class sdlBase;
+}
+
 namespace controller {
 
-	// Sets the zoom to start, stop, or reverse
+	// Input from the SDL2 thread, applied by the render thread between frames
 	typedef enum {
-		SET_ZOOM_PAUSE,
-		SET_ZOOM_REVERSE,
-		SET_ZOOM_RESUME
-	} USER_IO_STATE;
+		USER_COMMAND_PAN,			// Recentre on a click, x,y in [-1, 1] of the view
+		USER_COMMAND_PAN_PIXELS,	// Arrow keys and drag, pixelsX,pixelsY relative
+		USER_COMMAND_ZOOM,			// Zoom resume, pause or reverse
+		USER_COMMAND_DUMP			// dump_parameters_json
+	} USER_COMMAND_TYPE;
+
+	typedef struct userCommand {
+		USER_COMMAND_TYPE type;
+		double x, y;
+		int32_t pixelsX, pixelsY;
+		USER_IO_STATE zoomState;
+		uint64_t generation;		// View generation once the command is applied
+	} USER_COMMAND, *PUSER_COMMAND;
+
+	// Commands drained in one go, redundant ones coalesced
+	typedef struct pendingInput {
+		bool pan;
+		double panX, panY;
+		bool panPixels;				// Relative moves add up
+		int32_t panPixelsX, panPixelsY;
+		bool zoom;
+		USER_IO_STATE zoomState;
+		bool dump;
+		uint32_t commandCount;
+		uint64_t generation;		// Of the last command drained
+	} PENDING_INPUT, *PPENDING_INPUT;
 
 	class loopTimer {
 	private:
@@ -54,9 +106,21 @@ namespace controller {
 		// The actual SDL2 X,Y position of the mouse (for debugging purposes)
 		double inMouseX, inMouseY;
 	private:
-		double mouseX, mouseY;
-		bool setMouseState;
-		std::mutex mouseLock;
+		// SDL2 thread -> render thread, never blocks the SDL2 loop
+		spscQueue<userCommand, CONTROLLER_COMMAND_QUEUE_SIZE> commands;
+		std::atomic<uint64_t> droppedCommands;
+
+		// Moves on with every view changing command before it is queued. The CPU
+		//  renderer abandons a frame rendered for the generation of an older
+		//  command. Frames thrown away and the iterations they had cost
+		std::atomic<uint64_t> viewGeneration;
+		uint64_t cancelledFrames, wastedIterations;
+
+		// The render thread parks here (THREAD_STATE_PAUSED) once the frame on
+		//  screen is current and nothing moves, any command or a stop wakes it
+		std::mutex wakeLock;
+		std::condition_variable wakeCondition;
+		bool wakePending;
 
 		// Total size of the pixelBuffer (in bytes)
 		const size_t pixelBufferRawSize;
@@ -65,23 +129,83 @@ namespace controller {
 		// Window name
 		std::string sdlWindowTitle;
 
-		// Pointer from CUDA kernel to the rgba frame buffer
-		rgbaPixel* frameBuffer;	
+		// Frames handed from the render thread to the SDL2 renderer, allocated once
+		render::frameRing frames;
+
+		// SDL2 renderer, published by init_sdl2_renderer once it is set up. The
+		//  render thread starts first and skips its stats until then
+		std::atomic<render::sdlBase *> sdlRenderer;
 
 		// CUDA renderer
 		cuda::cudaKernel *cudaKernel;
 		std::thread *cudaThread;
-		thread_state threadStateCuda;
+		std::atomic<thread_state> threadStateCuda;
+
+		// Escape times of the last full GPU frame and the palette they are
+		//  coloured with, a palette change recolours gpuField without a launch
+		std::vector<uint32_t> gpuField;
+		cpu::colorizer gpuColours;
+
+		// CPU renderer, takes over deep zooms (double-double, perturbation)
+		mandelbrotFractalCpu *cpuKernel;
+
+		// Frames of the automatic zoom rendered ahead (CPU tiers), nullptr on a
+		//  single core. aheadNext is the view after the last one queued
+		renderAhead *ahead;
+		aheadView aheadNext;
+
+		// Clock of the automatic zoom and the ticks the view on screen stands at
+		zoomClock clock;
+		uint64_t zoomTicks;
+
+		// Precision ladder state, tier of the last frame and where it switched
+		cpu::PRECISION_TIER precisionTier;
+		cpu::PRECISION_TIER previousPrecisionTier;
+		double precisionSwitchScaleA;
+
+		// Coarse to fine passes after a click and on the CPU tiers
+		bool progressiveRendering;
 
 		// Test renderer (debug only)
 		std::thread *testFrameThread;
-		bool runTestFrameThread;
+		std::atomic<bool> runTestFrameThread;
 
-		// Controls the zoom on/off
-		USER_IO_STATE user_io_state = SET_ZOOM_RESUME;
+		// Controls the zoom on/off, applied from the command queue
+		std::atomic<USER_IO_STATE> user_io_state;
 
 	private:
-		rgbaPixel *generate_blank_frame(size_t pixelCount) const;
+		void generate_blank_frame(__inout rgbaPixel *out, size_t pixelCount) const;
+
+		/*
+		 * Render thread side of the command queue, the last click and zoom mode
+		 *  win (every click is relative to the frame on screen), pixel pans add up
+		 */
+		void drain_commands(__inout pendingInput *input);
+
+		void push_command(const userCommand &command);
+
+		void wake_render_thread(void);
+
+		/*
+		 * Blocks the render thread until wake_render_thread(), returns at once
+		 *  when a wake up arrived since the last drain
+		 */
+		void park_render_thread(void);
+
+		/*
+		 * Render thread: keeps the render-ahead queue full from the current view
+		 *  and shows its oldest frame in frame, the zoom state and *presentMs
+		 *  move on to it. Queued views are a frame interval of the zoom clock
+		 *  apart. ERROR_RENDER_CANCELLED after input, the queue is discarded
+		 */
+		error_t present_ahead_frame(cpu::PRECISION_TIER tier, __inout rgbaPixel *frame, __inout double *lastScaleA,
+			__inout double *presentMs);
+
+		/*
+		 * Render thread: full GPU frame of the current view, the GPU writes the
+		 *  iteration field and gpuColours colours it into frame
+		 */
+		error_t render_gpu_frame(__inout rgbaPixel *frame);
 
 		/*
 		 * CUDA rendering thread (primary)
@@ -112,13 +236,32 @@ namespace controller {
 
 			origOffsetX(offsetX), origOffsetY(offsetY),
 			pixelLength(length), pixelHeight(height), pixelBufferRawSize(length* height * sizeof(rgbaPixel)),
+			frames(length, height), sdlRenderer(nullptr),
 			cudaKernel(nullptr), cudaThread(nullptr),
+			gpuField(length * height),
+			gpuColours(cpu::cpuPixelColour, sizeof(cpu::cpuPixelColour) / sizeof(cpu::cpuPixelColour[0]),
+				CUDA_MANDELBROT_INTERATIONS),
+			testFrameThread(nullptr), runTestFrameThread(false),
 			threadStateCuda(THREAD_STATE_TERMINATED),
+			cpuKernel(nullptr), ahead(nullptr),
+			clock(CONTROLLER_ZOOM_TICK_MS), zoomTicks(0),
+			precisionTier(cpu::PRECISION_TIER_DOUBLE), previousPrecisionTier(cpu::PRECISION_TIER_DOUBLE),
+			precisionSwitchScaleA(scaleA),
+			progressiveRendering(true),
 			origScaleA(scaleA), origScaleB(scaleB),
-			mouseX(0), mouseY(0), inMouseX(0), inMouseY(0), setMouseState(false),
+			inMouseX(0), inMouseY(0), droppedCommands(0),
+			viewGeneration(0), cancelledFrames(0), wastedIterations(0),
+			wakePending(false),
 			user_io_state(SET_ZOOM_RESUME)
 		{
-
+			// Shown until the render thread publishes its first frame, published
+			//  before any thread starts so the ring keeps a single writer
+			generate_blank_frame(frames.get_write_slot(), pixelLength * pixelHeight);
+			frames.publish();
+
+#if defined(CONTROLLER_VIRTUAL_CLOCK_MS)
+			clock.set_virtual_clock(CONTROLLER_VIRTUAL_CLOCK_MS);
+#endif //CONTROLLER_VIRTUAL_CLOCK_MS
 		}
 
 		/*
@@ -126,9 +269,16 @@ namespace controller {
 		 */
 		error_t create_cuda_thread(void);
 
+		/*
+		 * Zoom clock that moves frameMs per frame instead of following the wall
+		 *  clock, 0 goes back to the wall clock. Call before create_cuda_thread()
+		 */
+		void set_virtual_clock(double frameMs);
+
 		/*
 		 * Pauses the CUDA rendering thread
-		 *  The last rendered frame buffer will be stored
+		 *  The zoom stops, the thread parks once the last frame is complete and
+		 *  stays on screen until the next command
 		 */
 		error_t pause_cuda_thread(void);
 
@@ -161,6 +311,17 @@ namespace controller {
 		 */
 		void set_mouse_button_offset(uint32_t mouseX, uint32_t mouseY);
 
+		/*
+		 * Moves the view by whole pixels (arrow keys, drag), the CPU tiers only
+		 *  iterate the strips that come into view
+		 */
+		void pan_by_pixels(int32_t dx, int32_t dy);
+
+		/*
+		 * Queues a dump of the current parameters, written by the render thread
+		 */
+		void request_parameter_dump(void);
+
 		/*
 		 * Dump current fractal parameters into JSON format
 		 */
@@ -14,6 +14,9 @@
 // Debug output for CUDA grid sizes
 #define CUDA_DEBUG_OUT
 
+// Progressive passes, same sampling as CPU_PROGRESSIVE_PASSES (1/16, 1/4, full)
+#define CUDA_PROGRESSIVE_PASSES 3
+
 namespace cuda {
 	class cudaKernel {
 	private:
@@ -25,35 +28,66 @@ namespace cuda {
 		const size_t pixelBufferRawSize;
 		const size_t pixelLength, pixelHeight;
 
-		// CUDA frame buffer object
-		rgbaPixel *pixelBuffer;
-
 		// Scales
 		double scaleA, scaleB;
 		double scale;
 
-	public:
-		error_t generate_mandelbrot(void);
+		// Iterate in float instead of double (shallow zooms)
+		bool singlePrecision;
 
-		rgbaPixel *get_pixel_buffer(void) const
-		{
-			assert(pixelBuffer != nullptr);
-			return pixelBuffer;
-		}
+		// Device frame, allocated on the first launch and reused (the progressive
+		//  passes of one view accumulate in it)
+		rgbaPixel *deviceBuffer;
+
+		// Device iteration field, allocated on the first generate_iteration_field
+		uint32_t *deviceField;
+
+	public:
+		/*
+		 * Renders the current view into frame (host, pixelLength * pixelHeight),
+		 *  the caller owns frame
+		 */
+		error_t generate_mandelbrot(__inout rgbaPixel *frame);
+
+		/*
+		 * Progressive pass (0 .. CUDA_PROGRESSIVE_PASSES - 1) of the current
+		 *  view, each pass only launches the samples the coarser ones did not
+		 *  compute. frame receives all passes so far
+		 */
+		error_t generate_mandelbrot_pass(uint32_t pass, __inout rgbaPixel *frame);
+
+		/*
+		 * Escape time of every pixel (pixelLength * pixelHeight) into field,
+		 *  no colouring: the host colours it with cpu::colorizer, a palette
+		 *  change recolours the field without a launch
+		 */
+		error_t generate_iteration_field(__inout uint32_t *field);
 
 	private:
+		error_t allocate_device_buffer(void);
+
 		template<class T, typename... A>
 		error_t launch_kernel(T& kernel, dim3 work, A&&... args);
 
+		template<typename T>
+		error_t launch_mandelbrot_kernel(rgbaPixel *cudaBuffer);
+
+		template<typename T>
+		error_t launch_iteration_kernel(uint32_t *cudaField);
+
+		template<typename T>
+		error_t launch_mandelbrot_pass_kernel(rgbaPixel *cudaBuffer, uint32_t stride);
+
 	public:
 		// Constructor for PPM image generator
 		cudaKernel(double offsetX, double offsetY, size_t pixelLength, size_t pixelHeight) :
 			origOffsetX(offsetX), origOffsetY(offsetY),
 			offsetX(offsetX), offsetY(offsetY),
-			pixelBuffer(nullptr),
 			pixelLength(pixelLength), pixelHeight(pixelHeight),
 			pixelBufferRawSize(pixelLength * pixelHeight * sizeof(rgbaPixel)), 
-			scale(1.0 / (pixelLength / 4.0))
+			scale(1.0 / (pixelLength / 4.0)),
+			singlePrecision(false),
+			deviceBuffer(nullptr), deviceField(nullptr)
 		{
 
 		}
@@ -62,18 +96,24 @@ namespace cuda {
 		cudaKernel(double offsetX, double offsetY, size_t pixelLength, size_t pixelHeight, double scaleA, double scaleB) :
 			origOffsetX(offsetX), origOffsetY(offsetY),
 			offsetX(offsetX), offsetY(offsetY),
-			pixelBuffer(nullptr),
 			pixelLength(pixelLength), pixelHeight(pixelHeight),
 			pixelBufferRawSize(pixelLength *pixelHeight * sizeof(rgbaPixel)),
 			scaleA(scaleA), scaleB(scaleB),
-			scale(scaleA / (pixelLength / scaleB))
+			scale(scaleA / (pixelLength / scaleB)),
+			singlePrecision(false),
+			deviceBuffer(nullptr), deviceField(nullptr)
 		{
 
 		}
 
 		~cudaKernel(void)
 		{
-
+			if (deviceBuffer != nullptr) {
+				cudaFree(deviceBuffer);
+			}
+			if (deviceField != nullptr) {
+				cudaFree(deviceField);
+			}
 		}
 
 		double getOffsetX(void) const { return offsetX; }
@@ -85,6 +125,9 @@ namespace cuda {
 		void setOffsetY(double val) { offsetY = val; }
 		void setScaleA(double val) { scaleA = val; }
 		void setScaleB(double val) { scaleB = val; }
+
+		bool getSinglePrecision(void) const { return singlePrecision; }
+		void setSinglePrecision(bool val) { singlePrecision = val; }
 	};	
 }
 
@@ -80,7 +80,11 @@ void debugPrint(std::string level, std::string s)
 	std::string str(buffer);
 
 	ss = "[" + str + "]\t" + "[" + level + "] " + s + "\n";
+#if defined(_WIN32)
 	OutputDebugStringA(ss.c_str());
+#else //_WIN32
+	std::cerr << ss;
+#endif //_WIN32
 }
 #endif
 
@@ -0,0 +1,561 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+
+#include "types.h"
+
+/*
+ * Deflate (RFC 1951) compressor, CRC-32 and Adler-32 for the PNG encoder
+ *  There is no zlib in the tree. Matches are found greedily on hash chains,
+ *  every block of DEFLATE_BLOCK_SYMBOLS symbols gets its own Huffman codes
+ *  and is stored instead when that is smaller. A part of a stream can be
+ *  compressed on its own with the data before it as history: parts that
+ *  end on a byte boundary concatenate into one stream, and matches still
+ *  reach back across the joins.
+ */
+
+#define DEFLATE_WINDOW_SIZE			32768
+#define DEFLATE_MIN_MATCH			3
+#define DEFLATE_MAX_MATCH			258
+#define DEFLATE_HASH_BITS			15
+
+// Candidates compared at each position, more compresses better and slower
+#define DEFLATE_MAX_CHAIN			32
+
+// The positions inside longer matches are not hashed (runs of filtered rows)
+#define DEFLATE_MAX_INSERT			32
+
+#define DEFLATE_BLOCK_SYMBOLS		32768
+#define DEFLATE_MAX_CODE_BITS		15
+#define DEFLATE_MAX_CL_BITS			7
+#define DEFLATE_STORED_MAX			65535
+
+#define DEFLATE_LITLEN_CODES		286
+#define DEFLATE_DIST_CODES			30
+#define DEFLATE_CL_CODES			19
+#define DEFLATE_END_OF_BLOCK		256
+
+#define ADLER32_BASE				65521
+
+// Bytes summed before the modulo, the largest count that cannot overflow 32 bits
+#define ADLER32_NMAX				5552
+
+namespace deflate {
+	/*
+	 * CRC-32 (PNG chunks). crc is 0 to start, or the result of the bytes
+	 *  before data to continue
+	 */
+	static inline uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+	{
+		static const std::vector<uint32_t> table = [] {
+			std::vector<uint32_t> t(256);
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (uint32_t k = 0; k < 8; k++) {
+					c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+				}
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < length; i++) {
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	/*
+	 * Adler-32 (zlib trailer). adler is 1 to start, or the result of the
+	 *  bytes before data to continue
+	 */
+	static inline uint32_t adler32(uint32_t adler, const uint8_t *data, size_t length)
+	{
+		uint32_t a = adler & 0xffff, b = adler >> 16;
+		while (length > 0) {
+			const size_t n = std::min<size_t>(length, ADLER32_NMAX);
+			for (size_t i = 0; i < n; i++) {
+				a += data[i];
+				b += a;
+			}
+			a %= ADLER32_BASE;
+			b %= ADLER32_BASE;
+			data += n;
+			length -= n;
+		}
+		return a | (b << 16);
+	}
+
+	/*
+	 * Adler-32 of two parts from the Adler-32 of each, length2 is the length
+	 *  of the second part
+	 */
+	static inline uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2)
+	{
+		const uint64_t rem = length2 % ADLER32_BASE;
+		uint64_t sum1 = adler1 & 0xffff;
+		uint64_t sum2 = (rem * sum1) % ADLER32_BASE;
+		sum1 += (adler2 & 0xffff) + ADLER32_BASE - 1;
+		sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER32_BASE - rem;
+		if (sum1 >= ADLER32_BASE) {
+			sum1 -= ADLER32_BASE;
+		}
+		if (sum1 >= ADLER32_BASE) {
+			sum1 -= ADLER32_BASE;
+		}
+		if (sum2 >= (uint64_t)ADLER32_BASE << 1) {
+			sum2 -= (uint64_t)ADLER32_BASE << 1;
+		}
+		if (sum2 >= ADLER32_BASE) {
+			sum2 -= ADLER32_BASE;
+		}
+		return (uint32_t)(sum1 | (sum2 << 16));
+	}
+
+	class compressor {
+	private:
+		// Code of each match length and distance, base and extra bits of each code
+		typedef struct codeTables {
+			uint8_t lengthCode[DEFLATE_MAX_MATCH + 1];
+			uint8_t distanceCode[512];
+			uint16_t lengthBase[29];
+			uint8_t lengthExtra[29];
+			uint16_t distanceBase[DEFLATE_DIST_CODES];
+			uint8_t distanceExtra[DEFLATE_DIST_CODES];
+		} CODE_TABLES, *PCODE_TABLES;
+
+		std::vector<uint8_t> *out;
+		uint64_t bitBuffer;
+		uint32_t bitCount;
+
+		// Hash chains of positions in the data, -1 ends a chain
+		std::vector<int64_t> head, prev;
+
+		// Symbols of the block being collected: a literal byte, or length << 16 | distance
+		std::vector<uint32_t> symbols;
+		uint32_t litLenFreq[DEFLATE_LITLEN_CODES];
+		uint32_t distanceFreq[DEFLATE_DIST_CODES];
+
+	private:
+		static const codeTables &get_tables(void)
+		{
+			static const codeTables tables = [] {
+				codeTables t;
+				const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+					3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+				uint32_t base = DEFLATE_MIN_MATCH;
+				for (uint32_t code = 0; code < 29; code++) {
+					t.lengthExtra[code] = lengthExtra[code];
+					t.lengthBase[code] = (uint16_t)base;
+					for (uint32_t i = 0; i < (1u << lengthExtra[code]) && base + i <= DEFLATE_MAX_MATCH; i++) {
+						t.lengthCode[base + i] = (uint8_t)code;
+					}
+					base += 1u << lengthExtra[code];
+				}
+				// 258 has a code of its own, 227 + 31 would be the same length
+				t.lengthBase[28] = DEFLATE_MAX_MATCH;
+				t.lengthCode[DEFLATE_MAX_MATCH] = 28;
+
+				base = 1;
+				for (uint32_t code = 0; code < DEFLATE_DIST_CODES; code++) {
+					const uint32_t extra = code < 4 ? 0 : (code >> 1) - 1;
+					t.distanceExtra[code] = (uint8_t)extra;
+					t.distanceBase[code] = (uint16_t)base;
+					for (uint32_t i = 0; i < (1u << extra); i++) {
+						const uint32_t d = base - 1 + i;
+						t.distanceCode[d < 256 ? d : 256 + (d >> 7)] = (uint8_t)code;
+					}
+					base += 1u << extra;
+				}
+				return t;
+			}();
+			return tables;
+		}
+
+		static uint32_t get_distance_code(uint32_t distance)
+		{
+			const uint32_t d = distance - 1;
+			return get_tables().distanceCode[d < 256 ? d : 256 + (d >> 7)];
+		}
+
+		static uint32_t reverse_bits(uint32_t code, uint32_t bits)
+		{
+			uint32_t reversed = 0;
+			for (uint32_t i = 0; i < bits; i++) {
+				reversed = (reversed << 1) | ((code >> i) & 1);
+			}
+			return reversed;
+		}
+
+		/*
+		 * Huffman code lengths of freq, none longer than maxBits. Too deep trees
+		 *  are rebuilt from flattened frequencies. At least two symbols get a
+		 *  code, inflaters reject a tree of a single code of no length
+		 */
+		static void build_lengths(const uint32_t *freq, uint32_t count, uint32_t maxBits, __inout uint8_t *lengths)
+		{
+			std::vector<uint64_t> weight(freq, freq + count);
+			uint32_t used = 0;
+			for (uint32_t i = 0; i < count; i++) {
+				used += weight[i] != 0;
+			}
+			for (uint32_t i = 0; i < count && used < 2; i++) {
+				if (weight[i] == 0) {
+					weight[i] = 1;
+					used++;
+				}
+			}
+
+			typedef std::pair<uint64_t, uint32_t> heapNode;
+			std::vector<uint32_t> parent(count * 2), depth(count * 2);
+			for (;;) {
+				std::priority_queue<heapNode, std::vector<heapNode>, std::greater<heapNode>> heap;
+				for (uint32_t i = 0; i < count; i++) {
+					if (weight[i] != 0) {
+						heap.push(heapNode(weight[i], i));
+					}
+				}
+
+				// Internal nodes are numbered from count up, a parent is always above its children
+				uint32_t next = count;
+				while (heap.size() > 1) {
+					const heapNode a = heap.top();
+					heap.pop();
+					const heapNode b = heap.top();
+					heap.pop();
+					parent[a.second] = parent[b.second] = next;
+					heap.push(heapNode(a.first + b.first, next++));
+				}
+
+				const uint32_t root = next - 1;
+				uint32_t deepest = 0;
+				depth[root] = 0;
+				for (int64_t n = (int64_t)root - 1; n >= 0; n--) {
+					if (n >= count || weight[n] != 0) {
+						depth[n] = depth[parent[n]] + 1;
+					}
+				}
+				for (uint32_t i = 0; i < count; i++) {
+					lengths[i] = weight[i] != 0 ? (uint8_t)depth[i] : 0;
+					deepest = std::max<uint32_t>(deepest, lengths[i]);
+				}
+				if (deepest <= maxBits) {
+					return;
+				}
+
+				for (uint32_t i = 0; i < count; i++) {
+					weight[i] = (weight[i] + 1) >> 1;
+				}
+			}
+		}
+
+		// Canonical codes of lengths, bit reversed for put_bits
+		static void build_codes(const uint8_t *lengths, uint32_t count, __inout uint16_t *codes)
+		{
+			uint32_t lengthCount[DEFLATE_MAX_CODE_BITS + 1] = { 0 }, nextCode[DEFLATE_MAX_CODE_BITS + 1] = { 0 };
+			for (uint32_t i = 0; i < count; i++) {
+				lengthCount[lengths[i]]++;
+			}
+			lengthCount[0] = 0;
+
+			uint32_t code = 0;
+			for (uint32_t bits = 1; bits <= DEFLATE_MAX_CODE_BITS; bits++) {
+				code = (code + lengthCount[bits - 1]) << 1;
+				nextCode[bits] = code;
+			}
+			for (uint32_t i = 0; i < count; i++) {
+				codes[i] = lengths[i] != 0 ? (uint16_t)reverse_bits(nextCode[lengths[i]]++, lengths[i]) : 0;
+			}
+		}
+
+		void put_bits(uint32_t value, uint32_t count)
+		{
+			bitBuffer |= (uint64_t)value << bitCount;
+			bitCount += count;
+			while (bitCount >= 8) {
+				out->push_back((uint8_t)bitBuffer);
+				bitBuffer >>= 8;
+				bitCount -= 8;
+			}
+		}
+
+		void align_to_byte(void)
+		{
+			if (bitCount != 0) {
+				out->push_back((uint8_t)bitBuffer);
+			}
+			bitBuffer = 0;
+			bitCount = 0;
+		}
+
+		void write_stored(const uint8_t *data, size_t length, bool last)
+		{
+			do {
+				const size_t part = std::min<size_t>(length, DEFLATE_STORED_MAX);
+				put_bits(last && part == length ? 1 : 0, 1);
+				put_bits(0, 2);
+				align_to_byte();
+				const uint8_t header[4] = { (uint8_t)part, (uint8_t)(part >> 8),
+					(uint8_t)~part, (uint8_t)(~part >> 8) };
+				out->insert(out->end(), header, header + 4);
+				out->insert(out->end(), data, data + part);
+				data += part;
+				length -= part;
+			} while (length > 0);
+		}
+
+		/*
+		 * Writes the collected symbols as one block, data[0 .. length) are the
+		 *  bytes they stand for
+		 */
+		void write_block(const uint8_t *data, size_t length, bool last)
+		{
+			const codeTables &tables = get_tables();
+			litLenFreq[DEFLATE_END_OF_BLOCK] = 1;
+
+			uint8_t litLenLengths[DEFLATE_LITLEN_CODES], distanceLengths[DEFLATE_DIST_CODES];
+			build_lengths(litLenFreq, DEFLATE_LITLEN_CODES, DEFLATE_MAX_CODE_BITS, litLenLengths);
+			build_lengths(distanceFreq, DEFLATE_DIST_CODES, DEFLATE_MAX_CODE_BITS, distanceLengths);
+
+			uint32_t litLenCount = DEFLATE_LITLEN_CODES, distanceCount = DEFLATE_DIST_CODES;
+			while (litLenCount > 257 && litLenLengths[litLenCount - 1] == 0) {
+				litLenCount--;
+			}
+			while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) {
+				distanceCount--;
+			}
+
+			// Both length lists run-length coded with the code length alphabet (16, 17, 18 repeat)
+			std::vector<uint8_t> lengths(litLenLengths, litLenLengths + litLenCount);
+			lengths.insert(lengths.end(), distanceLengths, distanceLengths + distanceCount);
+			std::vector<uint16_t> clSymbols;
+			uint32_t clFreq[DEFLATE_CL_CODES] = { 0 };
+			for (size_t i = 0; i < lengths.size();) {
+				const uint8_t len = lengths[i];
+				size_t run = 1;
+				while (i + run < lengths.size() && lengths[i + run] == len) {
+					run++;
+				}
+				i += run;
+
+				if (len == 0) {
+					while (run >= 11) {
+						const size_t part = std::min<size_t>(run, 138);
+						clSymbols.push_back((uint16_t)(18 | (part - 11) << 8));
+						clFreq[18]++;
+						run -= part;
+					}
+					if (run >= 3) {
+						clSymbols.push_back((uint16_t)(17 | (run - 3) << 8));
+						clFreq[17]++;
+						run = 0;
+					}
+				}
+				else {
+					clSymbols.push_back(len);
+					clFreq[len]++;
+					run--;
+					while (run >= 3) {
+						const size_t part = std::min<size_t>(run, 6);
+						clSymbols.push_back((uint16_t)(16 | (part - 3) << 8));
+						clFreq[16]++;
+						run -= part;
+					}
+				}
+				for (; run > 0; run--) {
+					clSymbols.push_back(len);
+					clFreq[len]++;
+				}
+			}
+
+			static const uint8_t clOrder[DEFLATE_CL_CODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			static const uint8_t clExtra[3] = { 2, 3, 7 };
+			uint8_t clLengths[DEFLATE_CL_CODES];
+			build_lengths(clFreq, DEFLATE_CL_CODES, DEFLATE_MAX_CL_BITS, clLengths);
+			uint32_t clCount = DEFLATE_CL_CODES;
+			while (clCount > 4 && clLengths[clOrder[clCount - 1]] == 0) {
+				clCount--;
+			}
+
+			// Bits of the block against the bits stored
+			uint64_t bits = 3 + 5 + 5 + 4 + 3 * clCount;
+			for (uint32_t i = 0; i < DEFLATE_CL_CODES; i++) {
+				bits += (uint64_t)clFreq[i] * (clLengths[i] + (i >= 16 ? clExtra[i - 16] : 0));
+			}
+			for (uint32_t i = 0; i < DEFLATE_LITLEN_CODES; i++) {
+				bits += (uint64_t)litLenFreq[i] * (litLenLengths[i] + (i > DEFLATE_END_OF_BLOCK ? tables.lengthExtra[i - 257] : 0));
+			}
+			for (uint32_t i = 0; i < DEFLATE_DIST_CODES; i++) {
+				bits += (uint64_t)distanceFreq[i] * (distanceLengths[i] + tables.distanceExtra[i]);
+			}
+			const uint64_t storedBits = ((uint64_t)length / DEFLATE_STORED_MAX + 1) * (3 + 7 + 32) + (uint64_t)length * 8;
+
+			if (storedBits < bits) {
+				write_stored(data, length, last);
+			}
+			else {
+				uint16_t litLenCodes[DEFLATE_LITLEN_CODES], distanceCodes[DEFLATE_DIST_CODES], clCodes[DEFLATE_CL_CODES];
+				build_codes(litLenLengths, DEFLATE_LITLEN_CODES, litLenCodes);
+				build_codes(distanceLengths, DEFLATE_DIST_CODES, distanceCodes);
+				build_codes(clLengths, DEFLATE_CL_CODES, clCodes);
+
+				put_bits(last ? 1 : 0, 1);
+				put_bits(2, 2);
+				put_bits(litLenCount - 257, 5);
+				put_bits(distanceCount - 1, 5);
+				put_bits(clCount - 4, 4);
+				for (uint32_t i = 0; i < clCount; i++) {
+					put_bits(clLengths[clOrder[i]], 3);
+				}
+				for (size_t i = 0; i < clSymbols.size(); i++) {
+					const uint32_t symbol = clSymbols[i] & 0xff;
+					put_bits(clCodes[symbol], clLengths[symbol]);
+					if (symbol >= 16) {
+						put_bits(clSymbols[i] >> 8, clExtra[symbol - 16]);
+					}
+				}
+
+				for (size_t i = 0; i < symbols.size(); i++) {
+					const uint32_t symbol = symbols[i];
+					if (symbol < 256) {
+						put_bits(litLenCodes[symbol], litLenLengths[symbol]);
+						continue;
+					}
+
+					const uint32_t length = symbol >> 16, distance = symbol & 0xffff;
+					const uint32_t lengthCode = tables.lengthCode[length];
+					put_bits(litLenCodes[257 + lengthCode], litLenLengths[257 + lengthCode]);
+					put_bits(length - tables.lengthBase[lengthCode], tables.lengthExtra[lengthCode]);
+					const uint32_t distanceCode = get_distance_code(distance);
+					put_bits(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+					put_bits(distance - tables.distanceBase[distanceCode], tables.distanceExtra[distanceCode]);
+				}
+				put_bits(litLenCodes[DEFLATE_END_OF_BLOCK], litLenLengths[DEFLATE_END_OF_BLOCK]);
+			}
+
+			symbols.clear();
+			std::fill(litLenFreq, litLenFreq + DEFLATE_LITLEN_CODES, 0);
+			std::fill(distanceFreq, distanceFreq + DEFLATE_DIST_CODES, 0);
+		}
+
+		static uint32_t get_hash(const uint8_t *p)
+		{
+			const uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+			return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+		}
+
+		void insert_position(const uint8_t *base, int64_t position)
+		{
+			const uint32_t hash = get_hash(base + position);
+			prev[position & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+			head[hash] = position;
+		}
+
+	public:
+		/*
+		 * Compresses data[0 .. length) into blocks appended to *out. The
+		 *  historyBytes before data are what the stream held before, matches
+		 *  may reach into them. last closes the stream, otherwise an empty
+		 *  stored block ends the part on a byte boundary for the next one
+		 */
+		void compress(const uint8_t *data, size_t historyBytes, size_t length, bool last, __inout std::vector<uint8_t> *out)
+		{
+			this->out = out;
+			bitBuffer = 0;
+			bitCount = 0;
+			std::fill(head.begin(), head.end(), -1);
+			symbols.clear();
+			std::fill(litLenFreq, litLenFreq + DEFLATE_LITLEN_CODES, 0);
+			std::fill(distanceFreq, distanceFreq + DEFLATE_DIST_CODES, 0);
+
+			// Positions count from the start of the history
+			historyBytes = std::min<size_t>(historyBytes, DEFLATE_WINDOW_SIZE);
+			const uint8_t *base = data - historyBytes;
+			const int64_t end = (int64_t)(historyBytes + length);
+			for (int64_t p = 0; p < (int64_t)historyBytes && p + DEFLATE_MIN_MATCH <= end; p++) {
+				insert_position(base, p);
+			}
+
+			int64_t blockStart = (int64_t)historyBytes;
+			for (int64_t p = (int64_t)historyBytes; p < end;) {
+				uint32_t bestLength = 0, bestDistance = 0;
+				if (p + DEFLATE_MIN_MATCH <= end) {
+					const uint32_t maxLength = (uint32_t)std::min<int64_t>(DEFLATE_MAX_MATCH, end - p);
+					int64_t candidate = head[get_hash(base + p)];
+					for (uint32_t chain = 0; candidate >= 0 && p - candidate <= DEFLATE_WINDOW_SIZE &&
+						chain < DEFLATE_MAX_CHAIN; chain++) {
+						const uint8_t *a = base + candidate, *b = base + p;
+						if (a[bestLength] == b[bestLength]) {
+							uint32_t matched = 0;
+							while (matched < maxLength && a[matched] == b[matched]) {
+								matched++;
+							}
+							if (matched > bestLength) {
+								bestLength = matched;
+								bestDistance = (uint32_t)(p - candidate);
+								if (matched == maxLength) {
+									break;
+								}
+							}
+						}
+
+						// A slot overwritten by a newer position ends the chain
+						const int64_t next = prev[candidate & (DEFLATE_WINDOW_SIZE - 1)];
+						if (next >= candidate) {
+							break;
+						}
+						candidate = next;
+					}
+				}
+
+				if (bestLength >= DEFLATE_MIN_MATCH) {
+					symbols.push_back(bestLength << 16 | bestDistance);
+					litLenFreq[257 + get_tables().lengthCode[bestLength]]++;
+					distanceFreq[get_distance_code(bestDistance)]++;
+
+					const int64_t matchEnd = p + bestLength;
+					const int64_t insertEnd = bestLength <= DEFLATE_MAX_INSERT ? matchEnd : p + 1;
+					for (; p < insertEnd && p + DEFLATE_MIN_MATCH <= end; p++) {
+						insert_position(base, p);
+					}
+					p = matchEnd;
+				}
+				else {
+					if (p + DEFLATE_MIN_MATCH <= end) {
+						insert_position(base, p);
+					}
+					symbols.push_back(base[p]);
+					litLenFreq[base[p]]++;
+					p++;
+				}
+
+				if (symbols.size() >= DEFLATE_BLOCK_SYMBOLS) {
+					write_block(base + blockStart, (size_t)(p - blockStart), false);
+					blockStart = p;
+				}
+			}
+
+			write_block(base + blockStart, (size_t)(end - blockStart), last);
+			if (!last) {
+				write_stored(nullptr, 0, false);
+			}
+			align_to_byte();
+		}
+
+	public:
+		compressor(void) :
+			out(nullptr), bitBuffer(0), bitCount(0),
+			head((size_t)1 << DEFLATE_HASH_BITS, -1), prev(DEFLATE_WINDOW_SIZE, -1)
+		{
+			symbols.reserve(DEFLATE_BLOCK_SYMBOLS + 1);
+		}
+	};
+}
+
+//EOF
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+
+#include "types.h"
+#include "fixed_point.h"
+
+/*
+ * Double-double number (unevaluated sum hi + lo, |lo| <= ulp(hi) / 2)
+ *  About 106 mantissa bits at roughly 10x the cost of a double, which covers
+ *  the 1e-15..1e-30 zoom range before perturbation pays off. The error free
+ *  product uses a hardware FMA when the target has one, Dekker's split otherwise
+ */
+namespace cpu {
+	class doubleDouble {
+	public:
+		double hi, lo;
+
+	private:
+		// s + err == a + b exactly
+		static inline doubleDouble two_sum(double a, double b)
+		{
+			const double s = a + b;
+			const double bb = s - a;
+			return doubleDouble(s, (a - (s - bb)) + (b - bb));
+		}
+
+		// Same as two_sum, requires |a| >= |b|
+		static inline doubleDouble quick_two_sum(double a, double b)
+		{
+			const double s = a + b;
+			return doubleDouble(s, b - (s - a));
+		}
+
+#if defined(__FMA__) || defined(__AVX2__)
+		// p + err == a * b exactly
+		static inline doubleDouble two_prod(double a, double b)
+		{
+			const double p = a * b;
+			return doubleDouble(p, std::fma(a, b, -p));
+		}
+#else
+		// Dekker split, a == hi + lo with 26 significant bits each
+		static inline void split(double a, __inout double *hi, __inout double *lo)
+		{
+			const double t = 134217729.0 * a;
+			*hi = t - (t - a);
+			*lo = a - *hi;
+		}
+
+		// p + err == a * b exactly, std::fma would be a library call without hardware FMA
+		static inline doubleDouble two_prod(double a, double b)
+		{
+			double ah, al, bh, bl;
+			split(a, &ah, &al);
+			split(b, &bh, &bl);
+
+			const double p = a * b;
+			return doubleDouble(p, ((ah * bh - p) + ah * bl + al * bh) + al * bl);
+		}
+#endif //__FMA__ || __AVX2__
+
+	public:
+		double to_double(void) const { return hi + lo; }
+
+		doubleDouble operator-(void) const { return doubleDouble(-hi, -lo); }
+
+		doubleDouble operator+(const doubleDouble &b) const
+		{
+			doubleDouble s = two_sum(hi, b.hi);
+			const doubleDouble t = two_sum(lo, b.lo);
+			s.lo += t.hi;
+			s = quick_two_sum(s.hi, s.lo);
+			s.lo += t.lo;
+			return quick_two_sum(s.hi, s.lo);
+		}
+
+		doubleDouble operator-(const doubleDouble &b) const { return *this + (-b); }
+
+		doubleDouble operator*(const doubleDouble &b) const
+		{
+			doubleDouble p = two_prod(hi, b.hi);
+			p.lo += hi * b.lo + lo * b.hi;
+			return quick_two_sum(p.hi, p.lo);
+		}
+
+		bool operator<(const doubleDouble &b) const
+		{
+			return hi < b.hi || (hi == b.hi && lo < b.lo);
+		}
+
+	public:
+		doubleDouble(void) : hi(0.0), lo(0.0) { }
+		doubleDouble(double val) : hi(val), lo(0.0) { }
+		doubleDouble(double hi, double lo) : hi(hi), lo(lo) { }
+	};
+
+	// Rounds the high precision view centre to the nearest double-double
+	static inline doubleDouble to_double_double(const fixedPoint &val)
+	{
+		const double hi = val.to_double();
+		const double lo = (val - fixedPoint(hi)).to_double();
+		return doubleDouble(hi, lo);
+	}
+}
+
+//EOF
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include "types.h"
+
+// Shared by the CPU renderer and mandelbrot_kernel (kernel.cu)
+#if defined(__CUDACC__)
+#define ESCAPE_TIME_CALLABLE __host__ __device__
+#else
+#define ESCAPE_TIME_CALLABLE
+#endif //__CUDACC__
+
+// Periodicity check tolerance, as a fraction of the distance between two pixels
+#define PERIODICITY_CHECK_EPSILON	1e-3
+
+namespace cpu {
+	// Pixels that skipped the iteration budget, summed per frame
+	typedef struct escapeCounters {
+		uint64_t cardioidPixels;	// Inside the main cardioid or the period-2 bulb
+		uint64_t periodicPixels;	// Orbit revisited a saved point (Brent)
+		uint64_t iterationsSpent;	// Escape times summed, interior pixels count maxIter
+	} ESCAPE_COUNTERS, *PESCAPE_COUNTERS;
+
+	/*
+	 * Escape-time iteration, identical recurrence and bailout to mandelbrot_kernel
+	 *  Returns the number of iterations before |z| >= 2, or maxIter + 1 for
+	 *  points that never escaped. T is float, double or cpu::doubleDouble,
+	 *  2 * zx * zy is written as (zx + zx) * zy which is exact for every T
+	 */
+	template<typename T>
+	ESCAPE_TIME_CALLABLE static inline uint32_t escape_time(T x, T y, uint32_t maxIter)
+	{
+		uint32_t iter = 0;
+		T zx = T(0.0), zy = T(0.0), zx2 = T(0.0), zy2 = T(0.0);
+		const T bailout = T(4.0);
+
+		do {
+			zy = (zx + zx) * zy + y;
+			zx = zx2 - zy2 + x;
+			zx2 = zx * zx;
+			zy2 = zy * zy;
+		} while (iter++ < maxIter && zx2 + zy2 < bailout);
+
+		return iter;
+	}
+
+	/*
+	 * Same as escape_time, also returns |z|^2 at the exit for smooth colouring
+	 */
+	template<typename T>
+	static inline uint32_t escape_time_modulus(T x, T y, uint32_t maxIter, __inout T *modulus2)
+	{
+		uint32_t iter = 0;
+		T zx = T(0.0), zy = T(0.0), zx2 = T(0.0), zy2 = T(0.0);
+		const T bailout = T(4.0);
+
+		do {
+			zy = (zx + zx) * zy + y;
+			zx = zx2 - zy2 + x;
+			zx2 = zx * zx;
+			zy2 = zy * zy;
+		} while (iter++ < maxIter && zx2 + zy2 < bailout);
+
+		*modulus2 = zx2 + zy2;
+		return iter;
+	}
+
+	/*
+	 * Fractional escape time iter + 1 - log2(log2|z|), continuous across the
+	 *  bands of the integer count. Points that did not escape keep maxIter + 1
+	 */
+	static inline float smooth_escape_time(uint32_t iter, double modulus2, uint32_t maxIter)
+	{
+		if (iter > maxIter || !(modulus2 > 1.0)) {
+			return (float)iter;
+		}
+
+		const double mu = (double)iter + 1.0 - log2(0.5 * log2(modulus2));
+		return mu > 0.0 ? (float)mu : 0.0f;
+	}
+
+	/*
+	 * Main cardioid and period-2 bulb, points inside never escape
+	 */
+	template<typename T>
+	ESCAPE_TIME_CALLABLE static inline bool in_cardioid_or_bulb(T x, T y)
+	{
+		const T y2 = y * y;
+		const T xq = x - T(0.25);
+		const T q = xq * xq + y2;
+		if (q * (q + xq) < T(0.25) * y2) {
+			return true;
+		}
+
+		const T xb = x + T(1.0);
+		return xb * xb + y2 < T(0.0625);
+	}
+
+	/*
+	 * Same as escape_time, with Brent's cycle detection: the orbit is compared
+	 *  against a saved point that is refreshed after 1, 2, 4, 8... iterations.
+	 *  A revisit within epsilon marks the point as interior (maxIter + 1)
+	 */
+	template<typename T>
+	ESCAPE_TIME_CALLABLE static inline uint32_t escape_time_periodic(T x, T y, uint32_t maxIter, T epsilon,
+		__inout bool *periodic)
+	{
+		uint32_t iter = 0;
+		T zx = T(0.0), zy = T(0.0), zx2 = T(0.0), zy2 = T(0.0);
+		T savedX = T(0.0), savedY = T(0.0);
+		const T bailout = T(4.0);
+		uint32_t power = 1, lambda = 0;
+
+		for (;;) {
+			zy = (zx + zx) * zy + y;
+			zx = zx2 - zy2 + x;
+			zx2 = zx * zx;
+			zy2 = zy * zy;
+			if (!(iter++ < maxIter && zx2 + zy2 < bailout)) {
+				return iter;
+			}
+
+			const T dx = zx - savedX, dy = zy - savedY;
+			if (dx < epsilon && -epsilon < dx && dy < epsilon && -epsilon < dy) {
+				*periodic = true;
+				return maxIter + 1;
+			}
+
+			if (++lambda == power) {
+				savedX = zx;
+				savedY = zy;
+				power <<= 1;
+				lambda = 0;
+			}
+		}
+	}
+
+	/*
+	 * Scalar entry of the CPU kernels: cardioid test, then the periodic or the
+	 *  plain iteration (epsilon <= 0 disables the periodicity check)
+	 */
+	template<typename T>
+	static inline uint32_t escape_time_checked(T x, T y, uint32_t maxIter, T epsilon,
+		__inout escapeCounters *counters)
+	{
+		if (in_cardioid_or_bulb<T>(x, y)) {
+			counters->cardioidPixels++;
+			return maxIter + 1;
+		}
+
+		if (T(0.0) < epsilon) {
+			bool periodic = false;
+			const uint32_t iter = escape_time_periodic<T>(x, y, maxIter, epsilon, &periodic);
+			if (periodic) {
+				counters->periodicPixels++;
+			}
+			return iter;
+		}
+
+		return escape_time<T>(x, y, maxIter);
+	}
+}
+
+//EOF
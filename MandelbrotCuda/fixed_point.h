@@ -0,0 +1,235 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <cmath>
+
+#include "types.h"
+
+/*
+ * Sign-magnitude fixed point number for the perturbation reference orbit
+ *  limb[0] holds the integer part, limb[1..] the fraction in base 2^32, so
+ *  FIXED_POINT_LIMBS 12 resolves 2^-352 (~1e-106). Only what the reference
+ *  orbit and the view centre need is implemented: add, sub, mul, conversion
+ */
+#define FIXED_POINT_LIMBS			12
+
+namespace cpu {
+	class fixedPoint {
+	private:
+		bool negative;
+		uint32_t limb[FIXED_POINT_LIMBS];
+
+	private:
+		// Compares magnitudes, returns <0, 0, >0
+		static int32_t compare_magnitude(const fixedPoint &a, const fixedPoint &b)
+		{
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				if (a.limb[i] != b.limb[i]) {
+					return a.limb[i] < b.limb[i] ? -1 : 1;
+				}
+			}
+			return 0;
+		}
+
+		static void add_magnitude(const fixedPoint &a, const fixedPoint &b, __inout fixedPoint *out)
+		{
+			uint64_t carry = 0;
+			for (int32_t i = FIXED_POINT_LIMBS - 1; i >= 0; i--) {
+				const uint64_t sum = (uint64_t)a.limb[i] + b.limb[i] + carry;
+				out->limb[i] = (uint32_t)sum;
+				carry = sum >> 32;
+			}
+		}
+
+		// |a| must be >= |b|
+		static void sub_magnitude(const fixedPoint &a, const fixedPoint &b, __inout fixedPoint *out)
+		{
+			int64_t borrow = 0;
+			for (int32_t i = FIXED_POINT_LIMBS - 1; i >= 0; i--) {
+				int64_t diff = (int64_t)a.limb[i] - b.limb[i] - borrow;
+				borrow = diff < 0 ? 1 : 0;
+				out->limb[i] = (uint32_t)(diff + (borrow << 32));
+			}
+		}
+
+		static fixedPoint add_signed(const fixedPoint &a, const fixedPoint &b, bool negateB)
+		{
+			const bool bNegative = negateB ? !b.negative : b.negative;
+
+			fixedPoint out;
+			if (a.negative == bNegative) {
+				add_magnitude(a, b, &out);
+				out.negative = a.negative;
+			}
+			else if (compare_magnitude(a, b) >= 0) {
+				sub_magnitude(a, b, &out);
+				out.negative = a.negative;
+			}
+			else {
+				sub_magnitude(b, a, &out);
+				out.negative = bNegative;
+			}
+
+			if (out.is_zero()) {
+				out.negative = false;
+			}
+			return out;
+		}
+
+		// Divides the magnitude by a small integer, returns the remainder
+		uint32_t div_small(uint32_t d)
+		{
+			uint64_t rem = 0;
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				const uint64_t cur = (rem << 32) | limb[i];
+				limb[i] = (uint32_t)(cur / d);
+				rem = cur % d;
+			}
+			return (uint32_t)rem;
+		}
+
+		// Multiplies the fraction by a small integer, returns the integer overflow
+		uint32_t mul_small_fraction(uint32_t m)
+		{
+			uint64_t carry = 0;
+			for (int32_t i = FIXED_POINT_LIMBS - 1; i >= 1; i--) {
+				const uint64_t cur = (uint64_t)limb[i] * m + carry;
+				limb[i] = (uint32_t)cur;
+				carry = cur >> 32;
+			}
+			return (uint32_t)carry;
+		}
+
+	public:
+		bool is_zero(void) const
+		{
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				if (limb[i] != 0) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool is_negative(void) const { return negative; }
+
+		double to_double(void) const
+		{
+			double out = 0.0;
+			for (int32_t i = FIXED_POINT_LIMBS - 1; i >= 0; i--) {
+				out = out * (1.0 / 4294967296.0) + (double)limb[i];
+			}
+			return negative ? -out : out;
+		}
+
+		/*
+		 * Decimal representation with the given number of fractional digits
+		 */
+		std::string to_string(uint32_t digits) const
+		{
+			fixedPoint frac = *this;
+			std::string out = negative ? "-" : "";
+			out += std::to_string(limb[0]) + ".";
+			for (uint32_t i = 0; i < digits; i++) {
+				out += (char)('0' + frac.mul_small_fraction(10));
+			}
+			return out;
+		}
+
+		/*
+		 * Parses "[-]int.frac", digits beyond the precision are truncated
+		 */
+		static fixedPoint from_string(const std::string &s)
+		{
+			fixedPoint out;
+			size_t pos = 0;
+			const bool neg = !s.empty() && s[0] == '-';
+			if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+				pos = 1;
+			}
+
+			const size_t dot = s.find('.', pos);
+			const std::string intPart = s.substr(pos, dot == std::string::npos ? std::string::npos : dot - pos);
+			out.limb[0] = intPart.empty() ? 0 : (uint32_t)std::stoul(intPart);
+
+			// Horner from the last digit: frac = (digit + frac) / 10
+			if (dot != std::string::npos) {
+				fixedPoint frac;
+				for (size_t i = s.size(); i > dot + 1; i--) {
+					const char c = s[i - 1];
+					if (c < '0' || c > '9') {
+						continue;
+					}
+					frac.limb[0] = (uint32_t)(c - '0');
+					frac.div_small(10);
+				}
+				for (uint32_t i = 1; i < FIXED_POINT_LIMBS; i++) {
+					out.limb[i] = frac.limb[i];
+				}
+			}
+
+			out.negative = neg && !out.is_zero();
+			return out;
+		}
+
+		fixedPoint operator+(const fixedPoint &b) const { return add_signed(*this, b, false); }
+		fixedPoint operator-(const fixedPoint &b) const { return add_signed(*this, b, true); }
+
+		fixedPoint operator*(const fixedPoint &b) const
+		{
+			// Schoolbook product, limbs beyond the precision are truncated. Carries
+			//  run towards index 0, so both loops start at the least significant limb
+			uint64_t acc[2 * FIXED_POINT_LIMBS] = { 0 };
+			for (int32_t i = FIXED_POINT_LIMBS - 1; i >= 0; i--) {
+				if (limb[i] == 0) {
+					continue;
+				}
+				uint64_t carry = 0;
+				for (int32_t j = FIXED_POINT_LIMBS - 1; j >= 0; j--) {
+					const uint64_t cur = acc[i + j + 1] + (uint64_t)limb[i] * b.limb[j] + carry;
+					acc[i + j + 1] = (uint32_t)cur;
+					carry = cur >> 32;
+				}
+				acc[i] += carry;
+			}
+
+			// acc[k + 1] carries weight 2^(-32k)
+			fixedPoint out;
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				out.limb[i] = (uint32_t)acc[i + 1];
+			}
+			out.negative = (negative != b.negative) && !out.is_zero();
+			return out;
+		}
+
+		fixedPoint &operator+=(const fixedPoint &b) { *this = *this + b; return *this; }
+		fixedPoint &operator-=(const fixedPoint &b) { *this = *this - b; return *this; }
+
+	public:
+		fixedPoint(void) :
+			negative(false)
+		{
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				limb[i] = 0;
+			}
+		}
+
+		// Every double within the integer range converts exactly
+		fixedPoint(double val) :
+			negative(val < 0.0)
+		{
+			double mag = std::fabs(val);
+			for (uint32_t i = 0; i < FIXED_POINT_LIMBS; i++) {
+				const double whole = std::floor(mag);
+				limb[i] = (uint32_t)whole;
+				mag = (mag - whole) * 4294967296.0;
+			}
+			if (is_zero()) {
+				negative = false;
+			}
+		}
+	};
+}
+
+//EOF
\ No newline at end of file
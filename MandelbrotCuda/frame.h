@@ -2,7 +2,9 @@
 
 //#include "main.h"
 
-#include <SDL2/SDL.h>
+#include "types.h"
+#include "ppm.h"
+#include "output_stage.h"
 
 #include <vector>
 #include <cstdint>
@@ -11,6 +13,9 @@
 #include <functional>
 #include <fstream>
 
+// Alpha of an opaque pixel (SDL_ALPHA_OPAQUE), frames stay free of SDL
+#define FRAME_ALPHA_OPAQUE 255
+
 namespace frame
 {
 	typedef struct rgbPixel {
@@ -48,26 +53,44 @@ namespace frame
 			data.push_back({ r, g, b });
 		}
 
-		error_t write_to_file(std::string filename)
+		// Takes a frame of the renderers (width * height pixels), alpha is dropped
+		void load_rgba_frame(const rgbaPixel *pixels)
 		{
-			std::ofstream output(filename);
-			if (!output.is_open()) {
-				return -1;
+			data.resize((size_t)width * height);
+			for (size_t i = 0; i < data.size(); i++) {
+				data[i] = { pixels[i].red, pixels[i].green, pixels[i].blue };
 			}
+		}
 
-			output << "P6" << std::endl
-				<< width << " "
-				<< height << std::endl
-				<< 255 << std::endl;
+		// Binary P6, the last row first. Files named .png or .qoi are encoded instead, in the same row order
+		error_t write_to_file(std::string filename)
+		{
+			const FRAME_ENCODER encoder = get_file_encoder(filename);
+			if (encoder != FRAME_ENCODER_NETPBM) {
+				std::vector<rgbaPixel> rows((size_t)width * height);
+				for (uint32_t y = 0; y < height; y++) {
+					const rgbPixel *source = &data[(size_t)(height - 1 - y) * width];
+					for (uint32_t x = 0; x < width; x++) {
+						rows[(size_t)y * width + x] = { source[x].red, source[x].green, source[x].blue, FRAME_ALPHA_OPAQUE };
+					}
+				}
+				return write_encoded_frame(nullptr, encoder, ppm::PPM_FORMAT_P6, rows.data(), width, height, filename);
+			}
 
-			std::size_t row_size = width * sizeof(rgbPixel);
+			ppm::imageWriter writer;
+			if (writer.open(filename, ppm::PPM_FORMAT_P6, width, height) != 0) {
+				return -1;
+			}
 
 			for (int i = height - 1; i >= 0; i--)
 			{
-				output.write((char*)&data[i * width], row_size);
+				if (writer.write_raw_rows((const uint8_t *)&data[i * width], 1) != 0) {
+					writer.close();
+					return -1;
+				}
 			}
 
-			return 0;
+			return writer.close();
 		}
 
 		size_t get_checksum(void) const
@@ -90,7 +113,7 @@ namespace frame
 				out[bufOffset] = (i->red);
 				out[bufOffset + 1] = (i->green);
 				out[bufOffset + 2] = (i->blue);
-				out[bufOffset + 3] = SDL_ALPHA_OPAQUE;
+				out[bufOffset + 3] = FRAME_ALPHA_OPAQUE;
 			}
 
 			return out;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "types.h"
+#include "mailbox.h"
+
+/*
+ * Triple-buffered frame ring between the render thread and the SDL thread
+ *  A render::latestMailbox of frames, every slot is allocated once with the
+ *  frame size. The reader always gets the newest published frame, frames
+ *  published faster than they are shown are dropped.
+ */
+
+namespace render {
+	class frameRing {
+	private:
+		const size_t pixelLength, pixelHeight;
+		latestMailbox<std::vector<rgbaPixel>> frames;
+
+	public:
+		/*
+		 * Writer side: the slot stays with the render thread until publish()
+		 */
+		rgbaPixel *get_write_slot(void) { return frames.get_write_slot().data(); }
+
+		void publish(void) { frames.publish(); }
+
+		/*
+		 * Reader side: returns the newest published frame, or nullptr when
+		 *  nothing was published since the last call. The frame stays valid
+		 *  until the next call
+		 */
+		const rgbaPixel *acquire_read(void)
+		{
+			const std::vector<rgbaPixel> *frame = frames.acquire_read();
+			return frame != nullptr ? frame->data() : nullptr;
+		}
+
+		size_t get_pixel_length(void) const { return pixelLength; }
+		size_t get_pixel_height(void) const { return pixelHeight; }
+		uint64_t get_published_frames(void) const { return frames.get_published_count(); }
+		uint64_t get_dropped_frames(void) const { return frames.get_dropped_count(); }
+
+	public:
+		frameRing(size_t pixelLength, size_t pixelHeight) :
+			pixelLength(pixelLength), pixelHeight(pixelHeight)
+		{
+			frames.fill(std::vector<rgbaPixel>(pixelLength * pixelHeight, rgbaPixel{ 0, 0, 0, 0 }));
+		}
+	};
+}
+
+//EOF
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <cstring>
+
+#include "types.h"
+#include "fixed_point.h"
+#include "mapped_image.h"
+
+/*
+ * Iteration field files (.mbit)
+ *  The escape times of a render (uint32, maxIter + 1 = interior) or its
+ *  smooth escape times (float) with the view they belong to. A header of
+ *  MBIT_HEADER_BYTES is followed by the rows, each MBIT_ROW_ALIGNMENT
+ *  aligned, in frame order. Samples are in the byte order of the writer,
+ *  byteOrder tells a reader of the other order. Row y is at
+ *  headerBytes + y * rowStride: the file is mapped and read in place,
+ *  recolouring or analysing it needs no parsing and no iteration.
+ */
+
+#define MBIT_MAGIC					"MBIT"
+#define MBIT_VERSION				1
+#define MBIT_BYTE_ORDER				0x01020304
+
+// The rows start on a page, every row on a cache line (and a vector load)
+#define MBIT_HEADER_BYTES			4096
+#define MBIT_ROW_ALIGNMENT			64
+
+// Centre coordinates are stored as decimals, every digit fixedPoint resolves
+#define MBIT_CENTRE_CHARS			128
+#define MBIT_CENTRE_DIGITS			110
+
+namespace frame {
+	typedef enum {
+		MBIT_FIELD_ESCAPE_TIME,		// uint32_t, maxIter + 1 for the interior
+		MBIT_FIELD_SMOOTH			// float, fractional escape time, maxIter + 1 for the interior
+	} MBIT_FIELD;
+
+	typedef enum {
+		MBIT_FORMULA_MANDELBROT		// z = z^2 + c
+	} MBIT_FORMULA;
+
+	typedef struct mbitHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint32_t headerBytes;		// Offset of row 0
+		uint64_t rowStride;			// Bytes from one row to the next
+		uint32_t width, height;
+		uint32_t fieldType;			// MBIT_FIELD
+		uint32_t formula;			// MBIT_FORMULA
+		uint32_t maxIterations;
+		uint32_t precisionTier;		// cpu::PRECISION_TIER of the render
+		double scaleA, scaleB;		// View scale, as the renderers take it
+		double pixelScale;			// Complex plane units per pixel
+		char centerX[MBIT_CENTRE_CHARS], centerY[MBIT_CENTRE_CHARS];
+	} MBIT_HEADER, *PMBIT_HEADER;
+
+	/*
+	 * View and layout of an iteration field, everything but the samples
+	 */
+	typedef struct mbitView {
+		cpu::fixedPoint centerX, centerY;
+		double scaleA, scaleB;
+		uint32_t width, height;
+		uint32_t maxIterations;
+		uint32_t precisionTier;
+		MBIT_FIELD fieldType;
+		MBIT_FORMULA formula;
+	} MBIT_VIEW, *PMBIT_VIEW;
+
+	static inline uint64_t get_mbit_row_stride(uint32_t width)
+	{
+		const uint64_t bytes = (uint64_t)width * sizeof(uint32_t);
+		return (bytes + MBIT_ROW_ALIGNMENT - 1) / MBIT_ROW_ALIGNMENT * MBIT_ROW_ALIGNMENT;
+	}
+
+	/*
+	 * Writes a field of view.width * view.height samples with its view, the
+	 *  samples are uint32_t or float as view.fieldType says. Rows go through
+	 *  a mapping of as many rows as each write_rows call passes
+	 */
+	class iterationFileWriter {
+	private:
+		mappedFile file;
+		mbitView view;
+		uint64_t rowStride;
+
+	public:
+		error_t create(const std::string &filename, const mbitView &view)
+		{
+			if (view.width == 0 || view.height == 0) {
+				return -1;
+			}
+
+			this->view = view;
+			rowStride = get_mbit_row_stride(view.width);
+			if (file.create(filename, MBIT_HEADER_BYTES + rowStride * view.height) != 0) {
+				return -1;
+			}
+
+			uint8_t *out = file.map(0, MBIT_HEADER_BYTES);
+			if (out == nullptr) {
+				return -1;
+			}
+
+			mbitHeader header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.magic, MBIT_MAGIC, sizeof(header.magic));
+			header.version = MBIT_VERSION;
+			header.byteOrder = MBIT_BYTE_ORDER;
+			header.headerBytes = MBIT_HEADER_BYTES;
+			header.rowStride = rowStride;
+			header.width = view.width;
+			header.height = view.height;
+			header.fieldType = view.fieldType;
+			header.formula = view.formula;
+			header.maxIterations = view.maxIterations;
+			header.precisionTier = view.precisionTier;
+			header.scaleA = view.scaleA;
+			header.scaleB = view.scaleB;
+			header.pixelScale = view.scaleA / ((double)view.width / view.scaleB);
+			std::strncpy(header.centerX, view.centerX.to_string(MBIT_CENTRE_DIGITS).c_str(), MBIT_CENTRE_CHARS - 1);
+			std::strncpy(header.centerY, view.centerY.to_string(MBIT_CENTRE_DIGITS).c_str(), MBIT_CENTRE_CHARS - 1);
+
+			std::memset(out, 0, MBIT_HEADER_BYTES);
+			std::memcpy(out, &header, sizeof(header));
+			return file.unmap();
+		}
+
+		/*
+		 * Copies rows first .. first + count - 1 from samples (count rows of
+		 *  width samples, packed)
+		 */
+		error_t write_rows(uint32_t first, uint32_t count, const void *samples)
+		{
+			if (!file.is_open() || first > view.height || count > view.height - first) {
+				return -1;
+			}
+
+			uint8_t *out = file.map(MBIT_HEADER_BYTES + first * rowStride, (size_t)(count * rowStride));
+			if (out == nullptr) {
+				return -1;
+			}
+
+			const size_t rowBytes = (size_t)view.width * sizeof(uint32_t);
+			for (uint32_t i = 0; i < count; i++) {
+				std::memcpy(out + i * rowStride, (const uint8_t *)samples + i * rowBytes, rowBytes);
+			}
+			return file.unmap();
+		}
+
+		error_t close(void) { return file.close(); }
+	};
+
+	/*
+	 * Maps an .mbit file read only, the samples are used in place
+	 */
+	class iterationFile {
+	private:
+		mappedFile file;
+		const uint8_t *data;
+		mbitHeader header;
+		mbitView view;
+
+	public:
+		/*
+		 * Maps filename, -1 if it is not an .mbit file of this version and
+		 *  byte order, is shorter than its header says, its rows are not
+		 *  MBIT_ROW_ALIGNMENT aligned or its iteration count is above
+		 *  RENDER_MAX_ITERATIONS
+		 */
+		error_t open(const std::string &filename)
+		{
+			if (file.open(filename, false) != 0 || file.get_size() < MBIT_HEADER_BYTES) {
+				close();
+				return -1;
+			}
+
+			data = file.map(0, (size_t)file.get_size());
+			if (data == nullptr) {
+				close();
+				return -1;
+			}
+
+			std::memcpy(&header, data, sizeof(header));
+			header.centerX[MBIT_CENTRE_CHARS - 1] = header.centerY[MBIT_CENTRE_CHARS - 1] = '\0';
+			if (std::memcmp(header.magic, MBIT_MAGIC, sizeof(header.magic)) != 0 ||
+				header.version != MBIT_VERSION || header.byteOrder != MBIT_BYTE_ORDER ||
+				header.width == 0 || header.height == 0 || header.rowStride < (uint64_t)header.width * sizeof(uint32_t) ||
+				header.fieldType > MBIT_FIELD_SMOOTH || header.formula != MBIT_FORMULA_MANDELBROT) {
+				close();
+				return -1;
+			}
+
+			// The rows must fit, compared without a product a corrupt header could overflow,
+			//  and be aligned for the samples they are read as in place
+			const uint64_t size = file.get_size();
+			if (header.headerBytes < sizeof(header) || header.headerBytes > size ||
+				header.rowStride > (size - header.headerBytes) / header.height ||
+				header.headerBytes % MBIT_ROW_ALIGNMENT != 0 || header.rowStride % MBIT_ROW_ALIGNMENT != 0) {
+				close();
+				return -1;
+			}
+
+			// The iteration count sizes the colour table of whoever colours the field
+			if (header.maxIterations == 0 || header.maxIterations > RENDER_MAX_ITERATIONS) {
+				close();
+				return -1;
+			}
+
+			view.centerX = cpu::fixedPoint::from_string(header.centerX);
+			view.centerY = cpu::fixedPoint::from_string(header.centerY);
+			view.scaleA = header.scaleA;
+			view.scaleB = header.scaleB;
+			view.width = header.width;
+			view.height = header.height;
+			view.maxIterations = header.maxIterations;
+			view.precisionTier = header.precisionTier;
+			view.fieldType = (MBIT_FIELD)header.fieldType;
+			view.formula = (MBIT_FORMULA)header.formula;
+			return 0;
+		}
+
+		error_t close(void)
+		{
+			data = nullptr;
+			return file.close();
+		}
+
+		const mbitView &get_view(void) const { return view; }
+		const mbitHeader &get_header(void) const { return header; }
+
+		// Row y of an MBIT_FIELD_ESCAPE_TIME field
+		const uint32_t *get_escape_times(uint32_t y) const
+		{
+			return (const uint32_t *)(data + header.headerBytes + y * header.rowStride);
+		}
+
+		// Row y of an MBIT_FIELD_SMOOTH field
+		const float *get_smooth(uint32_t y) const
+		{
+			return (const float *)(data + header.headerBytes + y * header.rowStride);
+		}
+
+	public:
+		iterationFile(void) :
+			data(nullptr)
+		{
+
+		}
+	};
+}
+
+//EOF
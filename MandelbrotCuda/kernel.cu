@@ -1,6 +1,7 @@
 #include "cudaMandelbrot.h"
 #include "debug.h"
 #include "main.h"
+#include "escape_time.h"
 
 #include "cuda_occupancy.h"
 #include "cuda_runtime.h"
@@ -63,10 +64,24 @@ __constant__ rgbaPixel pixel_colour[16] =
 	{ 106,  52,   3 }
 };
 
+template<typename T>
 __global__ void mandelbrot_kernel(rgbaPixel* image,
 	int32_t width, int32_t height,
-	double scale,
-	double cx, double cy);
+	T scale,
+	T cx, T cy);
+
+template<typename T>
+__global__ void mandelbrot_pass_kernel(rgbaPixel* image,
+	int32_t width, int32_t height,
+	T scale,
+	T cx, T cy,
+	int32_t stride);
+
+template<typename T>
+__global__ void mandelbrot_iteration_kernel(std::uint32_t* field,
+	int32_t width, int32_t height,
+	T scale,
+	T cx, T cy);
 
 template<class T, typename... A>
 error_t cudaKernel::launch_kernel(T& kernel, dim3 work, A&&... args)
@@ -193,37 +208,128 @@ int get_thread_compute_capability(int major, int minor)
 	return 0;
 }
 
-error_t cudaKernel::generate_mandelbrot(void)
+error_t cudaKernel::allocate_device_buffer(void)
 {
-	rgbaPixel *cudaBuffer;
+	if (deviceBuffer == nullptr) {
+		cudaCall(cudaMalloc, (void**)&deviceBuffer, pixelBufferRawSize);
+	}
+
+	return 0;
+}
 
-	cudaCall(cudaMalloc, (void**)&cudaBuffer, pixelBufferRawSize);
-	cudaCall(cudaMemset, cudaBuffer, 0x0, pixelBufferRawSize);
+error_t cudaKernel::generate_mandelbrot(__inout rgbaPixel *frame)
+{
+	assert(frame != nullptr);
+	error_t err = allocate_device_buffer();
+	if (err != 0) {
+		return err;
+	}
+	cudaCall(cudaMemset, deviceBuffer, 0x0, pixelBufferRawSize);
 
 	scale = scaleA / ((double)pixelLength / scaleB);
-	error_t err = launch_kernel(mandelbrot_kernel,
-		dim3((int32_t)pixelLength, (int32_t)pixelHeight), 
-		cudaBuffer,
-		(int32_t)pixelLength, (int32_t)pixelHeight, 
-		scale, 
-		offsetX, offsetY);
+	err = singlePrecision ?
+		launch_mandelbrot_kernel<float>(deviceBuffer) :
+		launch_mandelbrot_kernel<double>(deviceBuffer);
+	if (err != 0) {
+		return err;
+	}
+
+	cudaCall(cudaMemcpy, (void*)frame, (const void *)deviceBuffer,
+		(const size_t)pixelBufferRawSize, cudaMemcpyDeviceToHost);
+
+	return 0;
+}
+
+error_t cudaKernel::generate_iteration_field(__inout uint32_t *field)
+{
+	assert(field != nullptr);
+	const size_t fieldRawSize = pixelLength * pixelHeight * sizeof(uint32_t);
+
+	// Every pixel is written, the field needs no clearing between frames
+	if (deviceField == nullptr) {
+		cudaCall(cudaMalloc, (void**)&deviceField, fieldRawSize);
+	}
+
+	scale = scaleA / ((double)pixelLength / scaleB);
+	error_t err = singlePrecision ?
+		launch_iteration_kernel<float>(deviceField) :
+		launch_iteration_kernel<double>(deviceField);
+	if (err != 0) {
+		return err;
+	}
+
+	cudaCall(cudaMemcpy, (void*)field, (const void *)deviceField,
+		(const size_t)fieldRawSize, cudaMemcpyDeviceToHost);
+
+	return 0;
+}
+
+template<typename T>
+error_t cudaKernel::launch_iteration_kernel(uint32_t *cudaField)
+{
+	return launch_kernel(mandelbrot_iteration_kernel<T>,
+		dim3((int32_t)pixelLength, (int32_t)pixelHeight),
+		cudaField,
+		(int32_t)pixelLength, (int32_t)pixelHeight,
+		(T)scale,
+		(T)offsetX, (T)offsetY);
+}
+
+error_t cudaKernel::generate_mandelbrot_pass(uint32_t pass, __inout rgbaPixel *frame)
+{
+	assert(pass < CUDA_PROGRESSIVE_PASSES && frame != nullptr);
+	error_t err = allocate_device_buffer();
+	if (err != 0) {
+		return err;
+	}
+
+	// Pass 0 writes every block, the finer passes build on the device frame
+	if (pass == 0) {
+		scale = scaleA / ((double)pixelLength / scaleB);
+	}
+
+	const uint32_t stride = 1u << (CUDA_PROGRESSIVE_PASSES - 1 - pass);
+	err = singlePrecision ?
+		launch_mandelbrot_pass_kernel<float>(deviceBuffer, stride) :
+		launch_mandelbrot_pass_kernel<double>(deviceBuffer, stride);
 	if (err != 0) {
 		return err;
 	}
 
-	pixelBuffer = (rgbaPixel *)std::malloc(pixelBufferRawSize);
-	std::memset(pixelBuffer, 0x0, pixelBufferRawSize);
-	cudaCall(cudaMemcpy, (void*)&pixelBuffer[0], (const void *)cudaBuffer, 
+	cudaCall(cudaMemcpy, (void*)frame, (const void *)deviceBuffer,
 		(const size_t)pixelBufferRawSize, cudaMemcpyDeviceToHost);
-	cudaCall(cudaFree, cudaBuffer);
 
 	return 0;
 }
 
+template<typename T>
+error_t cudaKernel::launch_mandelbrot_pass_kernel(rgbaPixel *cudaBuffer, uint32_t stride)
+{
+	return launch_kernel(mandelbrot_pass_kernel<T>,
+		dim3((int32_t)((pixelLength + stride - 1) / stride), (int32_t)((pixelHeight + stride - 1) / stride)),
+		cudaBuffer,
+		(int32_t)pixelLength, (int32_t)pixelHeight,
+		(T)scale,
+		(T)offsetX, (T)offsetY,
+		(int32_t)stride);
+}
+
+template<typename T>
+error_t cudaKernel::launch_mandelbrot_kernel(rgbaPixel *cudaBuffer)
+{
+	return launch_kernel(mandelbrot_kernel<T>,
+		dim3((int32_t)pixelLength, (int32_t)pixelHeight),
+		cudaBuffer,
+		(int32_t)pixelLength, (int32_t)pixelHeight,
+		(T)scale,
+		(T)offsetX, (T)offsetY);
+}
+
+template<typename T>
 __global__ void mandelbrot_kernel(rgbaPixel *image,
 	int32_t width, int32_t height,
-	double scale,
-	double cx, double cy)
+	T scale,
+	T cx, T cy)
 {
 	const int i = threadIdx.y + blockIdx.y * blockDim.y;
 	const int j = threadIdx.x + blockIdx.x * blockDim.x;
@@ -234,26 +340,15 @@ __global__ void mandelbrot_kernel(rgbaPixel *image,
 	}
 
 	const std::uint32_t max_iter = CUDA_MANDELBROT_INTERATIONS;
-	const double y = ((double)i - (double)(height >> 1)) * scale + cy;
-	const double x = ((double)j - (double)(width >> 1)) * scale + cx;
-
-	double zx = hypot(x - 0.25, y);
+	const T y = ((T)i - (T)(height >> 1)) * scale + cy;
+	const T x = ((T)j - (T)(width >> 1)) * scale + cx;
 
-	if (x < zx - 2.0 * zx * zx + 0.25 || (x + 1.0) * (x + 1.0) + y * y < 0.0625)
+	if (cpu::in_cardioid_or_bulb<T>(x, y))
 	{
 		return;
 	}
 
-	std::uint32_t iter = 0;
-	double zy, zx2, zy2;
-	zx = zy = zx2 = zy2 = 0.0;
-
-	do {
-		zy = 2.0 * zx * zy + y;
-		zx = zx2 - zy2 + x;
-		zx2 = zx * zx;
-		zy2 = zy * zy;
-	} while (iter++ < max_iter && zx2 + zy2 < 4.0);
+	const std::uint32_t iter = cpu::escape_time<T>(x, y, max_iter);
 
 	if (iter > 0 && iter < max_iter)
 	{
@@ -264,4 +359,83 @@ __global__ void mandelbrot_kernel(rgbaPixel *image,
 		image[i * width + j].blue = pixel_colour[colour_idx].blue;
 		image[i * width + j].alpha = 0x0;
 	}
-}
\ No newline at end of file
+}
+
+/*
+ * One thread per sample of a progressive pass, the sample is drawn as a
+ *  stride * stride block. Samples on the grid of the previous pass (twice the
+ *  stride) are already in the image and return early. Every colour is
+ *  written, black included, as the block holds the coarser sample
+ */
+template<typename T>
+__global__ void mandelbrot_pass_kernel(rgbaPixel *image,
+	int32_t width, int32_t height,
+	T scale,
+	T cx, T cy,
+	int32_t stride)
+{
+	const int i = (threadIdx.y + blockIdx.y * blockDim.y) * stride;
+	const int j = (threadIdx.x + blockIdx.x * blockDim.x) * stride;
+
+	if (i >= height || j >= width)
+	{
+		return;
+	}
+
+	const int coarserStride = stride << 1;
+	if (stride < (1 << (CUDA_PROGRESSIVE_PASSES - 1)) && i % coarserStride == 0 && j % coarserStride == 0)
+	{
+		return;
+	}
+
+	const std::uint32_t max_iter = CUDA_MANDELBROT_INTERATIONS;
+	const T y = ((T)i - (T)(height >> 1)) * scale + cy;
+	const T x = ((T)j - (T)(width >> 1)) * scale + cx;
+
+	rgbaPixel colour = { 0, 0, 0, 0 };
+	if (!cpu::in_cardioid_or_bulb<T>(x, y))
+	{
+		const std::uint32_t iter = cpu::escape_time<T>(x, y, max_iter);
+		if (iter > 0 && iter < max_iter)
+		{
+			colour = pixel_colour[iter % 16];
+			colour.alpha = 0x0;
+		}
+	}
+
+	for (int bi = i; bi < i + stride && bi < height; bi++)
+	{
+		for (int bj = j; bj < j + stride && bj < width; bj++)
+		{
+			image[bi * width + bj] = colour;
+		}
+	}
+}
+
+/*
+ * Same iteration as mandelbrot_kernel without the palette, writes the
+ *  escape time of every pixel (max_iter + 1 for the interior) for the
+ *  host colorizer
+ */
+template<typename T>
+__global__ void mandelbrot_iteration_kernel(std::uint32_t *field,
+	int32_t width, int32_t height,
+	T scale,
+	T cx, T cy)
+{
+	const int i = threadIdx.y + blockIdx.y * blockDim.y;
+	const int j = threadIdx.x + blockIdx.x * blockDim.x;
+
+	if (i >= height || j >= width)
+	{
+		return;
+	}
+
+	const std::uint32_t max_iter = CUDA_MANDELBROT_INTERATIONS;
+	const T y = ((T)i - (T)(height >> 1)) * scale + cy;
+	const T x = ((T)j - (T)(width >> 1)) * scale + cx;
+
+	field[i * width + j] = cpu::in_cardioid_or_bulb<T>(x, y) ?
+		max_iter + 1 :
+		cpu::escape_time<T>(x, y, max_iter);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Single-producer / single-consumer "latest value wins" mailbox
+ *  Three preallocated slots: one belongs to the writer, one to the reader
+ *  and the third sits in the exchange. publish() and acquire_read() move a
+ *  slot between the sides with one atomic swap, so neither side ever blocks
+ *  on the other. A value published before the reader took the previous one
+ *  replaces it (counted as dropped).
+ */
+
+// Exchange slot holds a value the reader has not taken yet
+#define MAILBOX_FRESH			0x80000000u
+#define MAILBOX_SLOT_MASK		0x7fffffffu
+
+namespace render {
+	template<typename T>
+	class latestMailbox {
+	private:
+		static const uint32_t slotCount = 3;
+		T slots[slotCount];
+
+		// Slot owned by each side, the third one is in exchange
+		uint32_t writeSlot, readSlot;
+		std::atomic<uint32_t> exchange;
+
+		std::atomic<uint64_t> publishedCount, droppedCount;
+
+	public:
+		/*
+		 * Writer side: the slot stays with the producer until publish()
+		 */
+		T &get_write_slot(void) { return slots[writeSlot]; }
+
+		/*
+		 * Hands the write slot to the reader and takes the exchange slot back
+		 *  as the next write slot
+		 */
+		void publish(void)
+		{
+			const uint32_t previous = exchange.exchange(writeSlot | MAILBOX_FRESH, std::memory_order_acq_rel);
+			if ((previous & MAILBOX_FRESH) != 0) {
+				droppedCount.fetch_add(1, std::memory_order_relaxed);
+			}
+			writeSlot = previous & MAILBOX_SLOT_MASK;
+			publishedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/*
+		 * Reader side: the newest published value, or nullptr when nothing was
+		 *  published since the last call. Valid until the next call
+		 */
+		const T *acquire_read(void)
+		{
+			if ((exchange.load(std::memory_order_acquire) & MAILBOX_FRESH) == 0) {
+				return nullptr;
+			}
+
+			readSlot = exchange.exchange(readSlot, std::memory_order_acq_rel) & MAILBOX_SLOT_MASK;
+			return &slots[readSlot];
+		}
+
+		uint64_t get_published_count(void) const { return publishedCount.load(std::memory_order_relaxed); }
+		uint64_t get_dropped_count(void) const { return droppedCount.load(std::memory_order_relaxed); }
+
+		// Every slot starts as a copy of init (preallocated buffers)
+		void fill(const T &init)
+		{
+			for (uint32_t i = 0; i < slotCount; i++) {
+				slots[i] = init;
+			}
+		}
+
+	public:
+		latestMailbox(void) :
+			writeSlot(0), readSlot(1), exchange(2),
+			publishedCount(0), droppedCount(0)
+		{
+
+		}
+
+		latestMailbox(const latestMailbox &) = delete;
+		latestMailbox &operator=(const latestMailbox &) = delete;
+	};
+}
+
+//EOF
@@ -15,10 +15,13 @@
 #include <iostream>     // std::cout
 #include <sstream>
 #include <iomanip>
+#include <thread>
 
 #include "main.h"
 #include "mandelbrot_cpu.h"
 #include "ppm.h"
+#include "output_stage.h"
+#include "iteration_file.h"
 #include "controller.h"
 
 #include "cuda_runtime.h"
@@ -59,6 +62,392 @@ int WINAPI WinMain(HINSTANCE hinstance,
     }
 #endif //TEST_MANDELBROT_CPU_FRAME
 
+#if defined(TEST_MANDELBROT_CPU_SCALING)
+    const uint32_t maxThreads = std::thread::hardware_concurrency();
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+        mandelbrotFractalCpu mFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+            RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+            IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, threads);
+        std::vector<rgbaPixel> frameBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+
+        // First pass warms up the pool
+        mFrac.compute_image_tiled(frameBuf.data());
+        err = mFrac.compute_image_tiled(frameBuf.data());
+        if (err != 0) {
+            return err;
+        }
+
+        const cpu::cpuRenderStats stats = mFrac.get_render_stats();
+        DINFO("CPU threads: " + std::to_string(stats.threadCount) +
+            " tiles: " + std::to_string(stats.tileCount) +
+            " stolen: " + std::to_string(stats.tilesStolen) +
+            " time: " + std::to_string(stats.frameRenderElapsedms) + " ms" +
+            " Mpix/s: " + std::to_string(stats.mpixPerSecond));
+    }
+#endif //TEST_MANDELBROT_CPU_SCALING
+
+#if defined(TEST_MANDELBROT_CPU_SIMD)
+    std::vector<rgbaPixel> scalarBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    std::vector<rgbaPixel> simdBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    const cpu::simd::SIMD_LEVEL hostLevel = cpu::simd::detect_simd_level();
+    for (uint32_t level = cpu::simd::SIMD_LEVEL_SCALAR; level <= (uint32_t)hostLevel; level++) {
+        mandelbrotFractalCpu mFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+            RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+            IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, 1);
+        mFrac.set_simd_level((cpu::simd::SIMD_LEVEL)level);
+
+        std::vector<rgbaPixel> &frameBuf = level == cpu::simd::SIMD_LEVEL_SCALAR ? scalarBuf : simdBuf;
+        err = mFrac.compute_image_tiled(frameBuf.data());
+        if (err != 0) {
+            return err;
+        }
+
+        const cpu::cpuRenderStats stats = mFrac.get_render_stats();
+        const bool match = std::memcmp(scalarBuf.data(), frameBuf.data(), frameBuf.size() * sizeof(rgbaPixel)) == 0;
+        DINFO(std::string("CPU kernel: ") + cpu::simd::get_simd_level_name(stats.simdLevel) +
+            " time: " + std::to_string(stats.frameRenderElapsedms) + " ms" +
+            " Mpix/s: " + std::to_string(stats.mpixPerSecond) +
+            (match ? "" : " (output differs from scalar)"));
+    }
+#endif //TEST_MANDELBROT_CPU_SIMD
+
+#if defined(TEST_MANDELBROT_CPU_SUBDIVISION)
+    std::vector<rgbaPixel> fullBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    std::vector<rgbaPixel> subdivBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        mandelbrotFractalCpu mFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+            RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+            IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, 1);
+        mFrac.set_subdivision(pass == 1);
+
+        std::vector<rgbaPixel> &frameBuf = pass == 0 ? fullBuf : subdivBuf;
+        err = mFrac.compute_image_tiled(frameBuf.data());
+        if (err != 0) {
+            return err;
+        }
+
+        size_t mismatched = 0;
+        for (size_t i = 0; i < frameBuf.size(); i++) {
+            mismatched += std::memcmp(&fullBuf[i], &frameBuf[i], sizeof(rgbaPixel)) != 0;
+        }
+
+        const cpu::cpuRenderStats stats = mFrac.get_render_stats();
+        DINFO(std::string(pass == 0 ? "Full" : "Subdivision") +
+            " time: " + std::to_string(stats.frameRenderElapsedms) + " ms" +
+            " iterated: " + std::to_string(stats.iteratedFraction) +
+            " mismatched pixels: " + std::to_string(mismatched));
+    }
+#endif //TEST_MANDELBROT_CPU_SUBDIVISION
+
+#if defined(TEST_MANDELBROT_CPU_RECOLOUR)
+    mandelbrotFractalCpu mFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+
+    std::vector<rgbaPixel> frameBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    err = mFrac.compute_image_tiled(frameBuf.data());
+    if (err != 0) {
+        return err;
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (uint32_t offset = 1; offset <= 16; offset++) {
+        mFrac.set_palette_offset(offset);
+        err = mFrac.recolour_image(frameBuf.data());
+        if (err != 0) {
+            return err;
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    DINFO(std::string("Render: ") + std::to_string(mFrac.get_render_stats().frameRenderElapsedms) + " ms" +
+        " recolour: " + std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count() / 16.0) + " ms");
+#endif //TEST_MANDELBROT_CPU_RECOLOUR
+
+#if defined(TEST_MANDELBROT_CPU_CANCEL)
+    mandelbrotFractalCpu cancelFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    cancelFrac.set_precision_tier(cpu::PRECISION_TIER_DOUBLE_DOUBLE);
+
+    std::vector<rgbaPixel> cancelBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    err = cancelFrac.compute_image_tiled(cancelBuf.data());
+    if (err != 0) {
+        return err;
+    }
+    const double fullElapsedms = cancelFrac.get_render_stats().frameRenderElapsedms;
+
+    std::atomic<bool> cancelFlag(false);
+    std::chrono::high_resolution_clock::time_point cancelTime;
+    cancelFrac.set_cancel_flag(&cancelFlag);
+    std::thread canceller([&cancelFlag, &cancelTime, fullElapsedms]() {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(fullElapsedms / 4.0));
+        cancelTime = std::chrono::high_resolution_clock::now();
+        cancelFlag = true;
+    });
+    err = cancelFrac.compute_image_tiled(cancelBuf.data());
+    const auto stopTime = std::chrono::high_resolution_clock::now();
+    canceller.join();
+    if (err != ERROR_RENDER_CANCELLED) {
+        DERROR("Frame was not cancelled: " + std::to_string(err));
+        return -1;
+    }
+
+    DINFO(std::string("Full frame: ") + std::to_string(fullElapsedms) + " ms" +
+        " stopped after: " + std::to_string(std::chrono::duration<double, std::milli>(stopTime - cancelTime).count()) + " ms" +
+        " wasted iterations: " + std::to_string(cancelFrac.get_render_stats().iterationsSpent));
+#endif //TEST_MANDELBROT_CPU_CANCEL
+
+#if defined(TEST_MANDELBROT_CPU_REPROJECTION)
+    for (uint32_t reuse = 0; reuse < 2; reuse++) {
+        mandelbrotFractalCpu zoomFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+            RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+            IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+        zoomFrac.set_reprojection(reuse != 0);
+
+        std::vector<rgbaPixel> zoomBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+        double scaleA = IMAGE_SCALEA, elapsedms = 0.0, reuseRatio = 0.0;
+        uint64_t iterationsSpent = 0;
+        const uint32_t zoomFrames = 32;
+        for (uint32_t i = 0; i <= zoomFrames; i++) {
+            err = zoomFrac.compute_image_tiled(zoomBuf.data());
+            if (err != 0) {
+                return err;
+            }
+
+            // The first frame has nothing to reuse
+            const cpu::cpuRenderStats stats = zoomFrac.get_render_stats();
+            if (i > 0) {
+                elapsedms += stats.frameRenderElapsedms;
+                reuseRatio += stats.reuseRatio;
+                iterationsSpent += stats.iterationsSpent;
+            }
+
+            scaleA *= 0.98;
+            zoomFrac.setScaleA(scaleA);
+        }
+
+        DINFO(std::string("Reprojection ") + (reuse != 0 ? "on" : "off") +
+            " time: " + std::to_string(elapsedms / zoomFrames) + " ms" +
+            " reused: " + std::to_string(reuseRatio / zoomFrames) +
+            " iterations: " + std::to_string(iterationsSpent / zoomFrames));
+    }
+#endif //TEST_MANDELBROT_CPU_REPROJECTION
+
+#if defined(TEST_MANDELBROT_CPU_TILE_CACHE)
+    mandelbrotFractalCpu cacheFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    cacheFrac.set_tile_cache_budget(TILE_CACHE_DEFAULT_BUDGET);
+
+    std::vector<rgbaPixel> cacheBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    const double panX = (RENDER_WINDOW_LENGTH / 2) * cacheFrac.get_pixel_scale();
+    const double cachePans[] = { 0.0, panX, -panX };
+    for (const double pan : cachePans) {
+        cacheFrac.offset_by(pan, 0.0);
+        err = cacheFrac.compute_image_tiled(cacheBuf.data());
+        if (err != 0) {
+            return err;
+        }
+
+        const cpu::cpuRenderStats stats = cacheFrac.get_render_stats();
+        DINFO(std::string("Tile cache pan: ") + std::to_string(pan) +
+            " time: " + std::to_string(stats.frameRenderElapsedms) + " ms" +
+            " hits: " + std::to_string(stats.cacheHits) +
+            " misses: " + std::to_string(stats.cacheMisses));
+    }
+
+    const cpu::tileCacheStats cacheStats = cacheFrac.get_tile_cache_stats();
+    DINFO("Tile cache entries: " + std::to_string(cacheStats.entries) +
+        " bytes: " + std::to_string(cacheStats.bytesUsed) +
+        " evictions: " + std::to_string(cacheStats.evictions));
+#endif //TEST_MANDELBROT_CPU_TILE_CACHE
+
+#if defined(TEST_MANDELBROT_CPU_RENDER_AHEAD)
+    cpu::threadPool aheadPool(THREAD_POOL_DEFAULT_WORKERS);
+    std::vector<rgbaPixel> aheadBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    const uint32_t aheadDepths[] = { 1, CONTROLLER_RENDER_AHEAD_DEPTH };
+    for (const uint32_t depth : aheadDepths) {
+        controller::renderAhead ahead(depth, RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+            CUDA_MANDELBROT_INTERATIONS, &aheadPool);
+        controller::aheadView view = { IMAGE_SCALEA, IMAGE_SCALEB, 0.0,
+            cpu::fixedPoint(FRACTAL_OFFSET_X), cpu::fixedPoint(FRACTAL_OFFSET_Y), cpu::PRECISION_TIER_DOUBLE };
+
+        const uint32_t aheadFrames = 32;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < aheadFrames; i++) {
+            while (ahead.can_queue()) {
+                ahead.queue(view);
+                view.scaleA *= 0.98;
+            }
+
+            controller::aheadView shown;
+            err = ahead.present(aheadBuf.data(), &shown);
+            if (err != 0) {
+                return err;
+            }
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        ahead.discard();
+
+        DINFO("Render-ahead depth " + std::to_string(depth) + ": " +
+            std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count() / aheadFrames) + " ms per frame");
+    }
+#endif //TEST_MANDELBROT_CPU_RENDER_AHEAD
+
+#if defined(TEST_FRAME_WRITERS)
+    mandelbrotFractalCpu writeFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    std::vector<rgbaPixel> writeBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    err = writeFrac.compute_image_tiled(writeBuf.data());
+    if (err != 0) {
+        return err;
+    }
+
+    const ppm::PPM_FORMAT writeFormats[] = { ppm::PPM_FORMAT_P6, ppm::PPM_FORMAT_P5, ppm::PPM_FORMAT_PAM, ppm::PPM_FORMAT_P3 };
+    const char *writeNames[] = { "P6", "P5", "PAM", "P3" };
+    for (uint32_t i = 0; i < 4; i++) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (writeFormats[i] == ppm::PPM_FORMAT_P5) {
+            err = ppm::write_iteration_map(PPM_OUTPUT_FILE, writeFrac.get_iteration_field(),
+                RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT, CUDA_MANDELBROT_INTERATIONS);
+        }
+        else {
+            err = ppm::write_frame(PPM_OUTPUT_FILE, writeFormats[i], writeBuf.data(),
+                RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (err != 0) {
+            return err;
+        }
+
+        const double elapsedms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        DINFO(std::string("Write ") + writeNames[i] + ": " + std::to_string(elapsedms) + " ms" +
+            " MB/s (RGB): " + std::to_string((double)writeBuf.size() * 3.0 / (elapsedms * 1000.0)));
+    }
+#endif //TEST_FRAME_WRITERS
+
+#if defined(TEST_FRAME_ENCODERS)
+    cpu::threadPool encodePool(THREAD_POOL_DEFAULT_WORKERS);
+    mandelbrotFractalCpu encodeFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    encodeFrac.set_thread_pool(&encodePool);
+    std::vector<rgbaPixel> encodeBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    err = encodeFrac.compute_image_tiled(encodeBuf.data());
+    if (err != 0) {
+        return err;
+    }
+
+    const char *encodeNames[] = { "PNG", "QOI" };
+    for (uint32_t i = 0; i < 2; i++) {
+        std::vector<uint8_t> encoded;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (i == 0) {
+            err = png::encode_png(&encodePool, encodeBuf.data(), RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT, false, &encoded);
+        }
+        else {
+            err = qoi::encode_qoi(&encodePool, encodeBuf.data(), RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT, false, &encoded);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (err != 0) {
+            return err;
+        }
+
+        const double elapsedms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        DINFO(std::string("Encode ") + encodeNames[i] + ": " + std::to_string(elapsedms) + " ms" +
+            " bytes: " + std::to_string(encoded.size()) +
+            " of RGB: " + std::to_string((double)encoded.size() / ((double)encodeBuf.size() * 3.0)));
+    }
+#endif //TEST_FRAME_ENCODERS
+
+#if defined(TEST_ITERATION_FILE)
+    mandelbrotFractalCpu fieldFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    std::vector<rgbaPixel> fieldBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    err = fieldFrac.compute_image_tiled(fieldBuf.data());
+    if (err != 0) {
+        return err;
+    }
+
+    frame::mbitView fieldView;
+    fieldView.centerX = cpu::fixedPoint(FRACTAL_OFFSET_X);
+    fieldView.centerY = cpu::fixedPoint(FRACTAL_OFFSET_Y);
+    fieldView.scaleA = IMAGE_SCALEA;
+    fieldView.scaleB = IMAGE_SCALEB;
+    fieldView.width = RENDER_WINDOW_LENGTH;
+    fieldView.height = RENDER_WINDOW_HEIGHT;
+    fieldView.maxIterations = CUDA_MANDELBROT_INTERATIONS;
+    fieldView.precisionTier = fieldFrac.get_render_stats().precisionTier;
+    fieldView.fieldType = frame::MBIT_FIELD_ESCAPE_TIME;
+    fieldView.formula = frame::MBIT_FORMULA_MANDELBROT;
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    frame::iterationFileWriter fieldWriter;
+    if (fieldWriter.create(MBIT_OUTPUT_FILE, fieldView) != 0 ||
+        fieldWriter.write_rows(0, RENDER_WINDOW_HEIGHT, fieldFrac.get_iteration_field()) != 0 ||
+        fieldWriter.close() != 0) {
+        return -1;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    frame::iterationFile fieldFile;
+    if (fieldFile.open(MBIT_OUTPUT_FILE) != 0) {
+        return -1;
+    }
+    cpu::colorizer fieldColours(cpu::cpuPixelColour, 16, CUDA_MANDELBROT_INTERATIONS);
+    std::vector<rgbaPixel> recolourBuf(fieldBuf.size());
+    for (uint32_t y = 0; y < RENDER_WINDOW_HEIGHT; y++) {
+        fieldColours.colorize(fieldFile.get_escape_times(y), RENDER_WINDOW_LENGTH, &recolourBuf[y * RENDER_WINDOW_LENGTH]);
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    const bool fieldMatch = std::memcmp(fieldBuf.data(), recolourBuf.data(), fieldBuf.size() * sizeof(rgbaPixel)) == 0;
+    DINFO(std::string("Iteration file write: ") + std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms" +
+        " map and recolour: " + std::to_string(std::chrono::duration<double, std::milli>(t3 - t2).count()) + " ms" +
+        " same frame: " + (fieldMatch ? "yes" : "no"));
+    fieldFile.close();
+#endif //TEST_ITERATION_FILE
+
+#if defined(TEST_MANDELBROT_PRECISION_TIERS)
+    std::vector<rgbaPixel> tierBuf(RENDER_WINDOW_LENGTH * RENDER_WINDOW_HEIGHT);
+    mandelbrotFractalCpu tierFrac(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT,
+        IMAGE_SCALEA, IMAGE_SCALEB, CUDA_MANDELBROT_INTERATIONS, THREAD_POOL_DEFAULT_WORKERS);
+    for (uint32_t tier = cpu::PRECISION_TIER_FLOAT; tier <= cpu::PRECISION_TIER_PERTURBATION; tier++) {
+        tierFrac.set_precision_tier((cpu::PRECISION_TIER)tier);
+        err = tierFrac.compute_image_tiled(tierBuf.data());
+        if (err != 0) {
+            return err;
+        }
+
+        const cpu::cpuRenderStats stats = tierFrac.get_render_stats();
+        DINFO(std::string("CPU tier: ") + cpu::get_precision_tier_name(stats.precisionTier) +
+            " time: " + std::to_string(stats.frameRenderElapsedms) + " ms" +
+            " Mpix/s: " + std::to_string(stats.mpixPerSecond));
+    }
+
+    cuda::cudaKernel tierKernel(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        RENDER_WINDOW_LENGTH, RENDER_WINDOW_HEIGHT, IMAGE_SCALEA, IMAGE_SCALEB);
+    for (uint32_t single = 0; single < 2; single++) {
+        tierKernel.setSinglePrecision(single != 0);
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        err = tierKernel.generate_mandelbrot(tierBuf.data());
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (err != 0) {
+            return err;
+        }
+
+        const double elapsedms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        DINFO(std::string("GPU tier: ") + (single != 0 ? "float" : "double") +
+            " time: " + std::to_string(elapsedms) + " ms" +
+            " Mpix/s: " + std::to_string((double)tierBuf.size() / (elapsedms * 1000.0)));
+    }
+#endif //TEST_MANDELBROT_PRECISION_TIERS
+
 #if defined(TEST_CONTROLLER_PATH)
     controller::loopTimer controller(
         FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y, 
@@ -82,10 +471,18 @@ int WINAPI WinMain(HINSTANCE hinstance,
 
 #if defined(TEST_MANDELBROT_GPU)
     frame::image frameBuf(FRAME_BUFFER_LENGTH, FRAME_BUFFER_HEIGHT);
-    cuda::cudaKernel kernel(&frameBuf, FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y);
-    if (kernel.generate_mandelbrot() != 0) {
+    cuda::cudaKernel kernel(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y,
+        FRAME_BUFFER_LENGTH, FRAME_BUFFER_HEIGHT, IMAGE_SCALEA, IMAGE_SCALEB);
+
+    // Escape times from the GPU, coloured on the host
+    std::vector<uint32_t> gpuField((size_t)FRAME_BUFFER_LENGTH * FRAME_BUFFER_HEIGHT);
+    if (kernel.generate_iteration_field(gpuField.data()) != 0) {
         return -1;
     }
+    std::vector<rgbaPixel> gpuFrame(gpuField.size());
+    cpu::colorizer gpuColours(cpu::cpuPixelColour, 16, CUDA_MANDELBROT_INTERATIONS);
+    gpuColours.colorize(gpuField.data(), gpuField.size(), gpuFrame.data());
+    frameBuf.load_rgba_frame(gpuFrame.data());
 
     const std::vector<uint8_t> rawFrameBuffer = frameBuf.export_raw_frame_buffer();
     DINFO("Frame buffer pixel count: " + std::to_string(rawFrameBuffer.size()));
@@ -103,7 +500,10 @@ int WINAPI WinMain(HINSTANCE hinstance,
         return -1;
     }
 
-    renderer.write_static_frame(rawFrameBuffer, FRAME_BUFFER_LENGTH, FRAME_BUFFER_HEIGHT);
+    // The raw frame buffer is r, g, b, alpha per pixel, the layout of rgbaPixel
+    render::frameRing staticFrames(FRAME_BUFFER_LENGTH, FRAME_BUFFER_HEIGHT);
+    renderer.set_frame_ring(&staticFrames);
+    renderer.write_static_frame((const rgbaPixel *)rawFrameBuffer.data(), FRAME_BUFFER_LENGTH, FRAME_BUFFER_HEIGHT);
 
     // Enter rendering loop
     error_t renderErr = renderer.enter_render_loop();
@@ -11,6 +11,42 @@
 // Tests the frame:: class to write data into a file
 #undef TEST_MANDELBROT_CPU_FRAME
 
+// Tests the tiled CPU renderer, reports Mpix/s for an increasing thread count
+#undef TEST_MANDELBROT_CPU_SCALING
+
+// Tests the vectorized CPU kernels, single thread Mpix/s for each instruction set
+#undef TEST_MANDELBROT_CPU_SIMD
+
+// Compares the tiled CPU renderer with and without Mariani-Silver subdivision
+#undef TEST_MANDELBROT_CPU_SUBDIVISION
+
+// Renders once, then times palette cycling through the colorizer (no iteration)
+#undef TEST_MANDELBROT_CPU_RECOLOUR
+
+// Cancels a deep CPU frame part way, reports how long the renderer took to stop
+#undef TEST_MANDELBROT_CPU_CANCEL
+
+// Zooms the CPU renderer for a few frames, reuse ratio and iterations against full frames
+#undef TEST_MANDELBROT_CPU_REPROJECTION
+
+// Pans the CPU renderer away and back, tile cache hits and time against the first frame
+#undef TEST_MANDELBROT_CPU_TILE_CACHE
+
+// Zooms through the same views one frame at a time and with the render-ahead queue
+#undef TEST_MANDELBROT_CPU_RENDER_AHEAD
+
+// Writes one CPU frame in every Netpbm format, MB/s per format
+#undef TEST_FRAME_WRITERS
+
+// Encodes one CPU frame as PNG and QOI on the renderer's pool, time and size per encoder
+#undef TEST_FRAME_ENCODERS
+
+// Writes the escape times of one CPU frame to an .mbit file, maps it and colours it again
+#undef TEST_ITERATION_FILE
+
+// Benchmarks every precision tier on the same view, Mpix/s per tier (CPU and GPU)
+#undef TEST_MANDELBROT_PRECISION_TIERS
+
 // Tests the mandelbrot GPU renderer
 #undef TEST_MANDELBROT_GPU
 
@@ -18,6 +54,7 @@
 #define TEST_CONTROLLER_PATH
 
 #define PPM_OUTPUT_FILE				"output.ppm"
+#define MBIT_OUTPUT_FILE			"output.mbit"
 
 // Location of the parameter files
 #define PARAMETER_FILE_FOLDER		"C:\\Users\\Stanr\\source\\repos\\MandelbrotCuda\\parameters\\"
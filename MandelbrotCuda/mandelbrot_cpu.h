@@ -2,10 +2,27 @@
 
 #include "ppm.h"
 #include "frame.h"
+#include "types.h"
+#include "thread_pool.h"
+#include "escape_time.h"
+#include "double_double.h"
+#include "mandelbrot_simd.h"
+#include "fixed_point.h"
+#include "perturbation.h"
+#include "precision_ladder.h"
+#include "mariani_silver.h"
+#include "colorizer.h"
+#include "tile_cache.h"
 
 #include <stdint.h>
-#include <complex>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <assert.h>
 //#include <ofstream>
 //#include <unistd.h>
 
@@ -14,24 +31,200 @@
 
 #define COLOR_GRADIENT 255
 
+// Edge length (in pixels) of a tile scheduled on the CPU thread pool
+#define CPU_RENDER_TILE_SIZE		64
+
+// Pixels whose coordinates are gathered per call of the vectorized kernels
+#define CPU_POINT_BATCH				256
+
+/*
+ * Batches are padded to a multiple of the widest vector (16 floats) with a
+ *  point that escapes on the first iteration, short batches from subdivision
+ *  would otherwise fall to the scalar tail of the kernels
+ */
+#define CPU_POINT_LANES				16
+#define CPU_POINT_PAD_X				4.0
+
+/*
+ * Progressive rendering, pass p samples every (1 << (CPU_PROGRESSIVE_PASSES - 1 - p))
+ *  pixel on both axes: 1/16, 1/4 then the remaining pixels of the frame
+ */
+#define CPU_PROGRESSIVE_PASSES		3
+
+/*
+ * Reprojection of the previous frame during a continuous zoom. Every column
+ *  and row keeps the coordinate it was iterated at, a new column (row) takes
+ *  over the nearest old one within CPU_REPROJECT_TOLERANCE pixels of its
+ *  ideal position. Pixels whose column and row both matched are copied
+ */
+// Half a pixel keeps ~70% of a 2% zoom step (nearest neighbour), 0.25 only ~15%
+#define CPU_REPROJECT_TOLERANCE		0.5
+
+// Largest change of scale between two frames that is still reprojected
+#define CPU_REPROJECT_MAX_RATIO		2.0
+
+/*
+ * Tile cache. A zoom level is one of CPU_TILE_CACHE_LEVELS_PER_OCTAVE pixel
+ *  spacings per halving of the scale, a frame whose edge lies within
+ *  CPU_TILE_CACHE_LEVEL_SNAP pixels of a level is drawn at its spacing. The
+ *  centre moves by under half a pixel onto the global grid of the spacing
+ */
+#define CPU_TILE_CACHE_LEVELS_PER_OCTAVE	32
+#define CPU_TILE_CACHE_LEVEL_SNAP			0.25
+
+// Views further from the origin (in pixels) are not cached, 2^52 keeps grid indices exact
+#define CPU_TILE_CACHE_MAX_GRID				4503599627370496.0
+
+// A reprojected tile is stored when its columns and rows are this close (in pixels) to the grid
+#define CPU_TILE_CACHE_GRID_TOLERANCE		(1.0 / 64.0)
+
+namespace cpu {
+	// Host copy of the pixel_colour table in kernel.cu, default palette of the colorizer
+	static const rgbaPixel cpuPixelColour[16] =
+	{
+		{ 66,  30,  15 },
+		{ 25,   7,  26 },
+		{ 9,   1,  47 },
+		{ 4,   4,  73 },
+		{ 0,   7, 100 },
+		{ 12,  44, 138 },
+		{ 24,  82, 177 },
+		{ 57, 125, 209 },
+		{ 134, 181, 229 },
+		{ 211, 236, 248 },
+		{ 241, 233, 191 },
+		{ 248, 201,  95 },
+		{ 255, 170,   0 },
+		{ 204, 128,   0 },
+		{ 153,  87,   0 },
+		{ 106,  52,   3 }
+	};
+
+	typedef struct renderTile {
+		uint32_t x, y;
+		uint32_t width, height;
+	} RENDER_TILE, *PRENDER_TILE;
+
+	typedef struct cpuRenderStats {
+		double frameRenderElapsedms; // milliseconds
+		uint64_t pixelCount;
+		uint32_t threadCount;
+		uint32_t tileCount;
+		uint64_t tilesStolen;
+		double mpixPerSecond;
+		simd::SIMD_LEVEL simdLevel;
+		PRECISION_TIER precisionTier;
+		uint32_t referenceCount;	// Perturbation reference orbits
+		uint64_t glitchedPixels;	// Perturbation pixels rebased
+		uint64_t cardioidPixels;	// Interior pixels skipped by the cardioid / bulb test
+		uint64_t periodicPixels;	// Interior pixels that exited on the periodicity check
+		uint64_t iteratedPixels;	// Pixels iterated, the rest was filled by subdivision or an earlier pass
+		double iteratedFraction;
+		uint32_t progressivePass;	// 0 for full frames
+		uint64_t iterationsSpent;	// Escape times summed, interior pixels count maxIter
+		bool cancelled;				// Abandoned part way, the frame is incomplete
+		uint64_t reusedPixels;		// Copied from the previous frame (reprojection)
+		double reuseRatio;
+		uint64_t cacheHits;			// Tiles served from the tile cache
+		uint64_t cacheMisses;
+	} CPU_RENDER_STATS, *PCPU_RENDER_STATS;
+}
+
 class mandelbrotFractalCpu {
 private:
 	uint32_t iterations;
 	float xWindowLength, yWindowLength;
 
+	// x,y position of the fractal image (complex plane)
+	double offsetX, offsetY;
+
+	// Full precision copy of the offset, deep zooms outgrow a double
+	cpu::fixedPoint centerX, centerY;
+
+	// Scales, same meaning as cuda::cudaKernel
+	double scaleA, scaleB;
+	double scale;
+
+	// Total size of the pixelBuffer (in bytes)
+	const size_t pixelLength, pixelHeight;
+	const size_t pixelBufferRawSize;
+
+	// The pixels are a region of a regionFrameLength * regionFrameHeight frame
+	//  starting at (regionFirstColumn, regionFirstRow): out of core bands and
+	//  pyramid tiles. The frame itself and 0, 0 for a whole frame
+	size_t regionFrameLength, regionFrameHeight;
+	size_t regionFirstColumn, regionFirstRow;
+
+	// Tiled renderer
+	const uint32_t threadCount;
+	cpu::threadPool *pool;
+	bool sharedPool;			// Owned by the caller (set_thread_pool)
+	cpu::cpuRenderStats renderStats;
+
+	// Vectorized kernels, selected at runtime
+	cpu::simd::SIMD_LEVEL simdLevel;
+	cpu::simd::escapePointsKernel escapePoints;
+	cpu::simd::escapePointsKernelFloat escapePointsFloat;
+
+	// Brent periodicity check on the escape-time tiers (optional)
+	bool periodicityCheck;
+
+	// Mariani-Silver subdivision of each tile (optional)
+	bool subdivision;
+
+	// Deep zoom engine and its escape time buffer
+	cpu::PRECISION_TIER precisionTier;
+	bool autoPrecision;
+	cpu::doubleDouble centerXDD, centerYDD;
+	cpu::perturbationEngine *perturbation;
+
+	// Iteration field of the last frame, the colorizer turns it into pixels
+	std::vector<uint32_t> iterationBuffer;
+
+	// Fractional escape times of the last frame (smooth colouring only)
+	std::vector<float> smoothBuffer;
+	bool smoothColouring, smoothFieldValid;
+	cpu::colorizer colouring;
+
+	// Frame the progressive passes are drawn into
+	std::vector<rgbaPixel> progressiveBuffer;
+
+	// Coordinate of every column and row of the field, relative to the centre
+	std::vector<double> columnDelta, rowDelta;
+
+	// Reprojection (optional), the previous field and the view it was iterated at
+	bool reprojection;
+	bool reprojectValid;
+	cpu::PRECISION_TIER reprojectTier;
+	cpu::fixedPoint reprojectCenterX, reprojectCenterY;
+	double reprojectScale;
+	std::vector<uint32_t> previousIterationBuffer;
+	std::vector<double> previousColumnDelta, previousRowDelta;
+
+	// Tile cache (optional), frame pixel (0, 0) sits on column gridColumn and
+	//  row gridRow of the level's grid once the centre moved by gridSnap
+	cpu::tileCache *cache;
+	bool cacheFrame;
+	double gridSnapX, gridSnapY;
+	int64_t gridColumn, gridRow;
+	std::vector<uint8_t> cachedTiles;	// Progressive: tiles served at pass 0
+
+	// Set by another thread once the frame in flight is stale (optional),
+	//  checked before every batch of points (double-double: every point)
+	frameCancel cancel;
+
 private:
+	template<typename T = float>
 	uint32_t compute_point(uint32_t x, uint32_t y)
 	{
-		std::complex<float> point((float)x / xWindowLength - X_WINDOW_OFFSET,
-			(float)y / yWindowLength - Y_WINDOW_OFFSET);
+		const T pointX = T((double)x / xWindowLength - X_WINDOW_OFFSET);
+		const T pointY = T((double)y / yWindowLength - Y_WINDOW_OFFSET);
 
-		std::complex<float> z(0, 0);
-		uint32_t iter = 0;
-		while (abs(z) < 2 && iter <= this->iterations) {
-			z = z * z + point;
-			iter++;
+		if (cpu::in_cardioid_or_bulb<T>(pointX, pointY)) {
+			return 0;
 		}
 
+		const uint32_t iter = cpu::escape_time<T>(pointX, pointY, iterations);
 		if (iter < iterations) {
 			return COLOR_GRADIENT * iter / (iterations - 1);
 		}
@@ -40,6 +233,534 @@ private:
 		}
 	}
 
+	/*
+	 * Escape times of count pixels of tile, given as indices (y * width + x)
+	 *  inside the tile, in the arithmetic of the current tier. Coordinates come
+	 *  from columnDelta and rowDelta and are gathered in batches for the
+	 *  vectorized kernels. Double-double has no
+	 *  vectorized kernel, its pixel mapping is done in double-double so the
+	 *  offset keeps its precision
+	 */
+	void evaluate_points(const cpu::renderTile &tile, const uint32_t *pixels, uint32_t count,
+		__inout cpu::escapeCounters *counters, __inout uint32_t *out) const
+	{
+		const double periodEpsilon = get_period_epsilon();
+		const double *columns = &columnDelta[tile.x], *rows = &rowDelta[tile.y];
+
+		for (uint32_t first = 0; first < count; first += CPU_POINT_BATCH) {
+			// A cancelled frame is thrown away, the rest of the tile stays at 0
+			if (cancel_requested()) {
+				std::memset(&out[first], 0x0, (count - first) * sizeof(uint32_t));
+				return;
+			}
+
+			const uint32_t batch = std::min<uint32_t>(CPU_POINT_BATCH, count - first);
+			const uint32_t padded = (batch + CPU_POINT_LANES - 1) / CPU_POINT_LANES * CPU_POINT_LANES;
+			const uint32_t *batchPixels = &pixels[first];
+			uint32_t result[CPU_POINT_BATCH];
+
+			switch (precisionTier) {
+			case cpu::PRECISION_TIER_FLOAT: {
+				float x[CPU_POINT_BATCH], y[CPU_POINT_BATCH];
+				for (uint32_t k = 0; k < batch; k++) {
+					x[k] = (float)columns[batchPixels[k] % tile.width] + (float)offsetX;
+					y[k] = (float)rows[batchPixels[k] / tile.width] + (float)offsetY;
+				}
+				for (uint32_t k = batch; k < padded; k++) {
+					x[k] = (float)CPU_POINT_PAD_X;
+					y[k] = 0.0f;
+				}
+				escapePointsFloat(x, y, padded, iterations, (float)periodEpsilon, counters, result);
+				std::memcpy(&out[first], result, batch * sizeof(uint32_t));
+				counters->iterationsSpent += sum_iterations(result, batch);
+				break;
+			}
+			case cpu::PRECISION_TIER_DOUBLE_DOUBLE:
+				// Scalar and slow, a batch can outlast the cancel latency
+				for (uint32_t k = 0; k < batch; k++) {
+					if (cancel_requested()) {
+						std::memset(&out[first + k], 0x0, (batch - k) * sizeof(uint32_t));
+						break;
+					}
+					const cpu::doubleDouble x = cpu::doubleDouble(columns[batchPixels[k] % tile.width]) + centerXDD;
+					const cpu::doubleDouble y = cpu::doubleDouble(rows[batchPixels[k] / tile.width]) + centerYDD;
+					out[first + k] = cpu::escape_time_checked<cpu::doubleDouble>(x, y, iterations,
+						cpu::doubleDouble(periodEpsilon), counters);
+				}
+				counters->iterationsSpent += sum_iterations(&out[first], batch);
+				break;
+			default: {
+				double x[CPU_POINT_BATCH], y[CPU_POINT_BATCH];
+				for (uint32_t k = 0; k < batch; k++) {
+					x[k] = columns[batchPixels[k] % tile.width] + offsetX;
+					y[k] = rows[batchPixels[k] / tile.width] + offsetY;
+				}
+				for (uint32_t k = batch; k < padded; k++) {
+					x[k] = CPU_POINT_PAD_X;
+					y[k] = 0.0;
+				}
+				escapePoints(x, y, padded, iterations, periodEpsilon, counters, result);
+				std::memcpy(&out[first], result, batch * sizeof(uint32_t));
+				counters->iterationsSpent += sum_iterations(result, batch);
+				break;
+			}
+			}
+		}
+	}
+
+	uint64_t sum_iterations(const uint32_t *iter, uint32_t count) const
+	{
+		uint64_t sum = 0;
+		for (uint32_t k = 0; k < count; k++) {
+			sum += std::min(iter[k], iterations);
+		}
+
+		return sum;
+	}
+
+	bool cancel_requested(void) const
+	{
+		return is_frame_cancelled(cancel);
+	}
+
+	/*
+	 * Escape time and fractional escape time of every pixel of tile, scalar
+	 *  (the vectorized kernels do not keep the final |z|)
+	 */
+	template<typename T>
+	void evaluate_smooth_point(T x, T y, __inout cpu::escapeCounters *counters,
+		__inout uint32_t *iter, __inout float *smooth) const
+	{
+		if (cpu::in_cardioid_or_bulb<T>(x, y)) {
+			counters->cardioidPixels++;
+			*iter = iterations + 1;
+			*smooth = (float)*iter;
+			return;
+		}
+
+		T modulus2 = T(0.0);
+		*iter = cpu::escape_time_modulus<T>(x, y, iterations, &modulus2);
+		*smooth = cpu::smooth_escape_time(*iter, to_double(modulus2), iterations);
+		counters->iterationsSpent += std::min(*iter, iterations);
+	}
+
+	static double to_double(float val) { return (double)val; }
+	static double to_double(double val) { return val; }
+	static double to_double(const cpu::doubleDouble &val) { return val.to_double(); }
+
+	void evaluate_smooth_tile(const cpu::renderTile &tile, __inout cpu::escapeCounters *counters,
+		__inout uint32_t *iterationField, __inout float *smoothField) const
+	{
+		const double halfLength = get_centre_column(), halfHeight = get_centre_row();
+
+		for (uint32_t i = tile.y; i < tile.y + tile.height; i++) {
+			const double rowDelta = ((double)i - halfHeight) * scale;
+			for (uint32_t j = tile.x; j < tile.x + tile.width; j++) {
+				const double columnDelta = ((double)j - halfLength) * scale;
+				uint32_t *iter = &iterationField[i * pixelLength + j];
+				float *smooth = &smoothField[i * pixelLength + j];
+
+				switch (precisionTier) {
+				case cpu::PRECISION_TIER_FLOAT:
+					evaluate_smooth_point<float>((float)columnDelta + (float)offsetX, (float)rowDelta + (float)offsetY,
+						counters, iter, smooth);
+					break;
+				case cpu::PRECISION_TIER_DOUBLE_DOUBLE:
+					evaluate_smooth_point<cpu::doubleDouble>(cpu::doubleDouble(columnDelta) + centerXDD,
+						cpu::doubleDouble(rowDelta) + centerYDD, counters, iter, smooth);
+					break;
+				default:
+					evaluate_smooth_point<double>(columnDelta + offsetX, rowDelta + offsetY, counters, iter, smooth);
+					break;
+				}
+			}
+		}
+	}
+
+	// Global tile holding frame pixel (x, y), the tile boundaries of the frame follow the grid.
+	//  Tiles of other subdivision or periodicity settings are other entries
+	cpu::tileKey get_tile_key(uint32_t x, uint32_t y) const
+	{
+		const int64_t edge = CPU_RENDER_TILE_SIZE;
+		const int64_t column = gridColumn + x, row = gridRow + y;
+		uint64_t level;
+		std::memcpy(&level, &scale, sizeof(level));
+		return cpu::tileKey{ level,
+			column >= 0 ? column / edge : (column - edge + 1) / edge,
+			row >= 0 ? row / edge : (row - edge + 1) / edge,
+			iterations, (uint32_t)precisionTier,
+			(subdivision ? TILE_KEY_SUBDIVISION : 0u) | (periodicityCheck ? TILE_KEY_PERIODICITY : 0u) };
+	}
+
+	static uint32_t get_grid_phase(int64_t index)
+	{
+		const int64_t edge = CPU_RENDER_TILE_SIZE;
+		return (uint32_t)(((index % edge) + edge) % edge);
+	}
+
+	/*
+	 * Copies tile from the cache into the field and colours it, a tile at the
+	 *  frame edge takes its part of the global tile. False on a miss
+	 */
+	bool serve_cached_tile(__inout rgbaPixel *buffer, __inout uint32_t *iterationField, const cpu::renderTile &tile) const
+	{
+		uint32_t cached[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		if (!cacheFrame || !cache->lookup(get_tile_key(tile.x, tile.y), cached)) {
+			return false;
+		}
+
+		const uint32_t phaseX = get_grid_phase(gridColumn + tile.x), phaseY = get_grid_phase(gridRow + tile.y);
+		for (uint32_t i = 0; i < tile.height; i++) {
+			std::memcpy(&iterationField[(tile.y + i) * pixelLength + tile.x],
+				&cached[(phaseY + i) * CPU_RENDER_TILE_SIZE + phaseX], tile.width * sizeof(uint32_t));
+		}
+		colour_tile(buffer, iterationField, nullptr, tile);
+
+		return true;
+	}
+
+	// Stores a complete tile of the field, partial tiles at the frame edge are not kept
+	void store_cached_tile(const uint32_t *iterationField, const cpu::renderTile &tile) const
+	{
+		if (!cacheFrame || tile.width != CPU_RENDER_TILE_SIZE || tile.height != CPU_RENDER_TILE_SIZE ||
+			cancel_requested()) {
+			return;
+		}
+
+		uint32_t complete[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		for (uint32_t i = 0; i < tile.height; i++) {
+			std::memcpy(&complete[i * CPU_RENDER_TILE_SIZE], &iterationField[(tile.y + i) * pixelLength + tile.x],
+				tile.width * sizeof(uint32_t));
+		}
+		cache->insert(get_tile_key(tile.x, tile.y), complete);
+	}
+
+	// Columns and rows of tile at their grid coordinate (not reprojected from another view)
+	bool tile_on_grid(const cpu::renderTile &tile) const
+	{
+		const double halfLength = get_centre_column(), halfHeight = get_centre_row();
+		const double tolerance = CPU_TILE_CACHE_GRID_TOLERANCE * scale;
+		for (uint32_t j = tile.x; j < tile.x + tile.width; j++) {
+			if (std::abs(columnDelta[j] - (((double)j - halfLength) * scale + gridSnapX)) > tolerance) {
+				return false;
+			}
+		}
+		for (uint32_t i = tile.y; i < tile.y + tile.height; i++) {
+			if (std::abs(rowDelta[i] - (((double)i - halfHeight) * scale + gridSnapY)) > tolerance) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/*
+	 * Iterates one tile (every pixel or subdivided) into the iteration field
+	 *  and colours it, returns the number of pixels actually iterated. Smooth
+	 *  colouring fills smoothField as well (nullptr when off)
+	 */
+	uint64_t render_tile(__inout rgbaPixel *buffer, __inout uint32_t *iterationField, __inout float *smoothField,
+		const cpu::renderTile &tile, __inout cpu::escapeCounters *counters) const
+	{
+		uint32_t tileIterations[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		const uint32_t tilePixels = tile.width * tile.height;
+		uint64_t iterated = 0;
+
+		if (smoothField != nullptr) {
+			evaluate_smooth_tile(tile, counters, iterationField, smoothField);
+			colour_tile(buffer, iterationField, smoothField, tile);
+			return tilePixels;
+		}
+
+		if (serve_cached_tile(buffer, iterationField, tile)) {
+			return 0;
+		}
+
+		if (subdivision) {
+			auto evaluate = [this, &tile, counters](const uint32_t *pixels, uint32_t count, uint32_t *out) {
+				evaluate_points(tile, pixels, count, counters, out);
+			};
+			cpu::marianiSilver<decltype(evaluate)> subdivider(evaluate, tile.width, tile.height, tileIterations);
+			iterated = subdivider.render();
+		}
+		else {
+			uint32_t pixels[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+			for (uint32_t k = 0; k < tilePixels; k++) {
+				pixels[k] = k;
+			}
+			evaluate_points(tile, pixels, tilePixels, counters, tileIterations);
+			iterated = tilePixels;
+		}
+
+		for (uint32_t i = 0; i < tile.height; i++) {
+			std::memcpy(&iterationField[(tile.y + i) * pixelLength + tile.x], &tileIterations[i * tile.width],
+				tile.width * sizeof(uint32_t));
+		}
+		colour_tile(buffer, iterationField, nullptr, tile);
+		store_cached_tile(iterationField, tile);
+
+		return iterated;
+	}
+
+	/*
+	 * Iterates the samples of one progressive pass in a tile, samples of the
+	 *  coarser passes are skipped. Each sample fills a stride * stride block of
+	 *  the iteration field that the finer passes overwrite. Returns the
+	 *  samples iterated
+	 */
+	uint64_t render_tile_pass(__inout rgbaPixel *buffer, __inout uint32_t *iterationField,
+		const cpu::renderTile &tile, uint32_t stride, __inout cpu::escapeCounters *counters) const
+	{
+		uint32_t pixels[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE] = { 0 };
+		uint32_t tileIterations[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		const uint32_t coarserStride = stride << 1;
+		const bool firstPass = stride == 1u << (CPU_PROGRESSIVE_PASSES - 1);
+		uint32_t count = 0;
+
+		// Samples sit on the stride grid of the tile, every pass splits the frame the same way
+		for (uint32_t i = 0; i < tile.height; i += stride) {
+			for (uint32_t j = 0; j < tile.width; j += stride) {
+				if (!firstPass && i % coarserStride == 0 && j % coarserStride == 0) {
+					continue;
+				}
+				pixels[count++] = i * tile.width + j;
+			}
+		}
+
+		evaluate_points(tile, pixels, count, counters, tileIterations);
+
+		for (uint32_t k = 0; k < count; k++) {
+			const uint32_t i = pixels[k] / tile.width, j = pixels[k] % tile.width;
+			const uint32_t blockHeight = std::min(stride, tile.height - i);
+			const uint32_t blockWidth = std::min(stride, tile.width - j);
+			for (uint32_t bi = 0; bi < blockHeight; bi++) {
+				uint32_t *row = &iterationField[(tile.y + i + bi) * pixelLength + tile.x + j];
+				for (uint32_t bj = 0; bj < blockWidth; bj++) {
+					row[bj] = tileIterations[k];
+				}
+			}
+		}
+		colour_tile(buffer, iterationField, nullptr, tile);
+
+		return count;
+	}
+
+	/*
+	 * Copies the pixels of a tile whose column and row both have a source in
+	 *  the previous field, iterates the others. Returns the pixels iterated
+	 */
+	uint64_t render_tile_reprojected(__inout rgbaPixel *buffer, __inout uint32_t *iterationField,
+		const uint32_t *previousField, const int32_t *columnSource, const int32_t *rowSource,
+		const cpu::renderTile &tile, __inout cpu::escapeCounters *counters) const
+	{
+		uint32_t pixels[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE] = { 0 };
+		uint32_t computed[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		uint32_t tileIterations[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE];
+		uint32_t count = 0;
+
+		for (uint32_t i = 0; i < tile.height; i++) {
+			const int32_t sourceRow = rowSource[tile.y + i];
+			for (uint32_t j = 0; j < tile.width; j++) {
+				const int32_t sourceColumn = columnSource[tile.x + j];
+				if (sourceRow >= 0 && sourceColumn >= 0) {
+					tileIterations[i * tile.width + j] = previousField[sourceRow * pixelLength + sourceColumn];
+				}
+				else {
+					pixels[count++] = i * tile.width + j;
+				}
+			}
+		}
+
+		// The exposed pixels may have been seen before. A cached tile holds grid
+		//  coordinates, it only replaces a tile whose columns and rows are on
+		//  the grid: the deltas are per frame column and row, they cannot be
+		//  reset for one tile without moving the reprojected pixels around it
+		const bool onGrid = count != 0 && tile_on_grid(tile);
+		if (onGrid && serve_cached_tile(buffer, iterationField, tile)) {
+			return 0;
+		}
+
+		evaluate_points(tile, pixels, count, counters, computed);
+		for (uint32_t k = 0; k < count; k++) {
+			tileIterations[pixels[k]] = computed[k];
+		}
+
+		for (uint32_t i = 0; i < tile.height; i++) {
+			std::memcpy(&iterationField[(tile.y + i) * pixelLength + tile.x], &tileIterations[i * tile.width],
+				tile.width * sizeof(uint32_t));
+		}
+		colour_tile(buffer, iterationField, nullptr, tile);
+
+		// Pixels carried over from a zoom sit off the grid, only exact tiles are kept
+		if (onGrid) {
+			store_cached_tile(iterationField, tile);
+		}
+
+		return count;
+	}
+
+	// Column and row the centre falls on, a region counts them from its first pixel
+	double get_centre_column(void) const
+	{
+		return (double)(regionFrameLength >> 1) - (double)regionFirstColumn;
+	}
+
+	double get_centre_row(void) const
+	{
+		return (double)(regionFrameHeight >> 1) - (double)regionFirstRow;
+	}
+
+	// Pixel centres of a frame rendered from scratch
+	void reset_grid(void)
+	{
+		const double halfLength = get_centre_column(), halfHeight = get_centre_row();
+		columnDelta.resize(pixelLength);
+		rowDelta.resize(pixelHeight);
+		for (uint32_t j = 0; j < pixelLength; j++) {
+			columnDelta[j] = ((double)j - halfLength) * scale + gridSnapX;
+		}
+		for (uint32_t i = 0; i < pixelHeight; i++) {
+			rowDelta[i] = ((double)i - halfHeight) * scale + gridSnapY;
+		}
+	}
+
+	/*
+	 * Nearest multiple of spacing to centre (approx is its double value), the
+	 *  multiple goes to *index and the distance to it is returned.
+	 *  |approx / spacing| must stay below CPU_TILE_CACHE_MAX_GRID
+	 */
+	static double snap_to_grid(const cpu::fixedPoint &centre, double approx, double spacing, __inout int64_t *index)
+	{
+		const double split = 67108864.0;	// 2^26, each half of the index fits the integer limb
+		int64_t k = (int64_t)std::llround(approx / spacing);
+		double snap = 0.0;
+
+		// approx is off by up to a pixel, a second round lands on the nearest multiple
+		for (uint32_t round = 0; ; round++) {
+			const double high = (double)(k / (int64_t)split), low = (double)(k % (int64_t)split);
+			const cpu::fixedPoint multiple = cpu::fixedPoint(high) * cpu::fixedPoint(spacing * split) +
+				cpu::fixedPoint(low) * cpu::fixedPoint(spacing);
+			snap = (multiple - centre).to_double();
+
+			const int64_t correction = (int64_t)std::llround(snap / spacing);
+			if (correction == 0 || round == 2) {
+				break;
+			}
+			k -= correction;
+		}
+
+		*index = k;
+		return snap;
+	}
+
+	/*
+	 * Pass 0 of a frame with the tile cache: picks the zoom level and moves the
+	 *  centre onto its grid, sets cacheFrame. Without the cache the frame keeps
+	 *  its own scale and centre
+	 */
+	void prepare_tile_grid(void)
+	{
+		cacheFrame = false;
+		gridSnapX = gridSnapY = 0.0;
+		gridColumn = gridRow = 0;
+		if (cache == nullptr || smoothColouring || precisionTier == cpu::PRECISION_TIER_PERTURBATION) {
+			return;
+		}
+
+		const double level = std::round(-std::log2(scale) * CPU_TILE_CACHE_LEVELS_PER_OCTAVE);
+		const double levelScale = std::exp2(-level / CPU_TILE_CACHE_LEVELS_PER_OCTAVE);
+		if (std::abs(levelScale - scale) * (double)(regionFrameLength >> 1) <= CPU_TILE_CACHE_LEVEL_SNAP * scale) {
+			scale = levelScale;
+		}
+
+		if (std::abs(offsetX) / scale >= CPU_TILE_CACHE_MAX_GRID || std::abs(offsetY) / scale >= CPU_TILE_CACHE_MAX_GRID) {
+			return;
+		}
+
+		gridSnapX = snap_to_grid(centerX, offsetX, scale, &gridColumn);
+		gridSnapY = snap_to_grid(centerY, offsetY, scale, &gridRow);
+		gridColumn -= (int64_t)(regionFrameLength >> 1) - (int64_t)regionFirstColumn;
+		gridRow -= (int64_t)(regionFrameHeight >> 1) - (int64_t)regionFirstRow;
+		cacheFrame = true;
+	}
+
+	/*
+	 * One axis of the reprojection, both grids are sorted. The old grid is
+	 *  relative to the old centre, shift is the move of the centre since and
+	 *  snap the offset of the new grid (see prepare_tile_grid).
+	 *  source[j] receives the old column (row) taken over by j or -1, delta[j]
+	 *  the coordinate it is iterated at. An old column is taken at most once,
+	 *  returns the matches
+	 */
+	static uint32_t match_axis(const std::vector<double> &previous, double shift, double half, double newScale,
+		double snap, double tolerance, __inout std::vector<double> &delta, __inout std::vector<int32_t> &source)
+	{
+		uint32_t k = 0, matched = 0;
+		int32_t lastTaken = -1;
+		for (uint32_t j = 0; j < delta.size(); j++) {
+			const double ideal = ((double)j - half) * newScale + snap;
+			while (k + 1 < previous.size() && std::abs(previous[k + 1] - shift - ideal) <= std::abs(previous[k] - shift - ideal)) {
+				k++;
+			}
+
+			// The nearest one went to the previous column, the next one may still fit
+			uint32_t candidate = k;
+			if ((int32_t)candidate == lastTaken && candidate + 1 < previous.size()) {
+				candidate++;
+			}
+
+			source[j] = -1;
+			delta[j] = ideal;
+			if ((int32_t)candidate != lastTaken && std::abs(previous[candidate] - shift - ideal) <= tolerance) {
+				source[j] = (int32_t)candidate;
+				delta[j] = previous[candidate] - shift;
+				lastTaken = (int32_t)candidate;
+				matched++;
+			}
+		}
+
+		return matched;
+	}
+
+	void colour_tile(__inout rgbaPixel *buffer, const uint32_t *iterationField, const float *smoothField,
+		const cpu::renderTile &tile) const
+	{
+		for (uint32_t i = tile.y; i < tile.y + tile.height; i++) {
+			const size_t first = i * pixelLength + tile.x;
+			if (smoothField != nullptr) {
+				colouring.colorize_smooth(&smoothField[first], tile.width, &buffer[first]);
+			}
+			else {
+				colouring.colorize(&iterationField[first], tile.width, &buffer[first]);
+			}
+		}
+	}
+
+	// Orbit revisit tolerance, a fraction of the pixel spacing (0 = check disabled)
+	double get_period_epsilon(void) const
+	{
+		return periodicityCheck ? scale * PERIODICITY_CHECK_EPSILON : 0.0;
+	}
+
+	// Tile boundaries follow the grid of the tile cache, the frame origin without it
+	std::vector<cpu::renderTile> split_tiles(void) const
+	{
+		std::vector<cpu::renderTile> tiles;
+		const uint32_t firstWidth = CPU_RENDER_TILE_SIZE - get_grid_phase(gridColumn);
+		const uint32_t firstHeight = CPU_RENDER_TILE_SIZE - get_grid_phase(gridRow);
+		for (uint32_t y = 0; y < pixelHeight;) {
+			const uint32_t height = std::min<uint32_t>(y == 0 ? firstHeight : CPU_RENDER_TILE_SIZE, (uint32_t)pixelHeight - y);
+			for (uint32_t x = 0; x < pixelLength;) {
+				const uint32_t width = std::min<uint32_t>(x == 0 ? firstWidth : CPU_RENDER_TILE_SIZE, (uint32_t)pixelLength - x);
+				tiles.push_back({ x, y, width, height });
+				x += width;
+			}
+			y += height;
+		}
+
+		return tiles;
+	}
+
 public:
 	std::vector<ppm::ppm_pixel> *compute_image_ppm()
 	{
@@ -47,7 +768,7 @@ public:
 		for (uint32_t y = 0; y < yWindowLength; y++) {
 			for (uint32_t x = 0; x < xWindowLength; x++) {
 				o->push_back({x, y, compute_point(x, y)});
-			}			
+			}
 		}
 
 		return o;
@@ -64,17 +785,583 @@ public:
 		return 0;
 	}
 
+	/*
+	 * Renders the current view into buffer (pixelLength * pixelHeight pixels)
+	 *  The viewport is split into CPU_RENDER_TILE_SIZE tiles that are executed
+	 *  on the work-stealing pool
+	 */
+	error_t compute_image_tiled(__inout rgbaPixel *buffer)
+	{
+		return render_frame(buffer, 0, false);
+	}
+
+	/*
+	 * Renders progressive pass (0 .. get_progressive_pass_count() - 1) into
+	 *  buffer, which has to hold the previous passes of the same view. Pass 0
+	 *  picks the scale and the precision tier, the view must not change until
+	 *  the last pass
+	 */
+	error_t compute_image_pass(uint32_t pass, __inout rgbaPixel *buffer)
+	{
+		assert(pass < get_progressive_pass_count());
+		return render_frame(buffer, pass, true);
+	}
+
+	/*
+	 * Perturbation renders the whole frame in one pass
+	 */
+	uint32_t get_progressive_pass_count(void) const
+	{
+		return precisionTier == cpu::PRECISION_TIER_PERTURBATION ? 1 : CPU_PROGRESSIVE_PASSES;
+	}
+
+private:
+	error_t render_frame(__inout rgbaPixel *buffer, uint32_t pass, bool progressive)
+	{
+		assert(buffer != nullptr);
+		get_thread_pool();
+
+		auto t1 = std::chrono::high_resolution_clock::now();
+		const uint64_t stolenBefore = pool->get_tasks_stolen();
+
+		if (pass == 0) {
+			scale = get_pixel_scale();
+			if (autoPrecision) {
+				precisionTier = cpu::select_precision_tier(scale, offsetX, offsetY);
+			}
+			prepare_tile_grid();
+		}
+		std::vector<cpu::renderTile> tiles = split_tiles();
+		const cpu::tileCacheStats cacheBefore = get_tile_cache_stats();
+
+		// The previous field becomes the source, the new one is written over the older
+		const bool reproject = !progressive && can_reproject();
+		std::vector<int32_t> columnSource, rowSource;
+		uint64_t reusedPixels = 0;
+		if (reproject) {
+			iterationBuffer.swap(previousIterationBuffer);
+			columnDelta.swap(previousColumnDelta);
+			rowDelta.swap(previousRowDelta);
+			columnDelta.resize(pixelLength);
+			rowDelta.resize(pixelHeight);
+			columnSource.resize(pixelLength);
+			rowSource.resize(pixelHeight);
+
+			// A pan by whole pixels matches exactly, only the exposed strips are iterated
+			const double shiftX = (centerX - reprojectCenterX).to_double();
+			const double shiftY = (centerY - reprojectCenterY).to_double();
+			const double tolerance = CPU_REPROJECT_TOLERANCE * scale;
+			const uint64_t matchedColumns = match_axis(previousColumnDelta, shiftX, get_centre_column(), scale,
+				gridSnapX, tolerance, columnDelta, columnSource);
+			const uint64_t matchedRows = match_axis(previousRowDelta, shiftY, get_centre_row(), scale,
+				gridSnapY, tolerance, rowDelta, rowSource);
+			reusedPixels = matchedColumns * matchedRows;
+
+			// Tiles with the most to iterate first, the strips a zoom out exposes at the
+			//  edges would otherwise be picked up last and hold the frame back
+			std::vector<uint32_t> tileMissing(tiles.size());
+			for (size_t t = 0; t < tiles.size(); t++) {
+				uint32_t columns = 0, rows = 0;
+				for (uint32_t j = tiles[t].x; j < tiles[t].x + tiles[t].width; j++) {
+					columns += columnSource[j] >= 0;
+				}
+				for (uint32_t i = tiles[t].y; i < tiles[t].y + tiles[t].height; i++) {
+					rows += rowSource[i] >= 0;
+				}
+				tileMissing[t] = tiles[t].width * tiles[t].height - columns * rows;
+			}
+			std::vector<uint32_t> order(tiles.size());
+			for (uint32_t t = 0; t < order.size(); t++) {
+				order[t] = t;
+			}
+			std::stable_sort(order.begin(), order.end(), [&tileMissing](uint32_t a, uint32_t b) {
+				return tileMissing[a] > tileMissing[b];
+			});
+			std::vector<cpu::renderTile> sorted;
+			for (const uint32_t t : order) {
+				sorted.push_back(tiles[t]);
+			}
+			tiles.swap(sorted);
+		}
+		else if (pass == 0) {
+			reset_grid();
+		}
+		reprojectValid = false;
+
+		// One counter slot per tile, summed once the frame is done
+		std::vector<cpu::escapeCounters> tileCounters(tiles.size(), cpu::escapeCounters{ 0 });
+		std::vector<uint64_t> tileIterated(tiles.size(), 0);
+
+		iterationBuffer.resize(pixelLength * pixelHeight);
+		uint32_t *iterationField = iterationBuffer.data();
+
+		// Smooth colouring needs the scalar path, full frames of the escape-time tiers only
+		smoothFieldValid = smoothColouring && !progressive && precisionTier != cpu::PRECISION_TIER_PERTURBATION;
+		if (smoothFieldValid) {
+			smoothBuffer.resize(pixelLength * pixelHeight);
+		}
+		float *smoothField = smoothFieldValid ? smoothBuffer.data() : nullptr;
+
+		renderStats.referenceCount = 0;
+		renderStats.glitchedPixels = 0;
+		uint64_t deepIterationsSpent = 0;
+		if (precisionTier == cpu::PRECISION_TIER_PERTURBATION) {
+			if (perturbation == nullptr) {
+				perturbation = new cpu::perturbationEngine();
+			}
+
+			error_t err = perturbation->render(centerX, centerY, scale,
+				(uint32_t)pixelLength, (uint32_t)pixelHeight, get_centre_column(), get_centre_row(), iterations,
+				iterationField, pool, &cancel);
+			deepIterationsSpent = perturbation->get_stats().iterationsSpent;
+			if (err == ERROR_RENDER_CANCELLED) {
+				renderStats.iterationsSpent = deepIterationsSpent;
+				renderStats.cancelled = true;
+				return err;
+			}
+			if (err != 0) {
+				return err;
+			}
+
+			pool->parallel_for(tiles.size(), [this, buffer, iterationField, &tiles](size_t i) {
+				colour_tile(buffer, iterationField, nullptr, tiles[i]);
+			});
+
+			// Perturbation iterates every pixel
+			for (size_t i = 0; i < tiles.size(); i++) {
+				tileIterated[i] = (uint64_t)tiles[i].width * tiles[i].height;
+			}
+
+			const cpu::perturbationStats deepStats = perturbation->get_stats();
+			renderStats.referenceCount = deepStats.referenceCount;
+			renderStats.glitchedPixels = deepStats.glitchedPixels;
+		}
+		else if (progressive) {
+			const uint32_t stride = 1u << (CPU_PROGRESSIVE_PASSES - 1 - pass);
+			const bool lastPass = pass + 1 == get_progressive_pass_count();
+			if (pass == 0) {
+				centerXDD = cpu::to_double_double(centerX);
+				centerYDD = cpu::to_double_double(centerY);
+				cachedTiles.assign(tiles.size(), 0);
+			}
+			pool->parallel_for(tiles.size(), [this, buffer, iterationField, stride, pass, lastPass,
+				&tiles, &tileCounters, &tileIterated](size_t i) {
+				if (cancel_requested()) {
+					return;
+				}
+
+				// A cached tile is complete after pass 0, the finer passes skip it
+				if (pass == 0) {
+					cachedTiles[i] = serve_cached_tile(buffer, iterationField, tiles[i]);
+				}
+				if (cachedTiles[i]) {
+					return;
+				}
+
+				tileIterated[i] = render_tile_pass(buffer, iterationField, tiles[i], stride, &tileCounters[i]);
+				if (lastPass) {
+					store_cached_tile(iterationField, tiles[i]);
+				}
+			});
+		}
+		else if (reproject) {
+			centerXDD = cpu::to_double_double(centerX);
+			centerYDD = cpu::to_double_double(centerY);
+			const uint32_t *previousField = previousIterationBuffer.data();
+			pool->parallel_for(tiles.size(), [this, buffer, iterationField, previousField, &columnSource, &rowSource,
+				&tiles, &tileCounters, &tileIterated](size_t i) {
+				if (cancel_requested()) {
+					return;
+				}
+				tileIterated[i] = render_tile_reprojected(buffer, iterationField, previousField,
+					columnSource.data(), rowSource.data(), tiles[i], &tileCounters[i]);
+			});
+		}
+		else {
+			centerXDD = cpu::to_double_double(centerX);
+			centerYDD = cpu::to_double_double(centerY);
+			pool->parallel_for(tiles.size(), [this, buffer, iterationField, smoothField, &tiles, &tileCounters, &tileIterated](size_t i) {
+				if (cancel_requested()) {
+					return;
+				}
+				tileIterated[i] = render_tile(buffer, iterationField, smoothField, tiles[i], &tileCounters[i]);
+			});
+		}
+
+		// The flag stays set until the owner clears it, any tile cut short shows here
+		const bool abandoned = cancel_requested();
+
+		auto t2 = std::chrono::high_resolution_clock::now();
+		const double elapsedms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+		renderStats.frameRenderElapsedms = elapsedms;
+		renderStats.pixelCount = (uint64_t)pixelLength * pixelHeight;
+		renderStats.threadCount = pool->get_worker_count();
+		renderStats.tileCount = (uint32_t)tiles.size();
+		renderStats.tilesStolen = pool->get_tasks_stolen() - stolenBefore;
+		renderStats.simdLevel = simdLevel;
+		renderStats.precisionTier = precisionTier;
+		renderStats.progressivePass = pass;
+		renderStats.cardioidPixels = 0;
+		renderStats.periodicPixels = 0;
+		renderStats.iterationsSpent = deepIterationsSpent;
+		for (const cpu::escapeCounters &counters : tileCounters) {
+			renderStats.cardioidPixels += counters.cardioidPixels;
+			renderStats.periodicPixels += counters.periodicPixels;
+			renderStats.iterationsSpent += counters.iterationsSpent;
+		}
+		renderStats.cancelled = abandoned;
+
+		renderStats.iteratedPixels = 0;
+		for (const uint64_t iterated : tileIterated) {
+			renderStats.iteratedPixels += iterated;
+		}
+		renderStats.iteratedFraction = renderStats.pixelCount != 0 ?
+			(double)renderStats.iteratedPixels / (double)renderStats.pixelCount : 0.0;
+		renderStats.mpixPerSecond = elapsedms > 0.0 ?
+			(double)(progressive ? renderStats.iteratedPixels : renderStats.pixelCount) / (elapsedms * 1000.0) : 0.0;
+		renderStats.reusedPixels = reusedPixels;
+		renderStats.reuseRatio = renderStats.pixelCount != 0 ? (double)reusedPixels / (double)renderStats.pixelCount : 0.0;
+		const cpu::tileCacheStats cacheAfter = get_tile_cache_stats();
+		renderStats.cacheHits = cacheAfter.hits - cacheBefore.hits;
+		renderStats.cacheMisses = cacheAfter.misses - cacheBefore.misses;
+
+		// Every pixel sits at its own coordinate after a full frame or the last pass
+		if (!abandoned && precisionTier != cpu::PRECISION_TIER_PERTURBATION &&
+			(!progressive || pass + 1 == get_progressive_pass_count())) {
+			reprojectValid = true;
+			reprojectTier = precisionTier;
+			reprojectCenterX = centerX;
+			reprojectCenterY = centerY;
+			reprojectScale = scale;
+		}
+
+		// The field holds a mix of two views, smooth recolouring must not use it
+		if (abandoned) {
+			smoothFieldValid = false;
+			return ERROR_RENDER_CANCELLED;
+		}
+
+		return 0;
+	}
+
+public:
+	/*
+	 * Same contract as cuda::cudaKernel::generate_mandelbrot, renders into a
+	 *  frame owned by the caller
+	 */
+	error_t generate_mandelbrot(__inout rgbaPixel *frame)
+	{
+		return compute_image_tiled(frame);
+	}
+
+	/*
+	 * Progressive variant of generate_mandelbrot, the passes accumulate in
+	 *  progressiveBuffer and each one is copied to frame
+	 */
+	error_t generate_mandelbrot_pass(uint32_t pass, __inout rgbaPixel *frame)
+	{
+		progressiveBuffer.resize(pixelLength * pixelHeight);
+		error_t err = compute_image_pass(pass, progressiveBuffer.data());
+		if (err != 0) {
+			return err;
+		}
+
+		std::memcpy(frame, progressiveBuffer.data(), pixelBufferRawSize);
+		return 0;
+	}
+
+	/*
+	 * Colours the last frame again with the current palette, no iteration.
+	 *  Palette swaps and palette cycling go through here
+	 */
+	error_t recolour_image(__inout rgbaPixel *buffer)
+	{
+		assert(buffer != nullptr);
+		if (pool == nullptr || iterationBuffer.size() != pixelLength * pixelHeight) {
+			return -1;
+		}
+
+		const std::vector<cpu::renderTile> tiles = split_tiles();
+		const uint32_t *iterationField = iterationBuffer.data();
+		const float *smoothField = smoothFieldValid ? smoothBuffer.data() : nullptr;
+		pool->parallel_for(tiles.size(), [this, buffer, iterationField, smoothField, &tiles](size_t i) {
+			colour_tile(buffer, iterationField, smoothField, tiles[i]);
+		});
+
+		return 0;
+	}
+
+	/*
+	 * Escape time of every pixel of the last frame (maxIter + 1 = interior),
+	 *  pixelLength * pixelHeight entries
+	 */
+	const uint32_t *get_iteration_field(void) const
+	{
+		return iterationBuffer.empty() ? nullptr : iterationBuffer.data();
+	}
+
+	// Fractional escape times of the last frame, nullptr unless smooth colouring was used
+	const float *get_smooth_field(void) const
+	{
+		return smoothFieldValid ? smoothBuffer.data() : nullptr;
+	}
+
+	void set_palette(const rgbaPixel *colours, uint32_t count) { colouring.set_palette(colours, count); }
+	void set_palette_offset(uint32_t offset) { colouring.set_palette_offset(offset); }
+	uint32_t get_palette_offset(void) const { return colouring.get_palette_offset(); }
+
+	// Fractional escape times and interpolated palette, off by default (scalar kernel)
+	void set_smooth_colouring(bool val) { smoothColouring = val; }
+	bool get_smooth_colouring(void) const { return smoothColouring; }
+
+	cpu::cpuRenderStats get_render_stats(void) const { return renderStats; }
+
+	/*
+	 * True when the next full frame (the current scaleA and centre) can reuse
+	 *  the last one: same tier, a complete escape-time field, a change of scale
+	 *  within CPU_REPROJECT_MAX_RATIO and a pan that keeps part of the frame
+	 *  in view. Smooth colouring always iterates
+	 */
+	bool can_reproject(void) const
+	{
+		if (!reprojection || !reprojectValid || smoothColouring ||
+			precisionTier == cpu::PRECISION_TIER_PERTURBATION || precisionTier != reprojectTier) {
+			return false;
+		}
+
+		const double nextScale = get_pixel_scale();
+		const double ratio = nextScale > reprojectScale ? nextScale / reprojectScale : reprojectScale / nextScale;
+		if (ratio > CPU_REPROJECT_MAX_RATIO) {
+			return false;
+		}
+
+		const double shiftX = std::abs((centerX - reprojectCenterX).to_double()) / nextScale;
+		const double shiftY = std::abs((centerY - reprojectCenterY).to_double()) / nextScale;
+		return shiftX < (double)pixelLength && shiftY < (double)pixelHeight;
+	}
+
+	// Frame to frame reuse of the iteration field during a zoom, off by default
+	void set_reprojection(bool val) { reprojection = val; }
+	bool get_reprojection(void) const { return reprojection; }
+
+	/*
+	 * Keeps iterated tiles in a cpu::tileCache of byteBudget bytes (see
+	 *  TILE_CACHE_DEFAULT_BUDGET), 0 drops the cache. Off by default, frames
+	 *  then keep their exact scale and centre
+	 */
+	void set_tile_cache_budget(size_t byteBudget)
+	{
+		if (byteBudget == 0) {
+			delete cache;
+			cache = nullptr;
+			cacheFrame = false;
+			return;
+		}
+
+		if (cache == nullptr) {
+			cache = new cpu::tileCache(CPU_RENDER_TILE_SIZE, byteBudget);
+		}
+		else {
+			cache->set_byte_budget(byteBudget);
+		}
+	}
+
+	// Counters since the cache was created, all 0 without a cache
+	cpu::tileCacheStats get_tile_cache_stats(void) const
+	{
+		return cache != nullptr ? cache->get_stats() : cpu::tileCacheStats{ 0 };
+	}
+
+	/*
+	 * Frames stop at the next batch of points once *flag is set and
+	 *  return ERROR_RENDER_CANCELLED. The owner clears the flag, nullptr disables
+	 */
+	void set_cancel_flag(const std::atomic<bool> *flag) { cancel.flag = flag; }
+
+	/*
+	 * Frames stop the same way once *generation differs from frameGeneration.
+	 *  Set before every frame with the generation it is rendered for
+	 */
+	void set_cancel_generation(const std::atomic<uint64_t> *generation, uint64_t frameGeneration)
+	{
+		cancel.generation = generation;
+		cancel.frameGeneration = frameGeneration;
+	}
+
+	/*
+	 * Renders on a pool owned by the caller instead of one of its own, call
+	 *  before the first frame. Renderers sharing a pool run their frames side
+	 *  by side, the tiles of one fill the workers the other leaves idle
+	 */
+	void set_thread_pool(cpu::threadPool *shared)
+	{
+		assert(pool == nullptr && shared != nullptr);
+		pool = shared;
+		sharedPool = true;
+	}
+
+	// Pool the frames run on, created with the first frame unless shared
+	cpu::threadPool *get_thread_pool(void)
+	{
+		if (pool == nullptr) {
+			pool = new cpu::threadPool(threadCount);
+		}
+		return pool;
+	}
+
+	/*
+	 * Forces a narrower instruction set (benchmarking), levels the host does
+	 *  not support fall back to the widest supported one
+	 */
+	void set_simd_level(cpu::simd::SIMD_LEVEL level)
+	{
+		const cpu::simd::SIMD_LEVEL supported = cpu::simd::detect_simd_level();
+		simdLevel = level > supported ? supported : level;
+		escapePoints = cpu::simd::get_escape_points_kernel(simdLevel);
+		escapePointsFloat = cpu::simd::get_escape_points_kernel_float(simdLevel);
+		colouring.set_simd_level(simdLevel);
+	}
+
+	cpu::simd::SIMD_LEVEL get_simd_level(void) const { return simdLevel; }
+
+	double getOffsetX(void) const { return offsetX; }
+	double getOffsetY(void) const { return offsetY; }
+	double getScaleA(void) const { return scaleA; }
+	double getScaleB(void) const { return scaleB; }
+
+	// Complex distance between two pixels for the current scaleA
+	double get_pixel_scale(void) const { return scaleA / ((double)regionFrameLength / scaleB); }
+
+	void setOffsetX(double val) { offsetX = val; centerX = cpu::fixedPoint(val); }
+	void setOffsetY(double val) { offsetY = val; centerY = cpu::fixedPoint(val); }
+
+	/*
+	 * Moves the view by (dx, dy) without losing precision in the offset. A
+	 *  move by whole pixels (see get_pixel_scale) is reprojected exactly
+	 */
+	void offset_by(double dx, double dy)
+	{
+		centerX += cpu::fixedPoint(dx);
+		centerY += cpu::fixedPoint(dy);
+		offsetX = centerX.to_double();
+		offsetY = centerY.to_double();
+	}
+
+	void set_center(const cpu::fixedPoint &x, const cpu::fixedPoint &y)
+	{
+		centerX = x;
+		centerY = y;
+		offsetX = centerX.to_double();
+		offsetY = centerY.to_double();
+	}
+
+	const cpu::fixedPoint &get_center_x(void) const { return centerX; }
+	const cpu::fixedPoint &get_center_y(void) const { return centerY; }
+
+	void set_precision_tier(cpu::PRECISION_TIER tier) { precisionTier = tier; autoPrecision = false; }
+	cpu::PRECISION_TIER get_precision_tier(void) const { return precisionTier; }
+
+	/*
+	 * Renders the pixelLength * pixelHeight pixels from (firstColumn, firstRow)
+	 *  of a frameLength * frameHeight frame around the centre, at the scale
+	 *  of that frame (scaleA spans frameLength): every pixel is iterated at
+	 *  the coordinate it has in the whole frame (out of core bands, pyramid
+	 *  tiles and their borders)
+	 */
+	void set_frame_region(size_t frameLength, size_t frameHeight, size_t firstColumn, size_t firstRow)
+	{
+		regionFrameLength = frameLength;
+		regionFrameHeight = frameHeight;
+		regionFirstColumn = firstColumn;
+		regionFirstRow = firstRow;
+	}
+
+	// Mariani-Silver subdivision of the tiles, off by default. The last field is
+	//  not reprojected across a change, cached tiles are keyed by it
+	void set_subdivision(bool val)
+	{
+		reprojectValid = reprojectValid && val == subdivision;
+		subdivision = val;
+	}
+	bool get_subdivision(void) const { return subdivision; }
+
+	// Brent cycle detection for interior points, off by default. Same as subdivision
+	void set_periodicity_check(bool val)
+	{
+		reprojectValid = reprojectValid && val == periodicityCheck;
+		periodicityCheck = val;
+	}
+	bool get_periodicity_check(void) const { return periodicityCheck; }
+
+	// Lets every frame pick its tier from the zoom depth (cpu::select_precision_tier)
+	void set_auto_precision(bool val) { autoPrecision = val; }
+	bool get_auto_precision(void) const { return autoPrecision; }
+	void setScaleA(double val) { scaleA = val; }
+	void setScaleB(double val) { scaleB = val; }
+
 public:
 	mandelbrotFractalCpu(uint32_t iterations, float xLength, float yLength) :
 		iterations(iterations),
-		xWindowLength(xLength), yWindowLength(yLength)
+		xWindowLength(xLength), yWindowLength(yLength),
+		offsetX(0.0), offsetY(0.0),
+		centerX(0.0), centerY(0.0),
+		scaleA(1.0), scaleB(4.0), scale(1.0 / (xLength / 4.0)),
+		pixelLength((size_t)xLength), pixelHeight((size_t)yLength),
+		pixelBufferRawSize((size_t)xLength * (size_t)yLength * sizeof(rgbaPixel)),
+		regionFrameLength((size_t)xLength), regionFrameHeight((size_t)yLength),
+		regionFirstColumn(0), regionFirstRow(0),
+		threadCount(THREAD_POOL_DEFAULT_WORKERS), pool(nullptr), sharedPool(false),
+		renderStats(cpu::cpuRenderStats{ 0 }),
+		periodicityCheck(false), subdivision(false),
+		precisionTier(cpu::PRECISION_TIER_DOUBLE), autoPrecision(false), perturbation(nullptr),
+		smoothColouring(false), smoothFieldValid(false),
+		colouring(cpu::cpuPixelColour, 16, iterations),
+		reprojection(false), reprojectValid(false), reprojectTier(cpu::PRECISION_TIER_DOUBLE),
+		reprojectScale(0.0),
+		cache(nullptr), cacheFrame(false), gridSnapX(0.0), gridSnapY(0.0), gridColumn(0), gridRow(0),
+		cancel(frameCancel{ nullptr, nullptr, 0 })
 	{
+		set_simd_level(cpu::simd::detect_simd_level());
+	}
 
+	// Constructor for the tiled renderer, view parameters match cuda::cudaKernel
+	mandelbrotFractalCpu(double offsetX, double offsetY, size_t pixelLength, size_t pixelHeight,
+		double scaleA, double scaleB, uint32_t iterations, uint32_t threadCount) :
+		iterations(iterations),
+		xWindowLength((float)pixelLength), yWindowLength((float)pixelHeight),
+		offsetX(offsetX), offsetY(offsetY),
+		centerX(offsetX), centerY(offsetY),
+		scaleA(scaleA), scaleB(scaleB), scale(scaleA / (pixelLength / scaleB)),
+		pixelLength(pixelLength), pixelHeight(pixelHeight),
+		pixelBufferRawSize(pixelLength * pixelHeight * sizeof(rgbaPixel)),
+		regionFrameLength(pixelLength), regionFrameHeight(pixelHeight),
+		regionFirstColumn(0), regionFirstRow(0),
+		threadCount(threadCount), pool(nullptr), sharedPool(false),
+		renderStats(cpu::cpuRenderStats{ 0 }),
+		periodicityCheck(false), subdivision(false),
+		precisionTier(cpu::PRECISION_TIER_DOUBLE), autoPrecision(false), perturbation(nullptr),
+		smoothColouring(false), smoothFieldValid(false),
+		colouring(cpu::cpuPixelColour, 16, iterations),
+		reprojection(false), reprojectValid(false), reprojectTier(cpu::PRECISION_TIER_DOUBLE),
+		reprojectScale(0.0),
+		cache(nullptr), cacheFrame(false), gridSnapX(0.0), gridSnapY(0.0), gridColumn(0), gridRow(0),
+		cancel(frameCancel{ nullptr, nullptr, 0 })
+	{
+		set_simd_level(cpu::simd::detect_simd_level());
 	}
 
 	~mandelbrotFractalCpu()
 	{
-
+		if (perturbation != nullptr) {
+			delete perturbation;
+		}
+		if (cache != nullptr) {
+			delete cache;
+		}
+		if (pool != nullptr && !sharedPool) {
+			delete pool;
+		}
 	}
 };
 
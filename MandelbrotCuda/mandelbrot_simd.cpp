@@ -0,0 +1,588 @@
+#include "mandelbrot_simd.h"
+#include "escape_time.h"
+
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIMD_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif //_MSC_VER
+#endif //_M_X64 || __x86_64__
+
+// MSVC compiles any intrinsic without flags, GCC/Clang need a per-function target
+#if defined(_MSC_VER)
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif //_MSC_VER
+
+// AVX-512 implies FMA on GCC, a fused mul+add would no longer match cpu::escape_time
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif //__GNUC__
+
+using namespace cpu::simd;
+
+static inline uint32_t count_bits(uint32_t bits)
+{
+	uint32_t count = 0;
+	for (; bits != 0; bits &= bits - 1) {
+		count++;
+	}
+	return count;
+}
+
+static void escape_points_scalar(const double *x, const double *y,
+	uint32_t count, uint32_t maxIter, double periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	for (uint32_t k = 0; k < count; k++) {
+		out[k] = cpu::escape_time_checked<double>(x[k], y[k], maxIter, periodEpsilon, counters);
+	}
+}
+
+static void escape_points_scalar_float(const float *x, const float *y,
+	uint32_t count, uint32_t maxIter, float periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	for (uint32_t k = 0; k < count; k++) {
+		out[k] = cpu::escape_time_checked<float>(x[k], y[k], maxIter, periodEpsilon, counters);
+	}
+}
+
+/*
+ * Every vector kernel follows escape_time_checked: lanes inside the cardioid
+ *  or bulb start finished at maxIter + 1, then the orbit is iterated with the
+ *  lanes that escaped masked off. Brent's saved point is refreshed on the same
+ *  iterations for all lanes, since they all start together
+ */
+#if defined(SIMD_X86_64)
+SIMD_TARGET("sse2")
+static void escape_points_sse2(const double *x, const double *y,
+	uint32_t count, uint32_t maxIter, double periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m128d four = _mm_set1_pd(4.0);
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d quarter = _mm_set1_pd(0.25);
+	const __m128d sixteenth = _mm_set1_pd(0.0625);
+	const __m128d signBit = _mm_set1_pd(-0.0);
+	const __m128d veps = _mm_set1_pd(periodEpsilon);
+	const __m128i interior = _mm_set1_epi64x((int64_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0;
+
+	uint32_t k = 0;
+	for (; k + 2 <= count; k += 2) {
+		const __m128d vx = _mm_loadu_pd(&x[k]);
+		const __m128d vy = _mm_loadu_pd(&y[k]);
+		const __m128d vy2 = _mm_mul_pd(vy, vy);
+
+		const __m128d xq = _mm_sub_pd(vx, quarter);
+		const __m128d q = _mm_add_pd(_mm_mul_pd(xq, xq), vy2);
+		const __m128d xb = _mm_add_pd(vx, one);
+		const __m128d inside = _mm_or_pd(
+			_mm_cmplt_pd(_mm_mul_pd(q, _mm_add_pd(q, xq)), _mm_mul_pd(quarter, vy2)),
+			_mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(xb, xb), vy2), sixteenth));
+		counters->cardioidPixels += count_bits(_mm_movemask_pd(inside));
+
+		__m128d zx = _mm_setzero_pd(), zy = _mm_setzero_pd();
+		__m128d zx2 = _mm_setzero_pd(), zy2 = _mm_setzero_pd();
+		__m128d savedX = _mm_setzero_pd(), savedY = _mm_setzero_pd();
+		__m128d active = _mm_andnot_pd(inside, _mm_cmpeq_pd(zx, zx));
+		__m128i iter = _mm_and_si128(_mm_castpd_si128(inside), interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && _mm_movemask_pd(active) != 0; i++) {
+			zy = _mm_add_pd(_mm_mul_pd(_mm_add_pd(zx, zx), zy), vy);
+			zx = _mm_add_pd(_mm_sub_pd(zx2, zy2), vx);
+			zx2 = _mm_mul_pd(zx, zx);
+			zy2 = _mm_mul_pd(zy, zy);
+
+			// Active lanes are all ones (-1), subtracting counts them
+			iter = _mm_sub_epi64(iter, _mm_castpd_si128(active));
+			active = _mm_and_pd(active, _mm_cmplt_pd(_mm_add_pd(zx2, zy2), four));
+
+			if (periodic && i < maxIter) {
+				const __m128d dx = _mm_andnot_pd(signBit, _mm_sub_pd(zx, savedX));
+				const __m128d dy = _mm_andnot_pd(signBit, _mm_sub_pd(zy, savedY));
+				const __m128d cycle = _mm_and_pd(active, _mm_and_pd(_mm_cmplt_pd(dx, veps), _mm_cmplt_pd(dy, veps)));
+				const int32_t cycleBits = _mm_movemask_pd(cycle);
+				if (cycleBits != 0) {
+					counters->periodicPixels += count_bits(cycleBits);
+					iter = _mm_or_si128(_mm_andnot_si128(_mm_castpd_si128(cycle), iter),
+						_mm_and_si128(_mm_castpd_si128(cycle), interior));
+					active = _mm_andnot_pd(cycle, active);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		alignas(16) int64_t lane[2];
+		_mm_store_si128((__m128i *)lane, iter);
+		out[k] = (uint32_t)lane[0];
+		out[k + 1] = (uint32_t)lane[1];
+	}
+
+	escape_points_scalar(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+
+SIMD_TARGET("avx2")
+static void escape_points_avx2(const double *x, const double *y,
+	uint32_t count, uint32_t maxIter, double periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m256d four = _mm256_set1_pd(4.0);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	const __m256d sixteenth = _mm256_set1_pd(0.0625);
+	const __m256d signBit = _mm256_set1_pd(-0.0);
+	const __m256d veps = _mm256_set1_pd(periodEpsilon);
+	const __m256i interior = _mm256_set1_epi64x((int64_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0;
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		const __m256d vx = _mm256_loadu_pd(&x[k]);
+		const __m256d vy = _mm256_loadu_pd(&y[k]);
+		const __m256d vy2 = _mm256_mul_pd(vy, vy);
+
+		const __m256d xq = _mm256_sub_pd(vx, quarter);
+		const __m256d q = _mm256_add_pd(_mm256_mul_pd(xq, xq), vy2);
+		const __m256d xb = _mm256_add_pd(vx, one);
+		const __m256d inside = _mm256_or_pd(
+			_mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)), _mm256_mul_pd(quarter, vy2), _CMP_LT_OQ),
+			_mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), vy2), sixteenth, _CMP_LT_OQ));
+		counters->cardioidPixels += count_bits(_mm256_movemask_pd(inside));
+
+		__m256d zx = _mm256_setzero_pd(), zy = _mm256_setzero_pd();
+		__m256d zx2 = _mm256_setzero_pd(), zy2 = _mm256_setzero_pd();
+		__m256d savedX = _mm256_setzero_pd(), savedY = _mm256_setzero_pd();
+		__m256d active = _mm256_andnot_pd(inside, _mm256_cmp_pd(zx, zx, _CMP_EQ_OQ));
+		__m256i iter = _mm256_and_si256(_mm256_castpd_si256(inside), interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && _mm256_movemask_pd(active) != 0; i++) {
+			zy = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(zx, zx), zy), vy);
+			zx = _mm256_add_pd(_mm256_sub_pd(zx2, zy2), vx);
+			zx2 = _mm256_mul_pd(zx, zx);
+			zy2 = _mm256_mul_pd(zy, zy);
+
+			iter = _mm256_sub_epi64(iter, _mm256_castpd_si256(active));
+			active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(zx2, zy2), four, _CMP_LT_OQ));
+
+			if (periodic && i < maxIter) {
+				const __m256d dx = _mm256_andnot_pd(signBit, _mm256_sub_pd(zx, savedX));
+				const __m256d dy = _mm256_andnot_pd(signBit, _mm256_sub_pd(zy, savedY));
+				const __m256d cycle = _mm256_and_pd(active, _mm256_and_pd(
+					_mm256_cmp_pd(dx, veps, _CMP_LT_OQ), _mm256_cmp_pd(dy, veps, _CMP_LT_OQ)));
+				const int32_t cycleBits = _mm256_movemask_pd(cycle);
+				if (cycleBits != 0) {
+					counters->periodicPixels += count_bits(cycleBits);
+					iter = _mm256_blendv_epi8(iter, interior, _mm256_castpd_si256(cycle));
+					active = _mm256_andnot_pd(cycle, active);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		alignas(32) int64_t lane[4];
+		_mm256_store_si256((__m256i *)lane, iter);
+		for (uint32_t l = 0; l < 4; l++) {
+			out[k + l] = (uint32_t)lane[l];
+		}
+	}
+
+	escape_points_scalar(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+
+SIMD_TARGET("avx512f")
+static void escape_points_avx512(const double *x, const double *y,
+	uint32_t count, uint32_t maxIter, double periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m512d four = _mm512_set1_pd(4.0);
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	const __m512d sixteenth = _mm512_set1_pd(0.0625);
+	const __m512d veps = _mm512_set1_pd(periodEpsilon);
+	const __m512i increment = _mm512_set1_epi64(1);
+	const __m512i interior = _mm512_set1_epi64((int64_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0;
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		const __m512d vx = _mm512_loadu_pd(&x[k]);
+		const __m512d vy = _mm512_loadu_pd(&y[k]);
+		const __m512d vy2 = _mm512_mul_pd(vy, vy);
+
+		const __m512d xq = _mm512_sub_pd(vx, quarter);
+		const __m512d q = _mm512_add_pd(_mm512_mul_pd(xq, xq), vy2);
+		const __m512d xb = _mm512_add_pd(vx, one);
+		const __mmask8 inside =
+			_mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, xq)), _mm512_mul_pd(quarter, vy2), _CMP_LT_OQ) |
+			_mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(xb, xb), vy2), sixteenth, _CMP_LT_OQ);
+		counters->cardioidPixels += count_bits(inside);
+
+		__m512d zx = _mm512_setzero_pd(), zy = _mm512_setzero_pd();
+		__m512d zx2 = _mm512_setzero_pd(), zy2 = _mm512_setzero_pd();
+		__m512d savedX = _mm512_setzero_pd(), savedY = _mm512_setzero_pd();
+		__mmask8 active = (__mmask8)~inside;
+		__m512i iter = _mm512_maskz_mov_epi64(inside, interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && active != 0; i++) {
+			zy = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(zx, zx), zy), vy);
+			zx = _mm512_add_pd(_mm512_sub_pd(zx2, zy2), vx);
+			zx2 = _mm512_mul_pd(zx, zx);
+			zy2 = _mm512_mul_pd(zy, zy);
+
+			iter = _mm512_mask_add_epi64(iter, active, iter, increment);
+			active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(zx2, zy2), four, _CMP_LT_OQ);
+
+			if (periodic && i < maxIter) {
+				__mmask8 cycle = _mm512_mask_cmp_pd_mask(active, _mm512_abs_pd(_mm512_sub_pd(zx, savedX)), veps, _CMP_LT_OQ);
+				cycle = _mm512_mask_cmp_pd_mask(cycle, _mm512_abs_pd(_mm512_sub_pd(zy, savedY)), veps, _CMP_LT_OQ);
+				if (cycle != 0) {
+					counters->periodicPixels += count_bits(cycle);
+					iter = _mm512_mask_mov_epi64(iter, cycle, interior);
+					active = (__mmask8)(active & ~cycle);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		alignas(64) int64_t lane[8];
+		_mm512_store_si512((void *)lane, iter);
+		for (uint32_t l = 0; l < 8; l++) {
+			out[k + l] = (uint32_t)lane[l];
+		}
+	}
+
+	escape_points_scalar(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+
+SIMD_TARGET("sse2")
+static void escape_points_sse2_float(const float *x, const float *y,
+	uint32_t count, uint32_t maxIter, float periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	const __m128 sixteenth = _mm_set1_ps(0.0625f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 veps = _mm_set1_ps(periodEpsilon);
+	const __m128i interior = _mm_set1_epi32((int32_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0f;
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		const __m128 vx = _mm_loadu_ps(&x[k]);
+		const __m128 vy = _mm_loadu_ps(&y[k]);
+		const __m128 vy2 = _mm_mul_ps(vy, vy);
+
+		const __m128 xq = _mm_sub_ps(vx, quarter);
+		const __m128 q = _mm_add_ps(_mm_mul_ps(xq, xq), vy2);
+		const __m128 xb = _mm_add_ps(vx, one);
+		const __m128 inside = _mm_or_ps(
+			_mm_cmplt_ps(_mm_mul_ps(q, _mm_add_ps(q, xq)), _mm_mul_ps(quarter, vy2)),
+			_mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(xb, xb), vy2), sixteenth));
+		counters->cardioidPixels += count_bits(_mm_movemask_ps(inside));
+
+		__m128 zx = _mm_setzero_ps(), zy = _mm_setzero_ps();
+		__m128 zx2 = _mm_setzero_ps(), zy2 = _mm_setzero_ps();
+		__m128 savedX = _mm_setzero_ps(), savedY = _mm_setzero_ps();
+		__m128 active = _mm_andnot_ps(inside, _mm_cmpeq_ps(zx, zx));
+		__m128i iter = _mm_and_si128(_mm_castps_si128(inside), interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && _mm_movemask_ps(active) != 0; i++) {
+			zy = _mm_add_ps(_mm_mul_ps(_mm_add_ps(zx, zx), zy), vy);
+			zx = _mm_add_ps(_mm_sub_ps(zx2, zy2), vx);
+			zx2 = _mm_mul_ps(zx, zx);
+			zy2 = _mm_mul_ps(zy, zy);
+
+			iter = _mm_sub_epi32(iter, _mm_castps_si128(active));
+			active = _mm_and_ps(active, _mm_cmplt_ps(_mm_add_ps(zx2, zy2), four));
+
+			if (periodic && i < maxIter) {
+				const __m128 dx = _mm_andnot_ps(signBit, _mm_sub_ps(zx, savedX));
+				const __m128 dy = _mm_andnot_ps(signBit, _mm_sub_ps(zy, savedY));
+				const __m128 cycle = _mm_and_ps(active, _mm_and_ps(_mm_cmplt_ps(dx, veps), _mm_cmplt_ps(dy, veps)));
+				const int32_t cycleBits = _mm_movemask_ps(cycle);
+				if (cycleBits != 0) {
+					counters->periodicPixels += count_bits(cycleBits);
+					iter = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(cycle), iter),
+						_mm_and_si128(_mm_castps_si128(cycle), interior));
+					active = _mm_andnot_ps(cycle, active);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		_mm_storeu_si128((__m128i *)&out[k], iter);
+	}
+
+	escape_points_scalar_float(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+
+SIMD_TARGET("avx2")
+static void escape_points_avx2_float(const float *x, const float *y,
+	uint32_t count, uint32_t maxIter, float periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const __m256 sixteenth = _mm256_set1_ps(0.0625f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 veps = _mm256_set1_ps(periodEpsilon);
+	const __m256i interior = _mm256_set1_epi32((int32_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0f;
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		const __m256 vx = _mm256_loadu_ps(&x[k]);
+		const __m256 vy = _mm256_loadu_ps(&y[k]);
+		const __m256 vy2 = _mm256_mul_ps(vy, vy);
+
+		const __m256 xq = _mm256_sub_ps(vx, quarter);
+		const __m256 q = _mm256_add_ps(_mm256_mul_ps(xq, xq), vy2);
+		const __m256 xb = _mm256_add_ps(vx, one);
+		const __m256 inside = _mm256_or_ps(
+			_mm256_cmp_ps(_mm256_mul_ps(q, _mm256_add_ps(q, xq)), _mm256_mul_ps(quarter, vy2), _CMP_LT_OQ),
+			_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(xb, xb), vy2), sixteenth, _CMP_LT_OQ));
+		counters->cardioidPixels += count_bits(_mm256_movemask_ps(inside));
+
+		__m256 zx = _mm256_setzero_ps(), zy = _mm256_setzero_ps();
+		__m256 zx2 = _mm256_setzero_ps(), zy2 = _mm256_setzero_ps();
+		__m256 savedX = _mm256_setzero_ps(), savedY = _mm256_setzero_ps();
+		__m256 active = _mm256_andnot_ps(inside, _mm256_cmp_ps(zx, zx, _CMP_EQ_OQ));
+		__m256i iter = _mm256_and_si256(_mm256_castps_si256(inside), interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && _mm256_movemask_ps(active) != 0; i++) {
+			zy = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(zx, zx), zy), vy);
+			zx = _mm256_add_ps(_mm256_sub_ps(zx2, zy2), vx);
+			zx2 = _mm256_mul_ps(zx, zx);
+			zy2 = _mm256_mul_ps(zy, zy);
+
+			iter = _mm256_sub_epi32(iter, _mm256_castps_si256(active));
+			active = _mm256_and_ps(active, _mm256_cmp_ps(_mm256_add_ps(zx2, zy2), four, _CMP_LT_OQ));
+
+			if (periodic && i < maxIter) {
+				const __m256 dx = _mm256_andnot_ps(signBit, _mm256_sub_ps(zx, savedX));
+				const __m256 dy = _mm256_andnot_ps(signBit, _mm256_sub_ps(zy, savedY));
+				const __m256 cycle = _mm256_and_ps(active, _mm256_and_ps(
+					_mm256_cmp_ps(dx, veps, _CMP_LT_OQ), _mm256_cmp_ps(dy, veps, _CMP_LT_OQ)));
+				const int32_t cycleBits = _mm256_movemask_ps(cycle);
+				if (cycleBits != 0) {
+					counters->periodicPixels += count_bits(cycleBits);
+					iter = _mm256_blendv_epi8(iter, interior, _mm256_castps_si256(cycle));
+					active = _mm256_andnot_ps(cycle, active);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		_mm256_storeu_si256((__m256i *)&out[k], iter);
+	}
+
+	escape_points_scalar_float(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+
+SIMD_TARGET("avx512f")
+static void escape_points_avx512_float(const float *x, const float *y,
+	uint32_t count, uint32_t maxIter, float periodEpsilon,
+	__inout cpu::escapeCounters *counters, __inout uint32_t *out)
+{
+	const __m512 four = _mm512_set1_ps(4.0f);
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 quarter = _mm512_set1_ps(0.25f);
+	const __m512 sixteenth = _mm512_set1_ps(0.0625f);
+	const __m512 veps = _mm512_set1_ps(periodEpsilon);
+	const __m512i increment = _mm512_set1_epi32(1);
+	const __m512i interior = _mm512_set1_epi32((int32_t)maxIter + 1);
+	const bool periodic = periodEpsilon > 0.0f;
+
+	uint32_t k = 0;
+	for (; k + 16 <= count; k += 16) {
+		const __m512 vx = _mm512_loadu_ps(&x[k]);
+		const __m512 vy = _mm512_loadu_ps(&y[k]);
+		const __m512 vy2 = _mm512_mul_ps(vy, vy);
+
+		const __m512 xq = _mm512_sub_ps(vx, quarter);
+		const __m512 q = _mm512_add_ps(_mm512_mul_ps(xq, xq), vy2);
+		const __m512 xb = _mm512_add_ps(vx, one);
+		const __mmask16 inside =
+			_mm512_cmp_ps_mask(_mm512_mul_ps(q, _mm512_add_ps(q, xq)), _mm512_mul_ps(quarter, vy2), _CMP_LT_OQ) |
+			_mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(xb, xb), vy2), sixteenth, _CMP_LT_OQ);
+		counters->cardioidPixels += count_bits(inside);
+
+		__m512 zx = _mm512_setzero_ps(), zy = _mm512_setzero_ps();
+		__m512 zx2 = _mm512_setzero_ps(), zy2 = _mm512_setzero_ps();
+		__m512 savedX = _mm512_setzero_ps(), savedY = _mm512_setzero_ps();
+		__mmask16 active = (__mmask16)~inside;
+		__m512i iter = _mm512_maskz_mov_epi32(inside, interior);
+		uint32_t power = 1, lambda = 0;
+
+		for (uint32_t i = 0; i <= maxIter && active != 0; i++) {
+			zy = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(zx, zx), zy), vy);
+			zx = _mm512_add_ps(_mm512_sub_ps(zx2, zy2), vx);
+			zx2 = _mm512_mul_ps(zx, zx);
+			zy2 = _mm512_mul_ps(zy, zy);
+
+			iter = _mm512_mask_add_epi32(iter, active, iter, increment);
+			active = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(zx2, zy2), four, _CMP_LT_OQ);
+
+			if (periodic && i < maxIter) {
+				__mmask16 cycle = _mm512_mask_cmp_ps_mask(active, _mm512_abs_ps(_mm512_sub_ps(zx, savedX)), veps, _CMP_LT_OQ);
+				cycle = _mm512_mask_cmp_ps_mask(cycle, _mm512_abs_ps(_mm512_sub_ps(zy, savedY)), veps, _CMP_LT_OQ);
+				if (cycle != 0) {
+					counters->periodicPixels += count_bits(cycle);
+					iter = _mm512_mask_mov_epi32(iter, cycle, interior);
+					active = (__mmask16)(active & ~cycle);
+				}
+
+				if (++lambda == power) {
+					savedX = zx;
+					savedY = zy;
+					power <<= 1;
+					lambda = 0;
+				}
+			}
+		}
+
+		_mm512_storeu_si512((void *)&out[k], iter);
+	}
+
+	escape_points_scalar_float(&x[k], &y[k], count - k, maxIter, periodEpsilon, counters, &out[k]);
+}
+#endif //SIMD_X86_64
+
+SIMD_LEVEL cpu::simd::detect_simd_level(void)
+{
+#if defined(SIMD_X86_64)
+#if defined(_MSC_VER)
+	int info[4] = { 0 };
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) {
+		return SIMD_LEVEL_SSE2;
+	}
+
+	// The OS has to save the YMM (and ZMM) state on context switches
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6) {
+		return SIMD_LEVEL_AVX512;
+	}
+	if ((info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6) {
+		return SIMD_LEVEL_AVX2;
+	}
+	return SIMD_LEVEL_SSE2;
+#else //_MSC_VER
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SIMD_LEVEL_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return SIMD_LEVEL_AVX2;
+	}
+	return SIMD_LEVEL_SSE2;
+#endif //_MSC_VER
+#else //SIMD_X86_64
+	return SIMD_LEVEL_SCALAR;
+#endif //SIMD_X86_64
+}
+
+escapePointsKernel cpu::simd::get_escape_points_kernel(SIMD_LEVEL level)
+{
+	const SIMD_LEVEL supported = detect_simd_level();
+	if (level > supported) {
+		level = supported;
+	}
+
+	switch (level) {
+#if defined(SIMD_X86_64)
+	case SIMD_LEVEL_AVX512:
+		return escape_points_avx512;
+	case SIMD_LEVEL_AVX2:
+		return escape_points_avx2;
+	case SIMD_LEVEL_SSE2:
+		return escape_points_sse2;
+#endif //SIMD_X86_64
+	default:
+		return escape_points_scalar;
+	}
+}
+
+escapePointsKernelFloat cpu::simd::get_escape_points_kernel_float(SIMD_LEVEL level)
+{
+	const SIMD_LEVEL supported = detect_simd_level();
+	if (level > supported) {
+		level = supported;
+	}
+
+	switch (level) {
+#if defined(SIMD_X86_64)
+	case SIMD_LEVEL_AVX512:
+		return escape_points_avx512_float;
+	case SIMD_LEVEL_AVX2:
+		return escape_points_avx2_float;
+	case SIMD_LEVEL_SSE2:
+		return escape_points_sse2_float;
+#endif //SIMD_X86_64
+	default:
+		return escape_points_scalar_float;
+	}
+}
+
+const char *cpu::simd::get_simd_level_name(SIMD_LEVEL level)
+{
+	switch (level) {
+	case SIMD_LEVEL_SSE2:
+		return "SSE2";
+	case SIMD_LEVEL_AVX2:
+		return "AVX2";
+	case SIMD_LEVEL_AVX512:
+		return "AVX-512";
+	default:
+		return "scalar";
+	}
+}
+
+//EOF
\ No newline at end of file
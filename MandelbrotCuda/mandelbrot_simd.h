@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "types.h"
+#include "escape_time.h"
+
+/*
+ * Vectorized escape-time kernels for the CPU renderer
+ *  Each kernel iterates a batch of pixels, 2 (SSE2), 4 (AVX2) or 8 (AVX-512)
+ *  doubles per vector (twice as many floats for the float tier), with lanes
+ *  that escaped masked off. Results are bit-identical to cpu::escape_time.
+ *  The pixels do not have to be on the same row, so subdivision borders and
+ *  columns vectorize as well as full rows. The widest instruction set the
+ *  host supports is picked at runtime, intrinsics are kept out of this header
+ *  so it can be included from nvcc compiled units.
+ */
+
+namespace cpu {
+	namespace simd {
+		typedef enum {
+			SIMD_LEVEL_SCALAR,
+			SIMD_LEVEL_SSE2,
+			SIMD_LEVEL_AVX2,
+			SIMD_LEVEL_AVX512
+		} SIMD_LEVEL;
+
+		/*
+		 * Computes count pixels located at (x[k], y[k]) and writes the escape
+		 *  time of each to out. Same result as cpu::escape_time_checked,
+		 *  periodEpsilon <= 0 disables the periodicity check, early exits are
+		 *  added to counters
+		 */
+		typedef void (*escapePointsKernel)(const double *x, const double *y,
+			uint32_t count, uint32_t maxIter, double periodEpsilon,
+			__inout escapeCounters *counters, __inout uint32_t *out);
+
+		typedef void (*escapePointsKernelFloat)(const float *x, const float *y,
+			uint32_t count, uint32_t maxIter, float periodEpsilon,
+			__inout escapeCounters *counters, __inout uint32_t *out);
+
+		/*
+		 * Widest instruction set supported by both the CPU and the OS
+		 */
+		SIMD_LEVEL detect_simd_level(void);
+
+		/*
+		 * Returns the kernel for level (or the widest supported one below it)
+		 */
+		escapePointsKernel get_escape_points_kernel(SIMD_LEVEL level);
+		escapePointsKernelFloat get_escape_points_kernel_float(SIMD_LEVEL level);
+
+		const char *get_simd_level_name(SIMD_LEVEL level);
+	}
+}
+
+//EOF
\ No newline at end of file
@@ -0,0 +1,344 @@
+#pragma once
+
+#if defined(_WIN32)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif //NOMINMAX
+#include <Windows.h>
+#else //_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif //_WIN32
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <cstring>
+
+#include "types.h"
+#include "ppm.h"
+
+/*
+ * Images larger than memory
+ *  The output file is created at its final size and mapped one band of rows
+ *  at a time. Rows are written straight into the mapping, releasing a band
+ *  flushes its pages and unmaps them, so the resident part of the file never
+ *  exceeds one band whatever the size of the image. Existing files are
+ *  opened the same way, read only, to map what they hold (iteration_file.h).
+ */
+
+namespace frame {
+	class mappedFile {
+	private:
+#if defined(_WIN32)
+		HANDLE fileHandle, mappingHandle;
+#else //_WIN32
+		int fd;
+#endif //_WIN32
+		uint64_t size;
+		bool writable;
+
+		// The view is mapped from an aligned offset, data is the byte asked for
+		uint8_t *view, *data;
+		size_t viewLength;
+
+	public:
+		// Mapping offsets are multiples of this
+		static size_t get_map_granularity(void)
+		{
+#if defined(_WIN32)
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return (size_t)info.dwAllocationGranularity;
+#else //_WIN32
+			return (size_t)sysconf(_SC_PAGESIZE);
+#endif //_WIN32
+		}
+
+		/*
+		 * Creates (or truncates) filename and reserves size bytes on disk
+		 */
+		error_t create(const std::string &filename, uint64_t size)
+		{
+			if (is_open() || size == 0) {
+				return -1;
+			}
+
+#if defined(_WIN32)
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE) {
+				return -1;
+			}
+
+			LARGE_INTEGER end;
+			end.QuadPart = (LONGLONG)size;
+			if (!SetFilePointerEx(fileHandle, end, NULL, FILE_BEGIN) || !SetEndOfFile(fileHandle)) {
+				close();
+				return -1;
+			}
+
+			mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READWRITE,
+				(DWORD)(size >> 32), (DWORD)(size & 0xffffffff), NULL);
+			if (mappingHandle == NULL) {
+				close();
+				return -1;
+			}
+#else //_WIN32
+			fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0) {
+				return -1;
+			}
+
+			// Sparse when the file system cannot reserve the blocks
+			if (posix_fallocate(fd, 0, (off_t)size) != 0 && ftruncate(fd, (off_t)size) != 0) {
+				close();
+				return -1;
+			}
+#endif //_WIN32
+
+			this->size = size;
+			writable = true;
+			return 0;
+		}
+
+		/*
+		 * Opens an existing file, read only unless writable
+		 */
+		error_t open(const std::string &filename, bool writable)
+		{
+			if (is_open()) {
+				return -1;
+			}
+
+			uint64_t fileSize = 0;
+#if defined(_WIN32)
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE) {
+				return -1;
+			}
+
+			LARGE_INTEGER length;
+			if (!GetFileSizeEx(fileHandle, &length) || length.QuadPart == 0) {
+				close();
+				return -1;
+			}
+			fileSize = (uint64_t)length.QuadPart;
+
+			mappingHandle = CreateFileMappingA(fileHandle, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+			if (mappingHandle == NULL) {
+				close();
+				return -1;
+			}
+#else //_WIN32
+			fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+			if (fd < 0) {
+				return -1;
+			}
+
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+				close();
+				return -1;
+			}
+			fileSize = (uint64_t)info.st_size;
+#endif //_WIN32
+
+			this->size = fileSize;
+			this->writable = writable;
+			return 0;
+		}
+
+		/*
+		 * Maps length bytes from offset, an earlier view is released first.
+		 *  nullptr on failure
+		 */
+		uint8_t *map(uint64_t offset, size_t length)
+		{
+			if (!is_open() || length == 0 || offset + length > size || unmap() != 0) {
+				return nullptr;
+			}
+
+			const uint64_t aligned = offset - offset % get_map_granularity();
+			const size_t alignedLength = length + (size_t)(offset - aligned);
+#if defined(_WIN32)
+			void *mapped = MapViewOfFile(mappingHandle, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+				(DWORD)(aligned >> 32), (DWORD)(aligned & 0xffffffff), alignedLength);
+			if (mapped == NULL) {
+				return nullptr;
+			}
+#else //_WIN32
+			void *mapped = mmap(nullptr, alignedLength, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+				fd, (off_t)aligned);
+			if (mapped == MAP_FAILED) {
+				return nullptr;
+			}
+#endif //_WIN32
+
+			view = (uint8_t *)mapped;
+			viewLength = alignedLength;
+			data = view + (offset - aligned);
+			return data;
+		}
+
+		/*
+		 * Starts writing the view back and unmaps it, its pages leave the
+		 *  working set
+		 */
+		error_t unmap(void)
+		{
+			if (view == nullptr) {
+				return 0;
+			}
+
+			bool ok = true;
+#if defined(_WIN32)
+			ok = (!writable || FlushViewOfFile(view, 0)) && ok;
+			ok = UnmapViewOfFile(view) && ok;
+#else //_WIN32
+			ok = (!writable || msync(view, viewLength, MS_ASYNC) == 0) && ok;
+			ok = munmap(view, viewLength) == 0 && ok;
+#endif //_WIN32
+			view = data = nullptr;
+			viewLength = 0;
+
+			return ok ? 0 : -1;
+		}
+
+		error_t close(void)
+		{
+			error_t err = unmap();
+#if defined(_WIN32)
+			if (mappingHandle != NULL) {
+				CloseHandle(mappingHandle);
+				mappingHandle = NULL;
+			}
+			if (fileHandle != INVALID_HANDLE_VALUE) {
+				CloseHandle(fileHandle);
+				fileHandle = INVALID_HANDLE_VALUE;
+			}
+#else //_WIN32
+			if (fd >= 0) {
+				if (::close(fd) != 0) {
+					err = -1;
+				}
+				fd = -1;
+			}
+#endif //_WIN32
+			size = 0;
+			writable = false;
+			return err;
+		}
+
+		bool is_open(void) const
+		{
+#if defined(_WIN32)
+			return fileHandle != INVALID_HANDLE_VALUE;
+#else //_WIN32
+			return fd >= 0;
+#endif //_WIN32
+		}
+
+		uint64_t get_size(void) const { return size; }
+
+	public:
+		mappedFile(void) :
+#if defined(_WIN32)
+			fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL),
+#else //_WIN32
+			fd(-1),
+#endif //_WIN32
+			size(0), writable(false), view(nullptr), data(nullptr), viewLength(0)
+		{
+
+		}
+
+		~mappedFile(void)
+		{
+			close();
+		}
+
+		mappedFile(const mappedFile &) = delete;
+		mappedFile &operator=(const mappedFile &) = delete;
+	};
+
+	/*
+	 * Netpbm or raw image file (see ppm::get_header) written by bands of rows
+	 *  through a mappedFile. P3 has rows of varying length and is not supported
+	 */
+	class mappedImage {
+	private:
+		mappedFile file;
+
+		ppm::PPM_FORMAT format;
+		uint32_t width, height;
+		uint32_t maxVal;
+		uint64_t headerBytes;
+
+	public:
+		error_t create(const std::string &filename, ppm::PPM_FORMAT format, uint32_t width, uint32_t height,
+			uint32_t maxVal = 255)
+		{
+			if (format == ppm::PPM_FORMAT_P3 || width == 0 || height == 0) {
+				return -1;
+			}
+
+			this->format = format;
+			this->width = width;
+			this->height = height;
+			this->maxVal = maxVal;
+
+			const std::string header = ppm::get_header(format, width, height, maxVal);
+			headerBytes = header.size();
+			if (file.create(filename, headerBytes + (uint64_t)get_row_bytes() * height) != 0) {
+				return -1;
+			}
+
+			if (headerBytes != 0) {
+				uint8_t *out = file.map(0, (size_t)headerBytes);
+				if (out == nullptr) {
+					return -1;
+				}
+				std::memcpy(out, header.data(), header.size());
+			}
+
+			return file.unmap();
+		}
+
+		// Bytes of one row in the file
+		size_t get_row_bytes(void) const { return (size_t)width * ppm::get_pixel_bytes(format, maxVal); }
+
+		/*
+		 * Maps rows first .. first + count - 1, get_row_bytes() apart. The band
+		 *  mapped before is released
+		 */
+		uint8_t *map_rows(uint32_t first, uint32_t count)
+		{
+			if (first + count > height) {
+				return nullptr;
+			}
+			return file.map(headerBytes + (uint64_t)first * get_row_bytes(), (size_t)count * get_row_bytes());
+		}
+
+		// Flushes and unmaps the band
+		error_t release_rows(void) { return file.unmap(); }
+
+		error_t close(void) { return file.close(); }
+
+		ppm::PPM_FORMAT get_format(void) const { return format; }
+		uint32_t get_width(void) const { return width; }
+		uint32_t get_height(void) const { return height; }
+
+	public:
+		mappedImage(void) :
+			format(ppm::PPM_FORMAT_P6), width(0), height(0), maxVal(255), headerBytes(0)
+		{
+
+		}
+	};
+}
+
+//EOF
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "types.h"
+
+/*
+ * Mariani-Silver subdivision
+ *  Only the border of a rectangle is iterated. If every border pixel has the
+ *  same escape time the inside is filled with it, otherwise the rectangle is
+ *  split in two along its longer edge and both halves are processed the same
+ *  way. The Mandelbrot set is connected, so a uniform border cannot enclose
+ *  detail of a different escape time except for features smaller than a
+ *  rectangle that never touch its edge
+ */
+
+// Rectangles with an edge at or below this size are iterated completely
+#define MARIANI_SILVER_MIN_SIZE		10
+
+namespace cpu {
+	/*
+	 * Evaluator is called as evaluate(pixels, count, out), pixels are indices
+	 *  (y * width + x) into the field and the escape time of each has to be
+	 *  written to out. Pixels are queued and evaluated in batches so borders and
+	 *  columns reach the vectorized kernels as well as rows
+	 */
+	template<typename Evaluator>
+	class marianiSilver {
+	private:
+		const Evaluator &evaluate;
+		const uint32_t width, height;
+		uint32_t *field;
+
+		// Pixels already iterated (or filled), borders are shared between halves
+		std::vector<uint8_t> done;
+		std::vector<uint32_t> pending, results;
+		uint64_t iteratedPixels;
+
+	private:
+		void queue_pixel(uint32_t x, uint32_t y)
+		{
+			const uint32_t index = y * width + x;
+			if (!done[index]) {
+				done[index] = 1;
+				pending.push_back(index);
+			}
+		}
+
+		void queue_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+		{
+			for (uint32_t i = y; i < y + h; i++) {
+				for (uint32_t j = x; j < x + w; j++) {
+					queue_pixel(j, i);
+				}
+			}
+		}
+
+		// Iterates everything queued and stores it in the field
+		void flush(void)
+		{
+			if (pending.empty()) {
+				return;
+			}
+
+			results.resize(pending.size());
+			evaluate(pending.data(), (uint32_t)pending.size(), results.data());
+			for (size_t k = 0; k < pending.size(); k++) {
+				field[pending[k]] = results[k];
+			}
+			iteratedPixels += pending.size();
+			pending.clear();
+		}
+
+		void subdivide(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+		{
+			if (w <= 2 || h <= 2) {
+				queue_rect(x, y, w, h);
+				return;
+			}
+
+			queue_rect(x, y, w, 1);
+			queue_rect(x, y + h - 1, w, 1);
+			queue_rect(x, y + 1, 1, h - 2);
+			queue_rect(x + w - 1, y + 1, 1, h - 2);
+			flush();
+
+			const uint32_t value = field[y * width + x];
+			bool uniform = true;
+			for (uint32_t j = x; j < x + w && uniform; j++) {
+				uniform = field[y * width + j] == value && field[(y + h - 1) * width + j] == value;
+			}
+			for (uint32_t i = y + 1; i < y + h - 1 && uniform; i++) {
+				uniform = field[i * width + x] == value && field[i * width + x + w - 1] == value;
+			}
+
+			if (uniform) {
+				for (uint32_t i = y + 1; i < y + h - 1; i++) {
+					for (uint32_t j = x + 1; j < x + w - 1; j++) {
+						field[i * width + j] = value;
+						done[i * width + j] = 1;
+					}
+				}
+				return;
+			}
+
+			// No decision depends on the inside, it is batched with the next border
+			if (w <= MARIANI_SILVER_MIN_SIZE || h <= MARIANI_SILVER_MIN_SIZE) {
+				queue_rect(x + 1, y + 1, w - 2, h - 2);
+				return;
+			}
+
+			// Both halves keep the middle line as part of their border
+			if (w >= h) {
+				const uint32_t mid = w / 2;
+				subdivide(x, y, mid + 1, h);
+				subdivide(x + mid, y, w - mid, h);
+			}
+			else {
+				const uint32_t mid = h / 2;
+				subdivide(x, y, w, mid + 1);
+				subdivide(x, y + mid, w, h - mid);
+			}
+		}
+
+	public:
+		/*
+		 * Fills the whole field, returns the number of pixels actually iterated
+		 */
+		uint64_t render(void)
+		{
+			if (width != 0 && height != 0) {
+				subdivide(0, 0, width, height);
+				flush();
+			}
+			return iteratedPixels;
+		}
+
+	public:
+		marianiSilver(const Evaluator &evaluate, uint32_t width, uint32_t height, __inout uint32_t *field) :
+			evaluate(evaluate),
+			width(width), height(height),
+			field(field),
+			done((size_t)width * height, 0),
+			iteratedPixels(0)
+		{
+			pending.reserve((size_t)2 * (width + height));
+
+		}
+	};
+}
+
+//EOF
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+
+#include "types.h"
+#include "ppm.h"
+#include "png_encoder.h"
+#include "qoi_encoder.h"
+#include "thread_pool.h"
+
+/*
+ * Output stage of the frame writers
+ *  A frame goes to a file through one of the encoders: the Netpbm writers
+ *  of ppm.h, PNG or QOI. PNG and QOI encode bands of the frame on the pool.
+ *  outputStage keeps one frame in flight: the frame is handed over with its
+ *  buffer and encoded and written by a task on the pool, while the caller
+ *  renders the next frame on the same pool. A wait on the pool only runs
+ *  tasks of its own group, so the render never takes the encode over.
+ */
+
+namespace frame {
+	typedef enum {
+		FRAME_ENCODER_NETPBM,		// ppm.h, in the ppm::PPM_FORMAT asked for
+		FRAME_ENCODER_PNG,
+		FRAME_ENCODER_QOI
+	} FRAME_ENCODER;
+
+	// Encoder for the extension of filename, Netpbm unless it is .png or .qoi
+	static inline FRAME_ENCODER get_file_encoder(const std::string &filename)
+	{
+		const size_t dot = filename.rfind('.');
+		const std::string extension = dot == std::string::npos ? "" : filename.substr(dot);
+		if (extension == ".png") {
+			return FRAME_ENCODER_PNG;
+		}
+		if (extension == ".qoi") {
+			return FRAME_ENCODER_QOI;
+		}
+		return FRAME_ENCODER_NETPBM;
+	}
+
+	/*
+	 * Writes a width * height frame, rows in frame order, with encoder.
+	 *  netpbmFormat is only used by FRAME_ENCODER_NETPBM, pool may be nullptr
+	 */
+	static inline error_t write_encoded_frame(cpu::threadPool *pool, FRAME_ENCODER encoder, ppm::PPM_FORMAT netpbmFormat,
+		const rgbaPixel *pixels, uint32_t width, uint32_t height, const std::string &filename)
+	{
+		if (encoder == FRAME_ENCODER_NETPBM) {
+			return ppm::write_frame(filename, netpbmFormat, pixels, width, height);
+		}
+
+		std::vector<uint8_t> encoded;
+		const error_t err = encoder == FRAME_ENCODER_PNG ?
+			png::encode_png(pool, pixels, width, height, false, &encoded) :
+			qoi::encode_qoi(pool, pixels, width, height, false, &encoded);
+		if (err != 0) {
+			return err;
+		}
+
+		std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return -1;
+		}
+		file.write((const char *)encoded.data(), (std::streamsize)encoded.size());
+		file.close();
+
+		return file.fail() ? -1 : 0;
+	}
+
+	class outputStage {
+	private:
+		cpu::threadPool *pool;
+		cpu::taskGroup group;
+
+		// Frame in flight and where it goes
+		std::vector<rgbaPixel> pending;
+		std::string filename;
+
+		// Of the last frame written
+		error_t status;
+		double writeMs;
+
+	public:
+		/*
+		 * Blocks until the frame in flight is written, returns its status
+		 */
+		error_t wait(void)
+		{
+			pool->wait(&group);
+			return status;
+		}
+
+		/*
+		 * wait(), then frees the buffer of the stage
+		 */
+		error_t flush(void)
+		{
+			const error_t err = wait();
+			std::vector<rgbaPixel>().swap(pending);
+			return err;
+		}
+
+		/*
+		 * Waits for the frame before, then takes *frame (width * height pixels)
+		 *  and returns at once. *frame gets the buffer of the frame before, to
+		 *  be rendered into next. The status of the frame before is returned,
+		 *  the new frame is not queued when it failed
+		 */
+		error_t submit(FRAME_ENCODER encoder, ppm::PPM_FORMAT netpbmFormat, __inout std::vector<rgbaPixel> *frame,
+			uint32_t width, uint32_t height, const std::string &filename)
+		{
+			const error_t err = wait();
+			if (err != 0) {
+				return err;
+			}
+
+			pending.swap(*frame);
+			this->filename = filename;
+			pool->submit(&group, [this, encoder, netpbmFormat, width, height] {
+				const auto start = std::chrono::steady_clock::now();
+				status = write_encoded_frame(pool, encoder, netpbmFormat, pending.data(), width, height, this->filename);
+				writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			});
+
+			return 0;
+		}
+
+		// File of the frame submitted last, the one a failed status belongs to
+		const std::string &get_filename(void) const { return filename; }
+
+		// Encoding and writing time of the last frame written
+		double get_write_ms(void) const { return writeMs; }
+
+	public:
+		outputStage(cpu::threadPool *pool) :
+			pool(pool), status(0), writeMs(0.0)
+		{
+
+		}
+
+		~outputStage(void)
+		{
+			wait();
+		}
+
+		outputStage(const outputStage &) = delete;
+		outputStage &operator=(const outputStage &) = delete;
+	};
+}
+
+//EOF
@@ -0,0 +1,198 @@
+#include "perturbation.h"
+
+#include <stdint.h>
+#include <algorithm>
+
+using namespace cpu;
+
+void perturbationEngine::compute_reference(const fixedPoint &cx, const fixedPoint &cy, uint32_t maxIter)
+{
+	refX.resize(maxIter + 2);
+	refY.resize(maxIter + 2);
+	refNorm.resize(maxIter + 2);
+
+	fixedPoint zx, zy;
+	refX[0] = refY[0] = refNorm[0] = 0.0;
+	refLength = 0;
+
+	// Same number of bodies as cpu::escape_time, stops once the reference escaped
+	for (uint32_t n = 0; n <= maxIter; n++) {
+		const fixedPoint zx2 = zx * zx;
+		const fixedPoint zy2 = zy * zy;
+		const fixedPoint zxy = zx * zy;
+		zy = zxy + zxy + cy;
+		zx = zx2 - zy2 + cx;
+
+		refX[n + 1] = zx.to_double();
+		refY[n + 1] = zy.to_double();
+		refNorm[n + 1] = refX[n + 1] * refX[n + 1] + refY[n + 1] * refY[n + 1];
+		refLength = n + 1;
+
+		if (refNorm[n + 1] >= 4.0) {
+			break;
+		}
+	}
+}
+
+bool perturbationEngine::iterate_pixel(double dcx, double dcy, uint32_t maxIter,
+	__inout uint32_t *iterOut, __inout float *metric) const
+{
+	double dzx = 0.0, dzy = 0.0;
+
+	for (uint32_t n = 0; n <= maxIter; n++) {
+		// The reference escaped before this pixel did
+		if (n + 1 > refLength) {
+			*iterOut = n;
+			*metric = 0.0f;
+			return false;
+		}
+
+		const double zx = refX[n], zy = refY[n];
+		const double ndx = 2.0 * (zx * dzx - zy * dzy) + (dzx * dzx - dzy * dzy) + dcx;
+		const double ndy = 2.0 * (zx * dzy + zy * dzx) + 2.0 * dzx * dzy + dcy;
+		dzx = ndx;
+		dzy = ndy;
+
+		const double fx = refX[n + 1] + dzx;
+		const double fy = refY[n + 1] + dzy;
+		const double norm = fx * fx + fy * fy;
+		if (norm >= 4.0) {
+			*iterOut = n + 1;
+			return true;
+		}
+
+		if (norm < PERTURBATION_GLITCH_TOLERANCE * refNorm[n + 1]) {
+			*iterOut = n + 1;
+			*metric = (float)(norm / refNorm[n + 1]);
+			return false;
+		}
+	}
+
+	*iterOut = maxIter + 1;
+	return true;
+}
+
+uint32_t perturbationEngine::iterate_pixel_index(uint32_t index, uint32_t width, double scale, uint32_t maxIter,
+	__inout uint32_t *iterations)
+{
+	const double dcx = ((double)(index % width) - refPixelX) * scale;
+	const double dcy = ((double)(index / width) - refPixelY) * scale;
+
+	float metric = -1.0f;
+	if (iterate_pixel(dcx, dcy, maxIter, &iterations[index], &metric)) {
+		metric = -1.0f;
+	}
+	glitchMetric[index] = metric;
+
+	return std::min(iterations[index], maxIter);
+}
+
+static bool is_cancelled(const frameCancel *cancel)
+{
+	return cancel != nullptr && is_frame_cancelled(*cancel);
+}
+
+void perturbationEngine::collect_glitches(uint32_t pixelCount)
+{
+	glitchedPixels.clear();
+	for (uint32_t i = 0; i < pixelCount; i++) {
+		if (glitchMetric[i] >= 0.0f) {
+			glitchedPixels.push_back(i);
+		}
+	}
+}
+
+error_t perturbationEngine::render(const fixedPoint &centerX, const fixedPoint &centerY, double scale,
+	uint32_t width, uint32_t height, double centreColumn, double centreRow, uint32_t maxIter,
+	__inout uint32_t *iterations, __inout threadPool *pool,
+	const frameCancel *cancel)
+{
+	if (iterations == nullptr || pool == nullptr || width == 0 || height == 0) {
+		return -1;
+	}
+
+	const uint32_t pixelCount = width * height;
+	const double halfLength = centreColumn;
+	const double halfHeight = centreRow;
+	glitchMetric.resize(pixelCount);
+
+	// Primary reference at the frame centre
+	refPixelX = halfLength;
+	refPixelY = halfHeight;
+	compute_reference(centerX, centerY, maxIter);
+
+	stats = perturbationStats{ 0 };
+	stats.referenceCount = 1;
+	stats.referenceLength = refLength;
+	iterationsSpent = 0;
+
+	pool->parallel_for(height, [this, width, scale, maxIter, iterations, cancel](size_t row) {
+		if (is_cancelled(cancel)) {
+			return;
+		}
+
+		const uint32_t first = (uint32_t)row * width;
+		uint64_t spent = 0;
+		for (uint32_t index = first; index < first + width; index++) {
+			if ((index - first) % PERTURBATION_CANCEL_CHECK == 0 && is_cancelled(cancel)) {
+				break;
+			}
+			spent += iterate_pixel_index(index, width, scale, maxIter, iterations);
+		}
+		iterationsSpent.fetch_add(spent, std::memory_order_relaxed);
+	});
+
+	if (is_cancelled(cancel)) {
+		stats.iterationsSpent = iterationsSpent;
+		return ERROR_RENDER_CANCELLED;
+	}
+
+	collect_glitches(pixelCount);
+	stats.glitchedPixels = glitchedPixels.size();
+
+	// Rebase glitched pixels onto a secondary reference placed at the deepest glitch
+	while (!glitchedPixels.empty() && stats.referenceCount < PERTURBATION_MAX_REFERENCES) {
+		const uint32_t worst = *std::min_element(glitchedPixels.begin(), glitchedPixels.end(),
+			[this](uint32_t a, uint32_t b) { return glitchMetric[a] < glitchMetric[b]; });
+
+		refPixelX = (double)(worst % width);
+		refPixelY = (double)(worst / width);
+		compute_reference(
+			centerX + fixedPoint((refPixelX - halfLength) * scale),
+			centerY + fixedPoint((refPixelY - halfHeight) * scale),
+			maxIter);
+		stats.referenceCount++;
+
+		const size_t chunks = (glitchedPixels.size() + PERTURBATION_REBASE_CHUNK - 1) / PERTURBATION_REBASE_CHUNK;
+		pool->parallel_for(chunks, [this, width, scale, maxIter, iterations, cancel](size_t chunk) {
+			if (is_cancelled(cancel)) {
+				return;
+			}
+
+			const size_t first = chunk * PERTURBATION_REBASE_CHUNK;
+			const size_t last = std::min(first + PERTURBATION_REBASE_CHUNK, glitchedPixels.size());
+			uint64_t spent = 0;
+			for (size_t i = first; i < last; i++) {
+				if ((i - first) % PERTURBATION_CANCEL_CHECK == 0 && is_cancelled(cancel)) {
+					break;
+				}
+				spent += iterate_pixel_index(glitchedPixels[i], width, scale, maxIter, iterations);
+			}
+			iterationsSpent.fetch_add(spent, std::memory_order_relaxed);
+		});
+
+		if (is_cancelled(cancel)) {
+			stats.iterationsSpent = iterationsSpent;
+			return ERROR_RENDER_CANCELLED;
+		}
+
+		collect_glitches(pixelCount);
+	}
+
+	// Whatever is left keeps the iteration it glitched at
+	stats.unresolvedPixels = glitchedPixels.size();
+	stats.iterationsSpent = iterationsSpent;
+	return 0;
+}
+
+//EOF
\ No newline at end of file
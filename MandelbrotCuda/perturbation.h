@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+
+#include "types.h"
+#include "fixed_point.h"
+#include "thread_pool.h"
+
+/*
+ * Perturbation deep zoom engine
+ *  One reference orbit Z_n is computed per frame in fixed point, every pixel
+ *  then iterates only its double precision delta: dz' = 2*Z*dz + dz^2 + dc.
+ *  Pixels whose delta loses precision (Pauldelbrot criterion) or outlive the
+ *  reference orbit are flagged as glitched and re-iterated against a secondary
+ *  reference placed inside the glitch.
+ */
+
+// Glitch when |Z + dz|^2 < PERTURBATION_GLITCH_TOLERANCE * |Z|^2
+#define PERTURBATION_GLITCH_TOLERANCE		1e-6
+
+// Upper bound of reference orbits (primary + secondary) per frame
+#define PERTURBATION_MAX_REFERENCES			32
+
+// Glitched pixels handed to a worker per task when rebasing
+#define PERTURBATION_REBASE_CHUNK			1024
+
+// Pixels iterated between two checks of the cancel flag
+#define PERTURBATION_CANCEL_CHECK			32
+
+namespace cpu {
+	typedef struct perturbationStats {
+		uint32_t referenceCount;
+		uint32_t referenceLength;	// Iterations of the primary reference orbit
+		uint64_t glitchedPixels;	// Pixels rebased onto a secondary reference
+		uint64_t unresolvedPixels;	// Pixels still glitched after the last reference
+		uint64_t iterationsSpent;	// Escape times summed over every pass, interior pixels count maxIter
+	} PERTURBATION_STATS, *PPERTURBATION_STATS;
+
+	class perturbationEngine {
+	private:
+		// Reference orbit Z_0..Z_refLength and |Z_n|^2
+		std::vector<double> refX, refY, refNorm;
+		uint32_t refLength;
+
+		// Pixel offset of the current reference relative to the frame origin
+		double refPixelX, refPixelY;
+
+		// Glitch bookkeeping, glitchMetric is |z|^2 / |Z|^2 at detection (-1 = no glitch)
+		std::vector<float> glitchMetric;
+		std::vector<uint32_t> glitchedPixels;
+
+		perturbationStats stats;
+		std::atomic<uint64_t> iterationsSpent;
+
+	private:
+		void compute_reference(const fixedPoint &cx, const fixedPoint &cy, uint32_t maxIter);
+
+		/*
+		 * Iterates a single pixel against the current reference. Returns false if
+		 *  the pixel glitched, iterOut then holds the iteration it glitched at
+		 */
+		bool iterate_pixel(double dcx, double dcy, uint32_t maxIter,
+			__inout uint32_t *iterOut, __inout float *metric) const;
+
+		// Returns the iterations spent on the pixel
+		uint32_t iterate_pixel_index(uint32_t index, uint32_t width, double scale, uint32_t maxIter,
+			__inout uint32_t *iterations);
+
+		void collect_glitches(uint32_t pixelCount);
+
+	public:
+		/*
+		 * Renders width * height escape times around (centerX, centerY) with the
+		 *  pixel mapping of mandelbrot_kernel: c = center + (index - size / 2) * scale.
+		 *  centreColumn and centreRow locate the centre, width >> 1 and height >> 1
+		 *  unless the pixels are a region of a larger frame.
+		 *  Workers stop within PERTURBATION_CANCEL_CHECK pixels once *cancel is set,
+		 *  the render then returns ERROR_RENDER_CANCELLED
+		 */
+		error_t render(const fixedPoint &centerX, const fixedPoint &centerY, double scale,
+			uint32_t width, uint32_t height, double centreColumn, double centreRow, uint32_t maxIter,
+			__inout uint32_t *iterations, __inout threadPool *pool,
+			const frameCancel *cancel = nullptr);
+
+		perturbationStats get_stats(void) const { return stats; }
+
+	public:
+		perturbationEngine(void) :
+			refLength(0),
+			refPixelX(0.0), refPixelY(0.0),
+			stats(perturbationStats{ 0 }),
+			iterationsSpent(0)
+		{
+
+		}
+	};
+}
+
+//EOF
\ No newline at end of file
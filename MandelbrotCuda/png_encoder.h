@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "types.h"
+#include "deflate.h"
+#include "thread_pool.h"
+
+/*
+ * Chunk-parallel PNG encoder (8 bit RGB, or RGBA with keepAlpha)
+ *  Rows are filtered on the pool with PNG_ROW_FILTER, then the filtered
+ *  image is cut into bands of about PNG_BAND_BYTES that are deflated on the
+ *  pool independently, each primed with the last 32 KB of the band above.
+ *  Every band ends on a byte boundary and becomes one IDAT chunk with its
+ *  own CRC. The chunks form a single zlib stream, the Adler-32 of the bands
+ *  is combined at the end.
+ */
+
+// Filtered bytes deflated by one task
+#define PNG_BAND_BYTES				(1024 * 1024)
+
+#define PNG_FILTER_NONE				0
+#define PNG_FILTER_SUB				1
+#define PNG_FILTER_UP				2
+#define PNG_FILTER_AVERAGE			3
+#define PNG_FILTER_PAETH			4
+#define PNG_FILTER_COUNT			5
+
+// Each row with the filter of the smallest sum of absolute differences
+#define PNG_FILTER_ADAPTIVE			PNG_FILTER_COUNT
+
+// Palette coloured frames repeat exact colours that the predictors turn into
+//  noise: a 1080p frame takes 140 KB unfiltered and 250 KB filtered adaptively
+#define PNG_ROW_FILTER				PNG_FILTER_NONE
+
+#define PNG_COLOUR_RGB				2
+#define PNG_COLOUR_RGBA				6
+
+namespace png {
+	static inline void put_be32(uint32_t value, __inout std::vector<uint8_t> *out)
+	{
+		const uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+		out->insert(out->end(), bytes, bytes + 4);
+	}
+
+	// Length, type, data and CRC of a chunk, crc covers type and data
+	static inline void put_chunk(const char *type, const uint8_t *data, size_t length, uint32_t crc,
+		__inout std::vector<uint8_t> *out)
+	{
+		put_be32((uint32_t)length, out);
+		out->insert(out->end(), (const uint8_t *)type, (const uint8_t *)type + 4);
+		out->insert(out->end(), data, data + length);
+		put_be32(crc, out);
+	}
+
+	static inline uint8_t get_paeth(uint8_t a, uint8_t b, uint8_t c)
+	{
+		const int32_t p = (int32_t)a + b - c;
+		const int32_t pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) {
+			return a;
+		}
+		return pb <= pc ? b : c;
+	}
+
+	/*
+	 * Filters one row of rowBytes with filter (or PNG_FILTER_ADAPTIVE), above
+	 *  is the row before (zeros for the first). out takes the filter type and
+	 *  the filtered bytes, scratch PNG_FILTER_COUNT * rowBytes
+	 */
+	static inline void filter_row(const uint8_t *row, const uint8_t *above, size_t rowBytes, uint32_t pixelBytes,
+		uint32_t filter, __inout uint8_t *scratch, __inout uint8_t *out)
+	{
+		if (filter == PNG_FILTER_NONE) {
+			out[0] = PNG_FILTER_NONE;
+			std::memcpy(out + 1, row, rowBytes);
+			return;
+		}
+
+		uint64_t cost[PNG_FILTER_COUNT] = { 0 };
+		for (size_t i = 0; i < rowBytes; i++) {
+			const uint8_t a = i >= pixelBytes ? row[i - pixelBytes] : 0;
+			const uint8_t b = above[i];
+			const uint8_t c = i >= pixelBytes ? above[i - pixelBytes] : 0;
+			const uint8_t filtered[PNG_FILTER_COUNT] = {
+				row[i],
+				(uint8_t)(row[i] - a),
+				(uint8_t)(row[i] - b),
+				(uint8_t)(row[i] - ((a + b) >> 1)),
+				(uint8_t)(row[i] - get_paeth(a, b, c))
+			};
+			for (uint32_t f = 0; f < PNG_FILTER_COUNT; f++) {
+				scratch[f * rowBytes + i] = filtered[f];
+				cost[f] += (uint32_t)std::abs((int8_t)filtered[f]);
+			}
+		}
+
+		uint32_t best = filter;
+		if (filter == PNG_FILTER_ADAPTIVE) {
+			best = PNG_FILTER_NONE;
+			for (uint32_t f = 1; f < PNG_FILTER_COUNT; f++) {
+				if (cost[f] < cost[best]) {
+					best = f;
+				}
+			}
+		}
+		out[0] = (uint8_t)best;
+		std::memcpy(out + 1, scratch + best * rowBytes, rowBytes);
+	}
+
+	/*
+	 * Encodes a width * height frame, rows in frame order, into *out.
+	 *  Without a pool the bands are encoded on the calling thread
+	 */
+	static inline error_t encode_png(cpu::threadPool *pool, const rgbaPixel *pixels, uint32_t width, uint32_t height,
+		bool keepAlpha, __inout std::vector<uint8_t> *out)
+	{
+		if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) {
+			return -1;
+		}
+
+		const uint32_t pixelBytes = keepAlpha ? 4 : 3;
+		const size_t rowBytes = (size_t)width * pixelBytes, stride = rowBytes + 1;
+		const uint32_t bandRows = (uint32_t)std::max<size_t>(1, std::min<size_t>(height, PNG_BAND_BYTES / stride));
+		const uint32_t bandCount = (height + bandRows - 1) / bandRows;
+
+		// Every band filters its rows, the row above a band is converted again
+		std::vector<uint8_t> filtered(stride * height);
+		cpu::parallel_for(pool, bandCount, [&](size_t band) {
+			std::vector<uint8_t> current(rowBytes), above(rowBytes, 0), scratch(rowBytes * PNG_FILTER_COUNT);
+			const auto convert_row = [&](uint32_t y, uint8_t *row) {
+				const rgbaPixel *source = pixels + (size_t)y * width;
+				for (uint32_t x = 0; x < width; x++) {
+					std::memcpy(row + (size_t)x * pixelBytes, &source[x], pixelBytes);
+				}
+			};
+
+			const uint32_t first = (uint32_t)band * bandRows, last = std::min(height, first + bandRows);
+			if (first != 0) {
+				convert_row(first - 1, above.data());
+			}
+			for (uint32_t y = first; y < last; y++) {
+				convert_row(y, current.data());
+				filter_row(current.data(), above.data(), rowBytes, pixelBytes, PNG_ROW_FILTER, scratch.data(),
+					filtered.data() + (size_t)y * stride);
+				current.swap(above);
+			}
+		});
+
+		std::vector<std::vector<uint8_t>> bands(bandCount);
+		std::vector<uint32_t> bandCrc(bandCount), bandAdler(bandCount);
+		cpu::parallel_for(pool, bandCount, [&](size_t band) {
+			const size_t first = band * bandRows * stride;
+			const size_t length = std::min<size_t>((size_t)bandRows * stride, filtered.size() - first);
+			std::vector<uint8_t> &data = bands[band];
+			data.reserve(length / 4 + 64);
+
+			// zlib header: deflate, 32 KB window, no dictionary
+			if (band == 0) {
+				data.push_back(0x78);
+				data.push_back(0x01);
+			}
+
+			deflate::compressor compressor;
+			compressor.compress(filtered.data() + first, first, length, band == bandCount - 1, &data);
+
+			bandCrc[band] = deflate::crc32(deflate::crc32(0, (const uint8_t *)"IDAT", 4), data.data(), data.size());
+			bandAdler[band] = deflate::adler32(1, filtered.data() + first, length);
+		});
+
+		// The zlib trailer goes at the end of the last chunk, its CRC continues over it
+		uint32_t adler = bandAdler[0];
+		for (uint32_t band = 1; band < bandCount; band++) {
+			const size_t length = std::min<size_t>((size_t)bandRows * stride, filtered.size() - (size_t)band * bandRows * stride);
+			adler = deflate::adler32_combine(adler, bandAdler[band], length);
+		}
+		std::vector<uint8_t> &lastBand = bands[bandCount - 1];
+		const size_t trailer = lastBand.size();
+		put_be32(adler, &lastBand);
+		bandCrc[bandCount - 1] = deflate::crc32(bandCrc[bandCount - 1], lastBand.data() + trailer, 4);
+
+		static const uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+		out->clear();
+		out->insert(out->end(), signature, signature + 8);
+
+		std::vector<uint8_t> header;
+		put_be32(width, &header);
+		put_be32(height, &header);
+		header.push_back(8);
+		header.push_back(keepAlpha ? PNG_COLOUR_RGBA : PNG_COLOUR_RGB);
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(0);
+		put_chunk("IHDR", header.data(), header.size(),
+			deflate::crc32(deflate::crc32(0, (const uint8_t *)"IHDR", 4), header.data(), header.size()), out);
+
+		for (uint32_t band = 0; band < bandCount; band++) {
+			put_chunk("IDAT", bands[band].data(), bands[band].size(), bandCrc[band], out);
+			std::vector<uint8_t>().swap(bands[band]);
+		}
+		put_chunk("IEND", nullptr, 0, deflate::crc32(0, (const uint8_t *)"IEND", 4), out);
+
+		return 0;
+	}
+}
+
+//EOF
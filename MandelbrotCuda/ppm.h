@@ -5,14 +5,378 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <memory>
 
 #include "types.h"
 
+/*
+ * Netpbm writers: P6 (RGB), P5 (grayscale, iteration maps), PAM (RGBA),
+ *  P3 (RGB as text) and raw rgbaPixel rows
+ *  Rows are taken straight from the frames of the renderers and formatted
+ *  into one large aligned buffer that goes to the file in PPM_WRITE_BUFFER_SIZE
+ *  writes, there is no intermediate RGB copy of the frame. Rows are written
+ *  in frame order, row 0 first, as on screen.
+ */
+
+// Bytes formatted before each write to the file
+#define PPM_WRITE_BUFFER_SIZE		(4 * 1024 * 1024)
+#define PPM_BUFFER_ALIGNMENT		64
+
+// Largest sample of P5, two bytes big endian per sample above 255
+#define PPM_MAX_SAMPLE				65535
+
 namespace ppm {
 	typedef struct ppm_pixel {
 		uint32_t x, y, z;
 	} PPM_PIXEL, *PPPM_PIXEL;
 
+	typedef enum {
+		PPM_FORMAT_P6,			// Binary RGB
+		PPM_FORMAT_P5,			// Binary grayscale
+		PPM_FORMAT_PAM,			// P7, RGB_ALPHA
+		PPM_FORMAT_P3,			// Text RGB
+		PPM_FORMAT_RAW			// Headerless rgbaPixel rows, alpha as rendered
+	} PPM_FORMAT;
+
+	/*
+	 * Header of a width * height image, empty for PPM_FORMAT_RAW. maxVal is
+	 *  the largest sample (P5), the other formats take 255
+	 */
+	static inline std::string get_header(PPM_FORMAT format, uint32_t width, uint32_t height, uint32_t maxVal = 255)
+	{
+		switch (format) {
+		case PPM_FORMAT_P6:
+		case PPM_FORMAT_P5:
+		case PPM_FORMAT_P3:
+			return std::string(format == PPM_FORMAT_P6 ? "P6" : format == PPM_FORMAT_P5 ? "P5" : "P3") + "\n" +
+				std::to_string(width) + " " + std::to_string(height) + "\n" + std::to_string(maxVal) + "\n";
+		case PPM_FORMAT_PAM:
+			return "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) +
+				"\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+		default:
+			return "";
+		}
+	}
+
+	// Bytes of one pixel, 0 for the variable length P3
+	static inline uint32_t get_pixel_bytes(PPM_FORMAT format, uint32_t maxVal = 255)
+	{
+		switch (format) {
+		case PPM_FORMAT_P6:
+			return 3;
+		case PPM_FORMAT_P5:
+			return maxVal > 255 ? 2 : 1;
+		case PPM_FORMAT_PAM:
+		case PPM_FORMAT_RAW:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	// count pixels as RGB samples, out takes count * 3 bytes
+	static inline void encode_rgb(const rgbaPixel *pixels, size_t count, __inout uint8_t *out)
+	{
+		for (size_t k = 0; k < count; k++, out += 3) {
+			out[0] = pixels[k].red;
+			out[1] = pixels[k].green;
+			out[2] = pixels[k].blue;
+		}
+	}
+
+	// count pixels as RGBA samples, alpha is made opaque unless keepAlpha
+	static inline void encode_rgba(const rgbaPixel *pixels, size_t count, bool keepAlpha, __inout uint8_t *out)
+	{
+		std::memcpy(out, pixels, count * sizeof(rgbaPixel));
+		if (!keepAlpha) {
+			for (size_t k = 0; k < count; k++) {
+				out[k * 4 + 3] = 255;
+			}
+		}
+	}
+
+	/*
+	 * count escape times as grayscale samples (get_pixel_bytes of P5 each).
+	 *  Fields run to maxIter + 1 (interior), scaled down when that exceeds maxVal
+	 */
+	static inline void encode_gray(const uint32_t *iterations, size_t count, uint32_t maxIter, uint32_t maxVal,
+		__inout uint8_t *out)
+	{
+		const bool wide = maxVal > 255;
+		for (size_t k = 0; k < count; k++) {
+			uint32_t v = std::min(iterations[k], maxIter + 1);
+			if (maxIter + 1 > maxVal) {
+				v = (uint32_t)((uint64_t)v * maxVal / (maxIter + 1));
+			}
+			if (wide) {
+				*out++ = (uint8_t)(v >> 8);
+			}
+			*out++ = (uint8_t)v;
+		}
+	}
+
+	class imageWriter {
+	private:
+		std::ofstream output;
+
+		// PPM_WRITE_BUFFER_SIZE bytes at an aligned address of storage
+		std::unique_ptr<uint8_t[]> storage;
+		uint8_t *buffer;
+		size_t used;
+
+		PPM_FORMAT format;
+		uint32_t width, height;
+		uint32_t maxVal;
+		uint32_t rowsWritten;
+
+		// PAM: alpha as rendered, the renderers leave it at 0 (the textures do not blend)
+		bool keepAlpha;
+
+		// "0" .. "255" for the text path, the length in the last byte
+		char decimal[256][4];
+
+	private:
+		error_t flush(void)
+		{
+			if (used != 0) {
+				output.write((const char *)buffer, used);
+				used = 0;
+			}
+			return output.good() ? 0 : -1;
+		}
+
+		// Room for count samples of sampleBytes each, flushes first when full
+		error_t reserve(size_t sampleBytes, __inout size_t *count)
+		{
+			if (PPM_WRITE_BUFFER_SIZE - used < sampleBytes) {
+				if (flush() != 0) {
+					return -1;
+				}
+			}
+			*count = std::min(*count, (PPM_WRITE_BUFFER_SIZE - used) / sampleBytes);
+			return 0;
+		}
+
+		void build_decimal(void)
+		{
+			for (uint32_t v = 0; v < 256; v++) {
+				const std::string s = std::to_string(v);
+				std::memcpy(decimal[v], s.data(), s.size());
+				decimal[v][3] = (char)s.size();
+			}
+		}
+
+		// "r g b\n" per pixel, 12 bytes at most
+		void encode_text(const rgbaPixel *pixels, size_t count)
+		{
+			char *out = (char *)buffer + used;
+			for (size_t k = 0; k < count; k++) {
+				const char *r = decimal[pixels[k].red], *g = decimal[pixels[k].green], *b = decimal[pixels[k].blue];
+				std::memcpy(out, r, 4);
+				out += r[3];
+				*out++ = ' ';
+				std::memcpy(out, g, 4);
+				out += g[3];
+				*out++ = ' ';
+				std::memcpy(out, b, 4);
+				out += b[3];
+				*out++ = '\n';
+			}
+			used = (uint8_t *)out - buffer;
+		}
+
+	public:
+		/*
+		 * Creates filename and writes the header (see get_header), maxVal goes
+		 *  up to PPM_MAX_SAMPLE for P5
+		 */
+		error_t open(const std::string &filename, PPM_FORMAT format, uint32_t width, uint32_t height,
+			uint32_t maxVal = 255)
+		{
+			if (width == 0 || height == 0 || maxVal == 0 || maxVal > PPM_MAX_SAMPLE ||
+				(format != PPM_FORMAT_P5 && maxVal != 255)) {
+				return -1;
+			}
+
+			output.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!output.is_open()) {
+				return -1;
+			}
+
+			this->format = format;
+			this->width = width;
+			this->height = height;
+			this->maxVal = maxVal;
+			rowsWritten = 0;
+			used = 0;
+
+			const std::string header = get_header(format, width, height, maxVal);
+			std::memcpy(buffer, header.data(), header.size());
+			used = header.size();
+
+			return 0;
+		}
+
+		/*
+		 * Appends rowCount rows of a frame (width pixels each), every format but P5
+		 */
+		error_t write_rows(const rgbaPixel *rows, uint32_t rowCount)
+		{
+			if (format == PPM_FORMAT_P5 || rowsWritten + rowCount > height) {
+				return -1;
+			}
+
+			const size_t pixelBytes = format == PPM_FORMAT_P3 ? 12 : get_pixel_bytes(format);
+			size_t left = (size_t)rowCount * width;
+			while (left != 0) {
+				size_t count = left;
+				if (reserve(pixelBytes, &count) != 0) {
+					return -1;
+				}
+
+				switch (format) {
+				case PPM_FORMAT_P6:
+					encode_rgb(rows, count, buffer + used);
+					break;
+				case PPM_FORMAT_PAM:
+					encode_rgba(rows, count, keepAlpha, buffer + used);
+					break;
+				case PPM_FORMAT_RAW:
+					encode_rgba(rows, count, true, buffer + used);
+					break;
+				default:
+					encode_text(rows, count);
+					break;
+				}
+				if (format != PPM_FORMAT_P3) {
+					used += count * pixelBytes;
+				}
+				rows += count;
+				left -= count;
+			}
+
+			rowsWritten += rowCount;
+			return 0;
+		}
+
+		/*
+		 * Appends rowCount rows of an iteration field (P5), escape times run
+		 *  to maxIter + 1 (interior) and are scaled down when that exceeds maxVal
+		 */
+		error_t write_rows(const uint32_t *iterations, uint32_t rowCount, uint32_t maxIter)
+		{
+			if (format != PPM_FORMAT_P5 || rowsWritten + rowCount > height) {
+				return -1;
+			}
+
+			size_t left = (size_t)rowCount * width;
+			while (left != 0) {
+				size_t count = left;
+				if (reserve(get_pixel_bytes(format, maxVal), &count) != 0) {
+					return -1;
+				}
+
+				encode_gray(iterations, count, maxIter, maxVal, buffer + used);
+				used += count * get_pixel_bytes(format, maxVal);
+				iterations += count;
+				left -= count;
+			}
+
+			rowsWritten += rowCount;
+			return 0;
+		}
+
+		/*
+		 * Appends rowCount rows already in the sample layout of the format
+		 *  (P6: width * 3 bytes per row)
+		 */
+		error_t write_raw_rows(const uint8_t *rows, uint32_t rowCount)
+		{
+			if (format == PPM_FORMAT_P3 || rowsWritten + rowCount > height) {
+				return -1;
+			}
+
+			size_t left = (size_t)rowCount * width * get_pixel_bytes(format, maxVal);
+			while (left != 0) {
+				size_t count = left;
+				if (reserve(1, &count) != 0) {
+					return -1;
+				}
+
+				std::memcpy(buffer + used, rows, count);
+				used += count;
+				rows += count;
+				left -= count;
+			}
+
+			rowsWritten += rowCount;
+			return 0;
+		}
+
+		// Writes what is left, -1 unless every row was written
+		error_t close(void)
+		{
+			error_t err = flush();
+			output.close();
+			if (err != 0 || output.fail() || rowsWritten != height) {
+				return -1;
+			}
+			return 0;
+		}
+
+		void set_keep_alpha(bool val) { keepAlpha = val; }
+
+	public:
+		imageWriter(void) :
+			used(0), format(PPM_FORMAT_P6), width(0), height(0), maxVal(255), rowsWritten(0),
+			keepAlpha(false)
+		{
+			storage.reset(new uint8_t[PPM_WRITE_BUFFER_SIZE + PPM_BUFFER_ALIGNMENT]);
+			const uintptr_t base = (uintptr_t)storage.get();
+			buffer = storage.get() + ((PPM_BUFFER_ALIGNMENT - base % PPM_BUFFER_ALIGNMENT) % PPM_BUFFER_ALIGNMENT);
+			build_decimal();
+		}
+
+		imageWriter(const imageWriter &) = delete;
+		imageWriter &operator=(const imageWriter &) = delete;
+	};
+
+	// Writes a whole frame (width * height pixels) in any format but P5
+	static inline error_t write_frame(const std::string &filename, PPM_FORMAT format, const rgbaPixel *frame,
+		uint32_t width, uint32_t height)
+	{
+		imageWriter writer;
+		if (writer.open(filename, format, width, height) != 0) {
+			return -1;
+		}
+		if (writer.write_rows(frame, height) != 0) {
+			writer.close();
+			return -1;
+		}
+		return writer.close();
+	}
+
+	/*
+	 * Writes an iteration field (mandelbrotFractalCpu::get_iteration_field) as
+	 *  P5, the samples are the escape times up to PPM_MAX_SAMPLE
+	 */
+	static inline error_t write_iteration_map(const std::string &filename, const uint32_t *iterations,
+		uint32_t width, uint32_t height, uint32_t maxIter)
+	{
+		imageWriter writer;
+		const uint32_t maxVal = std::min<uint32_t>(maxIter + 1, PPM_MAX_SAMPLE);
+		if (writer.open(filename, PPM_FORMAT_P5, width, height, maxVal) != 0) {
+			return -1;
+		}
+		if (writer.write_rows(iterations, height, maxIter) != 0) {
+			writer.close();
+			return -1;
+		}
+		return writer.close();
+	}
+
 	class writePPMFile {
 	private:
 		std::string filename;
@@ -23,28 +387,37 @@ namespace ppm {
 
 
 	public:
+		// P3 of the grey levels in z, data holds the pixels row by row
 		error_t write_file()
 		{
-			std::ofstream mImage(filename);
-			if (!mImage.is_open()) {
+			if (data.size() < (size_t)width * height) {
 				return -1;
 			}
 
-			std::vector<ppm_pixel>::iterator pixelI = data.begin();
+			imageWriter writer;
+			if (writer.open(filename, PPM_FORMAT_P3, width, height) != 0) {
+				return -1;
+			}
 
-			mImage << "P3\n" << width << " " << height << " 255\n";
+			std::vector<rgbaPixel> row(width);
+			std::vector<ppm_pixel>::iterator pixelI = data.begin();
 			for (uint32_t y = 0; y < height; y++) {
-				for (uint32_t x = 0; x < width; x++) {
-					//mImage << (*pixelI).z << " " << 
+				for (uint32_t x = 0; x < width; x++, pixelI++) {
+					const BYTE grey = (BYTE)std::min<uint32_t>((*pixelI).z, 255);
+					row[x] = rgbaPixel{ grey, grey, grey, 0 };
+				}
+				if (writer.write_rows(row.data(), 1) != 0) {
+					writer.close();
+					return -1;
 				}
 			}
 
-			return 0;
+			return writer.close();
 		}
 
 		writePPMFile(std::string filename, std::vector<ppm_pixel> data, uint32_t width, uint32_t height) :
-			height(height), width(width),
 			filename(filename),
+			width(width), height(height),
 			data(data)
 		{
 
@@ -57,4 +430,4 @@ namespace ppm {
 	};
 }
 
-//EOF
\ No newline at end of file
+//EOF
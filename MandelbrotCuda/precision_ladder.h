@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+#include "types.h"
+
+/*
+ * Precision ladder, picks the cheapest arithmetic that still resolves the
+ *  pixel grid. A tier is usable while the pixel spacing is at least
+ *  PRECISION_LADDER_GUARD ulps of the largest coordinate in the orbit
+ */
+#define PRECISION_LADDER_GUARD				256.0
+
+// Machine epsilon of each tier (double-double carries ~104 significant bits)
+#define PRECISION_LADDER_EPSILON_FLOAT		1.1920928955078125e-7
+#define PRECISION_LADDER_EPSILON_DOUBLE		2.220446049250313e-16
+#define PRECISION_LADDER_EPSILON_DD			4.930380657631324e-32
+
+// Skips the double-double band, perturbation takes over directly from double
+#undef PRECISION_LADDER_SKIP_DOUBLE_DOUBLE
+
+namespace cpu {
+	// Arithmetic used for a frame, ordered from cheapest to deepest
+	typedef enum {
+		PRECISION_TIER_FLOAT,
+		PRECISION_TIER_DOUBLE,
+		PRECISION_TIER_DOUBLE_DOUBLE,
+		PRECISION_TIER_PERTURBATION
+	} PRECISION_TIER;
+
+	static inline const char *get_precision_tier_name(PRECISION_TIER tier)
+	{
+		switch (tier) {
+		case PRECISION_TIER_FLOAT:
+			return "float";
+		case PRECISION_TIER_DOUBLE:
+			return "double";
+		case PRECISION_TIER_DOUBLE_DOUBLE:
+			return "double-double";
+		case PRECISION_TIER_PERTURBATION:
+			return "perturbation";
+		default:
+			return "unknown";
+		}
+	}
+
+	/*
+	 * scale is the distance between two pixels (cudaKernel::scale), centerX/Y
+	 *  the view offset. |z| stays below 2 until it escapes, so the coordinate
+	 *  magnitude never drops under 2
+	 */
+	static inline PRECISION_TIER select_precision_tier(double scale, double centerX, double centerY)
+	{
+		const double magnitude = std::max(2.0, std::max(std::fabs(centerX), std::fabs(centerY)));
+		const double spacing = std::fabs(scale) / (magnitude * PRECISION_LADDER_GUARD);
+
+		if (spacing >= PRECISION_LADDER_EPSILON_FLOAT) {
+			return PRECISION_TIER_FLOAT;
+		}
+		if (spacing >= PRECISION_LADDER_EPSILON_DOUBLE) {
+			return PRECISION_TIER_DOUBLE;
+		}
+#if !defined(PRECISION_LADDER_SKIP_DOUBLE_DOUBLE)
+		if (spacing >= PRECISION_LADDER_EPSILON_DD) {
+			return PRECISION_TIER_DOUBLE_DOUBLE;
+		}
+#endif //PRECISION_LADDER_SKIP_DOUBLE_DOUBLE
+		return PRECISION_TIER_PERTURBATION;
+	}
+}
+
+//EOF
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "types.h"
+#include "thread_pool.h"
+
+/*
+ * QOI encoder ("Quite OK Image", qoiformat.org), RGB or RGBA with keepAlpha
+ *  The format is a single pass over the pixels, but a decoder only ever
+ *  follows the encoder: bands of QOI_BAND_PIXELS are encoded on the pool,
+ *  each starting from the last pixel of the band before and an index of its
+ *  own. A band only refers to index slots it wrote itself and ends any run
+ *  at its end, so the concatenated bands decode exactly like one stream.
+ */
+
+// Pixels encoded by one task
+#define QOI_BAND_PIXELS				(256 * 1024)
+
+#define QOI_OP_INDEX				0x00
+#define QOI_OP_DIFF					0x40
+#define QOI_OP_LUMA					0x80
+#define QOI_OP_RUN					0xc0
+#define QOI_OP_RGB					0xfe
+#define QOI_OP_RGBA					0xff
+
+#define QOI_MAX_RUN					62
+#define QOI_INDEX_SIZE				64
+#define QOI_HEADER_SIZE				14
+#define QOI_COLOURSPACE_SRGB		0
+
+namespace qoi {
+	static inline uint32_t get_index_position(const rgbaPixel &p)
+	{
+		return (p.red * 3 + p.green * 5 + p.blue * 7 + p.alpha * 11) % QOI_INDEX_SIZE;
+	}
+
+	static inline bool is_same_pixel(const rgbaPixel &a, const rgbaPixel &b)
+	{
+		return a.red == b.red && a.green == b.green && a.blue == b.blue && a.alpha == b.alpha;
+	}
+
+	/*
+	 * Encodes pixels first .. first + count - 1 into *out. previous is the
+	 *  pixel before first as the decoder will have it
+	 */
+	static inline void encode_band(const rgbaPixel *pixels, size_t first, size_t count, rgbaPixel previous,
+		bool keepAlpha, __inout std::vector<uint8_t> *out)
+	{
+		rgbaPixel index[QOI_INDEX_SIZE];
+		uint64_t indexWritten = 0;
+		uint32_t run = 0;
+
+		for (size_t i = first; i < first + count; i++) {
+			rgbaPixel p = pixels[i];
+			if (!keepAlpha) {
+				p.alpha = 255;
+			}
+
+			if (is_same_pixel(p, previous)) {
+				if (++run == QOI_MAX_RUN) {
+					out->push_back((uint8_t)(QOI_OP_RUN | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run != 0) {
+				out->push_back((uint8_t)(QOI_OP_RUN | (run - 1)));
+				run = 0;
+			}
+
+			const uint32_t slot = get_index_position(p);
+			if ((indexWritten >> slot & 1) && is_same_pixel(index[slot], p)) {
+				out->push_back((uint8_t)(QOI_OP_INDEX | slot));
+			}
+			else {
+				index[slot] = p;
+				indexWritten |= (uint64_t)1 << slot;
+
+				if (p.alpha == previous.alpha) {
+					const int32_t dr = (int8_t)(p.red - previous.red);
+					const int32_t dg = (int8_t)(p.green - previous.green);
+					const int32_t db = (int8_t)(p.blue - previous.blue);
+					const int32_t drg = dr - dg, dbg = db - dg;
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+						out->push_back((uint8_t)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+					}
+					else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+						out->push_back((uint8_t)(QOI_OP_LUMA | (dg + 32)));
+						out->push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+					}
+					else {
+						const uint8_t op[4] = { QOI_OP_RGB, p.red, p.green, p.blue };
+						out->insert(out->end(), op, op + 4);
+					}
+				}
+				else {
+					const uint8_t op[5] = { QOI_OP_RGBA, p.red, p.green, p.blue, p.alpha };
+					out->insert(out->end(), op, op + 5);
+				}
+			}
+			previous = p;
+		}
+
+		if (run != 0) {
+			out->push_back((uint8_t)(QOI_OP_RUN | (run - 1)));
+		}
+	}
+
+	/*
+	 * Encodes a width * height frame, rows in frame order, into *out.
+	 *  Without a pool the bands are encoded on the calling thread
+	 */
+	static inline error_t encode_qoi(cpu::threadPool *pool, const rgbaPixel *pixels, uint32_t width, uint32_t height,
+		bool keepAlpha, __inout std::vector<uint8_t> *out)
+	{
+		if (width == 0 || height == 0) {
+			return -1;
+		}
+
+		const size_t pixelCount = (size_t)width * height;
+		const size_t bandCount = (pixelCount + QOI_BAND_PIXELS - 1) / QOI_BAND_PIXELS;
+		std::vector<std::vector<uint8_t>> bands(bandCount);
+		cpu::parallel_for(pool, bandCount, [&](size_t band) {
+			const size_t first = band * QOI_BAND_PIXELS;
+			rgbaPixel previous = { 0, 0, 0, 255 };
+			if (first != 0) {
+				previous = pixels[first - 1];
+				if (!keepAlpha) {
+					previous.alpha = 255;
+				}
+			}
+
+			bands[band].reserve(QOI_BAND_PIXELS);
+			encode_band(pixels, first, std::min<size_t>(QOI_BAND_PIXELS, pixelCount - first), previous,
+				keepAlpha, &bands[band]);
+		});
+
+		const uint8_t header[QOI_HEADER_SIZE] = { 'q', 'o', 'i', 'f',
+			(uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+			(uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+			(uint8_t)(keepAlpha ? 4 : 3), QOI_COLOURSPACE_SRGB };
+		static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+		size_t total = QOI_HEADER_SIZE + sizeof(end);
+		for (size_t band = 0; band < bandCount; band++) {
+			total += bands[band].size();
+		}
+
+		out->clear();
+		out->reserve(total);
+		out->insert(out->end(), header, header + QOI_HEADER_SIZE);
+		for (size_t band = 0; band < bandCount; band++) {
+			out->insert(out->end(), bands[band].begin(), bands[band].end());
+			std::vector<uint8_t>().swap(bands[band]);
+		}
+		out->insert(out->end(), end, end + sizeof(end));
+
+		return 0;
+	}
+}
+
+//EOF
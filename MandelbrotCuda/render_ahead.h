@@ -0,0 +1,260 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <assert.h>
+
+#include "types.h"
+#include "mandelbrot_cpu.h"
+
+/*
+ * Speculative render-ahead for the automatic zoom on the CPU tiers
+ *  While nothing interferes, the views of the next frames follow from the
+ *  zoom state alone. Frame N + i goes to slot i % depth, every slot has a
+ *  worker thread and a renderer of its own and all of them share one thread
+ *  pool, so up to depth frames are iterated at once and the tail of one
+ *  frame keeps the cores the others leave idle busy. Frames are presented
+ *  in order. Any input makes the queue stale: cancel() stops the renderers
+ *  at their next batch of points and discard() empties the queue.
+ *  A slot reprojects from the frame it rendered depth steps earlier.
+ */
+
+namespace controller {
+	// View of one queued frame, the zoom state it leaves behind comes back with the frame
+	typedef struct aheadView {
+		double scaleA, scaleB;
+		double lastScaleA;
+		cpu::fixedPoint centerX, centerY;
+		cpu::PRECISION_TIER tier;
+		uint64_t zoomTicks;		// Zoom clock ticks the view stands at
+		double presentMs;		// Zoom clock time the frame is planned for
+		bool stop;				// Not queued: the zoom stopped or left the CPU tiers before it
+	} AHEAD_VIEW, *PAHEAD_VIEW;
+
+	class renderAhead {
+	private:
+		typedef enum {
+			AHEAD_SLOT_IDLE,
+			AHEAD_SLOT_QUEUED,
+			AHEAD_SLOT_RENDERING,
+			AHEAD_SLOT_READY
+		} AHEAD_SLOT_STATE;
+
+		typedef struct aheadSlot {
+			mandelbrotFractalCpu *renderer;
+			std::vector<rgbaPixel> frame;
+			aheadView view;
+			AHEAD_SLOT_STATE state;
+			error_t err;
+			std::thread *worker;
+		} AHEAD_SLOT, *PAHEAD_SLOT;
+
+		std::vector<aheadSlot *> slots;
+
+		// Sequence numbers of the next frame to present and to queue
+		uint64_t nextPresent, nextQueue;
+
+		// Guards the slot states, signalled on every change
+		std::mutex lock;
+		std::condition_variable changed;
+		bool running;
+
+		// Cancel flag of every renderer, set by cancel() from any thread
+		std::atomic<bool> discardFlag;
+
+		// Frames shown from the queue and frames thrown away
+		uint64_t presentedFrames, discardedFrames;
+
+	private:
+		static void worker_thread(renderAhead *ahead, aheadSlot *slot)
+		{
+			std::unique_lock<std::mutex> l(ahead->lock);
+			while (true) {
+				ahead->changed.wait(l, [ahead, slot] {
+					return !ahead->running || slot->state == AHEAD_SLOT_QUEUED;
+				});
+				if (!ahead->running) {
+					return;
+				}
+
+				slot->state = AHEAD_SLOT_RENDERING;
+				const aheadView view = slot->view;
+				l.unlock();
+
+				slot->renderer->setScaleA(view.scaleA);
+				slot->renderer->setScaleB(view.scaleB);
+				slot->renderer->set_center(view.centerX, view.centerY);
+				slot->renderer->set_precision_tier(view.tier);
+				const error_t err = slot->renderer->generate_mandelbrot(slot->frame.data());
+
+				l.lock();
+				slot->err = err;
+				slot->state = AHEAD_SLOT_READY;
+				ahead->changed.notify_all();
+			}
+		}
+
+	public:
+		uint32_t get_depth(void) const { return (uint32_t)slots.size(); }
+
+		// Frames queued and not presented yet
+		uint32_t get_queued(void)
+		{
+			std::lock_guard<std::mutex> l(lock);
+			return (uint32_t)(nextQueue - nextPresent);
+		}
+
+		bool is_active(void) { return get_queued() != 0; }
+
+		// The slot of the next sequence number is free
+		bool can_queue(void)
+		{
+			std::lock_guard<std::mutex> l(lock);
+			return slots[nextQueue % slots.size()]->state == AHEAD_SLOT_IDLE;
+		}
+
+		/*
+		 * Hands the next view in sequence to its slot, can_queue() has to be
+		 *  true. The render thread is the only caller
+		 */
+		void queue(const aheadView &view)
+		{
+			std::lock_guard<std::mutex> l(lock);
+			aheadSlot *slot = slots[nextQueue % slots.size()];
+			assert(slot->state == AHEAD_SLOT_IDLE);
+			slot->view = view;
+			slot->state = AHEAD_SLOT_QUEUED;
+			nextQueue++;
+			changed.notify_all();
+		}
+
+		/*
+		 * Waits for the oldest queued frame and copies it to out, its view goes
+		 *  to *view. Returns ERROR_RENDER_CANCELLED once cancel() was called,
+		 *  the caller discards the queue then
+		 */
+		error_t present(__inout rgbaPixel *out, __inout aheadView *view)
+		{
+			std::unique_lock<std::mutex> l(lock);
+			assert(nextPresent != nextQueue);
+			aheadSlot *slot = slots[nextPresent % slots.size()];
+			changed.wait(l, [this, slot] {
+				return slot->state == AHEAD_SLOT_READY || discardFlag.load();
+			});
+			if (discardFlag.load()) {
+				return ERROR_RENDER_CANCELLED;
+			}
+
+			const error_t err = slot->err;
+			if (err == 0) {
+				std::memcpy(out, slot->frame.data(), slot->frame.size() * sizeof(rgbaPixel));
+				*view = slot->view;
+				presentedFrames++;
+			}
+			slot->state = AHEAD_SLOT_IDLE;
+			nextPresent++;
+
+			return err;
+		}
+
+		/*
+		 * Any thread: the queued frames are stale. Frames in flight stop at
+		 *  their next batch of points, a waiting present() returns
+		 */
+		void cancel(void)
+		{
+			discardFlag = true;
+			std::lock_guard<std::mutex> l(lock);
+			changed.notify_all();
+		}
+
+		/*
+		 * Render thread: empties the queue once no renderer is busy anymore.
+		 *  The next queue() starts a new sequence
+		 */
+		void discard(void)
+		{
+			discardFlag = true;
+
+			std::unique_lock<std::mutex> l(lock);
+			for (aheadSlot *slot : slots) {
+				if (slot->state == AHEAD_SLOT_QUEUED) {
+					slot->state = AHEAD_SLOT_IDLE;
+				}
+			}
+			changed.wait(l, [this] {
+				for (const aheadSlot *slot : slots) {
+					if (slot->state == AHEAD_SLOT_RENDERING) {
+						return false;
+					}
+				}
+				return true;
+			});
+
+			discardedFrames += nextQueue - nextPresent;
+			for (aheadSlot *slot : slots) {
+				slot->state = AHEAD_SLOT_IDLE;
+			}
+			nextPresent = nextQueue = 0;
+			discardFlag = false;
+		}
+
+		uint64_t get_presented_frames(void) const { return presentedFrames; }
+		uint64_t get_discarded_frames(void) const { return discardedFrames; }
+
+	public:
+		/*
+		 * depth slots rendering pixelLength * pixelHeight frames on pool, set up
+		 *  like the renderer of the render thread (subdivision, reprojection)
+		 */
+		renderAhead(uint32_t depth, size_t pixelLength, size_t pixelHeight, uint32_t iterations,
+			cpu::threadPool *pool) :
+			nextPresent(0), nextQueue(0), running(true), discardFlag(false),
+			presentedFrames(0), discardedFrames(0)
+		{
+			assert(depth != 0 && pool != nullptr);
+			for (uint32_t i = 0; i < depth; i++) {
+				aheadSlot *slot = new aheadSlot();
+				slot->renderer = new mandelbrotFractalCpu(0.0, 0.0, pixelLength, pixelHeight,
+					1.0, 4.0, iterations, THREAD_POOL_DEFAULT_WORKERS);
+				slot->renderer->set_thread_pool(pool);
+				slot->renderer->set_subdivision(true);
+				slot->renderer->set_reprojection(true);
+				slot->renderer->set_cancel_flag(&discardFlag);
+				slot->frame.resize(pixelLength * pixelHeight);
+				slot->state = AHEAD_SLOT_IDLE;
+				slot->err = 0;
+				slots.push_back(slot);
+			}
+			for (aheadSlot *slot : slots) {
+				slot->worker = new std::thread(&worker_thread, this, slot);
+			}
+		}
+
+		~renderAhead(void)
+		{
+			cancel();
+			{
+				std::lock_guard<std::mutex> l(lock);
+				running = false;
+				changed.notify_all();
+			}
+
+			for (aheadSlot *slot : slots) {
+				slot->worker->join();
+				delete slot->worker;
+				delete slot->renderer;
+				delete slot;
+			}
+		}
+
+		renderAhead(const renderAhead &) = delete;
+		renderAhead &operator=(const renderAhead &) = delete;
+	};
+}
+
+//EOF
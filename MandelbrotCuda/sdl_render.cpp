@@ -229,6 +229,7 @@ void LTexture::render(int x, int y)
 error_t sdlBase::render_loop(sdlBase* b)
 {
 	assert(b->window != nullptr && b->renderer != nullptr);
+	assert(b->frames != nullptr);
 	DINFO("Starting SDL2 renderer loop thread");
 
 	SDL_Color textColor = { 255, 255, 255, 255 };
@@ -252,6 +253,10 @@ error_t sdlBase::render_loop(sdlBase* b)
 	 * Primary rendering loop
 	 */
 	while (b->doRender) {
+		const cudaRenderingStats *latestStats = b->statsMailbox.acquire_read();
+		if (latestStats != nullptr) {
+			b->cudaStats = *latestStats;
+		}
 
 #if defined(RENDER_ENABLE_FPS_CAP)
 		float avgFPS = countedFrames / (b->fpsTimer.getTicks() / 1000.f);
@@ -264,6 +269,26 @@ error_t sdlBase::render_loop(sdlBase* b)
 
 #if defined(RENDER_CUDA_STATS)
 		SCREEN_STATS("Last CUDA rendering time: " + std::to_string(b->cudaStats.frameRenderElapsedms) + " ms");
+		if (b->cudaStats.progressivePasses > 1) {
+			SCREEN_STATS("Progressive passes: " + std::to_string(b->cudaStats.progressivePasses) +
+				" first pass: " + std::to_string(b->cudaStats.firstPassElapsedms) + " ms");
+		}
+		if (b->cudaStats.reuseRatio > 0.0) {
+			SCREEN_STATS("Reprojected: " + std::to_string(b->cudaStats.reuseRatio * 100.0) + "% of the frame reused");
+		}
+		if (b->cudaStats.tileCacheHits + b->cudaStats.tileCacheMisses > 0) {
+			SCREEN_STATS("Tile cache: " + std::to_string(b->cudaStats.tileCacheHits) + " hits " +
+				std::to_string(b->cudaStats.tileCacheMisses) + " misses " +
+				std::to_string(b->cudaStats.tileCacheEvictions) + " evictions");
+		}
+		if (b->cudaStats.renderAheadQueued + b->cudaStats.renderAheadDiscarded > 0) {
+			SCREEN_STATS("Render-ahead: " + std::to_string(b->cudaStats.renderAheadQueued) + " queued " +
+				std::to_string(b->cudaStats.renderAheadDiscarded) + " discarded");
+		}
+		if (b->cudaStats.cancelledFrames > 0) {
+			SCREEN_STATS("Cancelled frames: " + std::to_string(b->cudaStats.cancelledFrames) +
+				" wasted iterations: " + std::to_string(b->cudaStats.wastedIterations));
+		}
 #endif //RENDER_CUDA_STATS
 
 #if defined(DISPLAY_KERNEL_PARAMETERS)
@@ -272,6 +297,11 @@ error_t sdlBase::render_loop(sdlBase* b)
 			to_string_with_precision(b->cudaStats.scaleA / ((double)b->framePixelLength / b->cudaStats.scaleB), 32));
 		SCREEN_STATS("(fractal offset) C.x: " + to_string_with_precision(b->cudaStats.offsetX, 32));
 		SCREEN_STATS("(fractal offset) C.y: " + to_string_with_precision(b->cudaStats.offsetY, 32));
+		if (b->cudaStats.precisionTier != nullptr && b->cudaStats.previousPrecisionTier != nullptr) {
+			SCREEN_STATS("Precision tier: " + std::string(b->cudaStats.precisionTier) +
+				" (from " + b->cudaStats.previousPrecisionTier + " at SCALE Alpha: " +
+				to_string_with_precision(b->cudaStats.precisionSwitchScaleA, 32) + ")");
+		}
 #endif //DISPLAY_KERNEL_PARAMETERS
 
 		SDL_GetMouseState((int *)&b->mouseX, (int *)&b->mouseY);
@@ -284,7 +314,6 @@ error_t sdlBase::render_loop(sdlBase* b)
 #endif //DISPLAY_MOUSE_LOCATION
 
 		SDL_Event sdlEvent;
-		error_t err;
 		while (SDL_PollEvent(&sdlEvent) != 0) {
 			switch (sdlEvent.type) {
 			case SDL_QUIT:
@@ -308,18 +337,28 @@ error_t sdlBase::render_loop(sdlBase* b)
 					controllerPtr->set_user_io_state(controller::SET_ZOOM_REVERSE);
 					break;
 
+				// Pans the view by CONTROLLER_PAN_STEP pixels
+				case SDLK_LEFT:
+					controllerPtr->pan_by_pixels(-CONTROLLER_PAN_STEP, 0);
+					break;
+				case SDLK_RIGHT:
+					controllerPtr->pan_by_pixels(CONTROLLER_PAN_STEP, 0);
+					break;
+				case SDLK_UP:
+					controllerPtr->pan_by_pixels(0, -CONTROLLER_PAN_STEP);
+					break;
+				case SDLK_DOWN:
+					controllerPtr->pan_by_pixels(0, CONTROLLER_PAN_STEP);
+					break;
+
 				// Sets the crosshair
 				case SDLK_c:
 					b->drawCrosshair = !b->drawCrosshair;
 					break;
 
-				// Dumps the current controller parameters into JSON
+				// Dumps the current controller parameters into JSON (render thread)
 				case SDLK_d:
-					err = controllerPtr->dump_parameters_json();
-					if (err != 0) {
-						DERROR("Failed to dump parameters to JSON: " + std::to_string(err));
-						std::exit(err);
-					}
+					controllerPtr->request_parameter_dump();
 					break;
 
 				// Teriminate application
@@ -340,6 +379,14 @@ error_t sdlBase::render_loop(sdlBase* b)
 				}
 				break;
 
+			// Right button drag, the image follows the cursor
+			case SDL_MOUSEMOTION:
+				if ((sdlEvent.motion.state & SDL_BUTTON_RMASK) != 0 &&
+					(sdlEvent.motion.xrel != 0 || sdlEvent.motion.yrel != 0)) {
+					controllerPtr->pan_by_pixels(-sdlEvent.motion.xrel, -sdlEvent.motion.yrel);
+				}
+				break;
+
 			case SDL_WINDOWEVENT:
 				switch (sdlEvent.window.event) {
 				case SDL_WINDOWEVENT_CLOSE:
@@ -371,9 +418,9 @@ error_t sdlBase::render_loop(sdlBase* b)
 
 		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "2");
 
-		// Draw raw frame buffer
-		frameBufferLock->lock();
-		if (refreshBuffer) {
+		// Draw raw frame buffer, the slot stays ours until the next acquire_read
+		const rgbaPixel *frameBuffer = frames->acquire_read();
+		if (frameBuffer != nullptr) {
 			unsigned char* lockedPixels = nullptr;
 			int pitch = 0;
 			SDL_LockTexture(frameTexture,
@@ -382,8 +429,6 @@ error_t sdlBase::render_loop(sdlBase* b)
 				&pitch);
 			std::memcpy(lockedPixels, frameBuffer, frameTotalPixels * sizeof(rgbaPixel));
 			SDL_UnlockTexture(frameTexture);
-			
-			refreshBuffer = false;
 		} 
 		
 		/*
@@ -397,8 +442,6 @@ error_t sdlBase::render_loop(sdlBase* b)
 			);
 		}
 		*/
-		
-		frameBufferLock->unlock();
 
 		// Copy frame image into renderer
 		SDL_RenderCopy(renderer, frameTexture, NULL, NULL);
@@ -453,21 +496,13 @@ error_t sdlBase::render_loop(sdlBase* b)
 	return 0;
 }
 
-void sdlBase::write_static_frame(__in rgbaPixel* frame, size_t length, size_t height)
+void sdlBase::write_static_frame(const rgbaPixel* frame, size_t length, size_t height)
 {
-	frameBufferLock->lock();
-
-	if (this->frameBuffer != nullptr) {
-		std::free(frameBuffer);
-	}
-
-	framePixelLength = length;
-	framePixelHeight = height;
-	frameTotalPixels = framePixelHeight * framePixelLength;
-	frameBuffer = frame;
-	refreshBuffer = true;
+	assert(frames != nullptr);
+	assert(length == frames->get_pixel_length() && height == frames->get_pixel_height());
 
-	frameBufferLock->unlock();
+	std::memcpy(frames->get_write_slot(), frame, length * height * sizeof(rgbaPixel));
+	frames->publish();
 }
 
 error_t sdlBase::init_window(void)
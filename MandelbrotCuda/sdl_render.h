@@ -5,6 +5,7 @@
 #include <SDL2/SDL_ttf.h>
 
 #include <mutex>
+#include <atomic>
 #include <assert.h>
 #include <chrono>
 #include <string>
@@ -12,6 +13,8 @@
 
 #include "main.h"
 #include "types.h"
+#include "frame_ring.h"
+#include "mailbox.h"
 
 #define FPS_COUNTER_FONT_TYPE		"C:\\Windows\\Fonts\\Arial.ttf"
 #define FPS_COUNTER_FONT_SIZE		20
@@ -136,6 +139,29 @@ namespace render
 		double frameRenderElapsedms; // milliseconds
 		double offsetX, offsetY;
 		double scaleA, scaleB;
+
+		// Precision ladder, tier of this frame and the last switch point
+		const char *precisionTier;
+		const char *previousPrecisionTier;
+		double precisionSwitchScaleA;
+
+		// Progressive passes of this frame and the latency to the first one
+		uint32_t progressivePasses;
+		double firstPassElapsedms;
+
+		// Frames abandoned for a newer view and the iterations they cost
+		uint64_t cancelledFrames;
+		uint64_t wastedIterations;
+
+		// Share of the frame copied from the previous one (CPU reprojection)
+		double reuseRatio;
+
+		// CPU tile cache counters since the start
+		uint64_t tileCacheHits, tileCacheMisses, tileCacheEvictions;
+
+		// Automatic zoom frames in the render-ahead queue, frames thrown away on input
+		uint32_t renderAheadQueued;
+		uint64_t renderAheadDiscarded;
 	} CUDA_RENDERING_STATS, *PCUDA_RENDERING_STATS;
 
 	class sdlBase {
@@ -146,20 +172,18 @@ namespace render
 		SDL_Window *window;
 		SDL_Renderer *renderer;
 
-		// Frame buffer sync 
-		std::mutex *frameBufferLock;
-		
-		// Frame buffer (SDL2 texture array)
+		// Frames from the render thread (SDL2 texture array), owned by the caller
 		//   Each pixel contains r, g, b, alpha, 8 bits each
+		frameRing *frames;
 		size_t framePixelLength, framePixelHeight, frameTotalPixels;
-		rgbaPixel *frameBuffer;
-		bool refreshBuffer;
 
 		// Render loop flag
-		bool doRender;
+		std::atomic<bool> doRender;
 		std::thread *renderThread;
 
-		// Counter for the CUDA rendering
+		// Counter for the CUDA rendering, published by the render thread and
+		//  copied to cudaStats (render loop only) when a new one arrives
+		latestMailbox<cudaRenderingStats> statsMailbox;
 		cudaRenderingStats cudaStats;
 
 		// Draw cross hairs
@@ -183,7 +207,17 @@ namespace render
 	public:
 		// Function for SDL2 raw frame buffer, uses format:
 		//  4 bytes per pixel: r, g, b, alpha
-		void write_static_frame(__in rgbaPixel* frame, size_t length, size_t height);
+		//  The frame is copied into the ring, the caller keeps ownership
+		void write_static_frame(const rgbaPixel* frame, size_t length, size_t height);
+
+		// Frame source of the render loop, has to be set before enter_render_loop
+		void set_frame_ring(__inout frameRing *ring)
+		{
+			frames = ring;
+			framePixelLength = ring->get_pixel_length();
+			framePixelHeight = ring->get_pixel_height();
+			frameTotalPixels = framePixelLength * framePixelHeight;
+		}
 
 		error_t enter_render_loop(void)
 		{
@@ -198,9 +232,11 @@ namespace render
 			doRender = false;
 		}
 
-		void update_cuda_rendering_stats(cudaRenderingStats stats)
+		// Render thread side, never waits on the render loop
+		void update_cuda_rendering_stats(const cudaRenderingStats &stats)
 		{
-			cudaStats = stats;
+			statsMailbox.get_write_slot() = stats;
+			statsMailbox.publish();
 		}
 
 	public:
@@ -208,8 +244,7 @@ namespace render
 			windowHeight(height), windowWidth(width), windowTitle(windowTitle),
 			window(nullptr), renderer(nullptr),
 			doRender(false), renderThread(nullptr),
-			frameBuffer(nullptr), framePixelHeight(0), framePixelLength(0), refreshBuffer(false),
-			frameBufferLock(new std::mutex()),
+			frames(nullptr), framePixelHeight(0), framePixelLength(0), frameTotalPixels(0),
 			cudaStats(cudaRenderingStats{ 56666666555 }),
 #if defined(RENDER_ENABLE_FPS_CAP)
 			frameCount(0),
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Bounded single-producer / single-consumer queue
+ *  A ring of capacity slots with a head owned by the consumer and a tail
+ *  owned by the producer, neither side takes a lock. push() fails when the
+ *  queue is full instead of waiting. capacity has to be a power of two.
+ */
+
+namespace controller {
+	template<typename T, size_t capacity>
+	class spscQueue {
+	private:
+		static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0, "capacity has to be a power of two");
+
+		T slots[capacity];
+
+		// Free running counters, index = counter % capacity
+		std::atomic<size_t> head;	// Next slot to pop (consumer)
+		std::atomic<size_t> tail;	// Next slot to push (producer)
+
+	public:
+		/*
+		 * Producer side, returns false (and drops val) when the queue is full
+		 */
+		bool push(const T &val)
+		{
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == capacity) {
+				return false;
+			}
+
+			slots[t & (capacity - 1)] = val;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*
+		 * Consumer side, returns false when the queue is empty
+		 */
+		bool pop(__inout T *val)
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) {
+				return false;
+			}
+
+			*val = slots[h & (capacity - 1)];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Either side, a snapshot
+		bool empty(void) const
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+
+	public:
+		spscQueue(void) : head(0), tail(0)
+		{
+
+		}
+
+		spscQueue(const spscQueue &) = delete;
+		spscQueue &operator=(const spscQueue &) = delete;
+	};
+}
+
+//EOF
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <iterator>
+
+#include "types.h"
+
+/*
+ * Work-stealing thread pool used by the CPU renderers
+ *  Every worker owns a deque. New work is pushed to and popped from the back
+ *  of the owner's deque, idle workers steal the oldest task from the front
+ *  of another worker's deque. Escape-time cost differs by orders of magnitude
+ *  between tiles, so this balances far better than a static row split.
+ *  The items of a parallel_for are started in index order instead: owners
+ *  take them from the front as well, callers sort the items they want
+ *  started first to the lowest indices.
+ */
+
+// Number of workers when none is specified (0 = std::thread::hardware_concurrency)
+#define THREAD_POOL_DEFAULT_WORKERS		0
+
+namespace cpu {
+	class threadPool;
+
+	/*
+	 * A batch of tasks that can be waited on as a whole
+	 */
+	class taskGroup {
+	private:
+		std::atomic<size_t> pending;
+		std::mutex waitLock;
+		std::condition_variable waitCond;
+
+		friend class threadPool;
+
+	private:
+		// The count drops under waitLock, see threadPool::wait
+		void task_done(void)
+		{
+			std::lock_guard<std::mutex> l(waitLock);
+			if (pending.fetch_sub(1) == 1) {
+				waitCond.notify_all();
+			}
+		}
+
+	public:
+		bool is_done(void) const { return pending.load() == 0; }
+
+		taskGroup(void) :
+			pending(0)
+		{
+
+		}
+	};
+
+	class threadPool {
+	private:
+		typedef struct poolTask {
+			std::function<void(void)> func;
+			taskGroup *group;
+			bool inOrder;				// Item of a parallel_for, taken from the front
+		} POOL_TASK, *PPOOL_TASK;
+
+		typedef struct workerQueue {
+			std::mutex lock;
+			std::deque<poolTask> tasks;
+		} WORKER_QUEUE, *PWORKER_QUEUE;
+
+		// Identifies the pool and queue owned by the calling thread
+		typedef struct workerIdentity {
+			const threadPool *pool;
+			uint32_t index;
+		} WORKER_IDENTITY, *PWORKER_IDENTITY;
+
+		std::vector<workerQueue *> queues;
+		std::vector<std::thread *> workers;
+
+		// Idle workers park here until work is queued
+		std::mutex sleepLock;
+		std::condition_variable sleepCond;
+
+		std::atomic<size_t> queuedTasks;
+		std::atomic<uint32_t> nextQueue;
+		std::atomic<bool> running;
+
+		// Counters
+		std::atomic<uint64_t> tasksExecuted, tasksStolen;
+
+	private:
+		static workerIdentity &current_worker(void)
+		{
+			static thread_local workerIdentity identity = { nullptr, 0 };
+			return identity;
+		}
+
+		// Returns the queue index owned by the caller, or -1 for external threads
+		int32_t own_queue_index(void) const
+		{
+			const workerIdentity &id = current_worker();
+			return id.pool == this ? (int32_t)id.index : -1;
+		}
+
+		/*
+		 * Takes a task of group only (of any group for nullptr) from q, false
+		 *  when it holds none. The owner takes the newest task unless it is an
+		 *  item of a parallel_for, those and thieves go from the front
+		 */
+		bool take_task(workerQueue *q, const taskGroup *only, bool owner, __inout poolTask *out)
+		{
+			std::lock_guard<std::mutex> l(q->lock);
+			std::deque<poolTask>::iterator pick = q->tasks.end();
+			if (owner) {
+				for (std::deque<poolTask>::reverse_iterator i = q->tasks.rbegin(); i != q->tasks.rend(); ++i) {
+					if (only == nullptr || i->group == only) {
+						pick = std::prev(i.base());
+						break;
+					}
+				}
+			}
+
+			if (!owner || (pick != q->tasks.end() && pick->inOrder)) {
+				for (std::deque<poolTask>::iterator i = q->tasks.begin(); i != q->tasks.end(); ++i) {
+					if (only == nullptr || i->group == only) {
+						pick = i;
+						break;
+					}
+				}
+			}
+
+			if (pick == q->tasks.end()) {
+				return false;
+			}
+			*out = std::move(*pick);
+			q->tasks.erase(pick);
+			queuedTasks--;
+			return true;
+		}
+
+		bool pop_task(int32_t ownIndex, const taskGroup *only, __inout poolTask *out)
+		{
+			const uint32_t queueCount = (uint32_t)queues.size();
+
+			if (ownIndex >= 0 && take_task(queues[ownIndex], only, true, out)) {
+				return true;
+			}
+
+			// Steal the oldest task of another worker
+			const uint32_t start = ownIndex >= 0 ? (uint32_t)ownIndex + 1 : nextQueue.load();
+			for (uint32_t i = 0; i < queueCount; i++) {
+				const uint32_t victim = (start + i) % queueCount;
+				if ((int32_t)victim == ownIndex) {
+					continue;
+				}
+
+				if (take_task(queues[victim], only, false, out)) {
+					if (ownIndex >= 0) {
+						tasksStolen++;
+					}
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void run_task(__inout poolTask *task)
+		{
+			task->func();
+			tasksExecuted++;
+			task->group->task_done();
+		}
+
+		static void worker_thread(threadPool *pool, uint32_t index)
+		{
+			workerIdentity &id = current_worker();
+			id.pool = pool;
+			id.index = index;
+
+			while (pool->running) {
+				poolTask task;
+				if (pool->pop_task((int32_t)index, nullptr, &task)) {
+					pool->run_task(&task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> l(pool->sleepLock);
+				pool->sleepCond.wait(l, [pool] {
+					return !pool->running || pool->queuedTasks.load() > 0;
+				});
+			}
+		}
+
+		void push_task(uint32_t queueIndex, std::function<void(void)> func, __inout taskGroup *group, bool inOrder)
+		{
+			workerQueue *q = queues[queueIndex];
+			std::lock_guard<std::mutex> l(q->lock);
+			q->tasks.push_back({ std::move(func), group, inOrder });
+		}
+
+		void wake_workers(size_t count)
+		{
+			std::lock_guard<std::mutex> l(sleepLock);
+			if (count == 1) {
+				sleepCond.notify_one();
+			}
+			else {
+				sleepCond.notify_all();
+			}
+		}
+
+	public:
+		/*
+		 * Queues a single task, returns immediately
+		 */
+		void submit(__inout taskGroup *group, std::function<void(void)> func)
+		{
+			group->pending++;
+
+			const int32_t ownIndex = own_queue_index();
+			const uint32_t queueIndex = ownIndex >= 0 ?
+				(uint32_t)ownIndex : nextQueue.fetch_add(1) % (uint32_t)queues.size();
+			queuedTasks++;
+			push_task(queueIndex, std::move(func), group, false);
+
+			wake_workers(1);
+		}
+
+		/*
+		 * Blocks until every task in the group has finished. The calling thread
+		 *  executes the queued tasks of the group while it waits, so nested
+		 *  waits cannot deadlock. Tasks of other groups are left to the
+		 *  workers: a render waiting on its tiles does not pick up a frame
+		 *  encode queued beside them
+		 */
+		void wait(__inout taskGroup *group)
+		{
+			const int32_t ownIndex = own_queue_index();
+			while (!group->is_done()) {
+				poolTask task;
+				if (pop_task(ownIndex, group, &task)) {
+					run_task(&task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> l(group->waitLock);
+				group->waitCond.wait(l, [group] { return group->is_done(); });
+			}
+
+			// The worker of the last task may still be inside task_done, the
+			//  group must outlive it: that worker holds waitLock until it is done
+			std::lock_guard<std::mutex> l(group->waitLock);
+		}
+
+		/*
+		 * Runs func(0..count-1) across the pool and waits for completion
+		 *  Indices are dealt round-robin so that neighbouring (similarly
+		 *  expensive) items start out on different workers, every queue is
+		 *  worked from its lowest index, so low indices are started first
+		 */
+		void parallel_for(size_t count, const std::function<void(size_t)> &func)
+		{
+			if (count == 0) {
+				return;
+			}
+
+			taskGroup group;
+			group.pending += count;
+
+			const uint32_t queueCount = (uint32_t)queues.size();
+			const uint32_t start = nextQueue.fetch_add(1);
+			queuedTasks += count;
+			for (size_t i = 0; i < count; i++) {
+				push_task((uint32_t)((start + i) % queueCount), [&func, i] { func(i); }, &group, true);
+			}
+
+			wake_workers(count);
+
+			wait(&group);
+		}
+
+		uint32_t get_worker_count(void) const { return (uint32_t)workers.size(); }
+		uint64_t get_tasks_executed(void) const { return tasksExecuted.load(); }
+		uint64_t get_tasks_stolen(void) const { return tasksStolen.load(); }
+
+	public:
+		threadPool(uint32_t workerCount) :
+			queuedTasks(0), nextQueue(0), running(true),
+			tasksExecuted(0), tasksStolen(0)
+		{
+			if (workerCount == THREAD_POOL_DEFAULT_WORKERS) {
+				workerCount = std::thread::hardware_concurrency();
+			}
+			if (workerCount == 0) {
+				workerCount = 1;
+			}
+
+			for (uint32_t i = 0; i < workerCount; i++) {
+				queues.push_back(new workerQueue());
+			}
+			for (uint32_t i = 0; i < workerCount; i++) {
+				workers.push_back(new std::thread(&worker_thread, this, i));
+			}
+		}
+
+		~threadPool(void)
+		{
+			running = false;
+			wake_workers(workers.size());
+
+			for (std::vector<std::thread *>::iterator i = workers.begin(); i != workers.end(); ++i) {
+				(*i)->join();
+				delete *i;
+			}
+			for (std::vector<workerQueue *>::iterator i = queues.begin(); i != queues.end(); ++i) {
+				delete *i;
+			}
+		}
+	};
+
+	/*
+	 * pool->parallel_for, or a plain loop on the calling thread without a pool
+	 */
+	static inline void parallel_for(threadPool *pool, size_t count, const std::function<void(size_t)> &func)
+	{
+		if (pool != nullptr) {
+			pool->parallel_for(count, func);
+			return;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			func(i);
+		}
+	}
+}
+
+//EOF
\ No newline at end of file
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+/*
+ * LRU cache of iterated tiles for the CPU renderer
+ *  Tiles sit on a grid that is global to a zoom level: tile (tileX, tileY)
+ *  of a level covers the pixels tileX * edge .. (tileX + 1) * edge - 1 of the
+ *  plane divided into pixels of the level's spacing. A view whose pixel
+ *  centres fall on that grid finds its tiles again wherever it was panned
+ *  from. Entries are evicted least recently used first once the byte budget
+ *  is exceeded. Every call takes the cache lock, tiles are looked up and
+ *  stored from the workers of the thread pool.
+ */
+
+// Default memory budget (bytes), 64 MB holds ~4000 tiles of 64x64
+#define TILE_CACHE_DEFAULT_BUDGET	(64ull * 1024 * 1024)
+
+// Renderer options a tile was iterated with (tileKey::options), tiles of
+//  other options may hold other escape times
+#define TILE_KEY_SUBDIVISION		0x1		// Mariani-Silver fill, lossy
+#define TILE_KEY_PERIODICITY		0x2		// Periodicity check, ends interior orbits early
+
+namespace cpu {
+	typedef struct tileKey {
+		uint64_t zoomLevel;		// Bit pattern of the pixel spacing, identifies the level
+		int64_t tileX, tileY;	// Tile on the global grid of the level
+		uint32_t maxIter;
+		uint32_t formula;		// Arithmetic the tile was iterated in (cpu::PRECISION_TIER)
+		uint32_t options;		// TILE_KEY_* the tile was iterated with
+
+		bool operator==(const tileKey &other) const
+		{
+			return zoomLevel == other.zoomLevel && tileX == other.tileX && tileY == other.tileY &&
+				maxIter == other.maxIter && formula == other.formula && options == other.options;
+		}
+	} TILE_KEY, *PTILE_KEY;
+
+	typedef struct tileKeyHash {
+		size_t operator()(const tileKey &key) const
+		{
+			// 64-bit FNV-1a over the fields
+			uint64_t hash = 0xcbf29ce484222325ull;
+			const uint64_t fields[6] = { key.zoomLevel, (uint64_t)key.tileX, (uint64_t)key.tileY,
+				key.maxIter, key.formula, key.options };
+			for (const uint64_t field : fields) {
+				hash = (hash ^ field) * 0x100000001b3ull;
+			}
+			return (size_t)hash;
+		}
+	} TILE_KEY_HASH, *PTILE_KEY_HASH;
+
+	typedef struct tileCacheStats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint64_t entries;
+		uint64_t bytesUsed;
+		uint64_t byteBudget;
+	} TILE_CACHE_STATS, *PTILE_CACHE_STATS;
+
+	class tileCache {
+	private:
+		typedef struct cacheEntry {
+			tileKey key;
+			std::vector<uint32_t> iterations;
+		} CACHE_ENTRY, *PCACHE_ENTRY;
+
+		// Front is the most recently used
+		std::list<cacheEntry> entries;
+		std::unordered_map<tileKey, std::list<cacheEntry>::iterator, tileKeyHash> index;
+
+		const uint32_t tileEdge;
+		size_t byteBudget, bytesUsed;
+		uint64_t hits, misses, evictions;
+		mutable std::mutex lock;
+
+	private:
+		// Iterations plus the list node and the index slot
+		size_t get_entry_bytes(void) const
+		{
+			return (size_t)tileEdge * tileEdge * sizeof(uint32_t) + sizeof(cacheEntry) +
+				sizeof(tileKey) + 4 * sizeof(void *);
+		}
+
+		// Caller holds the lock
+		void evict_to(size_t budget)
+		{
+			while (bytesUsed > budget && !entries.empty()) {
+				index.erase(entries.back().key);
+				entries.pop_back();
+				bytesUsed -= get_entry_bytes();
+				evictions++;
+			}
+		}
+
+	public:
+		/*
+		 * Copies the tile into out (tileEdge * tileEdge escape times, row major)
+		 *  and marks it used, false on a miss
+		 */
+		bool lookup(const tileKey &key, __inout uint32_t *out)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			const auto found = index.find(key);
+			if (found == index.end()) {
+				misses++;
+				return false;
+			}
+
+			entries.splice(entries.begin(), entries, found->second);
+			std::memcpy(out, found->second->iterations.data(), found->second->iterations.size() * sizeof(uint32_t));
+			hits++;
+			return true;
+		}
+
+		/*
+		 * Stores a complete tile (tileEdge * tileEdge escape times), the least
+		 *  recently used tiles make room for it
+		 */
+		void insert(const tileKey &key, const uint32_t *iterations)
+		{
+			const size_t count = (size_t)tileEdge * tileEdge;
+
+			std::lock_guard<std::mutex> guard(lock);
+			if (get_entry_bytes() > byteBudget) {
+				return;
+			}
+
+			const auto found = index.find(key);
+			if (found != index.end()) {
+				entries.splice(entries.begin(), entries, found->second);
+				std::memcpy(found->second->iterations.data(), iterations, count * sizeof(uint32_t));
+				return;
+			}
+
+			evict_to(byteBudget - get_entry_bytes());
+			entries.push_front(cacheEntry{ key, std::vector<uint32_t>(iterations, iterations + count) });
+			index[key] = entries.begin();
+			bytesUsed += get_entry_bytes();
+		}
+
+		// Shrinking the budget evicts right away, 0 empties the cache
+		void set_byte_budget(size_t bytes)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			byteBudget = bytes;
+			evict_to(byteBudget);
+		}
+
+		void clear(void)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			entries.clear();
+			index.clear();
+			bytesUsed = 0;
+		}
+
+		tileCacheStats get_stats(void) const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return tileCacheStats{ hits, misses, evictions, (uint64_t)entries.size(), bytesUsed, byteBudget };
+		}
+
+		uint32_t get_tile_edge(void) const { return tileEdge; }
+
+	public:
+		tileCache(uint32_t tileEdge, size_t byteBudget) :
+			tileEdge(tileEdge), byteBudget(byteBudget), bytesUsed(0),
+			hits(0), misses(0), evictions(0)
+		{
+
+		}
+
+		tileCache(const tileCache &) = delete;
+		tileCache &operator=(const tileCache &) = delete;
+	};
+}
+
+//EOF
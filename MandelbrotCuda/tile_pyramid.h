@@ -0,0 +1,448 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#include "types.h"
+#include "ppm.h"
+#include "fixed_point.h"
+#include "precision_ladder.h"
+#include "thread_pool.h"
+#include "mandelbrot_cpu.h"
+
+/*
+ * Tile pyramid (deep zoom) export of one view
+ *  The finest level is the view at its full size, every coarser level halves
+ *  it until the image fits one tile. Level 0 is the coarsest, tiles are
+ *  PYRAMID_TILE_SIZE square (smaller at the right and bottom edges) and go to
+ *  <dir>/<level>/<column>_<row>.ppm with <dir>/manifest.json describing the
+ *  pyramid.
+ *  The quadtree is walked depth first. Only tiles of the finest level are
+ *  iterated, a coarser tile is the 2x2 box filtered mosaic of its children.
+ *  Before a tile is descended into, the border of its footprint is iterated
+ *  at the finest resolution: the Mandelbrot set has no holes, so a border
+ *  that is interior all the way round encloses interior only (the Mariani-
+ *  Silver argument). Such a tile is listed as interior in the manifest,
+ *  neither it nor any tile below it is written, and iteration work follows
+ *  the boundary of the set instead of the pixel count.
+ *  No pixel is iterated twice: a footprint takes the part of its border on
+ *  the border of its parent from there, a finest tile only iterates the
+ *  pixels inside its border.
+ */
+
+#define PYRAMID_TILE_SIZE			256
+#define PYRAMID_MANIFEST			"manifest.json"
+
+namespace batch {
+	typedef struct pyramidStats {
+		uint32_t levels;
+		uint64_t tilesRendered;		// Finest level tiles iterated
+		uint64_t tilesMerged;		// Coarser tiles built from their children
+		uint64_t tilesInterior;		// Interior tiles, nothing below them is generated
+		uint64_t pixelsIterated;	// Finest level pixels iterated (tiles and borders), all the work done
+		uint64_t pixelsFinest;		// Pixels of the finest level
+	} PYRAMID_STATS, *PPYRAMID_STATS;
+
+	class pyramidExporter {
+	private:
+		typedef struct tileId {
+			uint32_t level, column, row;
+		} TILE_ID, *PTILE_ID;
+
+		// Pixels of one tile, empty for an interior tile
+		typedef struct tileImage {
+			uint32_t width, height;
+			std::vector<rgbaPixel> pixels;
+		} TILE_IMAGE, *PTILE_IMAGE;
+
+		// A row or column of finest level pixels on the border of a footprint
+		typedef struct borderLine {
+			uint32_t x, y, length;
+			bool vertical;
+			std::vector<uint32_t> field;
+			std::vector<rgbaPixel> pixels;
+		} BORDER_LINE, *PBORDER_LINE;
+
+		cpu::threadPool *pool;
+
+		// View of the finest level
+		cpu::fixedPoint centerX, centerY;
+		double scaleA, scaleB;
+		double pixelScale;
+		uint32_t width, height;
+		uint32_t iterations;
+		cpu::PRECISION_TIER tier;
+		bool smooth;
+
+		std::string directory;
+		uint32_t levels;
+
+		// One renderer per region size (tiles, border rows and columns)
+		std::map<std::pair<uint32_t, uint32_t>, std::unique_ptr<mandelbrotFractalCpu>> renderers;
+
+		std::vector<tileId> interiorTiles;
+		rgbaPixel interiorColour;
+		pyramidStats stats;
+
+	private:
+		// Finest level pixels one pixel of level spans
+		uint32_t get_level_shift(uint32_t level) const { return levels - 1 - level; }
+
+		uint32_t get_level_width(uint32_t level) const
+		{
+			return (uint32_t)((((uint64_t)width) + (1ull << get_level_shift(level)) - 1) >> get_level_shift(level));
+		}
+
+		uint32_t get_level_height(uint32_t level) const
+		{
+			return (uint32_t)((((uint64_t)height) + (1ull << get_level_shift(level)) - 1) >> get_level_shift(level));
+		}
+
+		bool tile_exists(uint32_t level, uint32_t column, uint32_t row) const
+		{
+			return (uint64_t)column * PYRAMID_TILE_SIZE < get_level_width(level) &&
+				(uint64_t)row * PYRAMID_TILE_SIZE < get_level_height(level);
+		}
+
+		/*
+		 * Iterates the w * h pixels of the finest level from (x, y) into out,
+		 *  returns the iteration field of the region. The regions are parts of
+		 *  the finest level frame, every pixel is iterated where a render of
+		 *  the whole view puts it
+		 */
+		const uint32_t *render_region(uint32_t x, uint32_t y, uint32_t w, uint32_t h, __inout rgbaPixel *out)
+		{
+			std::unique_ptr<mandelbrotFractalCpu> &renderer = renderers[std::make_pair(w, h)];
+			if (!renderer) {
+				renderer.reset(new mandelbrotFractalCpu(0.0, 0.0, w, h, scaleA, scaleB,
+					iterations, THREAD_POOL_DEFAULT_WORKERS));
+				renderer->set_thread_pool(pool);
+				renderer->set_center(centerX, centerY);
+				renderer->set_precision_tier(tier);
+				renderer->set_smooth_colouring(smooth);
+			}
+
+			// Pixel (i, j) of the region is pixel (x + i, y + j) of the finest level
+			renderer->set_frame_region(width, height, x, y);
+
+			if (renderer->compute_image_tiled(out) != 0) {
+				return nullptr;
+			}
+			stats.pixelsIterated += (uint64_t)w * h;
+			return renderer->get_iteration_field();
+		}
+
+		// Copies pixel k of line from the border of the parent, false when it is not on it
+		static bool copy_from_border(const std::vector<borderLine> &parent, uint32_t k, __inout borderLine *line)
+		{
+			const uint32_t px = line->vertical ? line->x : line->x + k;
+			const uint32_t py = line->vertical ? line->y + k : line->y;
+			for (const borderLine &known : parent) {
+				const bool on = known.vertical ?
+					px == known.x && py >= known.y && py - known.y < known.length :
+					py == known.y && px >= known.x && px - known.x < known.length;
+				if (on) {
+					const uint32_t at = known.vertical ? py - known.y : px - known.x;
+					line->field[k] = known.field[at];
+					line->pixels[k] = known.pixels[at];
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/*
+		 * Fills line, its pixels on the border of the parent are taken from
+		 *  there and the runs between them are iterated
+		 */
+		error_t fill_line(const std::vector<borderLine> &parent, __inout borderLine *line)
+		{
+			line->field.resize(line->length);
+			line->pixels.resize(line->length);
+
+			uint32_t run = 0;
+			for (uint32_t k = 0; k <= line->length; k++) {
+				if (k < line->length && !copy_from_border(parent, k, line)) {
+					continue;
+				}
+
+				if (run < k) {
+					const uint32_t count = k - run;
+					const uint32_t *field = line->vertical ?
+						render_region(line->x, line->y + run, 1, count, &line->pixels[run]) :
+						render_region(line->x + run, line->y, count, 1, &line->pixels[run]);
+					if (field == nullptr) {
+						return -1;
+					}
+					std::copy(field, field + count, &line->field[run]);
+				}
+				run = k + 1;
+			}
+			return 0;
+		}
+
+		/*
+		 * Border of the footprint at (x, y), w * h finest level pixels, as
+		 *  lines no two of which share a pixel. parent is the border of the
+		 *  footprint above, empty for the root
+		 */
+		error_t get_footprint_border(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+			const std::vector<borderLine> &parent, __inout std::vector<borderLine> *border)
+		{
+			border->clear();
+			border->push_back(borderLine{ x, y, w, false });
+			if (h > 1) {
+				border->push_back(borderLine{ x, y + h - 1, w, false });
+			}
+			if (h > 2) {
+				border->push_back(borderLine{ x, y + 1, h - 2, true });
+				if (w > 1) {
+					border->push_back(borderLine{ x + w - 1, y + 1, h - 2, true });
+				}
+			}
+
+			for (borderLine &line : *border) {
+				if (fill_line(parent, &line) != 0) {
+					return -1;
+				}
+			}
+			return 0;
+		}
+
+		// Every pixel of the border is interior
+		bool border_is_interior(const std::vector<borderLine> &border) const
+		{
+			for (const borderLine &line : border) {
+				for (const uint32_t iter : line.field) {
+					if (iter <= iterations) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		error_t write_tile(const tileId &id, const tileImage &tile) const
+		{
+			const std::filesystem::path level = std::filesystem::path(directory) / std::to_string(id.level);
+			const std::string name = std::to_string(id.column) + "_" + std::to_string(id.row) + ".ppm";
+			return ppm::write_frame((level / name).string(), ppm::PPM_FORMAT_P6, tile.pixels.data(),
+				tile.width, tile.height);
+		}
+
+		/*
+		 * 2x2 box filter of the children of id into *tile, interior children
+		 *  are filled with the interior colour. Children cut by the edge of the
+		 *  image average the pixels they have
+		 */
+		void merge_children(const tileId &id, const tileImage *children, const bool *interior, __inout tileImage *tile)
+		{
+			const uint32_t childWidth = get_level_width(id.level + 1), childHeight = get_level_height(id.level + 1);
+			for (uint32_t i = 0; i < tile->height; i++) {
+				for (uint32_t j = 0; j < tile->width; j++) {
+					uint32_t red = 0, green = 0, blue = 0, count = 0;
+					for (uint32_t di = 0; di < 2; di++) {
+						for (uint32_t dj = 0; dj < 2; dj++) {
+							// Pixel of the child level, relative to the first child
+							const uint32_t ci = 2 * i + di, cj = 2 * j + dj;
+							if ((uint64_t)id.row * 2 * PYRAMID_TILE_SIZE + ci >= childHeight ||
+								(uint64_t)id.column * 2 * PYRAMID_TILE_SIZE + cj >= childWidth) {
+								continue;
+							}
+
+							const uint32_t child = (ci / PYRAMID_TILE_SIZE) * 2 + cj / PYRAMID_TILE_SIZE;
+							const rgbaPixel &p = interior[child] ? interiorColour :
+								children[child].pixels[(size_t)(ci % PYRAMID_TILE_SIZE) * children[child].width + cj % PYRAMID_TILE_SIZE];
+							red += p.red;
+							green += p.green;
+							blue += p.blue;
+							count++;
+						}
+					}
+
+					tile->pixels[(size_t)i * tile->width + j] = rgbaPixel{ (BYTE)((red + count / 2) / count),
+						(BYTE)((green + count / 2) / count), (BYTE)((blue + count / 2) / count), 0 };
+				}
+			}
+		}
+
+		/*
+		 * Generates tile id and everything below it, *interior is set when its
+		 *  footprint is interior (nothing is written then). parentBorder is the
+		 *  border of the tile above, empty for the root
+		 */
+		error_t build_tile(const tileId &id, const std::vector<borderLine> &parentBorder,
+			__inout tileImage *tile, __inout bool *interior)
+		{
+			const uint32_t shift = get_level_shift(id.level);
+			const uint64_t span = (uint64_t)PYRAMID_TILE_SIZE << shift;
+			const uint32_t x = (uint32_t)(id.column * span), y = (uint32_t)(id.row * span);
+			const uint32_t w = (uint32_t)std::min<uint64_t>(span, width - x);
+			const uint32_t h = (uint32_t)std::min<uint64_t>(span, height - y);
+
+			std::vector<borderLine> border;
+			error_t err = get_footprint_border(x, y, w, h, parentBorder, &border);
+			if (err != 0) {
+				return err;
+			}
+			*interior = border_is_interior(border);
+			if (*interior) {
+				interiorTiles.push_back(id);
+				stats.tilesInterior++;
+				interiorColour = border[0].pixels[0];
+				return 0;
+			}
+
+			tile->width = std::min<uint32_t>(PYRAMID_TILE_SIZE, get_level_width(id.level) - id.column * PYRAMID_TILE_SIZE);
+			tile->height = std::min<uint32_t>(PYRAMID_TILE_SIZE, get_level_height(id.level) - id.row * PYRAMID_TILE_SIZE);
+			tile->pixels.resize((size_t)tile->width * tile->height);
+
+			if (shift == 0) {
+				// The border is done, the pixels inside it are left
+				if (w > 2 && h > 2) {
+					std::vector<rgbaPixel> inside((size_t)(w - 2) * (h - 2));
+					if (render_region(x + 1, y + 1, w - 2, h - 2, inside.data()) == nullptr) {
+						return -1;
+					}
+					for (uint32_t i = 0; i < h - 2; i++) {
+						std::copy(&inside[(size_t)i * (w - 2)], &inside[(size_t)(i + 1) * (w - 2)],
+							&tile->pixels[(size_t)(i + 1) * w + 1]);
+					}
+				}
+				for (const borderLine &line : border) {
+					for (uint32_t k = 0; k < line.length; k++) {
+						const uint32_t px = line.vertical ? line.x : line.x + k;
+						const uint32_t py = line.vertical ? line.y + k : line.y;
+						tile->pixels[(size_t)(py - y) * w + (px - x)] = line.pixels[k];
+					}
+				}
+				stats.tilesRendered++;
+			}
+			else {
+				tileImage children[4];
+				bool childInterior[4] = { true, true, true, true };
+				for (uint32_t k = 0; k < 4; k++) {
+					const tileId child = { id.level + 1, id.column * 2 + (k & 1), id.row * 2 + (k >> 1) };
+					if (!tile_exists(child.level, child.column, child.row)) {
+						continue;
+					}
+					err = build_tile(child, border, &children[k], &childInterior[k]);
+					if (err != 0) {
+						return err;
+					}
+				}
+
+				merge_children(id, children, childInterior, tile);
+				stats.tilesMerged++;
+			}
+
+			return write_tile(id, *tile);
+		}
+
+		error_t write_manifest(void) const
+		{
+			// Enough decimals to place the centre well inside a pixel
+			const uint32_t digits = (uint32_t)std::max(17.0, std::ceil(-std::log10(pixelScale)) + 6.0);
+
+			std::ofstream manifest((std::filesystem::path(directory) / PYRAMID_MANIFEST).string());
+			if (!manifest.is_open()) {
+				return -1;
+			}
+
+			// Doubles round trip with 17 significant digits
+			manifest << std::setprecision(17) << "{\n"
+				<< "\t\"tileSize\": " << PYRAMID_TILE_SIZE << ",\n"
+				<< "\t\"format\": \"ppm\",\n"
+				<< "\t\"width\": " << width << ",\n"
+				<< "\t\"height\": " << height << ",\n"
+				<< "\t\"levels\": [\n";
+			for (uint32_t level = 0; level < levels; level++) {
+				manifest << "\t\t{ \"level\": " << level << ", \"width\": " << get_level_width(level)
+					<< ", \"height\": " << get_level_height(level) << " }" << (level + 1 < levels ? ",\n" : "\n");
+			}
+			manifest << "\t],\n"
+				<< "\t\"view\": { \"x\": \"" << centerX.to_string(digits) << "\", \"y\": \""
+				<< centerY.to_string(digits) << "\", \"pixelScale\": " << pixelScale
+				<< ", \"iterations\": " << iterations << ", \"tier\": \"" << cpu::get_precision_tier_name(tier) << "\" },\n"
+				<< "\t\"interiorColour\": [" << (uint32_t)interiorColour.red << ", " << (uint32_t)interiorColour.green
+				<< ", " << (uint32_t)interiorColour.blue << "],\n"
+				<< "\t\"interiorTiles\": [";
+			for (size_t k = 0; k < interiorTiles.size(); k++) {
+				manifest << (k == 0 ? "\n" : ",\n") << "\t\t[" << interiorTiles[k].level << ", "
+					<< interiorTiles[k].column << ", " << interiorTiles[k].row << "]";
+			}
+			manifest << (interiorTiles.empty() ? "]\n" : "\n\t]\n") << "}\n";
+
+			return manifest.good() ? 0 : -1;
+		}
+
+	public:
+		/*
+		 * Writes the pyramid of the view to directory (created if needed).
+		 *  Tiles of the manifest's interiorTiles and everything below them are
+		 *  not written, a viewer fills them with interiorColour
+		 */
+		error_t export_pyramid(const std::string &directory)
+		{
+			this->directory = directory;
+			interiorTiles.clear();
+			stats = pyramidStats{ 0 };
+			stats.levels = levels;
+			stats.pixelsFinest = (uint64_t)width * height;
+
+			std::error_code ec;
+			for (uint32_t level = 0; level < levels; level++) {
+				std::filesystem::create_directories(std::filesystem::path(directory) / std::to_string(level), ec);
+				if (ec) {
+					return -1;
+				}
+			}
+
+			tileImage root;
+			bool interior = false;
+			const error_t err = build_tile(tileId{ 0, 0, 0 }, std::vector<borderLine>(), &root, &interior);
+			if (err != 0) {
+				return err;
+			}
+
+			return write_manifest();
+		}
+
+		pyramidStats get_stats(void) const { return stats; }
+		uint32_t get_level_count(void) const { return levels; }
+
+	public:
+		/*
+		 * Pyramid of a width * height view, parameters as mandelbrotFractalCpu.
+		 *  The tier is fixed for the whole pyramid
+		 */
+		pyramidExporter(cpu::threadPool *pool, const cpu::fixedPoint &centerX, const cpu::fixedPoint &centerY,
+			uint32_t width, uint32_t height, double scaleA, double scaleB, uint32_t iterations,
+			cpu::PRECISION_TIER tier, bool smooth) :
+			pool(pool),
+			centerX(centerX), centerY(centerY),
+			scaleA(scaleA), scaleB(scaleB),
+			pixelScale(scaleA / ((double)width / scaleB)),
+			width(width), height(height), iterations(iterations),
+			tier(tier), smooth(smooth),
+			levels(1), interiorColour(rgbaPixel{ 0, 0, 0, 0 }), stats(pyramidStats{ 0 })
+		{
+			while ((std::max(width, height) + (1u << (levels - 1)) - 1) >> (levels - 1) > PYRAMID_TILE_SIZE) {
+				levels++;
+			}
+		}
+
+		pyramidExporter(const pyramidExporter &) = delete;
+		pyramidExporter &operator=(const pyramidExporter &) = delete;
+	};
+}
+
+//EOF
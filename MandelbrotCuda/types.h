@@ -4,8 +4,38 @@
 #include <stdint.h>
 #include <string>
 #include <iostream>
+#include <atomic>
 
 typedef int32_t error_t;
+
+// SAL annotation of the Windows headers, empty for other compilers
+#if !defined(_MSC_VER) && !defined(__inout)
+#define __inout
+#endif //_MSC_VER
+
+// Returned by the renderers when the frame in flight was abandoned for a newer view
+#define ERROR_RENDER_CANCELLED 1
+
+// Largest iteration count a frame is rendered or coloured with: the colour table
+//  holds maxIter + 2 entries (64 MB at this count) and maxIter + 1 marks the interior
+#define RENDER_MAX_ITERATIONS		(1u << 24)
+
+/*
+ * Stops the frame in flight, set from another thread: by flag, or by
+ *  generation once *generation moved on from frameGeneration, the
+ *  generation the frame was started for. nullptr members are ignored
+ */
+typedef struct frameCancel {
+	const std::atomic<bool> *flag;
+	const std::atomic<uint64_t> *generation;
+	uint64_t frameGeneration;
+} FRAME_CANCEL, *PFRAME_CANCEL;
+
+static inline bool is_frame_cancelled(const frameCancel &cancel)
+{
+	return (cancel.flag != nullptr && cancel.flag->load(std::memory_order_relaxed)) ||
+		(cancel.generation != nullptr && cancel.generation->load(std::memory_order_relaxed) != cancel.frameGeneration);
+}
 typedef uint8_t BYTE, * PBYTE;
 
 // Definition of the SDL_PIXELFORMAT_ARGB8888 format
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "main.h"
+#include "types.h"
+
+/*
+ * Clock of the automatic zoom
+ *  The zoom advances in fixed ticks of CONTROLLER_ZOOM_TICK_MS, a frame
+ *  shows the zoom as it stands at the time the frame is expected on screen.
+ *  The wall clock predicts that time from the smoothed interval between
+ *  frames, so fast and slow machines zoom at the same speed. The virtual
+ *  clock moves a fixed interval per frame instead, the frame sequence is
+ *  then the same on every run (benchmarks). The zoom steps themselves are
+ *  pure functions of the zoom state, kept here with the clock so both can
+ *  be checked without the render thread.
+ */
+
+// Weight of the newest frame interval in the smoothed estimate
+#define ZOOM_CLOCK_SMOOTHING		0.125
+
+namespace controller {
+
+	// Sets the zoom to start, stop, or reverse
+	typedef enum {
+		SET_ZOOM_PAUSE,
+		SET_ZOOM_REVERSE,
+		SET_ZOOM_RESUME
+	} USER_IO_STATE;
+
+	/*
+	 * Change of scaleA for one zoom tick, a pure function of the zoom
+	 *  state: f(x) = -ALPHA * x * e^(-BETA * lastScaleA)
+	 */
+	static inline double next_zoom_step(USER_IO_STATE state, double scaleA, double lastScaleA)
+	{
+		double newSCALEA = 0.0;
+		switch (state) {
+		case SET_ZOOM_PAUSE:
+			break; // Perform no zoom
+		case SET_ZOOM_REVERSE:
+			newSCALEA = ZOOM_ALPHA * scaleA * std::exp(-ZOOM_BETA * lastScaleA);
+			if (newSCALEA >= MAX_DELTA_SCALE_A) {
+				newSCALEA = 0.0;
+			}
+			break;
+		case SET_ZOOM_RESUME:
+			newSCALEA = -ZOOM_ALPHA * scaleA * std::exp(-ZOOM_BETA * lastScaleA);
+		}
+
+		return newSCALEA;
+	}
+
+	/*
+	 * Applies ticks zoom steps to *scaleA and *lastScaleA, returns the
+	 *  change of scaleA (0 when paused or at the limit)
+	 */
+	static inline double advance_zoom(USER_IO_STATE state, __inout double *scaleA, __inout double *lastScaleA,
+		uint64_t ticks)
+	{
+		const double before = *scaleA;
+		for (uint64_t i = 0; i < ticks; i++) {
+			const double step = next_zoom_step(state, *scaleA, *lastScaleA);
+			if (step == 0.0) {
+				break;
+			}
+			*scaleA += step;
+			*lastScaleA -= step;
+		}
+
+		return *scaleA - before;
+	}
+
+	class zoomClock {
+	private:
+		std::chrono::steady_clock::time_point start;
+
+		// Virtual clock, 0 = wall clock
+		double virtualFrameMs;
+		double virtualNowMs;
+
+		// Wall clock, smoothed time between two frames shown
+		double frameEstimateMs;
+		double lastPresentedMs;
+
+	public:
+		bool is_virtual(void) const { return virtualFrameMs > 0.0; }
+
+		double now_ms(void) const
+		{
+			if (is_virtual()) {
+				return virtualNowMs;
+			}
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		// Expected time between frames
+		double get_frame_interval_ms(void) const { return is_virtual() ? virtualFrameMs : frameEstimateMs; }
+
+		// Time the frame being prepared now is expected on screen
+		double next_presentation_ms(void) const { return now_ms() + get_frame_interval_ms(); }
+
+		/*
+		 * A frame planned for presentMs was shown, the virtual clock moves to
+		 *  presentMs, the wall clock updates its interval estimate
+		 */
+		void frame_presented(double presentMs)
+		{
+			if (is_virtual()) {
+				virtualNowMs = presentMs;
+				return;
+			}
+
+			const double now = now_ms();
+			if (lastPresentedMs >= 0.0) {
+				frameEstimateMs += ZOOM_CLOCK_SMOOTHING * ((now - lastPresentedMs) - frameEstimateMs);
+			}
+			lastPresentedMs = now;
+		}
+
+		// A pause breaks the frame rhythm, the next interval is not measured
+		void restart_interval(void) { lastPresentedMs = -1.0; }
+
+		/*
+		 * Every frame advances the clock by frameMs, 0 goes back to the wall
+		 *  clock. Time starts over at 0 either way
+		 */
+		void set_virtual_clock(double frameMs)
+		{
+			virtualFrameMs = frameMs;
+			virtualNowMs = 0.0;
+			start = std::chrono::steady_clock::now();
+			lastPresentedMs = -1.0;
+		}
+
+		// Whole zoom ticks elapsed at ms
+		static uint64_t get_ticks(double ms, double tickMs)
+		{
+			return ms > 0.0 ? (uint64_t)(ms / tickMs) : 0;
+		}
+
+		/*
+		 * Ticks the zoom takes for a frame planned for presentMs, *zoomTicks
+		 *  (the tick the zoom stands at) moves on to presentMs. A late frame
+		 *  catches up at most maxTicks, the rest is dropped
+		 */
+		static uint64_t take_ticks(double presentMs, double tickMs, uint64_t maxTicks, __inout uint64_t *zoomTicks)
+		{
+			const uint64_t targetTicks = get_ticks(presentMs, tickMs);
+			const uint64_t ticks = targetTicks > *zoomTicks ? std::min<uint64_t>(targetTicks - *zoomTicks, maxTicks) : 0;
+			*zoomTicks = std::max(*zoomTicks, targetTicks);
+			return ticks;
+		}
+
+	public:
+		zoomClock(double initialFrameMs) :
+			start(std::chrono::steady_clock::now()),
+			virtualFrameMs(0.0), virtualNowMs(0.0),
+			frameEstimateMs(initialFrameMs), lastPresentedMs(-1.0)
+		{
+
+		}
+	};
+}
+
+//EOF
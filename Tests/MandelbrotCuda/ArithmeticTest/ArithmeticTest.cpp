@@ -0,0 +1,138 @@
+// g++ -std=c++17 -O2 ArithmeticTest.cpp
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <cmath>
+
+#include "../../../MandelbrotCuda/double_double.h"
+#include "../../../MandelbrotCuda/fixed_point.h"
+#include "../../../MandelbrotCuda/precision_ladder.h"
+#include "../test_check.h"
+
+// |a - b| as a double, exact enough to compare against small bounds
+static double get_distance(const cpu::fixedPoint &a, const cpu::fixedPoint &b)
+{
+	return std::fabs((a - b).to_double());
+}
+
+static bool is_normalised(const cpu::doubleDouble &v)
+{
+	return v.hi + v.lo == v.hi;
+}
+
+static void test_double_double(void)
+{
+	const double tiny = std::ldexp(1.0, -60);
+
+	// Sums keep what a double rounds away
+	const cpu::doubleDouble sum = cpu::doubleDouble(1.0) + cpu::doubleDouble(tiny);
+	CHECK(sum.hi == 1.0 && sum.lo == tiny);
+	const cpu::doubleDouble diff = sum - cpu::doubleDouble(1.0);
+	CHECK(diff.hi == tiny && diff.lo == 0.0);
+
+	// (1 + 2^-30)^2 = 1 + 2^-29 + 2^-60, exactly representable
+	const cpu::doubleDouble x(1.0 + std::ldexp(1.0, -30));
+	const cpu::doubleDouble square = x * x;
+	CHECK(square.hi == 1.0 + std::ldexp(1.0, -29));
+	CHECK(square.lo == tiny);
+	CHECK(is_normalised(square));
+
+	// Signs and ordering
+	CHECK((-square).hi == -square.hi && (-square).lo == -square.lo);
+	CHECK(cpu::doubleDouble(1.0) < sum);
+	CHECK(!(sum < cpu::doubleDouble(1.0)));
+	CHECK(cpu::doubleDouble(1.0, -tiny) < cpu::doubleDouble(1.0));
+
+	// 1/3 to ~106 bits: 3 * third - 1 vanishes far below double precision
+	const cpu::fixedPoint thirdFixed = cpu::fixedPoint::from_string(
+		"0.33333333333333333333333333333333333333333333333333333333333333333333333333333333333333333333333333333333");
+	const cpu::doubleDouble third = cpu::to_double_double(thirdFixed);
+	CHECK(is_normalised(third));
+	CHECK(third.lo != 0.0);
+	CHECK(get_distance(cpu::fixedPoint(third.hi) + cpu::fixedPoint(third.lo), thirdFixed) < 1e-32);
+
+	const cpu::doubleDouble residual = third * cpu::doubleDouble(3.0) - cpu::doubleDouble(1.0);
+	CHECK(std::fabs(residual.to_double()) < 1e-31);
+
+	// A z^2 + c step at a depth double cannot resolve
+	const cpu::doubleDouble c(-0.75, 1e-20), z(0.5, 1e-21);
+	const cpu::doubleDouble next = z * z + c;
+	CHECK(next.hi == -0.5);
+	CHECK(std::fabs(next.lo - (1e-20 + 1e-21)) < 1e-35);
+}
+
+static void test_fixed_point(void)
+{
+	// Doubles convert exactly both ways
+	const double values[] = { 0.0, 1.0, -1.0, 0.5, -2.75, 1.0 / 3.0, -0.7436438870371587, std::ldexp(1.0, -200), 123456.789 };
+	for (double v : values) {
+		CHECK(cpu::fixedPoint(v).to_double() == v);
+	}
+	CHECK(!cpu::fixedPoint(-0.0).is_negative());
+	CHECK(cpu::fixedPoint(0.0).is_zero());
+
+	// Signed addition and subtraction
+	const cpu::fixedPoint a(1.25), b(-3.5);
+	CHECK((a + b).to_double() == -2.25);
+	CHECK((a - b).to_double() == 4.75);
+	CHECK((b - b).is_zero() && !(b - b).is_negative());
+	CHECK(((a + b) - b - a).is_zero());
+
+	cpu::fixedPoint acc(0.0);
+	acc += a;
+	acc -= b;
+	CHECK(acc.to_double() == 4.75);
+
+	// Products, including ones below double's exponent range
+	CHECK((a * b).to_double() == -4.375);
+	CHECK((b * b).to_double() == 12.25);
+	const cpu::fixedPoint small(std::ldexp(1.0, -150));
+	const cpu::fixedPoint smallSquare = small * small;
+	CHECK(!smallSquare.is_zero());
+	CHECK(smallSquare.to_double() == std::ldexp(1.0, -300));
+	CHECK((small * cpu::fixedPoint(-1.0)).is_negative());
+
+	// Decimal strings
+	CHECK(cpu::fixedPoint(0.75).to_string(4) == "0.7500");
+	CHECK(cpu::fixedPoint(-2.5).to_string(2) == "-2.50");
+	CHECK(cpu::fixedPoint::from_string("-2.5").to_double() == -2.5);
+	CHECK(cpu::fixedPoint::from_string("+0.125").to_double() == 0.125);
+	CHECK(cpu::fixedPoint::from_string("7").to_double() == 7.0);
+	CHECK(!cpu::fixedPoint::from_string("-0.000").is_negative());
+
+	// 110 digits (what .mbit files store) give the number back to within its last bit,
+	//  both conversions truncate
+	const cpu::fixedPoint centre = cpu::fixedPoint(-0.743643887037158704752191506114774) +
+		cpu::fixedPoint(std::ldexp(1.0, -300)) * cpu::fixedPoint(3.0);
+	const cpu::fixedPoint parsed = cpu::fixedPoint::from_string(centre.to_string(110));
+	CHECK(get_distance(parsed, centre) <= std::ldexp(1.0, -32 * (FIXED_POINT_LIMBS - 1)));
+	CHECK(parsed.is_negative());
+}
+
+static void test_precision_ladder(void)
+{
+	CHECK(cpu::select_precision_tier(1e-3, -0.5, 0.0) == cpu::PRECISION_TIER_FLOAT);
+	CHECK(cpu::select_precision_tier(1e-8, -0.5, 0.0) == cpu::PRECISION_TIER_DOUBLE);
+	CHECK(cpu::select_precision_tier(1e-20, -0.5, 0.0) == cpu::PRECISION_TIER_DOUBLE_DOUBLE);
+	CHECK(cpu::select_precision_tier(1e-40, -0.5, 0.0) == cpu::PRECISION_TIER_PERTURBATION);
+
+	// Never a cheaper tier when zooming in
+	cpu::PRECISION_TIER last = cpu::PRECISION_TIER_FLOAT;
+	for (double scale = 1.0; scale > 1e-60; scale *= 0.5) {
+		const cpu::PRECISION_TIER tier = cpu::select_precision_tier(scale, -1.7, 0.01);
+		CHECK(tier >= last);
+		last = tier;
+	}
+	CHECK(last == cpu::PRECISION_TIER_PERTURBATION);
+}
+
+int main(int argc, char **argv)
+{
+	test_double_double();
+	test_fixed_point();
+	test_precision_ladder();
+
+	return report_checks("arithmetic");
+}
+
+//EOF
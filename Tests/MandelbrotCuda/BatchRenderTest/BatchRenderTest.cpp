@@ -0,0 +1,311 @@
+// g++ -std=c++17 -O2 -pthread -I../../../MandelbrotCuda BatchRenderTest.cpp ../../../MandelbrotCuda/mandelbrot_simd.cpp ../../../MandelbrotCuda/colorizer.cpp ../../../MandelbrotCuda/perturbation.cpp ../../../MandelbrotCuda/debug.cpp
+#include <stdint.h>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include "../../../MandelbrotCuda/main.h"
+#include "../../../MandelbrotCuda/batch_render.h"
+#include "../test_check.h"
+
+// Scratch files, in the working directory and removed again
+#define TEST_JOB_LIST				"batch_test_jobs.txt"
+#define TEST_BATCH_FILE				"batch_test_batch"
+#define TEST_DIRECT_FILE			"batch_test_direct"
+#define TEST_PYRAMID_DIR			"batch_test_pyramid"
+
+static std::vector<uint8_t> read_file(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static batch::renderJob get_test_job(uint32_t width, uint32_t height, const std::string &output)
+{
+	batch::renderJob job = batch::get_default_job(FRACTAL_OFFSET_X, FRACTAL_OFFSET_Y, IMAGE_SCALEA, IMAGE_SCALEB);
+	job.width = width;
+	job.height = height;
+	job.iterations = 200;
+	job.output = output;
+	return job;
+}
+
+// key=value tokens, good and bad values
+static void test_parse_tokens(void)
+{
+	batch::renderJob job = get_test_job(BATCH_DEFAULT_WIDTH, BATCH_DEFAULT_HEIGHT, BATCH_DEFAULT_OUTPUT);
+	CHECK(job.autoTier && job.autoFormat && job.windowBytes == 0 && !job.pyramid);
+
+	CHECK(batch::parse_job_token("width=640", &job) == 0 && job.width == 640);
+	CHECK(batch::parse_job_token("height=480", &job) == 0 && job.height == 480);
+	CHECK(batch::parse_job_token("iterations=5000", &job) == 0 && job.iterations == 5000);
+	CHECK(batch::parse_job_token("scaleA=0.5", &job) == 0 && job.scaleA == 0.5);
+	CHECK(batch::parse_job_token("x=-0.75", &job) == 0 && job.centerX.to_double() == -0.75);
+	CHECK(batch::parse_job_token("y=.125", &job) == 0 && job.centerY.to_double() == 0.125);
+	CHECK(batch::parse_job_token("tier=double-double", &job) == 0 && !job.autoTier &&
+		job.tier == cpu::PRECISION_TIER_DOUBLE_DOUBLE);
+	CHECK(batch::parse_job_token("tier=auto", &job) == 0 && job.autoTier);
+	CHECK(batch::parse_job_token("smooth=1", &job) == 0 && job.smooth);
+	CHECK(batch::parse_job_token("format=pam", &job) == 0 && !job.autoFormat && job.format == ppm::PPM_FORMAT_PAM);
+	CHECK(batch::parse_job_token("format=qoi", &job) == 0 && job.encoder == frame::FRAME_ENCODER_QOI);
+	CHECK(batch::parse_job_token("window=3", &job) == 0 && job.windowBytes == 3 * 1024 * 1024);
+	CHECK(batch::parse_job_token("offset=7", &job) == 0 && job.paletteOffset == 7);
+	CHECK(batch::parse_job_token("out=a.ppm", &job) == 0 && job.output == "a.ppm");
+
+	// A bad token fails, whatever it did to the job
+	const std::string tooMany = "iterations=" + std::to_string(RENDER_MAX_ITERATIONS + 1);
+	CHECK(batch::parse_job_token("iterations=" + std::to_string(RENDER_MAX_ITERATIONS), &job) == 0 &&
+		job.iterations == RENDER_MAX_ITERATIONS);
+	const char *bad[] = { "width=0", "width=-1", "width=12x", "height=", "iterations=0", tooMany.c_str(),
+		"iterations=4000000000", "iterations=4294967295", "scaleA=0",
+		"scaleB=-2", "x=1e5", "y=", "x=.", "tier=quad", "smooth=2", "format=gif", "out=", "pyramid=yes",
+		"colour=red", "=1", "width" };
+	for (const char *token : bad) {
+		batch::renderJob scratch = job;
+		CHECK(batch::parse_job_token(token, &scratch) != 0);
+	}
+}
+
+// Job lists: comments and blank lines are skipped, lines start from the defaults
+static void test_job_list(void)
+{
+	batch::renderJob defaults = get_test_job(320, 200, BATCH_DEFAULT_OUTPUT);
+	{
+		std::ofstream list(TEST_JOB_LIST);
+		list << "# two jobs\n\nwidth=100 out=a.ppm\n   \niterations=50 out=b.pgm # trailing comment\n";
+	}
+
+	std::vector<batch::renderJob> jobs;
+	uint32_t badLine = 0;
+	std::string reason;
+	CHECK(batch::load_job_list(TEST_JOB_LIST, defaults, &jobs, &badLine, &reason) == 0);
+	CHECK(jobs.size() == 2);
+	if (jobs.size() == 2) {
+		CHECK(jobs[0].width == 100 && jobs[0].height == 200 && jobs[0].iterations == 200 && jobs[0].output == "a.ppm");
+		CHECK(jobs[1].width == 320 && jobs[1].iterations == 50 && jobs[1].output == "b.pgm");
+	}
+
+	{
+		std::ofstream list(TEST_JOB_LIST);
+		list << "width=100\n# fine\nwidth=100 tier=quad\n";
+	}
+	jobs.clear();
+	CHECK(batch::load_job_list(TEST_JOB_LIST, defaults, &jobs, &badLine, &reason) != 0);
+	CHECK(badLine == 3);
+	CHECK(reason == "bad token tier=quad");
+
+	// Out of core renders netpbm and raw files only, the format may come from out
+	{
+		std::ofstream list(TEST_JOB_LIST);
+		list << "window=1 out=a.ppm\nwindow=1 out=a.raw\nwindow=1 out=a.png pyramid=1\nwindow=1 out=a.png\n";
+	}
+	jobs.clear();
+	CHECK(batch::load_job_list(TEST_JOB_LIST, defaults, &jobs, &badLine, &reason) != 0);
+	CHECK(badLine == 4);
+	CHECK(reason.compare(0, 7, "window=") == 0);
+
+	std::remove(TEST_JOB_LIST);
+	CHECK(batch::load_job_list(TEST_JOB_LIST, defaults, &jobs, &badLine, &reason) != 0);
+	CHECK(badLine == 0);
+}
+
+// Format and encoder from the extension of out, unless format= names one
+static void test_output_format(void)
+{
+	batch::renderJob job = get_test_job(16, 16, "a.pgm");
+	CHECK(batch::get_output_format(job) == ppm::PPM_FORMAT_P5);
+	job.output = "a.pam";
+	CHECK(batch::get_output_format(job) == ppm::PPM_FORMAT_PAM);
+	job.output = "a.raw";
+	CHECK(batch::get_output_format(job) == ppm::PPM_FORMAT_RAW);
+	job.output = "a";
+	CHECK(batch::get_output_format(job) == ppm::PPM_FORMAT_P6);
+	CHECK(batch::get_output_encoder(job) == frame::FRAME_ENCODER_NETPBM);
+	job.output = "a.png";
+	CHECK(batch::get_output_encoder(job) == frame::FRAME_ENCODER_PNG);
+	job.output = "a.qoi";
+	CHECK(batch::get_output_encoder(job) == frame::FRAME_ENCODER_QOI);
+	job.output = "a.mbit";
+	CHECK(batch::is_field_output(job));
+
+	CHECK(batch::parse_job_token("format=p6", &job) == 0);
+	CHECK(batch::get_output_format(job) == ppm::PPM_FORMAT_P6 && !batch::is_field_output(job));
+
+	// Out of core takes the netpbm formats but P3, and raw
+	CHECK(batch::get_job_error(job) == nullptr);
+	CHECK(batch::parse_job_token("window=8", &job) == 0);
+	for (const char *format : { "format=p6", "format=p5", "format=pam", "format=raw" }) {
+		CHECK(batch::parse_job_token(format, &job) == 0 && batch::get_job_error(job) == nullptr);
+	}
+	for (const char *format : { "format=p3", "format=png", "format=qoi", "format=mbit" }) {
+		CHECK(batch::parse_job_token(format, &job) == 0 && batch::get_job_error(job) != nullptr);
+	}
+
+	// Pyramids and field colouring do not render out of core, the window does not apply
+	CHECK(batch::parse_job_token("pyramid=1", &job) == 0 && batch::get_job_error(job) == nullptr);
+	job.pyramid = false;
+	CHECK(batch::parse_job_token("field=a.mbit", &job) == 0 && batch::get_job_error(job) == nullptr);
+}
+
+/*
+ * The file of an in-memory job holds the frame a renderer of the same view
+ *  draws, P6 the colours and P5 the escape times
+ */
+static void test_render_job(batch::batchRenderer &renderer)
+{
+	for (ppm::PPM_FORMAT format : { ppm::PPM_FORMAT_P6, ppm::PPM_FORMAT_P5 }) {
+		batch::renderJob job = get_test_job(131, 77, TEST_BATCH_FILE);
+		job.autoFormat = false;
+		job.format = format;
+
+		batch::jobResult result;
+		CHECK(renderer.render_job(job, &result) == 0);
+		CHECK(renderer.finish() == 0);
+		CHECK(result.width == job.width && result.height == job.height && result.iterations == job.iterations);
+		CHECK(result.iteratedFraction > 0.0 && result.iteratedFraction <= 1.0);
+
+		mandelbrotFractalCpu direct(0.0, 0.0, job.width, job.height, job.scaleA, job.scaleB, job.iterations, 1);
+		direct.set_center(job.centerX, job.centerY);
+		direct.set_auto_precision(true);
+		std::vector<rgbaPixel> frame((size_t)job.width * job.height);
+		CHECK(direct.compute_image_tiled(frame.data()) == 0);
+		CHECK(direct.get_render_stats().precisionTier == result.tier);
+
+		if (format == ppm::PPM_FORMAT_P5) {
+			CHECK(ppm::write_iteration_map(TEST_DIRECT_FILE, direct.get_iteration_field(),
+				job.width, job.height, job.iterations) == 0);
+		}
+		else {
+			CHECK(ppm::write_frame(TEST_DIRECT_FILE, format, frame.data(), job.width, job.height) == 0);
+		}
+
+		const std::vector<uint8_t> written = read_file(TEST_BATCH_FILE), expected = read_file(TEST_DIRECT_FILE);
+		CHECK(!written.empty() && written == expected);
+	}
+
+	std::remove(TEST_BATCH_FILE);
+	std::remove(TEST_DIRECT_FILE);
+}
+
+/*
+ * Out of core jobs render in bands of rows, every band size gives the file
+ *  of the in-memory job byte for byte and the same iterated fraction
+ */
+static void test_out_of_core(batch::batchRenderer &renderer)
+{
+	const cpu::PRECISION_TIER tiers[] = { cpu::PRECISION_TIER_FLOAT, cpu::PRECISION_TIER_DOUBLE,
+		cpu::PRECISION_TIER_DOUBLE_DOUBLE };
+	for (cpu::PRECISION_TIER tier : tiers) {
+		for (ppm::PPM_FORMAT format : { ppm::PPM_FORMAT_P6, ppm::PPM_FORMAT_P5, ppm::PPM_FORMAT_PAM, ppm::PPM_FORMAT_RAW }) {
+			batch::renderJob job = get_test_job(641, 479, TEST_DIRECT_FILE);
+			job.autoTier = false;
+			job.tier = tier;
+			job.autoFormat = false;
+			job.format = format;
+
+			batch::jobResult inMemory;
+			CHECK(renderer.render_job(job, &inMemory) == 0);
+			CHECK(renderer.finish() == 0);
+			const std::vector<uint8_t> expected = read_file(TEST_DIRECT_FILE);
+			CHECK(!expected.empty());
+
+			// One row, a few uneven rows, window=1
+			job.output = TEST_BATCH_FILE;
+			for (uint64_t windowBytes : { (uint64_t)1, (uint64_t)100000, (uint64_t)1024 * 1024 }) {
+				job.windowBytes = windowBytes;
+				batch::jobResult outOfCore;
+				CHECK(renderer.render_job(job, &outOfCore) == 0);
+				CHECK(read_file(TEST_BATCH_FILE) == expected);
+				CHECK(outOfCore.tier == tier);
+				CHECK(outOfCore.iteratedFraction == inMemory.iteratedFraction);
+			}
+		}
+	}
+
+	std::remove(TEST_BATCH_FILE);
+	std::remove(TEST_DIRECT_FILE);
+}
+
+/*
+ * A pyramid with interior tiles iterates every pixel it needs once, its
+ *  finest tiles are the pixels of a render of the whole view and its
+ *  manifest gives back the exact pixel scale
+ */
+static void test_pyramid(cpu::threadPool *pool)
+{
+	const cpu::fixedPoint centerX(-0.2), centerY(0.0);
+	batch::pyramidExporter exporter(pool, centerX, centerY, 1300, 777, 0.3, 4.0, 300, cpu::PRECISION_TIER_DOUBLE, false);
+	CHECK(exporter.export_pyramid(TEST_PYRAMID_DIR) == 0);
+
+	const batch::pyramidStats stats = exporter.get_stats();
+	CHECK(stats.levels == 4 && stats.pixelsFinest == 1300 * 777);
+	CHECK(stats.tilesInterior != 0);
+	CHECK(stats.pixelsIterated < stats.pixelsFinest);
+
+	// All the work done: the borders of the interior tiles and the finest tiles,
+	//  no pixel twice
+	CHECK(stats.pixelsIterated == 420544);
+
+	mandelbrotFractalCpu whole(0.0, 0.0, 1300, 777, 0.3, 4.0, 300, 1);
+	whole.set_center(centerX, centerY);
+	whole.set_precision_tier(cpu::PRECISION_TIER_DOUBLE);
+	std::vector<rgbaPixel> frame((size_t)1300 * 777);
+	CHECK(whole.compute_image_tiled(frame.data()) == 0);
+
+	uint32_t compared = 0;
+	for (uint32_t row = 0; row * PYRAMID_TILE_SIZE < 777; row++) {
+		for (uint32_t column = 0; column * PYRAMID_TILE_SIZE < 1300; column++) {
+			const std::string tileFile = std::string(TEST_PYRAMID_DIR) + "/3/" + std::to_string(column) + "_" +
+				std::to_string(row) + ".ppm";
+			if (!std::filesystem::exists(tileFile)) {
+				continue;
+			}
+
+			const uint32_t x = column * PYRAMID_TILE_SIZE, y = row * PYRAMID_TILE_SIZE;
+			const uint32_t w = std::min<uint32_t>(PYRAMID_TILE_SIZE, 1300 - x), h = std::min<uint32_t>(PYRAMID_TILE_SIZE, 777 - y);
+			std::vector<rgbaPixel> crop((size_t)w * h);
+			for (uint32_t i = 0; i < h; i++) {
+				std::copy(&frame[(size_t)(y + i) * 1300 + x], &frame[(size_t)(y + i) * 1300 + x + w], &crop[(size_t)i * w]);
+			}
+			CHECK(ppm::write_frame(TEST_DIRECT_FILE, ppm::PPM_FORMAT_P6, crop.data(), w, h) == 0);
+			CHECK(read_file(tileFile) == read_file(TEST_DIRECT_FILE));
+			compared++;
+		}
+	}
+	CHECK(compared == stats.tilesRendered);
+	std::remove(TEST_DIRECT_FILE);
+
+	std::ifstream manifest(std::string(TEST_PYRAMID_DIR) + "/" + PYRAMID_MANIFEST);
+	const std::string text((std::istreambuf_iterator<char>(manifest)), std::istreambuf_iterator<char>());
+	const size_t key = text.find("\"pixelScale\": ");
+	CHECK(key != std::string::npos);
+	if (key != std::string::npos) {
+		CHECK(std::strtod(text.c_str() + key + 14, nullptr) == 0.3 / (1300.0 / 4.0));
+	}
+
+	std::error_code ec;
+	std::filesystem::remove_all(TEST_PYRAMID_DIR, ec);
+}
+
+int main(int argc, char **argv)
+{
+	test_parse_tokens();
+	test_job_list();
+	test_output_format();
+
+	batch::batchRenderer renderer(2);
+	test_render_job(renderer);
+	test_out_of_core(renderer);
+
+	cpu::threadPool pool(2);
+	test_pyramid(&pool);
+
+	return report_checks("batch render");
+}
+
+//EOF
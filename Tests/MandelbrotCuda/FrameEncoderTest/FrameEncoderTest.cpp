@@ -0,0 +1,595 @@
+// g++ -std=c++17 -O2 -pthread FrameEncoderTest.cpp
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+
+#include "../../../MandelbrotCuda/deflate.h"
+#include "../../../MandelbrotCuda/png_encoder.h"
+#include "../../../MandelbrotCuda/qoi_encoder.h"
+#include "../../../MandelbrotCuda/thread_pool.h"
+#include "../test_check.h"
+
+/*
+ * The encoders are checked by decoding what they write. The decoders below
+ *  follow RFC 1950/1951, the PNG specification and qoiformat.org, and share
+ *  no code with the encoders
+ */
+
+// Canonical Huffman code of an inflate block, symbols ordered by code
+typedef struct huffmanTable {
+	uint16_t counts[16];
+	std::vector<uint16_t> symbols;
+} HUFFMAN_TABLE, *PHUFFMAN_TABLE;
+
+class inflater {
+private:
+	const uint8_t *data;
+	size_t size, position;
+	uint32_t bitBuffer, bitCount;
+	bool failed;
+
+	uint32_t get_bits(uint32_t count)
+	{
+		while (bitCount < count) {
+			if (position >= size) {
+				failed = true;
+				return 0;
+			}
+			bitBuffer |= (uint32_t)data[position++] << bitCount;
+			bitCount += 8;
+		}
+		const uint32_t value = bitBuffer & ((1u << count) - 1);
+		bitBuffer >>= count;
+		bitCount -= count;
+		return value;
+	}
+
+	static void build_table(const uint8_t *lengths, uint32_t count, __inout huffmanTable *table)
+	{
+		std::memset(table->counts, 0, sizeof(table->counts));
+		for (uint32_t i = 0; i < count; i++) {
+			table->counts[lengths[i]]++;
+		}
+		table->counts[0] = 0;
+
+		uint16_t offsets[16] = { 0 };
+		for (uint32_t bits = 1; bits < 15; bits++) {
+			offsets[bits + 1] = offsets[bits] + table->counts[bits];
+		}
+		table->symbols.assign(count, 0);
+		for (uint32_t i = 0; i < count; i++) {
+			if (lengths[i] != 0) {
+				table->symbols[offsets[lengths[i]]++] = (uint16_t)i;
+			}
+		}
+	}
+
+	int32_t decode(const huffmanTable &table)
+	{
+		int32_t code = 0, first = 0, index = 0;
+		for (uint32_t bits = 1; bits <= 15; bits++) {
+			code |= (int32_t)get_bits(1);
+			const int32_t count = table.counts[bits];
+			if (code - first < count) {
+				return table.symbols[index + code - first];
+			}
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		failed = true;
+		return -1;
+	}
+
+	bool inflate_codes(const huffmanTable &litLen, const huffmanTable &distance, __inout std::vector<uint8_t> *out)
+	{
+		static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const uint16_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const uint16_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		for (;;) {
+			const int32_t symbol = decode(litLen);
+			if (failed || symbol < 0) {
+				return false;
+			}
+			if (symbol < 256) {
+				out->push_back((uint8_t)symbol);
+				continue;
+			}
+			if (symbol == 256) {
+				return true;
+			}
+
+			// Length code, its extra bits, then the distance code and its extra bits
+			const int32_t lengthCode = symbol - 257;
+			if (lengthCode >= 29) {
+				return false;
+			}
+			const size_t length = lengthBase[lengthCode] + get_bits(lengthExtra[lengthCode]);
+			const int32_t distanceCode = decode(distance);
+			if (failed || distanceCode < 0 || distanceCode >= 30) {
+				return false;
+			}
+			const size_t back = distanceBase[distanceCode] + get_bits(distanceExtra[distanceCode]);
+			if (failed || back > out->size()) {
+				return false;
+			}
+			for (size_t i = 0; i < length; i++) {
+				out->push_back((*out)[out->size() - back]);
+			}
+		}
+	}
+
+	bool inflate_stored(__inout std::vector<uint8_t> *out)
+	{
+		bitBuffer = 0;
+		bitCount = 0;
+		if (position + 4 > size) {
+			return false;
+		}
+		const uint32_t length = data[position] | data[position + 1] << 8;
+		const uint32_t check = data[position + 2] | data[position + 3] << 8;
+		position += 4;
+		if ((length ^ 0xffff) != check || position + length > size) {
+			return false;
+		}
+		out->insert(out->end(), data + position, data + position + length);
+		position += length;
+		return true;
+	}
+
+	bool inflate_fixed(__inout std::vector<uint8_t> *out)
+	{
+		uint8_t lengths[288 + 30];
+		for (uint32_t i = 0; i < 288; i++) {
+			lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+		}
+		for (uint32_t i = 0; i < 30; i++) {
+			lengths[288 + i] = 5;
+		}
+
+		huffmanTable litLen, distance;
+		build_table(lengths, 288, &litLen);
+		build_table(lengths + 288, 30, &distance);
+		return inflate_codes(litLen, distance, out);
+	}
+
+	bool inflate_dynamic(__inout std::vector<uint8_t> *out)
+	{
+		static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		const uint32_t litLenCount = get_bits(5) + 257, distanceCount = get_bits(5) + 1, codeCount = get_bits(4) + 4;
+		if (litLenCount > 286 || distanceCount > 30) {
+			return false;
+		}
+
+		uint8_t lengths[320] = { 0 };
+		for (uint32_t i = 0; i < codeCount; i++) {
+			lengths[order[i]] = (uint8_t)get_bits(3);
+		}
+		huffmanTable codeLengths;
+		build_table(lengths, 19, &codeLengths);
+
+		std::memset(lengths, 0, sizeof(lengths));
+		for (uint32_t i = 0; i < litLenCount + distanceCount;) {
+			const int32_t symbol = decode(codeLengths);
+			if (failed || symbol < 0) {
+				return false;
+			}
+			if (symbol < 16) {
+				lengths[i++] = (uint8_t)symbol;
+				continue;
+			}
+
+			uint8_t repeat = 0;
+			uint32_t times = 0;
+			if (symbol == 16) {
+				if (i == 0) {
+					return false;
+				}
+				repeat = lengths[i - 1];
+				times = 3 + get_bits(2);
+			}
+			else {
+				times = symbol == 17 ? 3 + get_bits(3) : 11 + get_bits(7);
+			}
+			if (i + times > litLenCount + distanceCount) {
+				return false;
+			}
+			while (times-- != 0) {
+				lengths[i++] = repeat;
+			}
+		}
+		if (lengths[256] == 0) {
+			return false;
+		}
+
+		huffmanTable litLen, distance;
+		build_table(lengths, litLenCount, &litLen);
+		build_table(lengths + litLenCount, distanceCount, &distance);
+		return inflate_codes(litLen, distance, out);
+	}
+
+public:
+	/*
+	 * Inflates a raw deflate stream, false on a malformed stream or one that
+	 *  does not end exactly at size
+	 */
+	bool inflate(const uint8_t *data, size_t size, __inout std::vector<uint8_t> *out)
+	{
+		this->data = data;
+		this->size = size;
+		position = 0;
+		bitBuffer = bitCount = 0;
+		failed = false;
+
+		for (bool last = false; !last;) {
+			last = get_bits(1) != 0;
+			const uint32_t type = get_bits(2);
+			bool ok = false;
+			switch (type) {
+			case 0: ok = inflate_stored(out); break;
+			case 1: ok = inflate_fixed(out); break;
+			case 2: ok = inflate_dynamic(out); break;
+			default: break;
+			}
+			if (!ok || failed) {
+				return false;
+			}
+		}
+		return position == size;
+	}
+};
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Reverses one filtered row in place, above is the row before (zeros for the first)
+static bool unfilter_row(uint8_t filter, const uint8_t *above, size_t rowBytes, uint32_t pixelBytes, __inout uint8_t *row)
+{
+	for (size_t i = 0; i < rowBytes; i++) {
+		const uint8_t a = i >= pixelBytes ? row[i - pixelBytes] : 0;
+		const uint8_t b = above[i];
+		const uint8_t c = i >= pixelBytes ? above[i - pixelBytes] : 0;
+		switch (filter) {
+		case PNG_FILTER_NONE: break;
+		case PNG_FILTER_SUB: row[i] += a; break;
+		case PNG_FILTER_UP: row[i] += b; break;
+		case PNG_FILTER_AVERAGE: row[i] += (uint8_t)((a + b) >> 1); break;
+		case PNG_FILTER_PAETH: {
+			const int32_t p = (int32_t)a + b - c;
+			const int32_t pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+			row[i] += pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+			break;
+		}
+		default: return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Decodes a PNG of the encoder, checks the signature, every chunk CRC, the
+ *  zlib header and Adler-32. The pixels go to *pixels, alpha 255 for RGB
+ */
+static bool decode_png(const std::vector<uint8_t> &png, __inout uint32_t *width, __inout uint32_t *height,
+	__inout std::vector<rgbaPixel> *pixels)
+{
+	static const uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	if (png.size() < 8 || std::memcmp(png.data(), signature, 8) != 0) {
+		return false;
+	}
+
+	std::vector<uint8_t> zlib;
+	uint32_t colourType = 0;
+	bool ended = false;
+	for (size_t p = 8; p < png.size() && !ended;) {
+		if (p + 12 > png.size()) {
+			return false;
+		}
+		const uint32_t length = get_be32(&png[p]);
+		if (p + 12 + length > png.size()) {
+			return false;
+		}
+		const uint8_t *type = &png[p + 4], *body = &png[p + 8];
+		if (deflate::crc32(0, type, length + 4) != get_be32(body + length)) {
+			return false;
+		}
+
+		if (std::memcmp(type, "IHDR", 4) == 0) {
+			*width = get_be32(body);
+			*height = get_be32(body + 4);
+			colourType = body[9];
+			if (length != 13 || body[8] != 8 || body[10] != 0 || body[11] != 0 || body[12] != 0) {
+				return false;
+			}
+		}
+		else if (std::memcmp(type, "IDAT", 4) == 0) {
+			zlib.insert(zlib.end(), body, body + length);
+		}
+		else if (std::memcmp(type, "IEND", 4) == 0) {
+			ended = length == 0 && p + 12 == png.size();
+		}
+		p += 12 + length;
+	}
+	if (!ended || zlib.size() < 6 || (zlib[0] << 8 | zlib[1]) % 31 != 0 || (zlib[0] & 0x0f) != 8 || (zlib[1] & 0x20)) {
+		return false;
+	}
+
+	std::vector<uint8_t> filtered;
+	inflater inflate;
+	if (!inflate.inflate(zlib.data() + 2, zlib.size() - 6, &filtered) ||
+		deflate::adler32(1, filtered.data(), filtered.size()) != get_be32(&zlib[zlib.size() - 4])) {
+		return false;
+	}
+
+	const uint32_t pixelBytes = colourType == PNG_COLOUR_RGBA ? 4 : 3;
+	const size_t rowBytes = (size_t)*width * pixelBytes;
+	if ((colourType != PNG_COLOUR_RGB && colourType != PNG_COLOUR_RGBA) || filtered.size() != (rowBytes + 1) * *height) {
+		return false;
+	}
+
+	std::vector<uint8_t> above(rowBytes, 0);
+	pixels->resize((size_t)*width * *height);
+	for (uint32_t y = 0; y < *height; y++) {
+		uint8_t *row = &filtered[y * (rowBytes + 1)];
+		if (!unfilter_row(row[0], above.data(), rowBytes, pixelBytes, row + 1)) {
+			return false;
+		}
+		for (uint32_t x = 0; x < *width; x++) {
+			const uint8_t *p = row + 1 + (size_t)x * pixelBytes;
+			(*pixels)[(size_t)y * *width + x] = rgbaPixel{ p[0], p[1], p[2], pixelBytes == 4 ? p[3] : (BYTE)255 };
+		}
+		std::memcpy(above.data(), row + 1, rowBytes);
+	}
+	return true;
+}
+
+// Decodes a QOI stream, checks the header and the end marker
+static bool decode_qoi(const std::vector<uint8_t> &qoi, __inout uint32_t *width, __inout uint32_t *height,
+	__inout std::vector<rgbaPixel> *pixels)
+{
+	static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	if (qoi.size() < QOI_HEADER_SIZE + 8 || std::memcmp(qoi.data(), "qoif", 4) != 0 ||
+		std::memcmp(&qoi[qoi.size() - 8], end, 8) != 0) {
+		return false;
+	}
+	*width = get_be32(&qoi[4]);
+	*height = get_be32(&qoi[8]);
+
+	rgbaPixel index[QOI_INDEX_SIZE];
+	std::memset(index, 0, sizeof(index));
+	rgbaPixel p = { 0, 0, 0, 255 };
+	const size_t count = (size_t)*width * *height, last = qoi.size() - 8;
+	pixels->clear();
+	pixels->reserve(count);
+
+	size_t position = QOI_HEADER_SIZE;
+	while (pixels->size() < count) {
+		if (position >= last) {
+			return false;
+		}
+		const uint8_t op = qoi[position++];
+		uint32_t run = 1;
+		if (op == QOI_OP_RGB || op == QOI_OP_RGBA) {
+			const uint32_t bytes = op == QOI_OP_RGB ? 3 : 4;
+			if (position + bytes > last) {
+				return false;
+			}
+			p.red = qoi[position];
+			p.green = qoi[position + 1];
+			p.blue = qoi[position + 2];
+			if (op == QOI_OP_RGBA) {
+				p.alpha = qoi[position + 3];
+			}
+			position += bytes;
+		}
+		else if ((op & 0xc0) == QOI_OP_INDEX) {
+			p = index[op & 0x3f];
+		}
+		else if ((op & 0xc0) == QOI_OP_DIFF) {
+			p.red += ((op >> 4) & 3) - 2;
+			p.green += ((op >> 2) & 3) - 2;
+			p.blue += (op & 3) - 2;
+		}
+		else if ((op & 0xc0) == QOI_OP_LUMA) {
+			if (position >= last) {
+				return false;
+			}
+			const int32_t dg = (op & 0x3f) - 32, next = qoi[position++];
+			p.red += dg + ((next >> 4) & 0x0f) - 8;
+			p.green += dg;
+			p.blue += dg + (next & 0x0f) - 8;
+		}
+		else {
+			run = (op & 0x3f) + 1;
+		}
+
+		index[(p.red * 3 + p.green * 5 + p.blue * 7 + p.alpha * 11) % 64] = p;
+		for (uint32_t k = 0; k < run && pixels->size() < count; k++) {
+			pixels->push_back(p);
+		}
+	}
+	return position == last;
+}
+
+static bool is_same_frame(const std::vector<rgbaPixel> &decoded, const std::vector<rgbaPixel> &frame, bool keepAlpha)
+{
+	if (decoded.size() != frame.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < frame.size(); i++) {
+		const rgbaPixel &a = decoded[i], &b = frame[i];
+		if (a.red != b.red || a.green != b.green || a.blue != b.blue || a.alpha != (keepAlpha ? b.alpha : 255)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Test frames: noise, a smooth gradient with alpha, and palette bands with
+ *  long runs like a rendered frame
+ */
+static std::vector<rgbaPixel> get_frame(uint32_t kind, uint32_t width, uint32_t height)
+{
+	std::mt19937 random(width * 31 + height + kind);
+	std::vector<rgbaPixel> frame((size_t)width * height);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			rgbaPixel &p = frame[(size_t)y * width + x];
+			if (kind == 0) {
+				const uint32_t r = random();
+				p = rgbaPixel{ (BYTE)r, (BYTE)(r >> 8), (BYTE)(r >> 16), (BYTE)(r >> 24) };
+			}
+			else if (kind == 1) {
+				p = rgbaPixel{ (BYTE)(x + y), (BYTE)(x * 3), (BYTE)(y * 5), (BYTE)(255 - (x >> 2)) };
+			}
+			else {
+				const uint32_t band = ((x / 7) ^ (y / 5)) % 5 == 0 ? random() % 3 : (x + y) / 40;
+				p = rgbaPixel{ (BYTE)(band * 40), (BYTE)(band * 17), (BYTE)(255 - band * 9), 0 };
+			}
+		}
+	}
+	return frame;
+}
+
+static void test_checksums(void)
+{
+	const uint8_t digits[] = "123456789";
+	CHECK(deflate::crc32(0, digits, 9) == 0xcbf43926);
+	CHECK(deflate::crc32(deflate::crc32(0, digits, 4), digits + 4, 5) == 0xcbf43926);
+	CHECK(deflate::adler32(1, (const uint8_t *)"Wikipedia", 9) == 0x11e60398);
+
+	std::vector<uint8_t> data(100000);
+	std::mt19937 random(1);
+	for (uint8_t &b : data) {
+		b = (uint8_t)random();
+	}
+	for (size_t split : { (size_t)0, (size_t)1, (size_t)5552, (size_t)65521, (size_t)99999 }) {
+		const uint32_t first = deflate::adler32(1, data.data(), split);
+		const uint32_t second = deflate::adler32(1, data.data() + split, data.size() - split);
+		CHECK(deflate::adler32_combine(first, second, data.size() - split) == deflate::adler32(1, data.data(), data.size()));
+	}
+}
+
+// Whole streams and streams compressed in parts with their history inflate to the input
+static void test_deflate(void)
+{
+	std::mt19937 random(2);
+	std::vector<std::vector<uint8_t>> inputs(5);
+	inputs[1].assign(1, 42);
+	inputs[2].resize(200000);
+	for (uint8_t &b : inputs[2]) {
+		b = (uint8_t)random();
+	}
+	inputs[3].assign(300000, 7);
+	for (size_t i = 0; i < 250000; i++) {
+		inputs[4].push_back((uint8_t)("the quick brown fox "[i % 20] + (i % 997 == 0 ? 1 : 0)));
+	}
+
+	for (const std::vector<uint8_t> &input : inputs) {
+		std::vector<uint8_t> stream, inflated;
+		deflate::compressor compressor;
+		compressor.compress(input.data(), 0, input.size(), true, &stream);
+		inflater inflate;
+		CHECK(inflate.inflate(stream.data(), stream.size(), &inflated));
+		CHECK(inflated == input);
+
+		// Parts end on a byte boundary, matches reach back into the part before
+		stream.clear();
+		inflated.clear();
+		const size_t partBytes = 70001;
+		for (size_t first = 0; first < input.size() || first == 0; first += partBytes) {
+			const size_t length = std::min(partBytes, input.size() - first);
+			deflate::compressor part;
+			part.compress(input.data() + first, first, length, first + length >= input.size(), &stream);
+		}
+		CHECK(inflate.inflate(stream.data(), stream.size(), &inflated));
+		CHECK(inflated == input);
+	}
+}
+
+// Every filter of a row is undone by the decoder, adaptive picks one of them
+static void test_png_filters(void)
+{
+	const std::vector<rgbaPixel> frame = get_frame(1, 37, 2);
+	const uint32_t pixelBytes = 4;
+	const size_t rowBytes = 37 * pixelBytes;
+	std::vector<uint8_t> above(rowBytes), row(rowBytes), scratch(rowBytes * PNG_FILTER_COUNT), out(rowBytes + 1);
+	std::memcpy(above.data(), frame.data(), rowBytes);
+	std::memcpy(row.data(), frame.data() + 37, rowBytes);
+
+	for (uint32_t filter = PNG_FILTER_NONE; filter <= PNG_FILTER_ADAPTIVE; filter++) {
+		png::filter_row(row.data(), above.data(), rowBytes, pixelBytes, filter, scratch.data(), out.data());
+		CHECK(filter == PNG_FILTER_ADAPTIVE ? out[0] < PNG_FILTER_COUNT : out[0] == filter);
+		CHECK(unfilter_row(out[0], above.data(), rowBytes, pixelBytes, out.data() + 1));
+		CHECK(std::memcmp(out.data() + 1, row.data(), rowBytes) == 0);
+	}
+}
+
+/*
+ * PNG and QOI frames decode to the input, RGB and RGBA, one band and many.
+ *  The pool only changes who encodes a band, not the bytes
+ */
+static void test_round_trips(cpu::threadPool *pool)
+{
+	const struct {
+		uint32_t width, height;
+	} sizes[] = { { 1, 1 }, { 3, 2 }, { 127, 61 }, { 700, 800 } };
+
+	for (const auto &size : sizes) {
+		for (uint32_t kind = 0; kind < 3; kind++) {
+			const std::vector<rgbaPixel> frame = get_frame(kind, size.width, size.height);
+			for (bool keepAlpha : { false, true }) {
+				std::vector<uint8_t> encoded, serial;
+				std::vector<rgbaPixel> decoded;
+				uint32_t width = 0, height = 0;
+
+				CHECK(png::encode_png(pool, frame.data(), size.width, size.height, keepAlpha, &encoded) == 0);
+				CHECK(png::encode_png(nullptr, frame.data(), size.width, size.height, keepAlpha, &serial) == 0);
+				CHECK(encoded == serial);
+				CHECK(decode_png(encoded, &width, &height, &decoded));
+				CHECK(width == size.width && height == size.height);
+				CHECK(is_same_frame(decoded, frame, keepAlpha));
+
+				CHECK(qoi::encode_qoi(pool, frame.data(), size.width, size.height, keepAlpha, &encoded) == 0);
+				CHECK(qoi::encode_qoi(nullptr, frame.data(), size.width, size.height, keepAlpha, &serial) == 0);
+				CHECK(encoded == serial);
+				CHECK(encoded[12] == (keepAlpha ? 4 : 3));
+				CHECK(decode_qoi(encoded, &width, &height, &decoded));
+				CHECK(width == size.width && height == size.height);
+				CHECK(is_same_frame(decoded, frame, keepAlpha));
+			}
+		}
+	}
+
+	// 700x800 spans several bands of both encoders
+	CHECK((size_t)700 * 800 > QOI_BAND_PIXELS && (size_t)700 * 3 * 800 > PNG_BAND_BYTES);
+
+	std::vector<uint8_t> encoded;
+	CHECK(png::encode_png(pool, nullptr, 0, 1, false, &encoded) != 0);
+	CHECK(qoi::encode_qoi(pool, nullptr, 1, 0, false, &encoded) != 0);
+}
+
+int main(int argc, char **argv)
+{
+	test_checksums();
+	test_deflate();
+	test_png_filters();
+
+	cpu::threadPool pool(4);
+	test_round_trips(&pool);
+
+	return report_checks("frame encoders");
+}
+
+//EOF
@@ -0,0 +1,256 @@
+// g++ -std=c++17 -O2 -pthread HandoffTest.cpp
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "../../../MandelbrotCuda/mailbox.h"
+#include "../../../MandelbrotCuda/frame_ring.h"
+#include "../../../MandelbrotCuda/spsc_queue.h"
+#include "../test_check.h"
+
+// Published values, every word of a value holds its sequence number
+typedef struct sequenceValue {
+	uint64_t words[32];
+} SEQUENCE_VALUE, *PSEQUENCE_VALUE;
+
+// Queued items, both coordinates follow from the sequence number
+typedef struct queueItem {
+	uint64_t sequence;
+	double x, y;
+} QUEUE_ITEM, *PQUEUE_ITEM;
+
+static void test_mailbox_single_thread(void)
+{
+	render::latestMailbox<uint32_t> mailbox;
+	CHECK(mailbox.acquire_read() == nullptr);
+
+	mailbox.get_write_slot() = 1;
+	mailbox.publish();
+	const uint32_t *value = mailbox.acquire_read();
+	CHECK(value != nullptr && *value == 1);
+	CHECK(mailbox.acquire_read() == nullptr);
+
+	// The reader gets the newest value, the one it missed counts as dropped
+	mailbox.get_write_slot() = 2;
+	mailbox.publish();
+	mailbox.get_write_slot() = 3;
+	mailbox.publish();
+	value = mailbox.acquire_read();
+	CHECK(value != nullptr && *value == 3);
+	CHECK(mailbox.get_published_count() == 3);
+	CHECK(mailbox.get_dropped_count() == 1);
+
+	// The writer never gets the slot the reader holds
+	mailbox.get_write_slot() = 4;
+	CHECK(*value == 3);
+	CHECK(&mailbox.get_write_slot() != value);
+
+	render::latestMailbox<uint32_t> filled;
+	filled.fill(7);
+	CHECK(filled.get_write_slot() == 7);
+}
+
+// The reader sees whole values only, in publishing order, and the last one
+static void test_mailbox_threads(void)
+{
+	const uint64_t count = 200000;
+	render::latestMailbox<sequenceValue> mailbox;
+	std::atomic<bool> writerDone(false);
+
+	std::thread writer([&mailbox, &writerDone, count] {
+		for (uint64_t seq = 1; seq <= count; seq++) {
+			sequenceValue &slot = mailbox.get_write_slot();
+			for (uint64_t &word : slot.words) {
+				word = seq;
+			}
+			mailbox.publish();
+		}
+		writerDone = true;
+	});
+
+	uint64_t last = 0, received = 0, torn = 0, reordered = 0;
+	for (;;) {
+		const bool done = writerDone.load();
+		const sequenceValue *value = mailbox.acquire_read();
+		if (value != nullptr) {
+			for (uint64_t word : value->words) {
+				torn += word != value->words[0] ? 1 : 0;
+			}
+			reordered += value->words[0] <= last ? 1 : 0;
+			last = value->words[0];
+			received++;
+		}
+		else if (done) {
+			break;
+		}
+	}
+	writer.join();
+
+	CHECK(torn == 0);
+	CHECK(reordered == 0);
+	CHECK(last == count);
+	CHECK(mailbox.get_published_count() == count);
+	CHECK(received + mailbox.get_dropped_count() == count);
+}
+
+static void test_frame_ring(void)
+{
+	const size_t length = 64, height = 48, pixels = length * height;
+	render::frameRing ring(length, height);
+	CHECK(ring.get_pixel_length() == length && ring.get_pixel_height() == height);
+	CHECK(ring.acquire_read() == nullptr);
+
+	// Frames of one colour each, the reader must never see two colours in a frame
+	const uint32_t frameCount = 20000;
+	std::atomic<bool> writerDone(false);
+	std::thread writer([&ring, &writerDone, pixels, frameCount] {
+		for (uint32_t f = 1; f <= frameCount; f++) {
+			rgbaPixel *slot = ring.get_write_slot();
+			const rgbaPixel colour = { (BYTE)f, (BYTE)(f >> 8), (BYTE)(f >> 16), 255 };
+			for (size_t i = 0; i < pixels; i++) {
+				slot[i] = colour;
+			}
+			ring.publish();
+		}
+		writerDone = true;
+	});
+
+	uint32_t last = 0, torn = 0, reordered = 0;
+	uint64_t received = 0;
+	for (;;) {
+		const bool done = writerDone.load();
+		const rgbaPixel *frame = ring.acquire_read();
+		if (frame != nullptr) {
+			const uint32_t f = frame[0].red | frame[0].green << 8 | frame[0].blue << 16;
+			for (size_t i = 1; i < pixels; i++) {
+				torn += frame[i].red != frame[0].red || frame[i].green != frame[0].green ||
+					frame[i].blue != frame[0].blue ? 1 : 0;
+			}
+			reordered += f <= last ? 1 : 0;
+			last = f;
+			received++;
+		}
+		else if (done) {
+			break;
+		}
+	}
+	writer.join();
+
+	CHECK(torn == 0);
+	CHECK(reordered == 0);
+	CHECK(last == frameCount);
+	CHECK(ring.get_published_frames() == frameCount);
+	CHECK(received + ring.get_dropped_frames() == frameCount);
+}
+
+static void test_queue_single_thread(void)
+{
+	controller::spscQueue<uint32_t, 4> queue;
+	uint32_t value = 0;
+	CHECK(queue.empty());
+	CHECK(!queue.pop(&value));
+
+	// Full at capacity, a failed push leaves the queue as it was
+	for (uint32_t i = 0; i < 4; i++) {
+		CHECK(queue.push(i));
+	}
+	CHECK(!queue.push(99));
+	for (uint32_t i = 0; i < 4; i++) {
+		CHECK(queue.pop(&value) && value == i);
+	}
+	CHECK(queue.empty());
+
+	// First in, first out across many wraps of the ring
+	uint32_t next = 0, expected = 0, misordered = 0;
+	for (uint32_t round = 0; round < 1000; round++) {
+		for (uint32_t i = 0; i < round % 4 + 1; i++) {
+			CHECK(queue.push(next++));
+		}
+		while (queue.pop(&value)) {
+			misordered += value != expected++ ? 1 : 0;
+		}
+	}
+	CHECK(misordered == 0);
+	CHECK(expected == next);
+}
+
+// Every item pushed is popped once, in order, items that did not fit are
+//  reported by push
+static void test_queue_threads(void)
+{
+	const uint64_t count = 1000000;
+	controller::spscQueue<queueItem, 64> queue;
+	std::atomic<bool> producerDone(false);
+	uint64_t pushed = 0, pushedSum = 0;
+
+	std::thread producer([&] {
+		for (uint64_t i = 1; i <= count; i++) {
+			if (queue.push(queueItem{ i, (double)i, -(double)i })) {
+				pushed++;
+				pushedSum += i;
+			}
+		}
+		producerDone = true;
+	});
+
+	uint64_t popped = 0, poppedSum = 0, last = 0, misordered = 0, torn = 0;
+	queueItem item;
+	for (;;) {
+		const bool done = producerDone.load();
+		if (queue.pop(&item)) {
+			misordered += item.sequence <= last ? 1 : 0;
+			torn += item.x != (double)item.sequence || item.y != -(double)item.sequence ? 1 : 0;
+			last = item.sequence;
+			popped++;
+			poppedSum += item.sequence;
+		}
+		else if (done) {
+			break;
+		}
+	}
+	producer.join();
+
+	CHECK(misordered == 0);
+	CHECK(torn == 0);
+	CHECK(popped == pushed);
+	CHECK(poppedSum == pushedSum);
+	CHECK(queue.empty());
+}
+
+// A generation cancels once it moved on from the one the frame was started for
+static void test_frame_cancel(void)
+{
+	std::atomic<bool> flag(false);
+	std::atomic<uint64_t> generation(5);
+	frameCancel none = { nullptr, nullptr, 0 };
+	frameCancel byFlag = { &flag, nullptr, 0 };
+	frameCancel byGeneration = { nullptr, &generation, 5 };
+
+	CHECK(!is_frame_cancelled(none));
+	CHECK(!is_frame_cancelled(byFlag));
+	CHECK(!is_frame_cancelled(byGeneration));
+
+	flag = true;
+	generation = 6;
+	CHECK(is_frame_cancelled(byFlag));
+	CHECK(is_frame_cancelled(byGeneration));
+
+	byGeneration.frameGeneration = 6;
+	CHECK(!is_frame_cancelled(byGeneration));
+}
+
+int main(int argc, char **argv)
+{
+	test_mailbox_single_thread();
+	test_mailbox_threads();
+	test_frame_ring();
+	test_queue_single_thread();
+	test_queue_threads();
+	test_frame_cancel();
+
+	return report_checks("handoff");
+}
+
+//EOF
@@ -0,0 +1,276 @@
+// g++ -std=c++17 -O2 IterationFileTest.cpp
+#include <stdint.h>
+#include <stddef.h>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+#include "../../../MandelbrotCuda/iteration_file.h"
+#include "../test_check.h"
+
+// Scratch files, in the working directory and removed again
+#define TEST_FIELD_FILE				"mbit_test_field.mbit"
+#define TEST_CORRUPT_FILE			"mbit_test_corrupt.mbit"
+
+// Weight of the last fixedPoint limb, 2^-352
+#define TEST_CENTRE_ULP				std::ldexp(1.0, -32 * (FIXED_POINT_LIMBS - 1))
+
+static std::vector<uint8_t> read_file(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string &filename, const std::vector<uint8_t> &bytes)
+{
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	file.write((const char *)bytes.data(), (std::streamsize)bytes.size());
+}
+
+static frame::mbitView get_test_view(uint32_t width, uint32_t height, frame::MBIT_FIELD fieldType)
+{
+	frame::mbitView view;
+	view.centerX = cpu::fixedPoint::from_string("-0.74364388703715870475219150611477");
+	view.centerY = cpu::fixedPoint::from_string("0.13182590420531197049330376180529");
+	view.scaleA = 1.5e-9;
+	view.scaleB = 0.75;
+	view.width = width;
+	view.height = height;
+	view.maxIterations = 5000;
+	view.precisionTier = 2;
+	view.fieldType = fieldType;
+	view.formula = frame::MBIT_FORMULA_MANDELBROT;
+	return view;
+}
+
+// Sample (x, y) of the test field, maxIter + 1 marks the interior
+static uint32_t get_escape_time(uint32_t x, uint32_t y)
+{
+	return ((x * 7 + y * 13) % 11 == 0) ? 5001 : (x * 31 + y * 17) % 5000;
+}
+
+/*
+ * Writes a width x height field in bands of rowsPerWrite rows, -1 if the
+ *  writer fails
+ */
+static error_t write_field(const frame::mbitView &view, uint32_t rowsPerWrite)
+{
+	frame::iterationFileWriter writer;
+	if (writer.create(TEST_FIELD_FILE, view) != 0) {
+		return -1;
+	}
+
+	std::vector<uint32_t> band((size_t)view.width * rowsPerWrite);
+	for (uint32_t first = 0; first < view.height; first += rowsPerWrite) {
+		const uint32_t count = std::min(rowsPerWrite, view.height - first);
+		for (uint32_t y = 0; y < count; y++) {
+			for (uint32_t x = 0; x < view.width; x++) {
+				const uint32_t escape = get_escape_time(x, first + y);
+				if (view.fieldType == frame::MBIT_FIELD_SMOOTH) {
+					const float smooth = (float)escape + 0.25f;
+					std::memcpy(&band[(size_t)y * view.width + x], &smooth, sizeof(smooth));
+				}
+				else {
+					band[(size_t)y * view.width + x] = escape;
+				}
+			}
+		}
+		if (writer.write_rows(first, count, band.data()) != 0) {
+			return -1;
+		}
+	}
+
+	// Rows past the end are refused, also when first + count wraps
+	if (writer.write_rows(view.height, 1, band.data()) == 0 ||
+		writer.write_rows(1, UINT32_MAX, band.data()) == 0) {
+		return -1;
+	}
+	return writer.close();
+}
+
+// Row strides cover a row of 32 bit samples in whole cache lines
+static void test_row_stride(void)
+{
+	CHECK(frame::get_mbit_row_stride(1) == MBIT_ROW_ALIGNMENT);
+	CHECK(frame::get_mbit_row_stride(16) == MBIT_ROW_ALIGNMENT);
+	CHECK(frame::get_mbit_row_stride(17) == 2 * MBIT_ROW_ALIGNMENT);
+	CHECK(frame::get_mbit_row_stride(641) == 2624);
+	CHECK(frame::get_mbit_row_stride(UINT32_MAX) == 4ull * UINT32_MAX + 4);
+	CHECK(sizeof(frame::mbitHeader) <= MBIT_HEADER_BYTES);
+}
+
+// Both field types come back with their view, every row where the header says
+static void test_round_trip(void)
+{
+	for (frame::MBIT_FIELD fieldType : { frame::MBIT_FIELD_ESCAPE_TIME, frame::MBIT_FIELD_SMOOTH }) {
+		for (uint32_t rowsPerWrite : { 1u, 7u, 1000u }) {
+			const frame::mbitView view = get_test_view(641, 83, fieldType);
+			CHECK(write_field(view, rowsPerWrite) == 0);
+			CHECK(read_file(TEST_FIELD_FILE).size() == MBIT_HEADER_BYTES + frame::get_mbit_row_stride(641) * 83);
+
+			frame::iterationFile field;
+			CHECK(field.open(TEST_FIELD_FILE) == 0);
+
+			const frame::mbitHeader &header = field.get_header();
+			CHECK(header.headerBytes == MBIT_HEADER_BYTES);
+			CHECK(header.rowStride == frame::get_mbit_row_stride(641));
+			CHECK(header.pixelScale == view.scaleA / (641.0 / view.scaleB));
+
+			const frame::mbitView &read = field.get_view();
+			CHECK(read.width == 641 && read.height == 83);
+			CHECK(read.fieldType == fieldType && read.formula == frame::MBIT_FORMULA_MANDELBROT);
+			CHECK(read.maxIterations == 5000 && read.precisionTier == 2);
+			CHECK(read.scaleA == view.scaleA && read.scaleB == view.scaleB);
+			// The decimal centre reads back to the last limb, parsing truncates it by at most an ulp
+			CHECK(std::fabs((read.centerX - view.centerX).to_double()) <= TEST_CENTRE_ULP);
+			CHECK(std::fabs((read.centerY - view.centerY).to_double()) <= TEST_CENTRE_ULP);
+
+			uint32_t mismatches = 0;
+			for (uint32_t y = 0; y < 83; y++) {
+				const uint32_t *escape = field.get_escape_times(y);
+				const float *smooth = field.get_smooth(y);
+				CHECK(((uintptr_t)escape - (uintptr_t)field.get_escape_times(0)) % MBIT_ROW_ALIGNMENT == 0);
+				for (uint32_t x = 0; x < 641; x++) {
+					if (fieldType == frame::MBIT_FIELD_SMOOTH) {
+						mismatches += smooth[x] != (float)get_escape_time(x, y) + 0.25f;
+					}
+					else {
+						mismatches += escape[x] != get_escape_time(x, y);
+					}
+				}
+			}
+			CHECK(mismatches == 0);
+			CHECK(field.close() == 0);
+		}
+	}
+
+	// Empty fields are not written
+	frame::iterationFileWriter writer;
+	CHECK(writer.create(TEST_FIELD_FILE, get_test_view(0, 5, frame::MBIT_FIELD_ESCAPE_TIME)) != 0);
+	CHECK(writer.create(TEST_FIELD_FILE, get_test_view(5, 0, frame::MBIT_FIELD_ESCAPE_TIME)) != 0);
+	std::remove(TEST_FIELD_FILE);
+}
+
+/*
+ * Opens a copy of the valid file with corrupt applied to it, true if it
+ *  is refused
+ */
+static bool is_refused(const std::vector<uint8_t> &valid, const std::function<void(std::vector<uint8_t> &)> &corrupt)
+{
+	std::vector<uint8_t> bytes = valid;
+	corrupt(bytes);
+	write_file(TEST_CORRUPT_FILE, bytes);
+
+	frame::iterationFile field;
+	const bool refused = field.open(TEST_CORRUPT_FILE) != 0;
+	field.close();
+	return refused;
+}
+
+template <typename T>
+static void set_field(std::vector<uint8_t> &bytes, size_t offset, T value)
+{
+	std::memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+// Headers that do not describe the file are refused before a row is read
+static void test_corrupt_headers(void)
+{
+	const frame::mbitView view = get_test_view(16, 4, frame::MBIT_FIELD_ESCAPE_TIME);
+	CHECK(write_field(view, 4) == 0);
+	const std::vector<uint8_t> valid = read_file(TEST_FIELD_FILE);
+	std::remove(TEST_FIELD_FILE);
+	CHECK(valid.size() == MBIT_HEADER_BYTES + 4 * MBIT_ROW_ALIGNMENT);
+
+	// The untouched copy opens
+	CHECK(!is_refused(valid, [](std::vector<uint8_t> &) {}));
+
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { b[0] = 'X'; }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, version), MBIT_VERSION + 1); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, byteOrder), 0x04030201); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, width), 0); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 0); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, fieldType), 2); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, formula), 1); }));
+
+	// A row stride shorter than a row
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), 60); }));
+
+	// Rows past the end of the file: one row more, a stride one byte longer
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 5); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), MBIT_ROW_ALIGNMENT + 1); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { b.resize(b.size() - 1); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { b.resize(MBIT_HEADER_BYTES); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { b.resize(MBIT_HEADER_BYTES - 1); }));
+
+	// Strides whose product with the height wraps to something that fits
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), 1ull << 63);
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 2);
+	}));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), UINT64_MAX);
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 1);
+	}));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), (1ull << 62) + 16);
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 4);
+	}));
+
+	// Rows that would start inside the header, or after the end of the file
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), 0); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), (uint32_t)sizeof(frame::mbitHeader) - 1);
+	}));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), MBIT_ROW_ALIGNMENT); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), (uint32_t)b.size() + 1); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), UINT32_MAX); }));
+
+	// Rows that fit but are not aligned for the samples: the header a few bytes
+	//  short, a stride of 68 over 3 rows
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), MBIT_HEADER_BYTES - 4); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint64_t>(b, offsetof(frame::mbitHeader, rowStride), MBIT_ROW_ALIGNMENT + 4);
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, height), 3);
+	}));
+
+	// Iteration counts a colour table cannot be built for
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, maxIterations), 0); }));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, maxIterations), RENDER_MAX_ITERATIONS + 1);
+	}));
+	CHECK(is_refused(valid, [](std::vector<uint8_t> &b) { set_field<uint32_t>(b, offsetof(frame::mbitHeader, maxIterations), UINT32_MAX); }));
+	CHECK(!is_refused(valid, [](std::vector<uint8_t> &b) {
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, maxIterations), RENDER_MAX_ITERATIONS);
+	}));
+
+	// Rows may start at any aligned offset after the header that leaves room for them
+	CHECK(!is_refused(valid, [](std::vector<uint8_t> &b) {
+		const uint32_t headerBytes = (uint32_t)(sizeof(frame::mbitHeader) + MBIT_ROW_ALIGNMENT - 1) / MBIT_ROW_ALIGNMENT * MBIT_ROW_ALIGNMENT;
+		set_field<uint32_t>(b, offsetof(frame::mbitHeader, headerBytes), headerBytes);
+	}));
+
+	std::remove(TEST_CORRUPT_FILE);
+
+	// Files that are not there
+	frame::iterationFile field;
+	CHECK(field.open(TEST_CORRUPT_FILE) != 0);
+}
+
+int main(int argc, char **argv)
+{
+	test_row_stride();
+	test_round_trip();
+	test_corrupt_headers();
+
+	return report_checks("iteration files");
+}
+
+//EOF
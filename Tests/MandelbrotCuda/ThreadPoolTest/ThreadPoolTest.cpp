@@ -0,0 +1,223 @@
+// g++ -std=c++17 -O2 -pthread ThreadPoolTest.cpp
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstring>
+
+#include "../../../MandelbrotCuda/thread_pool.h"
+#include "../test_check.h"
+
+// Every task of a group has run once wait() returns
+static void test_submit_wait(cpu::threadPool &pool)
+{
+	const uint32_t taskCount = 1000;
+	std::atomic<uint32_t> done(0);
+	std::vector<uint32_t> results(taskCount, 0);
+
+	cpu::taskGroup group;
+	for (uint32_t i = 0; i < taskCount; i++) {
+		pool.submit(&group, [&done, &results, i] {
+			results[i] = i * 2;
+			done++;
+		});
+	}
+	pool.wait(&group);
+
+	CHECK(group.is_done());
+	CHECK(done.load() == taskCount);
+	for (uint32_t i = 0; i < taskCount; i++) {
+		CHECK(results[i] == i * 2);
+	}
+
+	// Waiting on an empty or finished group returns at once
+	cpu::taskGroup empty;
+	pool.wait(&empty);
+	pool.wait(&group);
+	CHECK(empty.is_done());
+}
+
+// Every index is visited exactly once, with and without a pool
+static void test_parallel_for(cpu::threadPool &pool)
+{
+	const size_t count = 4097;
+	std::vector<std::atomic<uint32_t>> visits(count);
+	for (size_t i = 0; i < count; i++) {
+		visits[i] = 0;
+	}
+
+	pool.parallel_for(count, [&visits](size_t i) { visits[i]++; });
+	cpu::parallel_for(&pool, count, [&visits](size_t i) { visits[i]++; });
+	cpu::parallel_for(nullptr, count, [&visits](size_t i) { visits[i]++; });
+	pool.parallel_for(0, [&visits](size_t i) { visits[0] += 100; });
+
+	for (size_t i = 0; i < count; i++) {
+		CHECK(visits[i].load() == 3);
+	}
+}
+
+/*
+ * Runs a parallel_for of count items that only note when they start,
+ *  returns the start position of every index. It is issued from a worker,
+ *  as the renderers' are when nested, and this thread does not take part
+ */
+static std::vector<uint32_t> get_start_order(cpu::threadPool &pool, size_t count)
+{
+	std::atomic<uint32_t> started(0);
+	std::vector<uint32_t> position(count, 0);
+
+	cpu::taskGroup group;
+	pool.submit(&group, [&pool, &started, &position, count] {
+		pool.parallel_for(count, [&started, &position](size_t i) {
+			position[i] = started++;
+		});
+	});
+	while (!group.is_done()) {
+		std::this_thread::yield();
+	}
+	pool.wait(&group);
+	return position;
+}
+
+// parallel_for starts its items in index order, the callers sort the most expensive first
+static void test_start_order(void)
+{
+	const size_t count = 256;
+
+	// A single worker runs the whole batch from its own queue, lowest index first
+	{
+		cpu::threadPool pool(1);
+		const std::vector<uint32_t> position = get_start_order(pool, count);
+		uint32_t misplaced = 0;
+		for (size_t i = 0; i < count; i++) {
+			misplaced += position[i] != i;
+		}
+		CHECK(misplaced == 0);
+	}
+
+	// On more workers the first half of the indices starts before the second
+	for (uint32_t workers : { 2u, 4u, 8u }) {
+		cpu::threadPool pool(workers);
+		for (uint32_t round = 0; round < 20; round++) {
+			const std::vector<uint32_t> position = get_start_order(pool, count);
+			uint64_t first = 0, second = 0;
+			for (size_t i = 0; i < count; i++) {
+				(i < count / 2 ? first : second) += position[i];
+			}
+			CHECK(first < second);
+		}
+	}
+}
+
+// Tasks that wait on groups of their own run those on the waiting worker
+static void test_nested_wait(cpu::threadPool &pool)
+{
+	const size_t outer = 64, inner = 64;
+	std::atomic<uint32_t> done(0);
+
+	pool.parallel_for(outer, [&pool, &done](size_t) {
+		pool.parallel_for(inner, [&done](size_t) { done++; });
+	});
+
+	CHECK(done.load() == outer * inner);
+}
+
+/*
+ * A waiter runs the tasks of its own group only: a render waiting on its
+ *  tiles must not pick up the frame encode queued beside them
+ */
+static void test_wait_own_group(void)
+{
+	cpu::threadPool pool(1);
+	std::atomic<bool> blockerStarted(false), release(false);
+
+	// The one worker is kept busy until the batch below is done
+	cpu::taskGroup background;
+	pool.submit(&background, [&blockerStarted, &release] {
+		blockerStarted = true;
+		while (!release) {
+			std::this_thread::yield();
+		}
+	});
+	while (!blockerStarted) {
+		std::this_thread::yield();
+	}
+
+	// Queued ahead of the batch, on the queue the waiter takes the batch from
+	cpu::taskGroup encode;
+	std::thread::id encodeThread;
+	pool.submit(&encode, [&encodeThread] { encodeThread = std::this_thread::get_id(); });
+
+	std::atomic<uint32_t> done(0);
+	pool.parallel_for(16, [&done](size_t) { done++; });
+	CHECK(done.load() == 16);
+	CHECK(!encode.is_done());
+
+	// The worker gets to it once it is free, this thread does not wait on it
+	release = true;
+	while (!encode.is_done()) {
+		std::this_thread::yield();
+	}
+	pool.wait(&encode);
+	pool.wait(&background);
+	CHECK(encodeThread != std::this_thread::get_id());
+}
+
+// A group is destroyed as soon as wait() returns: the worker that finished
+//  the last task must be done with it by then. Freed groups are overwritten
+//  so a late access shows up (and is reported by the sanitizers)
+static void test_group_lifetime(cpu::threadPool &pool)
+{
+	const uint32_t rounds = 20000;
+	uint32_t sum = 0;
+
+	for (uint32_t round = 0; round < rounds; round++) {
+		std::unique_ptr<cpu::taskGroup> group(new cpu::taskGroup());
+		uint32_t value = 0;
+		pool.submit(group.get(), [&value, round] { value = round; });
+		pool.wait(group.get());
+		sum += value == round ? 1 : 0;
+
+		cpu::taskGroup *freed = group.release();
+		freed->~taskGroup();
+		std::memset((void *)freed, 0xff, sizeof(cpu::taskGroup));
+		::operator delete(freed);
+	}
+
+	CHECK(sum == rounds);
+
+	for (uint32_t round = 0; round < rounds / 10; round++) {
+		std::atomic<uint32_t> done(0);
+		pool.parallel_for(3, [&done](size_t) { done++; });
+		CHECK(done.load() == 3);
+	}
+}
+
+static void test_counters(void)
+{
+	cpu::threadPool pool(2);
+	CHECK(pool.get_worker_count() == 2);
+
+	pool.parallel_for(100, [](size_t) {});
+	CHECK(pool.get_tasks_executed() == 100);
+}
+
+int main(int argc, char **argv)
+{
+	for (uint32_t workers : { 1u, 2u, 4u, 8u }) {
+		cpu::threadPool pool(workers);
+		test_submit_wait(pool);
+		test_parallel_for(pool);
+		test_nested_wait(pool);
+		test_group_lifetime(pool);
+	}
+	test_counters();
+	test_start_order();
+	test_wait_own_group();
+
+	return report_checks("thread pool");
+}
+
+//EOF
@@ -0,0 +1,185 @@
+// g++ -std=c++17 -O2 ZoomClockTest.cpp
+#include <stdint.h>
+#include <iostream>
+#include <cmath>
+
+#include "../../../MandelbrotCuda/zoom_clock.h"
+#include "../test_check.h"
+
+// The render loop constants (controller.h), the clock and the zoom take them as arguments
+#define TEST_TICK_MS				(1000.0 / 60.0)
+#define TEST_MAX_TICKS				16
+
+// Zoom state the render thread starts from
+#define TEST_SCALE_A				1.1
+#define TEST_LAST_SCALE_A			0.0000055
+
+static bool is_near(double a, double b)
+{
+	return std::fabs(a - b) <= 1e-12;
+}
+
+// Ticks at fixed timestamps, and the catch-up of a frame from the tick the zoom stands at
+static void test_ticks(void)
+{
+	CHECK(controller::zoomClock::get_ticks(-5.0, TEST_TICK_MS) == 0);
+	CHECK(controller::zoomClock::get_ticks(0.0, TEST_TICK_MS) == 0);
+	CHECK(controller::zoomClock::get_ticks(16.0, TEST_TICK_MS) == 0);
+	CHECK(controller::zoomClock::get_ticks(17.0, TEST_TICK_MS) == 1);
+	CHECK(controller::zoomClock::get_ticks(50.0, TEST_TICK_MS) == 3);
+	CHECK(controller::zoomClock::get_ticks(600.0, TEST_TICK_MS) == 36);
+
+	// Presentation time of each frame -> ticks it takes, zoom tick after it
+	const struct {
+		double presentMs;
+		uint64_t ticks, zoomTicks;
+	} frames[] = {
+		{ 10.0, 0, 0 },
+		{ 17.0, 1, 1 },
+		{ 20.0, 0, 1 },
+		{ 50.0, 2, 3 },
+		{ 50.0, 0, 3 },		// Same time again, nothing to catch up
+		{ 40.0, 0, 3 },		// Earlier than the zoom, it does not go back
+		{ 1055.0, 16, 63 },	// A stall catches up 16 ticks, the other 44 are dropped
+		{ 1060.0, 0, 63 },
+		{ 1070.0, 1, 64 }
+	};
+
+	uint64_t zoomTicks = 0;
+	for (const auto &frame : frames) {
+		const uint64_t ticks = controller::zoomClock::take_ticks(frame.presentMs, TEST_TICK_MS, TEST_MAX_TICKS, &zoomTicks);
+		CHECK(ticks == frame.ticks);
+		CHECK(zoomTicks == frame.zoomTicks);
+	}
+}
+
+// The virtual clock moves a fixed interval per frame presented
+static void test_virtual_clock(void)
+{
+	controller::zoomClock clock(TEST_TICK_MS);
+	CHECK(!clock.is_virtual());
+	CHECK(clock.get_frame_interval_ms() == TEST_TICK_MS);
+
+	clock.set_virtual_clock(20.0);
+	CHECK(clock.is_virtual());
+	CHECK(clock.now_ms() == 0.0);
+	CHECK(clock.get_frame_interval_ms() == 20.0);
+	CHECK(clock.next_presentation_ms() == 20.0);
+
+	clock.frame_presented(clock.next_presentation_ms());
+	CHECK(clock.now_ms() == 20.0);
+	CHECK(clock.next_presentation_ms() == 40.0);
+
+	// A frame not shown leaves the clock where it was
+	CHECK(clock.next_presentation_ms() == 40.0);
+
+	// Restarting starts the time over
+	clock.frame_presented(clock.next_presentation_ms());
+	clock.set_virtual_clock(50.0);
+	CHECK(clock.now_ms() == 0.0);
+	CHECK(clock.next_presentation_ms() == 50.0);
+}
+
+// Zoom factors of single ticks and of runs of ticks in every state
+static void test_zoom_steps(void)
+{
+	double scaleA = TEST_SCALE_A, lastScaleA = TEST_LAST_SCALE_A;
+	CHECK(controller::advance_zoom(controller::SET_ZOOM_PAUSE, &scaleA, &lastScaleA, 10) == 0.0);
+	CHECK(scaleA == TEST_SCALE_A && lastScaleA == TEST_LAST_SCALE_A);
+	CHECK(controller::advance_zoom(controller::SET_ZOOM_RESUME, &scaleA, &lastScaleA, 0) == 0.0);
+	CHECK(scaleA == TEST_SCALE_A);
+
+	// f(x) = -ALPHA * x * e^(-BETA * lastScaleA), lastScaleA takes the opposite change
+	const double expected = -ZOOM_ALPHA * TEST_SCALE_A * std::exp(-ZOOM_BETA * TEST_LAST_SCALE_A);
+	CHECK(controller::next_zoom_step(controller::SET_ZOOM_RESUME, scaleA, lastScaleA) == expected);
+	CHECK(controller::next_zoom_step(controller::SET_ZOOM_REVERSE, scaleA, lastScaleA) == 0.0);
+	CHECK(controller::next_zoom_step(controller::SET_ZOOM_PAUSE, scaleA, lastScaleA) == 0.0);
+
+	CHECK(controller::advance_zoom(controller::SET_ZOOM_RESUME, &scaleA, &lastScaleA, 1) == expected);
+	CHECK(is_near(scaleA, 0.6600060499584065));
+	CHECK(is_near(lastScaleA, 0.4399994500415936));
+	controller::advance_zoom(controller::SET_ZOOM_RESUME, &scaleA, &lastScaleA, 1);
+	CHECK(is_near(scaleA, 0.572127157495373));
+	CHECK(is_near(lastScaleA, 0.5278783425046271));
+
+	// n ticks at once are n single ticks
+	double runA = TEST_SCALE_A, runLast = TEST_LAST_SCALE_A;
+	double stepA = TEST_SCALE_A, stepLast = TEST_LAST_SCALE_A;
+	controller::advance_zoom(controller::SET_ZOOM_RESUME, &runA, &runLast, 36);
+	for (uint32_t i = 0; i < 36; i++) {
+		controller::advance_zoom(controller::SET_ZOOM_RESUME, &stepA, &stepLast, 1);
+	}
+	CHECK(runA == stepA && runLast == stepLast);
+	CHECK(is_near(runA, 0.10337461641067772));
+
+	// Zooming out stops before a step of MAX_DELTA_SCALE_A, after 8 ticks from 0.01
+	scaleA = 0.01;
+	lastScaleA = 0.0;
+	controller::advance_zoom(controller::SET_ZOOM_REVERSE, &scaleA, &lastScaleA, 100);
+	CHECK(is_near(scaleA, 0.1838654106035581));
+	CHECK(controller::next_zoom_step(controller::SET_ZOOM_REVERSE, scaleA, lastScaleA) == 0.0);
+	CHECK(controller::advance_zoom(controller::SET_ZOOM_REVERSE, &scaleA, &lastScaleA, 1) == 0.0);
+
+	scaleA = 0.01;
+	lastScaleA = 0.0;
+	controller::advance_zoom(controller::SET_ZOOM_REVERSE, &scaleA, &lastScaleA, 7);
+	CHECK(controller::next_zoom_step(controller::SET_ZOOM_REVERSE, scaleA, lastScaleA) != 0.0);
+}
+
+/*
+ * The render loop on the virtual clock for durationMs: every frame takes
+ *  the ticks up to its presentation time and is shown. Returns scaleA
+ */
+static double run_frames(double frameMs, double durationMs, __inout uint64_t *zoomTicks)
+{
+	controller::zoomClock clock(TEST_TICK_MS);
+	clock.set_virtual_clock(frameMs);
+
+	double scaleA = TEST_SCALE_A, lastScaleA = TEST_LAST_SCALE_A;
+	*zoomTicks = 0;
+	while (clock.now_ms() < durationMs) {
+		const double presentMs = clock.next_presentation_ms();
+		const uint64_t ticks = controller::zoomClock::take_ticks(presentMs, TEST_TICK_MS, TEST_MAX_TICKS, zoomTicks);
+		controller::advance_zoom(controller::SET_ZOOM_RESUME, &scaleA, &lastScaleA, ticks);
+		clock.frame_presented(presentMs);
+	}
+
+	return scaleA;
+}
+
+// The zoom at a point in time does not depend on the frame rate, until frames
+//  are slower than the catch-up limit
+static void test_frame_rate(void)
+{
+	double reference = TEST_SCALE_A, lastScaleA = TEST_LAST_SCALE_A;
+	controller::advance_zoom(controller::SET_ZOOM_RESUME, &reference, &lastScaleA, 36);
+
+	for (double frameMs : { 5.0, 10.0, 20.0, 25.0, 50.0, 100.0, 200.0 }) {
+		uint64_t zoomTicks = 0;
+		const double scaleA = run_frames(frameMs, 600.0, &zoomTicks);
+		CHECK(zoomTicks == 36);
+		CHECK(scaleA == reference);
+	}
+
+	// 300 ms frames would take 18 ticks each, they take 16
+	uint64_t zoomTicks = 0;
+	const double slow = run_frames(300.0, 600.0, &zoomTicks);
+	CHECK(zoomTicks == 36);
+	CHECK(is_near(slow, 0.11866402644534749));
+	CHECK(slow > reference);
+
+	// The same clock always gives the same frames
+	CHECK(run_frames(20.0, 600.0, &zoomTicks) == run_frames(20.0, 600.0, &zoomTicks));
+}
+
+int main(int argc, char **argv)
+{
+	test_ticks();
+	test_virtual_clock();
+	test_zoom_steps();
+	test_frame_rate();
+
+	return report_checks("zoom clock");
+}
+
+//EOF
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+
+/*
+ * Checks shared by the test projects
+ *  CHECK reports a failed condition with its file and line and carries on,
+ *  main ends with report_checks, which gives the exit code of the test.
+ */
+
+static uint32_t failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		std::cout << "FAILED " << __FILE__ << ":" << __LINE__ << " " << #cond << std::endl; \
+		failures++; \
+	} \
+} while (0)
+
+// Prints the outcome for area, 0 if every check passed, else 1
+static inline int report_checks(const char *area)
+{
+	if (failures != 0) {
+		std::cout << failures << " checks FAILED" << std::endl;
+		return 1;
+	}
+	std::cout << area << ": all checks passed" << std::endl;
+	return 0;
+}
+
+//EOF